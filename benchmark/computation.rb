@@ -9,7 +9,7 @@ module Benchmarks
       puts "\n=== Computation Benchmark ==="
       puts "Iterations: #{iterations}"
 
-      sandbox = QuickJS::Sandbox.new(memory_limit: 200_000, timeout_ms: 30_000)
+      sandbox = QuickJS::Sandbox.new(memory_limit: 1_000_000, timeout_ms: 30_000)
 
       Benchmark.bm(30) do |x|
         x.report("Fibonacci (recursive, n=10):") do
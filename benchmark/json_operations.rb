@@ -9,7 +9,7 @@ module Benchmarks
       puts "\n=== JSON Operations Benchmark ==="
       puts "Iterations: #{iterations}"
 
-      sandbox = QuickJS::Sandbox.new(memory_limit: 200_000)
+      sandbox = QuickJS::Sandbox.new(memory_limit: 1_000_000)
 
       Benchmark.bm(30) do |x|
         x.report("JSON.parse (simple):") do
@@ -1,30 +1,94 @@
 #!/usr/bin/env ruby
 # frozen_string_literal: true
 
-require_relative 'simple_operations'
-require_relative 'computation'
-require_relative 'json_operations'
-require_relative 'array_operations'
-require_relative 'sandbox_overhead'
-require_relative 'memory_limits'
-require_relative 'console_output'
-
-puts "=" * 70
-puts "QuickJS Benchmark Suite"
-puts "=" * 70
-puts "Ruby version: #{RUBY_VERSION}"
-puts "Platform: #{RUBY_PLATFORM}"
-puts "=" * 70
-
-# Run all benchmarks
-Benchmarks::SimpleOperations.run
-Benchmarks::Computation.run
-Benchmarks::JsonOperations.run
-Benchmarks::ArrayOperations.run
-Benchmarks::SandboxOverhead.run
-Benchmarks::MemoryLimits.run
-Benchmarks::ConsoleOutput.run
-
-puts "\n" + "=" * 70
-puts "Benchmark suite completed!"
-puts "=" * 70
+# Benchmark suite runner
+#
+#   ruby benchmark/runner.rb                          # run every scenario, print a summary
+#   ruby benchmark/runner.rb --json report.json       # also write the JSON report ("-" for stdout)
+#   ruby benchmark/runner.rb --save-baseline FILE     # store the report as a baseline
+#   ruby benchmark/runner.rb --baseline FILE          # compare with a baseline, exit 1 on regressions
+#   ruby benchmark/runner.rb --only fetch,churn/reset --scale 0.1
+#   ruby benchmark/runner.rb --legacy                 # the Benchmark.bm reports of each benchmark file
+
+require 'optparse'
+require 'json'
+
+options = { scale: 1.0, tolerance: 0.2 }
+OptionParser.new do |opts|
+  opts.banner = 'Usage: ruby benchmark/runner.rb [options]'
+  opts.on('--json FILE', 'Write the JSON report to FILE ("-" for stdout)') { |v| options[:json] = v }
+  opts.on('--baseline FILE', 'Compare with the baseline report in FILE') { |v| options[:baseline] = v }
+  opts.on('--save-baseline FILE', 'Write the report to FILE as the new baseline') { |v| options[:save_baseline] = v }
+  opts.on('--tolerance PCT', Float, 'Change beyond which a metric counts as a regression (default: 20)') do |v|
+    options[:tolerance] = v / 100.0
+  end
+  opts.on('--only NAMES', Array, 'Run only the scenarios with these names or name prefixes') { |v| options[:only] = v }
+  opts.on('--scale FACTOR', Float, 'Multiply iteration counts by FACTOR (default: 1.0)') { |v| options[:scale] = v }
+  opts.on('--list', 'List the scenarios') { options[:list] = true }
+  opts.on('--legacy', 'Run the Benchmark.bm reports instead') { options[:legacy] = true }
+end.parse!
+
+if options[:legacy]
+  require_relative 'simple_operations'
+  require_relative 'computation'
+  require_relative 'json_operations'
+  require_relative 'array_operations'
+  require_relative 'sandbox_overhead'
+  require_relative 'memory_limits'
+  require_relative 'console_output'
+
+  puts "=" * 70
+  puts "QuickJS Benchmark Suite"
+  puts "=" * 70
+  puts "Ruby version: #{RUBY_VERSION}"
+  puts "Platform: #{RUBY_PLATFORM}"
+  puts "=" * 70
+
+  Benchmarks::SimpleOperations.run
+  Benchmarks::Computation.run
+  Benchmarks::JsonOperations.run
+  Benchmarks::ArrayOperations.run
+  Benchmarks::SandboxOverhead.run
+  Benchmarks::MemoryLimits.run
+  Benchmarks::ConsoleOutput.run
+
+  puts "\n" + "=" * 70
+  puts "Benchmark suite completed!"
+  puts "=" * 70
+  exit
+end
+
+require_relative 'scenarios'
+
+if options[:list]
+  Benchmarks::Suite.scenarios.each { |s| puts format('%-32s %s', s.name, s.description) }
+  exit
+end
+
+# Progress goes to stderr when the report itself is written to stdout
+out = options[:json] == '-' ? $stderr : $stdout
+out.puts "QuickJS #{QuickJS::VERSION}, #{RUBY_DESCRIPTION}"
+report = Benchmarks::Suite.run(only: options[:only], scale: options[:scale], out: out)
+json = JSON.pretty_generate(report)
+
+if options[:json] == '-'
+  puts json
+elsif options[:json]
+  File.write(options[:json], json)
+end
+File.write(options[:save_baseline], json) if options[:save_baseline]
+
+if options[:baseline]
+  baseline = JSON.parse(File.read(options[:baseline]))
+  changes = Benchmarks::Suite.compare(report, baseline, tolerance: options[:tolerance])
+  regressions = changes.select { |c| c['regression'] }
+
+  out.puts "\nCompared with #{options[:baseline]} (#{baseline['git_commit'] || 'unknown commit'}, " \
+           "tolerance #{(options[:tolerance] * 100).round}%):"
+  changes.each do |c|
+    out.puts format('  %-32s %-18s %12.3f -> %12.3f  %+7.1f%%%s', c['scenario'], c['metric'], c['baseline'],
+                    c['current'], c['change'] * 100, c['regression'] ? '  REGRESSION' : '')
+  end
+  out.puts regressions.empty? ? 'No regressions.' : "#{regressions.size} regression(s)."
+  exit 1 unless regressions.empty?
+end
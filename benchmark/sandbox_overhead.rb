@@ -19,7 +19,7 @@ module Benchmarks
         x.report("Sandbox with custom limits:") do
           iterations.times do
             QuickJS::Sandbox.new(
-              memory_limit: 100_000,
+              memory_limit: 1_000_000,
               timeout_ms: 10_000,
               console_log_max_size: 20_000
             )
@@ -0,0 +1,205 @@
+# frozen_string_literal: true
+
+require 'socket'
+require_relative 'suite'
+
+module Benchmarks
+  # Local HTTP server for the fetch scenarios: answers every request with a
+  # small JSON body, so the scenarios measure the sandbox's side of fetch()
+  class LocalServer
+    BODY = '{"ok":true,"items":[1,2,3]}'
+
+    attr_reader :port
+
+    def self.instance
+      @instance ||= new
+    end
+
+    def initialize
+      @server = TCPServer.new('127.0.0.1', 0)
+      @port = @server.addr[1]
+      @thread = Thread.new { loop { Thread.new(@server.accept) { |client| serve(client) } } }
+    end
+
+    def http_options
+      { allowlist: ["http://127.0.0.1:#{port}/**"], block_private_ips: false, allowed_ports: [port],
+        max_requests: 100 }
+    end
+
+    def url(path)
+      "http://127.0.0.1:#{port}#{path}"
+    end
+
+    private
+
+    def serve(client)
+      while client.gets
+        while (line = client.gets) && line != "\r\n"; end
+        client.write("HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n" \
+                     "Content-Length: #{BODY.bytesize}\r\n\r\n#{BODY}")
+      end
+    rescue IOError, SystemCallError
+      nil
+    ensure
+      client.close
+    end
+  end
+
+  LARGE_INPUT = {
+    'items' => Array.new(1000) { |i| { 'id' => i, 'name' => "item #{i}", 'price' => i * 1.5, 'tags' => %w[a b c] } }
+  }.freeze
+  LARGE_INPUT_JSON = JSON.generate(LARGE_INPUT).freeze
+
+  # Records of one shape, read field by field by eval/record_transform
+  RECORDS_JS = <<~JS
+    globalThis.records = Array.from({ length: 5000 }, (_, i) =>
+      ({ id: i, price: i * 1.5, qty: i % 7, tax: 0.2, region: 'r' + (i % 4) }));
+  JS
+
+  MODULES = {
+    'lib/math.js' => 'export const sum = (xs) => xs.reduce((a, b) => a + b, 0);',
+    'lib/format.js' => "import { sum } from './math.js'; export const total = (xs) => `total: ${sum(xs)}`;"
+  }.freeze
+
+  class Suite
+    # Evaluation basics
+    scenario 'eval/simple', 'Evaluate a trivial expression in a reused sandbox',
+             iterations: 20_000, setup: -> { QuickJS::Sandbox.new } do |sandbox, _i|
+      sandbox.eval('1 + 2')
+    end
+
+    scenario 'eval/computation', 'Evaluate a CPU-bound loop',
+             iterations: 500, setup: -> { QuickJS::Sandbox.new } do |sandbox, _i|
+      sandbox.eval('(() => { let s = 0; for (let i = 0; i < 100000; i++) s += i % 7; return s; })()')
+    end
+
+    scenario 'eval/json', 'eval_json of an object result',
+             iterations: 10_000, setup: -> { QuickJS::Sandbox.new } do |sandbox, _i|
+      sandbox.eval_json('({ total: 3, items: [1, 2, 3] })')
+    end
+
+    scenario 'eval/record_transform', 'Map 5000 similarly shaped records to new objects',
+             iterations: 200,
+             setup: -> { QuickJS::Sandbox.new(memory_limit: 20_000_000).tap { |s| s.eval(RECORDS_JS) } } do |sandbox, _i|
+      sandbox.eval(<<~JS)
+        (() => {
+          let total = 0;
+          for (const r of records) {
+            const line = { id: r.id, net: r.price * r.qty, gross: r.price * r.qty * (1 + r.tax) };
+            if (r.region === 'r1') total += line.gross - line.net;
+          }
+          return total;
+        })()
+      JS
+    end
+
+    scenario 'call/function', 'Call a defined function with Ruby arguments',
+             iterations: 20_000,
+             setup: -> { QuickJS::Sandbox.new.tap { |s| s.eval('globalThis.add = (a, b) => a + b') } } do |sandbox, i|
+      sandbox.call('add', i, 1)
+    end
+
+    scenario 'script/run', 'Run precompiled bytecode',
+             iterations: 10_000,
+             setup: -> { [QuickJS::Sandbox.new].tap { |s| s << s[0].compile('[1, 2, 3].map((x) => x * 2)') } } do |(sandbox, script), _i|
+      script.run(sandbox)
+    end
+
+    # Large marshalling across the Ruby/JavaScript boundary
+    scenario 'marshal/large_input', 'set_variable with 1000 objects, then read one field',
+             iterations: 500, setup: -> { QuickJS::Sandbox.new(memory_limit: 20_000_000) } do |sandbox, _i|
+      sandbox.set_variable('data', LARGE_INPUT)
+      sandbox.eval('data.items.length')
+    end
+
+    scenario 'marshal/large_output', 'Return 1000 objects to Ruby',
+             iterations: 500, setup: -> { QuickJS::Sandbox.new(memory_limit: 20_000_000) } do |sandbox, _i|
+      sandbox.eval("Array.from({ length: 1000 }, (_, i) => ({ id: i, name: 'item ' + i, tags: ['a', 'b'] }))")
+    end
+
+    scenario 'marshal/lazy_output', 'Return 1000 objects as a Handle and read one',
+             iterations: 2000, setup: -> { QuickJS::Sandbox.new(memory_limit: 20_000_000) } do |sandbox, _i|
+      sandbox.eval("Array.from({ length: 1000 }, (_, i) => ({ id: i }))", lazy: true).value[500]['id']
+    end
+
+    scenario 'marshal/json_roundtrip', 'set_variable_json and eval_json with 1000 objects',
+             iterations: 500, setup: -> { QuickJS::Sandbox.new(memory_limit: 20_000_000) } do |sandbox, _i|
+      sandbox.set_variable_json('data', LARGE_INPUT_JSON)
+      sandbox.eval_json('data.items.filter((item) => item.id % 2)')
+    end
+
+    # Sandbox churn
+    scenario 'churn/sandbox', 'Create a sandbox and evaluate once',
+             iterations: 1000 do |_state, _i|
+      QuickJS::Sandbox.new.eval('1 + 2')
+    end
+
+    scenario 'churn/sandbox_arena', 'Create an arena sandbox and evaluate once',
+             iterations: 1000 do |_state, _i|
+      QuickJS::Sandbox.new(allocator: :arena).eval('1 + 2')
+    end
+
+    scenario 'churn/shared_runtime', 'Create a sandbox in a shared runtime and evaluate once',
+             iterations: 1000, setup: -> { QuickJS::Runtime.new } do |runtime, _i|
+      runtime.sandbox.eval('1 + 2')
+    end
+
+    scenario 'churn/reset', 'reset! a used sandbox and evaluate once',
+             iterations: 2000, setup: -> { QuickJS::Sandbox.new } do |sandbox, _i|
+      sandbox.eval('globalThis.x = [1, 2, 3]')
+      sandbox.reset!
+    end
+
+    scenario 'churn/modules', 'New sandbox importing cached modules',
+             iterations: 1000 do |_state, _i|
+      QuickJS::Sandbox.new(module_resolver: MODULES)
+                      .eval_module("import { total } from './lib/format.js'; export default total([1, 2, 3])",
+                                   name: 'main.js')
+    end
+
+    # fetch()
+    scenario 'fetch/sequential', 'Five sequential fetch() calls per eval',
+             iterations: 200, setup: -> { QuickJS::Sandbox.new(http: LocalServer.instance.http_options) } do |sandbox, _i|
+      sandbox.eval(<<~JS)
+        (async () => {
+          let n = 0;
+          for (let i = 0; i < 5; i++) n += (await (await fetch('#{LocalServer.instance.url('/seq')}')).json()).items.length;
+          return n;
+        })()
+      JS
+    end
+
+    scenario 'fetch/parallel', 'Ten concurrent fetch() calls per eval',
+             iterations: 200, setup: -> { QuickJS::Sandbox.new(http: LocalServer.instance.http_options) } do |sandbox, _i|
+      sandbox.eval(<<~JS)
+        Promise.all(Array.from({ length: 10 }, (_, i) => fetch('#{LocalServer.instance.url('/par/')}' + i).then((r) => r.json())))
+               .then((bodies) => bodies.length)
+      JS
+    end
+
+    # Concurrency
+    [1, 4].each do |threads|
+      scenario "concurrent/eval_#{threads}_threads", "CPU-bound evals on #{threads} threads, one sandbox each",
+               iterations: 400, threads: threads, setup: -> { QuickJS::Sandbox.new } do |sandbox, _i|
+        sandbox.eval('(() => { let s = 0; for (let i = 0; i < 50000; i++) s += i % 7; return s; })()')
+      end
+    end
+
+    # The four threads share one pool: it is shut down (once) afterwards
+    scenario 'concurrent/pool', 'Jobs submitted to a 4-sandbox Pool from 4 threads',
+             iterations: 2000, threads: 4,
+             setup: -> { (@pool ||= QuickJS::Pool.new(size: 4)) },
+             teardown: lambda { |pool|
+               pool.shutdown
+               @pool = nil
+             } do |pool, i|
+      pool.submit('input * 2', { input: i }).value
+    end
+
+    # Timers
+    scenario 'timers/zero_delay', 'Chain 20 setTimeout(0) callbacks',
+             iterations: 1000, setup: -> { QuickJS::Sandbox.new } do |sandbox, _i|
+      sandbox.eval('new Promise((done) => { let n = 0; const tick = () => (++n === 20 ? done(n) : setTimeout(tick, 0)); tick(); })')
+    end
+  end
+end
@@ -38,6 +38,26 @@ module Benchmarks
           end
         end
 
+        sandbox.eval("function add(a, b) { return a + b; }")
+
+        x.report("Function call (eval):") do
+          iterations.times do
+            sandbox.set_variable("a", 5)
+            sandbox.set_variable("b", 3)
+            sandbox.eval("add(a, b)")
+          end
+        end
+
+        x.report("Function call (Sandbox#call):") do
+          iterations.times { sandbox.call("add", 5, 3) }
+        end
+
+        sandbox.define_function("rubyAdd") { |a, b| a + b }
+
+        x.report("Ruby function x1000 (define_function):") do
+          iterations.times { sandbox.eval("(() => { let s = 0; for (let i = 0; i < 1000; i++) s = rubyAdd(s, i); return s; })()") }
+        end
+
         x.report("Boolean operations:") do
           iterations.times { sandbox.eval("true && false || true") }
         end
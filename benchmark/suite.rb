@@ -0,0 +1,199 @@
+# frozen_string_literal: true
+
+require 'json'
+require 'time'
+require_relative '../lib/quickjs'
+
+module Benchmarks
+  # Machine-readable benchmark harness
+  #
+  # Each scenario is warmed up, then timed iteration by iteration so the
+  # report carries latency percentiles as well as throughput, along with
+  # the Ruby allocations (GC.stat deltas) and RSS growth of the timed part.
+  # Reports are plain Hashes, written as JSON and compared against a stored
+  # baseline by Suite.compare.
+  class Suite
+    Scenario = Struct.new(:name, :description, :iterations, :warmup, :threads, :setup, :body, :teardown,
+                          keyword_init: true)
+
+    # Relative change beyond which Suite.compare reports a regression
+    DEFAULT_TOLERANCE = 0.2
+
+    # Metrics compared against the baseline: [path in the scenario report, true if higher is better]
+    COMPARED_METRICS = {
+      'ips' => [%w[ips], true],
+      'p50_ms' => [%w[latency_ms p50], false],
+      'p99_ms' => [%w[latency_ms p99], false],
+      'allocated_objects' => [%w[ruby_gc allocated_objects_per_iteration], false]
+    }.freeze
+
+    @scenarios = []
+
+    class << self
+      attr_reader :scenarios
+
+      # Register a scenario
+      #
+      # The setup block runs once before warmup and returns the state passed to
+      # each iteration (one state per thread for threaded scenarios). The body
+      # is one iteration: body.call(state, index).
+      #
+      # @param name [String] Unique name, used in reports and baselines
+      # @param iterations [Integer] Timed iterations (split across threads)
+      # @param warmup [Integer] Untimed iterations first (per thread)
+      # @param threads [Integer] Ruby threads running iterations concurrently
+      def scenario(name, description, iterations:, warmup: iterations / 10, threads: 1, setup: nil,
+                   teardown: nil, &body)
+        @scenarios << Scenario.new(name: name, description: description, iterations: iterations,
+                                   warmup: warmup, threads: threads, setup: setup || -> {},
+                                   body: body, teardown: teardown)
+      end
+
+      # Run scenarios and return the report
+      #
+      # @param only [Array<String>, nil] Names (or prefixes) of the scenarios to run
+      # @param scale [Float] Multiplier for iteration counts (e.g. 0.1 for a quick run)
+      def run(only: nil, scale: 1.0, out: $stdout)
+        selected = scenarios.select { |s| only.nil? || only.any? { |prefix| s.name.start_with?(prefix) } }
+        results = selected.map do |scenario|
+          out&.print format('%-32s', scenario.name)
+          result = measure(scenario, scale)
+          out&.puts format('%12.1f ips   p50 %8.3f ms   p99 %8.3f ms   %8.1f objects/iter',
+                           result['ips'], result['latency_ms']['p50'], result['latency_ms']['p99'],
+                           result['ruby_gc']['allocated_objects_per_iteration'])
+          result
+        end
+
+        {
+          'suite' => 'quickjs-ruby',
+          'version' => QuickJS::VERSION,
+          'ruby' => RUBY_DESCRIPTION,
+          'platform' => RUBY_PLATFORM,
+          'processors' => processor_count,
+          'git_commit' => git_commit,
+          'created_at' => Time.now.utc.iso8601,
+          'scenarios' => results
+        }
+      end
+
+      # Compare a report against a baseline report
+      #
+      # @return [Array<Hash>] One entry per scenario and metric present in both,
+      #   with the relative change and whether it is a regression
+      def compare(report, baseline, tolerance: DEFAULT_TOLERANCE)
+        previous = baseline.fetch('scenarios').to_h { |s| [s['name'], s] }
+        report.fetch('scenarios').flat_map do |current|
+          base = previous[current['name']]
+          next [] unless base
+
+          COMPARED_METRICS.filter_map do |metric, (path, higher_is_better)|
+            now = current.dig(*path)
+            was = base.dig(*path)
+            next unless now && was&.positive?
+
+            change = (now - was) / was.to_f
+            worse = higher_is_better ? -change : change
+            { 'scenario' => current['name'], 'metric' => metric, 'baseline' => was, 'current' => now,
+              'change' => change.round(4), 'regression' => worse > tolerance }
+          end
+        end
+      end
+
+      private
+
+      def measure(scenario, scale)
+        iterations = [(scenario.iterations * scale).round, scenario.threads].max
+        warmup = (scenario.warmup * scale).round
+        states = Array.new(scenario.threads) { scenario.setup.call }
+
+        run_threads(scenario, states, warmup) if warmup.positive?
+
+        GC.start
+        gc_before = GC.stat
+        rss_before = rss_kb
+        started = clock
+        latencies = run_threads(scenario, states, iterations / scenario.threads)
+        elapsed = clock - started
+        rss_after = rss_kb
+        gc_after = GC.stat
+
+        states.each { |state| scenario.teardown&.call(state) }
+        timed = latencies.size
+        {
+          'name' => scenario.name,
+          'description' => scenario.description,
+          'iterations' => timed,
+          'threads' => scenario.threads,
+          'elapsed_s' => elapsed.round(4),
+          'ips' => (timed / elapsed).round(2),
+          'latency_ms' => percentiles(latencies),
+          'ruby_gc' => gc_delta(gc_before, gc_after, timed),
+          'rss_kb' => { 'before' => rss_before, 'after' => rss_after, 'delta' => rss_after - rss_before }
+        }
+      end
+
+      # Run per_thread iterations on each thread; returns the latencies in ms
+      def run_threads(scenario, states, per_thread)
+        return time_iterations(scenario, states.first, per_thread) if scenario.threads == 1
+
+        states.map { |state| Thread.new { time_iterations(scenario, state, per_thread) } }.flat_map(&:value)
+      end
+
+      def time_iterations(scenario, state, count)
+        body = scenario.body
+        Array.new(count) do |i|
+          start = clock
+          body.call(state, i)
+          (clock - start) * 1000.0
+        end
+      end
+
+      def percentiles(latencies)
+        sorted = latencies.sort
+        pick = ->(q) { sorted[[(q * sorted.size).ceil - 1, 0].max].round(4) }
+        {
+          'min' => sorted.first.round(4),
+          'mean' => (sorted.sum / sorted.size).round(4),
+          'p50' => pick.call(0.50),
+          'p90' => pick.call(0.90),
+          'p99' => pick.call(0.99),
+          'max' => sorted.last.round(4)
+        }
+      end
+
+      def gc_delta(before, after, iterations)
+        allocated = after[:total_allocated_objects] - before[:total_allocated_objects]
+        {
+          'allocated_objects' => allocated,
+          'allocated_objects_per_iteration' => (allocated / iterations.to_f).round(2),
+          'gc_count' => after[:count] - before[:count],
+          'minor_gc_count' => after[:minor_gc_count] - before[:minor_gc_count],
+          'major_gc_count' => after[:major_gc_count] - before[:major_gc_count]
+        }
+      end
+
+      def clock
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+
+      # Resident set size in KB (0 where /proc is unavailable)
+      def rss_kb
+        File.read('/proc/self/status')[/VmRSS:\s+(\d+)/, 1].to_i
+      rescue SystemCallError
+        0
+      end
+
+      def processor_count
+        require 'etc'
+        Etc.nprocessors
+      end
+
+      def git_commit
+        commit = `git rev-parse --short HEAD 2>/dev/null`.strip
+        commit.empty? ? nil : commit
+      rescue SystemCallError
+        nil
+      end
+    end
+  end
+end
@@ -0,0 +1,242 @@
+/*
+ * Per-runtime arena allocator
+ *
+ * Memory comes from the system allocator in large chunks, split into
+ * pages that each serve one size class. Small blocks have no header: the
+ * page holding a block, found by masking its address, records its size
+ * class. Freed blocks go to a per-class free list and are reused by the
+ * same runtime only. Blocks above the largest class are allocated
+ * individually, page-aligned with the same header, and linked so that
+ * arena_destroy can release them along with the chunks, without walking
+ * the blocks that are still live.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "cutils.h"
+
+#define ARENA_PAGE_SIZE 16384
+#define ARENA_MIN_CHUNK (4 * ARENA_PAGE_SIZE)
+#define ARENA_MAX_CHUNK (8 * 1024 * 1024)
+
+// Size classes: multiples of 16 up to 128, then four per power of two up
+// to ARENA_MAX_SMALL (at most 25% rounding)
+#define ARENA_CLASS_COUNT 24
+#define ARENA_MAX_SMALL 2048
+#define ARENA_LARGE UINT32_MAX
+
+static const uint32_t arena_class_sizes[ARENA_CLASS_COUNT] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256,
+    320, 384, 448, 512,
+    640, 768, 896, 1024,
+    1280, 1536, 1792, 2048,
+};
+
+// Start of every page, and of every large block
+typedef struct ArenaPage {
+    uint32_t size_class;  // Index into arena_class_sizes, or ARENA_LARGE
+    size_t size;  // Usable size of a large block
+    struct ArenaPage *prev, *next;  // Large blocks of the arena
+} ArenaPage;
+
+// Blocks start 16-byte aligned after the header, like malloc's
+#define ARENA_HEADER_SIZE ((sizeof(ArenaPage) + 15) & ~(size_t)15)
+
+typedef struct ArenaFreeBlock {
+    struct ArenaFreeBlock *next;
+} ArenaFreeBlock;
+
+struct Arena {
+    void **chunks;
+    size_t chunk_count;
+    size_t chunk_capacity;
+    size_t chunk_size;  // Multiple of ARENA_PAGE_SIZE
+    char *next_page;  // Unused pages of the last chunk
+    char *chunk_end;
+    ArenaFreeBlock *free_lists[ARENA_CLASS_COUNT];
+    char *bump[ARENA_CLASS_COUNT];  // Never-used space in each class's last page
+    char *bump_end[ARENA_CLASS_COUNT];
+    ArenaPage *large;
+    size_t reserved;
+};
+
+static inline ArenaPage *arena_page_of(const void *ptr) {
+    return (ArenaPage *)((uintptr_t)ptr & ~(uintptr_t)(ARENA_PAGE_SIZE - 1));
+}
+
+// Smallest class holding size bytes (1 <= size <= ARENA_MAX_SMALL)
+static inline int arena_class_index(size_t size) {
+    if (size <= 128) {
+        return (int)((size + 15) >> 4) - 1;
+    }
+    unsigned int n = (unsigned int)size - 1;
+    int bits = 31 - clz32(n);  // 7 and up
+    return 8 + (bits - 7) * 4 + (int)((n >> (bits - 2)) & 3);
+}
+
+Arena *arena_new(size_t chunk_size) {
+    Arena *arena = calloc(1, sizeof(Arena));
+    if (!arena) {
+        return NULL;
+    }
+    if (chunk_size < ARENA_MIN_CHUNK) {
+        chunk_size = ARENA_MIN_CHUNK;
+    } else if (chunk_size > ARENA_MAX_CHUNK) {
+        chunk_size = ARENA_MAX_CHUNK;
+    }
+    arena->chunk_size = (chunk_size + ARENA_PAGE_SIZE - 1) & ~(size_t)(ARENA_PAGE_SIZE - 1);
+    return arena;
+}
+
+void arena_destroy(Arena *arena) {
+    if (!arena) {
+        return;
+    }
+    for (size_t i = 0; i < arena->chunk_count; i++) {
+        free(arena->chunks[i]);
+    }
+    free(arena->chunks);
+    ArenaPage *block = arena->large;
+    while (block) {
+        ArenaPage *next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
+
+static char *arena_new_page(Arena *arena) {
+    if (arena->next_page == arena->chunk_end) {
+        if (arena->chunk_count == arena->chunk_capacity) {
+            size_t capacity = arena->chunk_capacity ? arena->chunk_capacity * 2 : 8;
+            void **chunks = realloc(arena->chunks, capacity * sizeof(*chunks));
+            if (!chunks) {
+                return NULL;
+            }
+            arena->chunks = chunks;
+            arena->chunk_capacity = capacity;
+        }
+        void *chunk;
+        if (posix_memalign(&chunk, ARENA_PAGE_SIZE, arena->chunk_size) != 0) {
+            return NULL;
+        }
+        arena->chunks[arena->chunk_count++] = chunk;
+        arena->reserved += arena->chunk_size;
+        arena->next_page = chunk;
+        arena->chunk_end = (char *)chunk + arena->chunk_size;
+    }
+    char *page = arena->next_page;
+    arena->next_page += ARENA_PAGE_SIZE;
+    return page;
+}
+
+static void *arena_alloc_large(Arena *arena, size_t size) {
+    void *ptr;
+    if (size > SIZE_MAX - ARENA_HEADER_SIZE ||
+        posix_memalign(&ptr, ARENA_PAGE_SIZE, ARENA_HEADER_SIZE + size) != 0) {
+        return NULL;
+    }
+    ArenaPage *block = ptr;
+    block->size_class = ARENA_LARGE;
+    block->size = size;
+    block->prev = NULL;
+    block->next = arena->large;
+    if (arena->large) {
+        arena->large->prev = block;
+    }
+    arena->large = block;
+    arena->reserved += ARENA_HEADER_SIZE + size;
+    return (char *)block + ARENA_HEADER_SIZE;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    if (size > ARENA_MAX_SMALL) {
+        return arena_alloc_large(arena, size);
+    }
+
+    int index = arena_class_index(size ? size : 1);
+    ArenaFreeBlock *block = arena->free_lists[index];
+    if (block) {
+        arena->free_lists[index] = block->next;
+        return block;
+    }
+
+    uint32_t class_size = arena_class_sizes[index];
+    if (arena->bump_end[index] - arena->bump[index] < (ptrdiff_t)class_size) {
+        char *page = arena_new_page(arena);
+        if (!page) {
+            return NULL;
+        }
+        ((ArenaPage *)page)->size_class = index;
+        arena->bump[index] = page + ARENA_HEADER_SIZE;
+        arena->bump_end[index] = page + ARENA_PAGE_SIZE;
+    }
+    void *ptr = arena->bump[index];
+    arena->bump[index] += class_size;
+    return ptr;
+}
+
+void arena_free(Arena *arena, void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    ArenaPage *page = arena_page_of(ptr);
+    if (page->size_class == ARENA_LARGE) {
+        if (page->prev) {
+            page->prev->next = page->next;
+        } else {
+            arena->large = page->next;
+        }
+        if (page->next) {
+            page->next->prev = page->prev;
+        }
+        arena->reserved -= ARENA_HEADER_SIZE + page->size;
+        free(page);
+        return;
+    }
+
+    ArenaFreeBlock *block = ptr;
+    block->next = arena->free_lists[page->size_class];
+    arena->free_lists[page->size_class] = block;
+}
+
+void *arena_realloc(Arena *arena, void *ptr, size_t size) {
+    if (!ptr) {
+        return arena_alloc(arena, size);
+    }
+
+    // Keep the block when the new size maps to the same class, or for a
+    // large block, when it still fits without wasting more than half
+    size_t old_size = arena_usable_size(ptr);
+    ArenaPage *page = arena_page_of(ptr);
+    if (page->size_class == ARENA_LARGE
+            ? size <= old_size && size > old_size / 2
+            : size <= ARENA_MAX_SMALL && arena_class_index(size ? size : 1) == (int)page->size_class) {
+        return ptr;
+    }
+
+    void *new_ptr = arena_alloc(arena, size);
+    if (!new_ptr) {
+        return NULL;
+    }
+    memcpy(new_ptr, ptr, size < old_size ? size : old_size);
+    arena_free(arena, ptr);
+    return new_ptr;
+}
+
+size_t arena_usable_size(const void *ptr) {
+    if (!ptr) {
+        return 0;
+    }
+    const ArenaPage *page = arena_page_of(ptr);
+    return page->size_class == ARENA_LARGE ? page->size : arena_class_sizes[page->size_class];
+}
+
+size_t arena_reserved_bytes(const Arena *arena) {
+    return arena->reserved;
+}
@@ -0,0 +1,29 @@
+/*
+ * Per-runtime arena allocator, used by Sandbox.new(allocator: :arena)
+ */
+
+#ifndef QUICKJS_ARENA_H
+#define QUICKJS_ARENA_H
+
+#include <stddef.h>
+
+typedef struct Arena Arena;
+
+// Create an arena whose first chunk holds about chunk_size bytes (later
+// chunks have the same size). Returns NULL when out of memory.
+Arena *arena_new(size_t chunk_size);
+
+// Release every block of the arena at once, live or not
+void arena_destroy(Arena *arena);
+
+void *arena_alloc(Arena *arena, size_t size);
+void arena_free(Arena *arena, void *ptr);
+void *arena_realloc(Arena *arena, void *ptr, size_t size);
+
+// Bytes usable in a block returned by arena_alloc (at least the size asked for)
+size_t arena_usable_size(const void *ptr);
+
+// Bytes the arena has taken from the system allocator
+size_t arena_reserved_bytes(const Arena *arena);
+
+#endif
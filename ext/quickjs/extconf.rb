@@ -7,11 +7,23 @@ $CFLAGS << ' -std=gnu99 -Wall -Wextra -Wno-unused-parameter'
 $CFLAGS << ' -D_GNU_SOURCE'  # For asprintf
 $CFLAGS << ' -DCONFIG_VERSION=\"2025-12-22\"'  # QuickJS version
 
+# Used to size the JavaScript stack limit to the calling thread's stack
+have_func('pthread_getattr_np', 'pthread.h')
+have_func('pthread_get_stackaddr_np', 'pthread.h')
+
+# Faster value conversion on Rubies that have them (3.0+ / 3.2+)
+have_func('rb_enc_interned_str', 'ruby.h')
+have_func('rb_hash_new_capa', 'ruby.h')
+
 # Source files to compile
 # - quickjs_ext.c: Our Ruby extension wrapper
+# - web_api.c: Native Headers, URL and URLSearchParams
+# - arena.c: Arena allocator for Sandbox.new(allocator: :arena)
 # - Everything else: Upstream QuickJS (managed by `rake update_quickjs`)
 $srcs = %w[
   quickjs_ext.c
+  web_api.c
+  arena.c
   quickjs.c
   libregexp.c
   libunicode.c
@@ -260,6 +260,9 @@ struct JSRuntime {
     struct list_head tmp_obj_list; /* used during GC */
     JSGCPhaseEnum gc_phase : 8;
     size_t malloc_gc_threshold;
+    /* GC passes run and the time spent in them (see JS_GetGCStats) */
+    int64_t gc_count;
+    int64_t gc_time_ns;
     struct list_head weakref_list; /* list of JSWeakRefHeader.link */
 #ifdef DUMP_LEAKS
     struct list_head string_list; /* list of JSString.link */
@@ -6418,7 +6421,22 @@ static void JS_RunGCInternal(JSRuntime *rt, BOOL remove_weak_objects)
 
 void JS_RunGC(JSRuntime *rt)
 {
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
     JS_RunGCInternal(rt, TRUE);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    rt->gc_count++;
+    rt->gc_time_ns += (int64_t)(end.tv_sec - start.tv_sec) * 1000000000 +
+        (end.tv_nsec - start.tv_nsec);
+}
+
+/* Totals since the runtime was created, counting the passes triggered by
+   allocations as well as explicit JS_RunGC calls */
+void JS_GetGCStats(JSRuntime *rt, int64_t *pcount, int64_t *ptime_ns)
+{
+    *pcount = rt->gc_count;
+    *ptime_ns = rt->gc_time_ns;
 }
 
 /* Return false if not an object or if the object has already been
@@ -7132,7 +7150,10 @@ static void build_backtrace(JSContext *ctx, JSValueConst error_obj,
 
     if (!JS_IsObject(error_obj))
         return; /* protection in the out of memory case */
-    
+    /* error_obj is often the current exception: an out of memory error
+       raised while building the backtrace would free it */
+    error_obj = JS_DupValue(ctx, error_obj);
+
     js_dbuf_init(ctx, &dbuf);
     if (filename) {
         dbuf_printf(&dbuf, "    at %s", filename);
@@ -7141,7 +7162,7 @@ static void build_backtrace(JSContext *ctx, JSValueConst error_obj,
         dbuf_putc(&dbuf, '\n');
         str = JS_NewString(ctx, filename);
         if (JS_IsException(str))
-            return;
+            goto done;
         /* Note: SpiderMonkey does that, could update once there is a standard */
         if (JS_DefinePropertyValue(ctx, error_obj, JS_ATOM_fileName, str,
                                    JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE) < 0 ||
@@ -7149,7 +7170,7 @@ static void build_backtrace(JSContext *ctx, JSValueConst error_obj,
                                    JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE) < 0 ||
             JS_DefinePropertyValue(ctx, error_obj, JS_ATOM_columnNumber, JS_NewInt32(ctx, col_num),
                                    JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE) < 0) {
-            return;
+            goto done;
         }
     }
     for(sf = ctx->rt->current_stack_frame; sf != NULL; sf = sf->prev_frame) {
@@ -7195,9 +7216,51 @@ static void build_backtrace(JSContext *ctx, JSValueConst error_obj,
         str = JS_NULL;
     else
         str = JS_NewString(ctx, (char *)dbuf.buf);
+    if (!JS_IsException(str)) {
+        JS_DefinePropertyValue(ctx, error_obj, JS_ATOM_stack, str,
+                               JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    }
+ done:
     dbuf_free(&dbuf);
-    JS_DefinePropertyValue(ctx, error_obj, JS_ATOM_stack, str,
-                           JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    JS_FreeValue(ctx, error_obj);
+}
+
+/* Describe up to max_frames frames of the current call stack, innermost
+   first, without executing JS code (usable from an interrupt handler).
+   The atoms are owned by the caller. Returns the number of frames. */
+int JS_GetStackFrames(JSContext *ctx, JSStackFrameInfo *frames, int max_frames)
+{
+    JSStackFrame *sf;
+    JSObject *p;
+    JSProperty *pr;
+    JSShapeProperty *prs;
+    JSFunctionBytecode *b;
+    int n = 0, col_num;
+
+    for(sf = ctx->rt->current_stack_frame; sf != NULL && n < max_frames;
+        sf = sf->prev_frame) {
+        if (JS_VALUE_GET_TAG(sf->cur_func) != JS_TAG_OBJECT)
+            continue;
+        p = JS_VALUE_GET_OBJ(sf->cur_func);
+        frames[n].func_name = JS_ATOM_NULL;
+        frames[n].filename = JS_ATOM_NULL;
+        frames[n].line_num = 0;
+        prs = find_own_property(&pr, p, JS_ATOM_name);
+        if (prs && (prs->flags & JS_PROP_TMASK) == JS_PROP_NORMAL &&
+            JS_VALUE_GET_TAG(pr->u.value) == JS_TAG_STRING &&
+            JS_VALUE_GET_STRING(pr->u.value)->len != 0) {
+            frames[n].func_name = JS_NewAtomStr(ctx, JS_VALUE_GET_STRING(JS_DupValue(ctx, pr->u.value)));
+        }
+        if (js_class_has_bytecode(p->class_id)) {
+            b = p->u.func.function_bytecode;
+            if (b->has_debug) {
+                frames[n].filename = JS_DupAtom(ctx, b->debug.filename);
+                frames[n].line_num = find_line_num(ctx, b, -1, &col_num);
+            }
+        }
+        n++;
+    }
+    return n;
 }
 
 /* Note: it is important that no exception is returned by this function */
@@ -16426,6 +16489,14 @@ static BOOL js_get_fast_array(JSContext *ctx, JSValueConst obj,
     return FALSE;
 }
 
+/* Return the dense backing store of a fast array. The pointer is only
+   valid until the array is modified. */
+JS_BOOL JS_GetFastArray(JSContext *ctx, JSValueConst obj,
+                        JSValue **arrpp, uint32_t *countp)
+{
+    return js_get_fast_array(ctx, obj, arrpp, countp);
+}
+
 static __exception int js_append_enumerate(JSContext *ctx, JSValue *sp)
 {
     JSValue iterator, enumobj, method, value;
@@ -380,6 +380,9 @@ void JS_SetRuntimeOpaque(JSRuntime *rt, void *opaque);
 typedef void JS_MarkFunc(JSRuntime *rt, JSGCObjectHeader *gp);
 void JS_MarkValue(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func);
 void JS_RunGC(JSRuntime *rt);
+/* number of GC passes (explicit or triggered by allocations) and the
+   nanoseconds spent in them since the runtime was created */
+void JS_GetGCStats(JSRuntime *rt, int64_t *pcount, int64_t *ptime_ns);
 JS_BOOL JS_IsLiveObject(JSRuntime *rt, JSValueConst obj);
 
 JSContext *JS_NewContext(JSRuntime *rt);
@@ -761,6 +764,10 @@ JS_BOOL JS_SetConstructorBit(JSContext *ctx, JSValueConst func_obj, JS_BOOL val)
 
 JSValue JS_NewArray(JSContext *ctx);
 int JS_IsArray(JSContext *ctx, JSValueConst val);
+/* Return the dense backing store of a fast array. The pointer is only
+   valid until the array is modified. */
+JS_BOOL JS_GetFastArray(JSContext *ctx, JSValueConst obj,
+                        JSValue **arrpp, uint32_t *countp);
 
 JSValue JS_NewDate(JSContext *ctx, double epoch_ms);
 
@@ -915,6 +922,16 @@ void JS_SetHostPromiseRejectionTracker(JSRuntime *rt, JSHostPromiseRejectionTrac
 /* return != 0 if the JS code needs to be interrupted */
 typedef int JSInterruptHandler(JSRuntime *rt, void *opaque);
 void JS_SetInterruptHandler(JSRuntime *rt, JSInterruptHandler *cb, void *opaque);
+/* One frame of the call stack (see JS_GetStackFrames) */
+typedef struct JSStackFrameInfo {
+    JSAtom func_name; /* JS_ATOM_NULL if anonymous */
+    JSAtom filename; /* JS_ATOM_NULL for native functions */
+    int line_num; /* line of the function definition, 0 if unknown */
+} JSStackFrameInfo;
+/* Describe up to max_frames frames of the current call stack, innermost
+   first, without executing JS code (usable from an interrupt handler).
+   The atoms are owned by the caller. Returns the number of frames. */
+int JS_GetStackFrames(JSContext *ctx, JSStackFrameInfo *frames, int max_frames);
 /* if can_block is TRUE, Atomics.wait() can be used */
 void JS_SetCanBlock(JSRuntime *rt, JS_BOOL can_block);
 /* select which debug info is stripped from the compiled code */
@@ -5,18 +5,32 @@
 
 #include <ruby.h>
 #include <ruby/encoding.h>
+#include <ruby/thread.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <sys/time.h>
+#include <pthread.h>
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#elif defined(__linux__) || defined(__GLIBC__)
+#include <malloc.h>
+#elif defined(__FreeBSD__)
+#include <malloc_np.h>
+#endif
 
 #include "quickjs.h"
 #include "quickjs-libc.h"
+#include "arena.h"
+#include "web_api.h"
 
 // Ruby class references
 static VALUE rb_cQuickJS;
 static VALUE rb_cSandbox;
 static VALUE rb_cResult;
+static VALUE rb_cHandle;
+static VALUE rb_eQuickJSError;
 static VALUE rb_eQuickJSSyntaxError;
 static VALUE rb_eQuickJSJavascriptError;
 static VALUE rb_eQuickJSMemoryLimitError;
@@ -25,26 +39,234 @@ static VALUE rb_eQuickJSHTTPBlockedError;
 static VALUE rb_eQuickJSHTTPLimitError;
 static VALUE rb_eQuickJSHTTPError;
 
-// Context wrapper structure
+static ID id_call;
+static VALUE compiled_bytecode;  // ObjectSpace::WeakMap, see bytecode_register
+
+// When the sandbox runs a full GC pass after evaluating code
+typedef enum {
+    GC_ALWAYS,     // After every eval (and once per batch)
+    GC_THRESHOLD,  // Never explicitly; QuickJS collects once allocations cross gc_threshold
+    GC_NEVER,      // Never explicitly; QuickJS collects with its default threshold
+    GC_EVERY_N     // After every gc_interval evals
+} GCPolicy;
+
+struct SandboxHandle;
+
+// A sampled call stack, outermost frame last (see JS_GetStackFrames)
+typedef struct {
+    uint64_t count;  // Samples taken with this stack
+    int len;
+    JSStackFrameInfo frames[];
+} ProfileStack;
+
+// Distinct stacks sampled by eval(profile:). Filled by the interrupt
+// handler without the GVL, so it is a plain open-addressing hash table
+// rather than an st_table.
+typedef struct {
+    ProfileStack **slots;
+    size_t capacity;  // Power of two
+    size_t count;
+    uint64_t dropped;  // Samples not recorded (too many distinct stacks, out of memory)
+} ProfileTable;
+
+// A setTimeout/setInterval callback, allocated in the context's heap so
+// that timers count against the memory limit
+typedef struct {
+    int64_t deadline_ms;  // get_time_ms() time the timer fires at
+    uint64_t seq;  // Orders timers with the same deadline
+    int32_t id;
+    int32_t interval_ms;  // Period of setInterval, 0 for setTimeout
+    JSValue func;
+    int argc;
+    JSValue argv[];
+} Timer;
+
+struct ContextWrapper;
+
+// Bytes charged to one sandbox of a shared runtime (see shared_js_malloc).
+// Blocks keep pointing at it after the sandbox is gone, so it is freed
+// with the last of them.
+typedef struct {
+    size_t size;
+    size_t blocks;
+    size_t limit;  // The sandbox's share of the memory, SIZE_MAX for none
+    int orphaned;  // Set once the sandbox has been freed
+} MemoryAccount;
+
+// A JSRuntime shared by the sandboxes of a QuickJS::Runtime. Reference
+// counted: the Runtime object and each of its sandboxes hold a reference.
 typedef struct {
+    JSRuntime *rt;
+    int refs;
+    size_t heap_size;  // Mirrors the runtime's malloc_size
+    struct ContextWrapper *current;  // Sandbox running JavaScript (or being created), NULL when idle
+    struct ContextWrapper *zombies;  // Sandboxes garbage collected while another one was running
+} SharedRuntime;
+
+// Context wrapper structure
+typedef struct ContextWrapper {
     JSRuntime *rt;
     JSContext *ctx;
+    SharedRuntime *shared;  // Runtime of a sandbox created by Runtime#sandbox, NULL if it owns rt
+    MemoryAccount *account;  // Memory charged to the sandbox in its shared runtime
+    struct ContextWrapper *next_zombie;  // Next in shared->zombies
     size_t mem_limit;
     int64_t start_time_ms;
     int64_t timeout_ms;
     int timed_out;
+    volatile int interrupted;  // Set by the unblock function when Ruby interrupts the thread
+    int killed;  // Thread#kill arrived before the eval started (see eval_execute)
+    int busy;  // Set while a thread is executing JavaScript in this sandbox
+    int gvl_released;  // Set while JavaScript runs without the GVL
+    int discarding;  // Set while reset drops jobs left over from the previous context
+    int json_output;  // Set while eval_json runs: results are JSON-stringified
+    VALUE lazy_sandbox;  // Set to the sandbox by eval(lazy: true): object results become Handles
+    VALUE host_functions;  // Callables exposed by define_function, indexed by function data
+    VALUE host_function_names;  // Global name of each host function
+    struct SandboxHandle *handles;  // Live handles into this context (see new_handle)
+    JSValue *released_values;  // Values of collected handles, freed by the next eval_begin
+    size_t released_len;
+    size_t released_capa;
     char *console_output;
     size_t console_output_len;
     size_t console_output_capacity;
     size_t console_max_size;
     int console_truncated;
+    VALUE console_sink;  // Callable receiving batches of console lines instead of console_output, or nil
+    char *console_batch;  // Lines not yet passed to console_sink (see console_batch_line)
+    size_t console_batch_len;
+    size_t console_batch_capacity;
+    size_t console_flush_size;  // Batch size in bytes that makes console.log flush to console_sink
+    VALUE module_loader;  // Callable returning the bytecode of an imported module (see module_loader)
     VALUE rb_http_callback;  // Ruby callback for HTTP requests
+    VALUE rb_http_executor;  // HTTPExecutor running fetch() requests concurrently (takes precedence)
+    st_table *pending_fetches;  // Request id -> PendingFetch of fetch() calls in flight
+    pthread_mutex_t fetch_mutex;  // Guards fetch_completions, signals fetch_cond
+    pthread_cond_t fetch_cond;
+    uint64_t fetch_completions;  // Requests completed (see sandbox_fetch_ready)
+    uint64_t fetch_completions_seen;  // Value of fetch_completions last handled by event_wait
+    // Timers set by setTimeout/setInterval (see js_set_timer): a binary heap by deadline
+    Timer **timers;
+    size_t timer_count;
+    size_t timer_capacity;
+    int32_t last_timer_id;
+    uint64_t timer_seq;
+    Timer *firing_timer;  // Timer whose callback is running (see timer_fire)
+    int firing_timer_cleared;  // Set when the running timer is cleared by its own callback
     VALUE pending_ruby_exception;  // Ruby exception to re-raise after JS execution
+    st_table *script_cache;  // Bytecode String -> function read into this context (see run_script)
+    st_table *call_paths;  // Function path ("a.b.fn") -> atoms of its segments (see call)
+    GCPolicy gc_policy;
+    int64_t gc_interval;  // Evals between passes for GC_EVERY_N
+    size_t gc_threshold;  // Allocation threshold for GC_THRESHOLD, 0 for QuickJS's default
+    int64_t evals_since_gc;
+    // Allocator bookkeeping (see sandbox_malloc_funcs)
+    int use_arena;  // allocator: :arena, the runtime allocates from arena
+    Arena *arena;
+    size_t reported_heap_size;  // Heap bytes last reported to the Ruby GC (see heap_report)
+    size_t heap_size;  // Mirrors the runtime's malloc_size
+    size_t peak_heap_size;  // High-water mark of heap_size since eval_begin
+    uint64_t allocated_bytes;  // Total bytes ever allocated
+    // Per-eval metrics (see eval_metrics)
+    uint64_t eval_allocated_bytes_start;
+    double eval_wall_start_ms;
+    double eval_cpu_start_ms;
+    int64_t eval_gc_count_start;  // Runtime's GC totals at eval_begin (see JS_GetGCStats)
+    int64_t eval_gc_time_start_ns;
+    int64_t job_count;
+    int64_t interrupt_checks;
+    int detailed_metrics;  // Also report object/shape counts (walks the whole heap)
+    // Sampling profiler (see profile_sample)
+    double profile_request_ms;  // Interval asked for by the next eval, taken by eval_begin
+    double profile_interval_ms;  // Sampling interval of the running eval, 0 when not profiling
+    double profile_next_sample_ms;
+    ProfileTable profile;
 } ContextWrapper;
 
+// Maximum number of scripts whose function objects a sandbox keeps. The
+// functions live in the JavaScript heap and count against the memory limit.
+#define SCRIPT_CACHE_MAX_ENTRIES 64
+
+// Maximum number of function paths a sandbox keeps resolved into atoms
+#define CALL_PATH_CACHE_MAX_ENTRIES 256
+
+// A function path split into property atoms, e.g. "app.handlers.onEvent"
+typedef struct {
+    int len;
+    JSAtom atoms[];
+} CallPath;
+
 // Thread-local storage for current wrapper
 static __thread ContextWrapper *current_wrapper = NULL;
 
+// JavaScript stack limits. Ruby threads have much smaller machine stacks
+// (1MB by default) than the main thread, so the limit is derived from the
+// stack of whichever thread is about to run JavaScript.
+#define SANDBOX_MAX_STACK_SIZE (1024 * 1024)
+#define SANDBOX_FALLBACK_STACK_SIZE (256 * 1024)  // Stack bounds unknown (e.g. in a Fiber)
+#define SANDBOX_STACK_MARGIN (128 * 1024)  // Kept free for Ruby callbacks and QuickJS internals
+
+// Current thread's machine stack bounds, looked up once per thread
+static __thread char *thread_stack_low = NULL;
+static __thread char *thread_stack_high = NULL;
+static __thread int thread_stack_known = -1;
+
+static void lookup_thread_stack(void) {
+    thread_stack_known = 0;
+#if defined(HAVE_PTHREAD_GETATTR_NP)
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+        void *addr;
+        size_t size;
+        if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+            thread_stack_low = (char *)addr;
+            thread_stack_high = (char *)addr + size;
+            thread_stack_known = 1;
+        }
+        pthread_attr_destroy(&attr);
+    }
+#elif defined(HAVE_PTHREAD_GET_STACKADDR_NP)
+    thread_stack_high = (char *)pthread_get_stackaddr_np(pthread_self());
+    thread_stack_low = thread_stack_high - pthread_get_stacksize_np(pthread_self());
+    thread_stack_known = 1;
+#endif
+}
+
+// Point the runtime's stack overflow check at the calling thread's stack
+static void update_stack_limit(JSRuntime *rt) {
+    char marker;
+    char *sp = &marker;
+    size_t max_stack = SANDBOX_FALLBACK_STACK_SIZE;
+
+    if (thread_stack_known < 0) {
+        lookup_thread_stack();
+    }
+    if (thread_stack_known && sp > thread_stack_low && sp < thread_stack_high &&
+        (size_t)(sp - thread_stack_low) > SANDBOX_STACK_MARGIN + SANDBOX_FALLBACK_STACK_SIZE) {
+        max_stack = (size_t)(sp - thread_stack_low) - SANDBOX_STACK_MARGIN;
+    }
+    if (max_stack > SANDBOX_MAX_STACK_SIZE) {
+        max_stack = SANDBOX_MAX_STACK_SIZE;
+    }
+
+    JS_UpdateStackTop(rt);
+    JS_SetMaxStackSize(rt, max_stack);
+}
+
+// Run `func` with the GVL held. JavaScript normally executes without the
+// GVL (see eval_run), so native callbacks that touch Ruby objects must go
+// through this helper; it calls `func` directly when the GVL is already held.
+static void *with_gvl(ContextWrapper *wrapper, void *(*func)(void *), void *data) {
+    if (!wrapper || !wrapper->gvl_released) {
+        return func(data);
+    }
+
+    wrapper->gvl_released = 0;
+    void *ret = rb_thread_call_with_gvl(func, data);
+    wrapper->gvl_released = 1;
+    return ret;
+}
+
 // Get current time in milliseconds
 static int64_t get_time_ms(void) {
     struct timespec ts;
@@ -52,9 +274,493 @@ static int64_t get_time_ms(void) {
     return (int64_t)ts.tv_sec * 1000 + (ts.tv_nsec / 1000000);
 }
 
+// Get current time in milliseconds, with sub-millisecond precision
+static double get_time_ms_precise(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+// CPU time consumed by the calling thread, in milliseconds
+static double get_thread_cpu_time_ms(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1000000.0;
+}
+
+// Runtime allocator: the same accounting as QuickJS's default allocator
+// (which JS_SetMemoryLimit relies on), plus the totals reported in
+// Result#metrics. The JSMallocState opaque is the sandbox's wrapper.
+#if defined(__APPLE__)
+#define sandbox_malloc_usable_size(ptr) malloc_size(ptr)
+#else
+#define sandbox_malloc_usable_size(ptr) malloc_usable_size((void *)(ptr))
+#endif
+#define SANDBOX_MALLOC_OVERHEAD 8  // Same estimate QuickJS uses
+
+static void sandbox_track_heap(JSMallocState *s, size_t added) {
+    ContextWrapper *wrapper = (ContextWrapper *)s->opaque;
+    wrapper->heap_size = s->malloc_size;
+    wrapper->allocated_bytes += added;
+    if (wrapper->heap_size > wrapper->peak_heap_size) {
+        wrapper->peak_heap_size = wrapper->heap_size;
+    }
+}
+
+static void *sandbox_js_malloc(JSMallocState *s, size_t size) {
+    if (s->malloc_size + size > s->malloc_limit) {
+        return NULL;
+    }
+
+    void *ptr = malloc(size);
+    if (!ptr) {
+        return NULL;
+    }
+
+    size_t usable = sandbox_malloc_usable_size(ptr) + SANDBOX_MALLOC_OVERHEAD;
+    s->malloc_count++;
+    s->malloc_size += usable;
+    sandbox_track_heap(s, usable);
+    return ptr;
+}
+
+static void sandbox_js_free(JSMallocState *s, void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    s->malloc_count--;
+    s->malloc_size -= sandbox_malloc_usable_size(ptr) + SANDBOX_MALLOC_OVERHEAD;
+    ((ContextWrapper *)s->opaque)->heap_size = s->malloc_size;
+    free(ptr);
+}
+
+static void *sandbox_js_realloc(JSMallocState *s, void *ptr, size_t size) {
+    if (!ptr) {
+        return size == 0 ? NULL : sandbox_js_malloc(s, size);
+    }
+    if (size == 0) {
+        sandbox_js_free(s, ptr);
+        return NULL;
+    }
+
+    size_t old_size = sandbox_malloc_usable_size(ptr);
+    if (s->malloc_size + size - old_size > s->malloc_limit) {
+        return NULL;
+    }
+
+    ptr = realloc(ptr, size);
+    if (!ptr) {
+        return NULL;
+    }
+
+    size_t new_size = sandbox_malloc_usable_size(ptr);
+    s->malloc_size += new_size - old_size;
+    sandbox_track_heap(s, new_size > old_size ? new_size - old_size : 0);
+    return ptr;
+}
+
+static size_t sandbox_js_malloc_usable_size(const void *ptr) {
+    return sandbox_malloc_usable_size(ptr);
+}
+
+static const JSMallocFunctions sandbox_malloc_funcs = {
+    sandbox_js_malloc,
+    sandbox_js_free,
+    sandbox_js_realloc,
+    sandbox_js_malloc_usable_size,
+};
+
+// Arena allocator (allocator: :arena). Blocks have no per-block overhead,
+// so they are charged exactly their usable size. The whole arena is
+// released at once when the runtime goes away (see runtime_free).
+static void *sandbox_arena_malloc(JSMallocState *s, size_t size) {
+    if (s->malloc_size + size > s->malloc_limit) {
+        return NULL;
+    }
+
+    void *ptr = arena_alloc(((ContextWrapper *)s->opaque)->arena, size);
+    if (!ptr) {
+        return NULL;
+    }
+
+    size_t usable = arena_usable_size(ptr);
+    s->malloc_count++;
+    s->malloc_size += usable;
+    sandbox_track_heap(s, usable);
+    return ptr;
+}
+
+static void sandbox_arena_free(JSMallocState *s, void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    s->malloc_count--;
+    s->malloc_size -= arena_usable_size(ptr);
+    ((ContextWrapper *)s->opaque)->heap_size = s->malloc_size;
+    arena_free(((ContextWrapper *)s->opaque)->arena, ptr);
+}
+
+static void *sandbox_arena_realloc(JSMallocState *s, void *ptr, size_t size) {
+    if (!ptr) {
+        return size == 0 ? NULL : sandbox_arena_malloc(s, size);
+    }
+    if (size == 0) {
+        sandbox_arena_free(s, ptr);
+        return NULL;
+    }
+
+    size_t old_size = arena_usable_size(ptr);
+    if (s->malloc_size + size - old_size > s->malloc_limit) {
+        return NULL;
+    }
+
+    ptr = arena_realloc(((ContextWrapper *)s->opaque)->arena, ptr, size);
+    if (!ptr) {
+        return NULL;
+    }
+
+    size_t new_size = arena_usable_size(ptr);
+    s->malloc_size += new_size - old_size;
+    sandbox_track_heap(s, new_size > old_size ? new_size - old_size : 0);
+    return ptr;
+}
+
+static const JSMallocFunctions sandbox_arena_malloc_funcs = {
+    sandbox_arena_malloc,
+    sandbox_arena_free,
+    sandbox_arena_realloc,
+    arena_usable_size,
+};
+
+// Shared runtime allocator: the counting allocator above, with a header in
+// front of each block naming the MemoryAccount of the sandbox that was
+// running when it was allocated. Frees, which the GC makes at any time,
+// credit that sandbox again. Blocks allocated while no sandbox runs are
+// only charged to the runtime. The JSMallocState opaque is the
+// SharedRuntime.
+#define SHARED_BLOCK_HEADER 16  // Keeps malloc's alignment
+
+static inline void *shared_block_base(const void *ptr) {
+    return (char *)ptr - SHARED_BLOCK_HEADER;
+}
+
+static inline MemoryAccount *shared_block_account(const void *ptr) {
+    return *(MemoryAccount **)shared_block_base(ptr);
+}
+
+// Bytes charged for a block
+static inline size_t shared_block_size(const void *ptr) {
+    return sandbox_malloc_usable_size(shared_block_base(ptr)) + SANDBOX_MALLOC_OVERHEAD;
+}
+
+static void shared_track_heap(JSMallocState *s, MemoryAccount *account, size_t added) {
+    SharedRuntime *runtime = (SharedRuntime *)s->opaque;
+    runtime->heap_size = s->malloc_size;
+    ContextWrapper *wrapper = runtime->current;
+    if (account && wrapper && wrapper->account == account) {
+        wrapper->heap_size = account->size;
+        wrapper->allocated_bytes += added;
+        if (wrapper->heap_size > wrapper->peak_heap_size) {
+            wrapper->peak_heap_size = wrapper->heap_size;
+        }
+    }
+}
+
+static void *shared_js_malloc(JSMallocState *s, size_t size) {
+    ContextWrapper *owner = ((SharedRuntime *)s->opaque)->current;
+    MemoryAccount *account = owner ? owner->account : NULL;
+    if (s->malloc_size + size > s->malloc_limit || (account && account->size + size > account->limit) ||
+        size > SIZE_MAX - SHARED_BLOCK_HEADER) {
+        return NULL;
+    }
+
+    void *base = malloc(SHARED_BLOCK_HEADER + size);
+    if (!base) {
+        return NULL;
+    }
+    *(MemoryAccount **)base = account;
+    void *ptr = (char *)base + SHARED_BLOCK_HEADER;
+
+    size_t charged = shared_block_size(ptr);
+    s->malloc_count++;
+    s->malloc_size += charged;
+    if (account) {
+        account->size += charged;
+        account->blocks++;
+    }
+    shared_track_heap(s, account, charged);
+    return ptr;
+}
+
+static void shared_js_free(JSMallocState *s, void *ptr) {
+    if (!ptr) {
+        return;
+    }
+
+    MemoryAccount *account = shared_block_account(ptr);
+    size_t charged = shared_block_size(ptr);
+    s->malloc_count--;
+    s->malloc_size -= charged;
+    if (account) {
+        account->size -= charged;
+        account->blocks--;
+    }
+    if (account && account->orphaned && account->blocks == 0) {
+        free(account);
+        ((SharedRuntime *)s->opaque)->heap_size = s->malloc_size;
+    } else {
+        shared_track_heap(s, account, 0);
+    }
+    free(shared_block_base(ptr));
+}
+
+static void *shared_js_realloc(JSMallocState *s, void *ptr, size_t size) {
+    if (!ptr) {
+        return size == 0 ? NULL : shared_js_malloc(s, size);
+    }
+    if (size == 0) {
+        shared_js_free(s, ptr);
+        return NULL;
+    }
+
+    // The block stays charged to the sandbox that allocated it
+    MemoryAccount *account = shared_block_account(ptr);
+    size_t old_size = shared_block_size(ptr);
+    size_t old_usable = old_size - SANDBOX_MALLOC_OVERHEAD - SHARED_BLOCK_HEADER;
+    if (s->malloc_size + size - old_usable > s->malloc_limit ||
+        (account && account->size + size - old_usable > account->limit) ||
+        size > SIZE_MAX - SHARED_BLOCK_HEADER) {
+        return NULL;
+    }
+
+    void *base = realloc(shared_block_base(ptr), SHARED_BLOCK_HEADER + size);
+    if (!base) {
+        return NULL;
+    }
+    ptr = (char *)base + SHARED_BLOCK_HEADER;
+
+    size_t new_size = shared_block_size(ptr);
+    s->malloc_size += new_size - old_size;
+    if (account) {
+        account->size += new_size - old_size;
+    }
+    shared_track_heap(s, account, new_size > old_size ? new_size - old_size : 0);
+    return ptr;
+}
+
+static size_t shared_js_malloc_usable_size(const void *ptr) {
+    return sandbox_malloc_usable_size(shared_block_base(ptr)) - SHARED_BLOCK_HEADER;
+}
+
+static const JSMallocFunctions shared_malloc_funcs = {
+    shared_js_malloc,
+    shared_js_free,
+    shared_js_realloc,
+    shared_js_malloc_usable_size,
+};
+
+// Bytes the runtime holds from the system on behalf of the sandbox: what
+// it has allocated, all of the arena (which keeps freed blocks for reuse),
+// or what is charged to the sandbox in a shared runtime
+static size_t heap_bytes(const ContextWrapper *wrapper) {
+    if (wrapper->account) {
+        return wrapper->account->size;
+    }
+    return wrapper->arena ? arena_reserved_bytes(wrapper->arena) : wrapper->heap_size;
+}
+
+// Tell the Ruby GC how much the heap grew or shrank since the last report,
+// so its malloc pressure accounts for JavaScript memory. The allocator
+// runs without the GVL, so this is called at points that hold it (end of
+// eval, GC pass, reset, free).
+static void heap_report(ContextWrapper *wrapper) {
+    size_t size = heap_bytes(wrapper);
+    if (size != wrapper->reported_heap_size) {
+        rb_gc_adjust_memory_usage((ssize_t)size - (ssize_t)wrapper->reported_heap_size);
+        wrapper->reported_heap_size = size;
+    }
+}
+
+// Deepest stack recorded by the profiler; outer frames beyond it are cut
+#define PROFILE_MAX_DEPTH 128
+
+// Maximum number of distinct stacks recorded per eval
+#define PROFILE_MAX_STACKS 16384
+
+static size_t profile_stack_hash(const JSStackFrameInfo *frames, int len) {
+    size_t h = (size_t)len;
+    for (int i = 0; i < len; i++) {
+        h = h * 31 + frames[i].func_name;
+        h = h * 31 + frames[i].filename;
+        h = h * 31 + (size_t)frames[i].line_num;
+    }
+    return h;
+}
+
+static void profile_free_frames(JSRuntime *rt, JSStackFrameInfo *frames, int len) {
+    for (int i = 0; i < len; i++) {
+        JS_FreeAtomRT(rt, frames[i].func_name);
+        JS_FreeAtomRT(rt, frames[i].filename);
+    }
+}
+
+static void profile_clear(ContextWrapper *wrapper) {
+    ProfileTable *table = &wrapper->profile;
+    for (size_t i = 0; i < table->capacity; i++) {
+        ProfileStack *stack = table->slots[i];
+        if (stack) {
+            profile_free_frames(wrapper->rt, stack->frames, stack->len);
+            free(stack);
+        }
+    }
+    free(table->slots);
+    memset(table, 0, sizeof(*table));
+}
+
+// Slot of the stack with these frames, or of the empty slot where it goes
+static ProfileStack **profile_lookup(ProfileTable *table, const JSStackFrameInfo *frames, int len) {
+    size_t mask = table->capacity - 1;
+    for (size_t i = profile_stack_hash(frames, len) & mask;; i = (i + 1) & mask) {
+        ProfileStack *stack = table->slots[i];
+        if (!stack || (stack->len == len && memcmp(stack->frames, frames, len * sizeof(*frames)) == 0)) {
+            return &table->slots[i];
+        }
+    }
+}
+
+static int profile_grow(ProfileTable *table) {
+    size_t capacity = table->capacity ? table->capacity * 2 : 256;
+    ProfileStack **slots = calloc(capacity, sizeof(*slots));
+    if (!slots) {
+        return -1;
+    }
+    ProfileTable grown = { slots, capacity, table->count, table->dropped };
+    for (size_t i = 0; i < table->capacity; i++) {
+        ProfileStack *stack = table->slots[i];
+        if (stack) {
+            *profile_lookup(&grown, stack->frames, stack->len) = stack;
+        }
+    }
+    free(table->slots);
+    *table = grown;
+    return 0;
+}
+
+// Count one sample of the current call stack. Called from the interrupt
+// handler: it must not run JavaScript or touch Ruby.
+static void profile_sample(ContextWrapper *wrapper) {
+    ProfileTable *table = &wrapper->profile;
+    JSStackFrameInfo frames[PROFILE_MAX_DEPTH];
+    int len = JS_GetStackFrames(wrapper->ctx, frames, PROFILE_MAX_DEPTH);
+    if (len == 0) {
+        return;
+    }
+
+    if (table->count * 2 >= table->capacity && profile_grow(table) != 0) {
+        table->dropped++;
+        profile_free_frames(wrapper->rt, frames, len);
+        return;
+    }
+    ProfileStack **slot = profile_lookup(table, frames, len);
+    if (*slot) {
+        (*slot)->count++;
+        profile_free_frames(wrapper->rt, frames, len);
+        return;
+    }
+
+    ProfileStack *stack = table->count < PROFILE_MAX_STACKS
+        ? malloc(sizeof(ProfileStack) + len * sizeof(*frames))
+        : NULL;
+    if (!stack) {
+        table->dropped++;
+        profile_free_frames(wrapper->rt, frames, len);
+        return;
+    }
+    stack->count = 1;
+    stack->len = len;
+    memcpy(stack->frames, frames, len * sizeof(*frames));  // Takes over the atoms
+    *slot = stack;
+    table->count++;
+}
+
+// Frame in collapsed-stack notation: "name (file:line)". Semicolons
+// separate frames, so they are replaced in names.
+static void profile_append_frame(JSContext *ctx, VALUE out, const JSStackFrameInfo *frame) {
+    const char *name = frame->func_name != JS_ATOM_NULL ? JS_AtomToCString(ctx, frame->func_name) : NULL;
+    size_t start = RSTRING_LEN(out);
+    rb_str_cat_cstr(out, name ? name : "<anonymous>");
+    JS_FreeCString(ctx, name);
+    if (frame->filename != JS_ATOM_NULL) {
+        const char *filename = JS_AtomToCString(ctx, frame->filename);
+        rb_str_catf(out, " (%s:%d)", filename ? filename : "<null>", frame->line_num);
+        JS_FreeCString(ctx, filename);
+    } else {
+        rb_str_cat_cstr(out, " (native)");
+    }
+    char *p = RSTRING_PTR(out);
+    for (long i = start; i < RSTRING_LEN(out); i++) {
+        if (p[i] == ';') {
+            p[i] = ',';
+        }
+    }
+}
+
+// The samples of the eval in collapsed-stack format, one "outer;...;inner
+// count" line per stack (input for flamegraph.pl and compatible tools).
+// Empties the table.
+static VALUE profile_collapse(ContextWrapper *wrapper) {
+    ProfileTable *table = &wrapper->profile;
+    VALUE lines = rb_ary_new_capa(table->count + 1);
+    for (size_t i = 0; i < table->capacity; i++) {
+        ProfileStack *stack = table->slots[i];
+        if (!stack) {
+            continue;
+        }
+        VALUE line = rb_utf8_str_new(NULL, 0);
+        for (int j = stack->len - 1; j >= 0; j--) {
+            profile_append_frame(wrapper->ctx, line, &stack->frames[j]);
+            if (j > 0) {
+                rb_str_cat(line, ";", 1);
+            }
+        }
+        rb_str_catf(line, " %llu", (unsigned long long)stack->count);
+        rb_ary_push(lines, line);
+    }
+    if (table->dropped > 0) {
+        rb_ary_push(lines, rb_sprintf("(dropped) %llu", (unsigned long long)table->dropped));
+    }
+    profile_clear(wrapper);
+
+    rb_ary_sort_bang(lines);
+    VALUE profile = rb_ary_join(lines, rb_str_new_cstr("\n"));
+    if (RARRAY_LEN(lines) > 0) {
+        rb_str_cat(profile, "\n", 1);
+    }
+    return rb_obj_freeze(profile);
+}
+
 // Interrupt handler for timeout
 static int interrupt_handler(JSRuntime *rt, void *opaque) {
     ContextWrapper *wrapper = (ContextWrapper *)opaque;
+    wrapper->interrupt_checks++;
+
+    if (wrapper->profile_interval_ms > 0) {
+        double now = get_time_ms_precise();
+        if (now >= wrapper->profile_next_sample_ms) {
+            wrapper->profile_next_sample_ms = now + wrapper->profile_interval_ms;
+            profile_sample(wrapper);
+        }
+    }
+
+    // Ruby asked this thread to stop (Thread#kill, Thread#raise, Timeout, signal),
+    // or reset is discarding work that belongs to the old context
+    if (wrapper->interrupted || wrapper->discarding) {
+        return 1;
+    }
 
     if (wrapper->timeout_ms > 0) {
         int64_t elapsed = get_time_ms() - wrapper->start_time_ms;
@@ -67,6 +773,103 @@ static int interrupt_handler(JSRuntime *rt, void *opaque) {
     return 0;  // Continue execution
 }
 
+// Interrupt handler of shared runtimes: the limits are those of the
+// sandbox running
+static int shared_interrupt_handler(JSRuntime *rt, void *opaque) {
+    ContextWrapper *wrapper = ((SharedRuntime *)opaque)->current;
+    return wrapper ? interrupt_handler(rt, wrapper) : 0;
+}
+
+// Levels of the console methods, passed to console_sink as symbols
+typedef enum {
+    CONSOLE_LOG,
+    CONSOLE_INFO,
+    CONSOLE_WARN,
+    CONSOLE_ERROR,
+    CONSOLE_DEBUG,
+    CONSOLE_LEVEL_COUNT
+} ConsoleLevel;
+
+static const char *const console_level_names[CONSOLE_LEVEL_COUNT] = {
+    "log", "info", "warn", "error", "debug"
+};
+
+// Header of each line in console_batch, followed by its text
+typedef struct {
+    ConsoleLevel level;
+    size_t len;
+} ConsoleBatchLine;
+
+// Append to the console batch. Returns -1 (dropping the text) when out of memory.
+static int console_batch_append(ContextWrapper *wrapper, const void *data, size_t len) {
+    if (wrapper->console_batch_len + len > wrapper->console_batch_capacity) {
+        size_t new_capacity = wrapper->console_batch_capacity ? wrapper->console_batch_capacity * 2 : 1024;
+        if (new_capacity < wrapper->console_batch_len + len) {
+            new_capacity = wrapper->console_batch_len + len;
+        }
+        char *new_batch = realloc(wrapper->console_batch, new_capacity);
+        if (!new_batch) {
+            return -1;
+        }
+        wrapper->console_batch = new_batch;
+        wrapper->console_batch_capacity = new_capacity;
+    }
+    memcpy(wrapper->console_batch + wrapper->console_batch_len, data, len);
+    wrapper->console_batch_len += len;
+    return 0;
+}
+
+// Pass the batched lines to console_sink as one Array of [level, line]
+// pairs. The batch is emptied first, so lines are never delivered twice.
+static VALUE console_flush_body(VALUE ptr) {
+    ContextWrapper *wrapper = (ContextWrapper *)ptr;
+    VALUE lines = rb_ary_new();
+    size_t offset = 0;
+    while (offset < wrapper->console_batch_len) {
+        ConsoleBatchLine line;
+        memcpy(&line, wrapper->console_batch + offset, sizeof(line));
+        offset += sizeof(line);
+        VALUE text = rb_utf8_str_new(wrapper->console_batch + offset, line.len);
+        rb_ary_push(lines, rb_assoc_new(ID2SYM(rb_intern(console_level_names[line.level])), text));
+        offset += line.len;
+    }
+    wrapper->console_batch_len = 0;
+
+    rb_funcall(wrapper->console_sink, id_call, 1, lines);
+    return Qnil;
+}
+
+// Flush with the GVL held. A sink that raises stops the eval, like a
+// Ruby interrupt, and its exception is re-raised once JavaScript has unwound.
+static void *console_flush_with_gvl(void *ptr) {
+    ContextWrapper *wrapper = (ContextWrapper *)ptr;
+
+    int state = 0;
+    rb_protect(console_flush_body, (VALUE)wrapper, &state);
+    if (!state) {
+        return NULL;
+    }
+    VALUE exception = rb_errinfo();
+    rb_set_errinfo(Qnil);
+    if (NIL_P(exception)) {
+        // throw/break out of the block
+        exception = rb_exc_new_cstr(rb_eQuickJSError, "console sink exited without returning");
+    }
+    wrapper->console_batch_len = 0;
+    wrapper->pending_ruby_exception = exception;
+    wrapper->interrupted = 1;
+    return wrapper;
+}
+
+// Deliver the batched console lines to console_sink.
+// Returns -1 if the sink raised.
+static int console_flush(ContextWrapper *wrapper) {
+    if (wrapper->console_batch_len == 0) {
+        return 0;
+    }
+    return with_gvl(wrapper, console_flush_with_gvl, wrapper) ? -1 : 0;
+}
+
 // Append to console output buffer
 static void append_console_output(ContextWrapper *wrapper, const char *str, size_t len) {
     if (!wrapper || !str || len == 0) return;
@@ -110,11 +913,53 @@ static void append_console_output(ContextWrapper *wrapper, const char *str, size
     wrapper->console_output[wrapper->console_output_len] = '\0';
 }
 
-// console.log() implementation
-static JSValue js_console_log(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+// Add a console line to the batch for console_sink, flushing the batch
+// once it reaches console_flush_size bytes
+static JSValue console_batch_line(ContextWrapper *wrapper, JSContext *ctx, ConsoleLevel level,
+                                  int argc, JSValueConst *argv) {
+    if (wrapper->discarding) {
+        return JS_UNDEFINED;
+    }
+
+    size_t start = wrapper->console_batch_len;
+    ConsoleBatchLine line = { level, 0 };
+    int failed = console_batch_append(wrapper, &line, sizeof(line));
+    for (int i = 0; i < argc && !failed; i++) {
+        size_t len;
+        const char *str = JS_ToCStringLen(ctx, &len, argv[i]);
+        if (!str) {
+            // toString() threw
+            wrapper->console_batch_len = start;
+            return JS_EXCEPTION;
+        }
+        failed = (i > 0 && console_batch_append(wrapper, " ", 1)) ||
+                 console_batch_append(wrapper, str, len);
+        JS_FreeCString(ctx, str);
+    }
+    if (failed) {
+        wrapper->console_batch_len = start;
+        return JS_ThrowOutOfMemory(ctx);
+    }
+    line.len = wrapper->console_batch_len - start - sizeof(line);
+    memcpy(wrapper->console_batch + start, &line, sizeof(line));
+
+    if (wrapper->console_batch_len >= wrapper->console_flush_size && console_flush(wrapper) != 0) {
+        return JS_ThrowInternalError(ctx, "console sink raised %s",
+                                     rb_obj_classname(wrapper->pending_ruby_exception));
+    }
+    return JS_UNDEFINED;
+}
+
+// console.log() implementation, shared by the other console methods. The
+// magic is the ConsoleLevel.
+static JSValue js_console_log(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
     ContextWrapper *wrapper = current_wrapper;
     if (!wrapper) return JS_UNDEFINED;
 
+    if (!NIL_P(wrapper->console_sink)) {
+        return console_batch_line(wrapper, ctx, magic, argc, argv);
+    }
+
     for (int i = 0; i < argc; i++) {
         if (i > 0) {
             append_console_output(wrapper, " ", 1);
@@ -138,35 +983,536 @@ struct http_callback_args {
     VALUE url;
     VALUE body;
     VALUE headers;
+    long request_id;  // Set by http_start_wrapper
+    // Response fields, extracted and type-checked inside rb_protect
+    int status;
+    VALUE status_text;
+    VALUE response_body;
+    VALUE response_headers;
+    VALUE response_header_keys;
 };
 
-// Protected callback function
+// Extract and validate the fields of a response hash. Must run inside
+// rb_protect so that type errors in the hash are caught instead of
+// longjmp-ing across QuickJS frames.
+static void http_response_extract(struct http_callback_args *args, VALUE rb_response) {
+    // Extract response fields from Ruby hash
+    VALUE rb_status = rb_hash_aref(rb_response, ID2SYM(rb_intern("status")));
+    VALUE rb_status_text = rb_hash_aref(rb_response, ID2SYM(rb_intern("statusText")));
+    VALUE rb_response_body = rb_hash_aref(rb_response, ID2SYM(rb_intern("body")));
+    VALUE rb_response_headers = rb_hash_aref(rb_response, ID2SYM(rb_intern("headers")));
+
+    args->status = NIL_P(rb_status) ? 200 : NUM2INT(rb_status);
+    args->status_text = NIL_P(rb_status_text) ? rb_str_new2("OK") : rb_status_text;
+    args->response_body = NIL_P(rb_response_body) ? rb_str_new2("") : rb_response_body;
+    StringValueCStr(args->status_text);
+    StringValue(args->response_body);  // Bytes: may be binary or contain NULs
+
+    if (!NIL_P(rb_response_headers) && TYPE(rb_response_headers) == T_HASH) {
+        VALUE rb_keys = rb_funcall(rb_response_headers, rb_intern("keys"), 0);
+        long keys_len = RARRAY_LEN(rb_keys);
+        for (long i = 0; i < keys_len; i++) {
+            VALUE rb_key = rb_ary_entry(rb_keys, i);
+            VALUE rb_val = rb_hash_aref(rb_response_headers, rb_key);
+            StringValueCStr(rb_key);
+            StringValueCStr(rb_val);
+        }
+        args->response_headers = rb_response_headers;
+        args->response_header_keys = rb_keys;
+    }
+}
+
+// Protected callback function: runs a request synchronously
 static VALUE http_callback_wrapper(VALUE arg) {
     struct http_callback_args *args = (struct http_callback_args *)arg;
-    return rb_funcall(args->callback, rb_intern("call"), 4,
-                      args->method, args->url, args->body, args->headers);
+    VALUE rb_response = rb_funcall(args->callback, id_call, 4,
+                                   args->method, args->url, args->body, args->headers);
+    http_response_extract(args, rb_response);
+    return rb_response;
 }
 
-// fetch() implementation
-static JSValue js_fetch(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
-    ContextWrapper *wrapper = current_wrapper;
-    if (!wrapper) {
-        return JS_ThrowTypeError(ctx, "fetch() called outside sandbox context");
-    }
+// Protected function: starts a request on the HTTP executor (see
+// HTTPExecutor#start) and stores its id
+static VALUE http_start_wrapper(VALUE arg) {
+    struct http_callback_args *args = (struct http_callback_args *)arg;
+    VALUE options = rb_hash_new();
+    rb_hash_aset(options, ID2SYM(rb_intern("body")), args->body);
+    rb_hash_aset(options, ID2SYM(rb_intern("headers")), args->headers);
 
-    if (wrapper->rb_http_callback == Qnil) {
-        return JS_ThrowTypeError(ctx, "fetch() is not enabled - HTTP callback not configured");
-    }
+    VALUE rb_id = rb_funcall(args->callback, rb_intern("start"), 3, args->method, args->url, options);
+    args->request_id = NUM2LONG(rb_id);
+    return rb_id;
+}
 
-    // Parse arguments
-    if (argc < 1) {
-        return JS_ThrowTypeError(ctx, "fetch() requires at least 1 argument (url)");
-    }
+static VALUE http_response_extract_wrapper(VALUE arg) {
+    VALUE *argv = (VALUE *)arg;
+    http_response_extract((struct http_callback_args *)argv[0], argv[1]);
+    return Qnil;
+}
+
+// Response object returned by the native fetch(), from an extracted response
+static JSValue http_response_to_js(JSContext *ctx, struct http_callback_args *args) {
+    int status = args->status;
+    const char *status_text = RSTRING_PTR(args->status_text);
+
+    // Create Response object
+    JSValue response_obj = JS_NewObject(ctx);
+    if (JS_IsException(response_obj)) {
+        return response_obj;
+    }
+
+    // Add properties
+    JS_SetPropertyStr(ctx, response_obj, "status", JS_NewInt32(ctx, status));
+    JS_SetPropertyStr(ctx, response_obj, "statusText", JS_NewString(ctx, status_text));
+    JS_SetPropertyStr(ctx, response_obj, "ok", JS_NewBool(ctx, status >= 200 && status < 300));
+    // The body is passed as bytes: the Response polyfill decodes it only
+    // when the script asks for text
+    JS_SetPropertyStr(ctx, response_obj, "body",
+                      JS_NewArrayBufferCopy(ctx, (const uint8_t *)RSTRING_PTR(args->response_body),
+                                            RSTRING_LEN(args->response_body)));
+
+    // Add headers object - convert Ruby hash to JS object
+    JSValue headers_obj = JS_NewObject(ctx);
+    if (!NIL_P(args->response_header_keys)) {
+        long keys_len = RARRAY_LEN(args->response_header_keys);
+        for (long i = 0; i < keys_len; i++) {
+            VALUE rb_key = rb_ary_entry(args->response_header_keys, i);
+            VALUE rb_val = rb_hash_aref(args->response_headers, rb_key);
+            JS_SetPropertyStr(ctx, headers_obj, RSTRING_PTR(rb_key), JS_NewString(ctx, RSTRING_PTR(rb_val)));
+        }
+    }
+    JS_SetPropertyStr(ctx, response_obj, "headers", headers_obj);
+
+    return response_obj;
+}
+
+// Keep a Ruby exception raised by HTTP code to re-raise after JS execution
+// completes, and throw the JavaScript error fetch() fails with. We cannot
+// call rb_exc_raise here because it would longjmp out of QuickJS's call
+// stack, leaving objects in an inconsistent state.
+static JSValue http_throw_failed(JSContext *ctx, ContextWrapper *wrapper, VALUE exception) {
+    wrapper->pending_ruby_exception = exception;
+    return JS_ThrowInternalError(ctx, "HTTP request failed");
+}
+
+// A fetch() Promise waiting for its request to complete (see fetch_dispatch)
+typedef struct {
+    JSValue resolve;
+    JSValue reject;
+} PendingFetch;
+
+static void pending_fetch_free(JSContext *ctx, PendingFetch *pending) {
+    JS_FreeValue(ctx, pending->resolve);
+    JS_FreeValue(ctx, pending->reject);
+    free(pending);
+}
+
+static JSValue fetch_promise_new(JSContext *ctx, ContextWrapper *wrapper, long request_id) {
+    JSValue funcs[2];
+    JSValue promise = JS_NewPromiseCapability(ctx, funcs);
+    if (JS_IsException(promise)) {
+        return promise;
+    }
+
+    PendingFetch *pending = malloc(sizeof(PendingFetch));
+    if (!pending) {
+        JS_FreeValue(ctx, funcs[0]);
+        JS_FreeValue(ctx, funcs[1]);
+        JS_FreeValue(ctx, promise);
+        return JS_ThrowOutOfMemory(ctx);
+    }
+    pending->resolve = funcs[0];
+    pending->reject = funcs[1];
+    st_insert(wrapper->pending_fetches, (st_data_t)request_id, (st_data_t)pending);
+    return promise;
+}
+
+static VALUE fetch_take_completed(VALUE executor) {
+    return rb_funcall(executor, rb_intern("take_completed"), 0);
+}
+
+// Settle the Promises of the requests that completed since the last call.
+// Called with the GVL held (see eval_settle).
+static void *fetch_dispatch_with_gvl(void *ptr) {
+    ContextWrapper *wrapper = (ContextWrapper *)ptr;
+    JSContext *ctx = wrapper->ctx;
+
+    int state = 0;
+    VALUE completed = rb_protect(fetch_take_completed, wrapper->rb_http_executor, &state);
+    if (state) {
+        // Ruby interrupted the thread (Thread#raise, Timeout): stop the eval
+        // and re-raise the interrupt once JavaScript has unwound
+        VALUE exception = rb_errinfo();
+        rb_set_errinfo(Qnil);
+        if (rb_obj_is_kind_of(exception, rb_eException)) {
+            wrapper->pending_ruby_exception = exception;
+        }
+        wrapper->interrupted = 1;
+        return NULL;
+    }
+    if (!RB_TYPE_P(completed, T_ARRAY)) {
+        return NULL;
+    }
+
+    for (long i = 0; i < RARRAY_LEN(completed); i++) {
+        VALUE item = RARRAY_AREF(completed, i);
+        if (!RB_TYPE_P(item, T_ARRAY) || RARRAY_LEN(item) != 2 || !FIXNUM_P(RARRAY_AREF(item, 0))) {
+            continue;
+        }
+        st_data_t key = (st_data_t)FIX2LONG(RARRAY_AREF(item, 0));
+        st_data_t value;
+        if (!st_delete(wrapper->pending_fetches, &key, &value)) {
+            continue;
+        }
+        PendingFetch *pending = (PendingFetch *)value;
+        VALUE outcome = RARRAY_AREF(item, 1);
+
+        JSValue arg = JS_UNDEFINED;
+        if (!rb_obj_is_kind_of(outcome, rb_eException)) {
+            struct http_callback_args args = {
+                .status = 200,
+                .status_text = Qnil,
+                .response_body = Qnil,
+                .response_headers = Qnil,
+                .response_header_keys = Qnil
+            };
+            VALUE extract_argv[2] = { (VALUE)&args, outcome };
+            rb_protect(http_response_extract_wrapper, (VALUE)extract_argv, &state);
+            if (state) {
+                outcome = rb_errinfo();
+                rb_set_errinfo(Qnil);
+            } else {
+                arg = http_response_to_js(ctx, &args);
+            }
+        }
+        if (rb_obj_is_kind_of(outcome, rb_eException)) {
+            http_throw_failed(ctx, wrapper, outcome);
+            arg = JS_EXCEPTION;
+        }
+
+        JSValue settle = pending->resolve;
+        if (JS_IsException(arg)) {
+            arg = JS_GetException(ctx);
+            settle = pending->reject;
+        }
+        JS_FreeValue(ctx, JS_Call(ctx, settle, JS_UNDEFINED, 1, (JSValueConst *)&arg));
+        JS_FreeValue(ctx, arg);
+        pending_fetch_free(ctx, pending);
+    }
+    RB_GC_GUARD(completed);
+    return NULL;
+}
+
+// Convert a wait of `ms` milliseconds from now to a pthread_cond_timedwait deadline
+static struct timespec wait_deadline(int64_t ms) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+// Wait, without the GVL, until a request started by fetch() completes or
+// the clock reaches wake_ms (the next timer's deadline, -1 for none).
+// Returns 0 for a completed request and 1 once wake_ms is reached, or -1
+// if the eval times out or Ruby interrupts the thread first (eval_unblock
+// signals fetch_cond).
+static int event_wait(ContextWrapper *wrapper, int64_t wake_ms) {
+    int ret = -1;
+
+    pthread_mutex_lock(&wrapper->fetch_mutex);
+    while (!wrapper->interrupted) {
+        if (wrapper->fetch_completions != wrapper->fetch_completions_seen) {
+            wrapper->fetch_completions_seen = wrapper->fetch_completions;
+            ret = 0;
+            break;
+        }
+
+        int64_t now = get_time_ms();
+        int64_t until = wake_ms;
+        if (wrapper->timeout_ms > 0) {
+            int64_t timeout_at = wrapper->start_time_ms + wrapper->timeout_ms;
+            if (now >= timeout_at) {
+                wrapper->timed_out = 1;
+                break;
+            }
+            if (until < 0 || timeout_at < until) {
+                until = timeout_at;
+            }
+        }
+        if (wake_ms >= 0 && now >= wake_ms) {
+            ret = 1;
+            break;
+        }
+
+        if (until >= 0) {
+            struct timespec deadline = wait_deadline(until - now);
+            pthread_cond_timedwait(&wrapper->fetch_cond, &wrapper->fetch_mutex, &deadline);
+        } else {
+            pthread_cond_wait(&wrapper->fetch_cond, &wrapper->fetch_mutex);
+        }
+    }
+    pthread_mutex_unlock(&wrapper->fetch_mutex);
+
+    return ret;
+}
+
+// Timers: setTimeout and setInterval callbacks run by eval_settle once
+// their deadline passes, one at a time with the Promise jobs they queue
+// drained in between. Timers left when an eval ends (it timed out, was
+// interrupted or failed) are dropped.
+
+static inline int timer_before(const Timer *a, const Timer *b) {
+    return a->deadline_ms < b->deadline_ms ||
+           (a->deadline_ms == b->deadline_ms && a->seq < b->seq);
+}
+
+static void timer_sift_up(ContextWrapper *wrapper, size_t i) {
+    Timer **heap = wrapper->timers;
+    Timer *timer = heap[i];
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!timer_before(timer, heap[parent])) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = timer;
+}
+
+static void timer_sift_down(ContextWrapper *wrapper, size_t i) {
+    Timer **heap = wrapper->timers;
+    Timer *timer = heap[i];
+    for (;;) {
+        size_t child = 2 * i + 1;
+        if (child >= wrapper->timer_count) {
+            break;
+        }
+        if (child + 1 < wrapper->timer_count && timer_before(heap[child + 1], heap[child])) {
+            child++;
+        }
+        if (!timer_before(heap[child], timer)) {
+            break;
+        }
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = timer;
+}
+
+static int timer_push(JSContext *ctx, ContextWrapper *wrapper, Timer *timer) {
+    if (wrapper->timer_count == wrapper->timer_capacity) {
+        size_t capacity = wrapper->timer_capacity ? wrapper->timer_capacity * 2 : 8;
+        Timer **timers = js_realloc(ctx, wrapper->timers, capacity * sizeof(*timers));
+        if (!timers) {
+            return -1;
+        }
+        wrapper->timers = timers;
+        wrapper->timer_capacity = capacity;
+    }
+    timer->seq = wrapper->timer_seq++;
+    wrapper->timers[wrapper->timer_count++] = timer;
+    timer_sift_up(wrapper, wrapper->timer_count - 1);
+    return 0;
+}
+
+static void timer_remove_at(ContextWrapper *wrapper, size_t i) {
+    Timer *last = wrapper->timers[--wrapper->timer_count];
+    if (i == wrapper->timer_count) {
+        return;
+    }
+    wrapper->timers[i] = last;
+    if (i > 0 && timer_before(last, wrapper->timers[(i - 1) / 2])) {
+        timer_sift_up(wrapper, i);
+    } else {
+        timer_sift_down(wrapper, i);
+    }
+}
+
+static void timer_free(JSContext *ctx, Timer *timer) {
+    JS_FreeValue(ctx, timer->func);
+    for (int i = 0; i < timer->argc; i++) {
+        JS_FreeValue(ctx, timer->argv[i]);
+    }
+    js_free(ctx, timer);
+}
+
+static void timers_clear(ContextWrapper *wrapper) {
+    for (size_t i = 0; i < wrapper->timer_count; i++) {
+        timer_free(wrapper->ctx, wrapper->timers[i]);
+    }
+    js_free(wrapper->ctx, wrapper->timers);
+    wrapper->timers = NULL;
+    wrapper->timer_count = 0;
+    wrapper->timer_capacity = 0;
+}
+
+// setTimeout(callback, delay, ...args) and setInterval (magic 1). Returns
+// the timer id.
+static JSValue js_set_timer(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
+    ContextWrapper *wrapper = current_wrapper;
+    if (!wrapper || wrapper->discarding) {
+        return JS_ThrowInternalError(ctx, "Timers cannot be set outside an eval");
+    }
+    if (argc < 1 || !JS_IsFunction(ctx, argv[0])) {
+        return JS_ThrowTypeError(ctx, "callback is not a function");
+    }
+
+    // Like browsers, a missing, negative or NaN delay is 0 and longer ones cap at INT32_MAX
+    double delay = 0;
+    if (argc > 1 && JS_ToFloat64(ctx, &delay, argv[1]) < 0) {
+        return JS_EXCEPTION;
+    }
+    int32_t delay_ms = delay >= 1 ? (delay < INT32_MAX ? (int32_t)delay : INT32_MAX) : 0;
+
+    int timer_argc = argc > 2 ? argc - 2 : 0;
+    Timer *timer = js_malloc(ctx, sizeof(Timer) + timer_argc * sizeof(JSValue));
+    if (!timer) {
+        return JS_EXCEPTION;
+    }
+    timer->deadline_ms = get_time_ms() + delay_ms;
+    timer->id = wrapper->last_timer_id = wrapper->last_timer_id == INT32_MAX ? 1 : wrapper->last_timer_id + 1;
+    // An interval repeats at least every millisecond
+    timer->interval_ms = magic ? (delay_ms > 0 ? delay_ms : 1) : 0;
+    timer->func = JS_DupValue(ctx, argv[0]);
+    timer->argc = timer_argc;
+    for (int i = 0; i < timer_argc; i++) {
+        timer->argv[i] = JS_DupValue(ctx, argv[i + 2]);
+    }
+
+    if (timer_push(ctx, wrapper, timer) < 0) {
+        timer_free(ctx, timer);
+        return JS_EXCEPTION;
+    }
+    return JS_NewInt32(ctx, timer->id);
+}
+
+// clearTimeout(id) and clearInterval(id), which clear either kind of timer
+static JSValue js_clear_timer(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    ContextWrapper *wrapper = current_wrapper;
+    int32_t id;
+    if (!wrapper || argc < 1 || !JS_IsNumber(argv[0]) || JS_ToInt32(ctx, &id, argv[0]) < 0) {
+        return JS_UNDEFINED;
+    }
+
+    if (wrapper->firing_timer && wrapper->firing_timer->id == id) {
+        wrapper->firing_timer_cleared = 1;
+        return JS_UNDEFINED;
+    }
+    for (size_t i = 0; i < wrapper->timer_count; i++) {
+        Timer *timer = wrapper->timers[i];
+        if (timer->id == id) {
+            timer_remove_at(wrapper, i);
+            timer_free(ctx, timer);
+            break;
+        }
+    }
+    return JS_UNDEFINED;
+}
+
+// Run the callback of the earliest timer (which is due), rescheduling it
+// if it is an interval. Returns -1 if the callback threw.
+static int timer_fire(ContextWrapper *wrapper) {
+    JSContext *ctx = wrapper->ctx;
+    Timer *timer = wrapper->timers[0];
+    timer_remove_at(wrapper, 0);
+
+    wrapper->firing_timer = timer;
+    wrapper->firing_timer_cleared = 0;
+    JSValue ret = JS_Call(ctx, timer->func, JS_UNDEFINED, timer->argc, timer->argv);
+    wrapper->firing_timer = NULL;
+
+    int failed = JS_IsException(ret);
+    JS_FreeValue(ctx, ret);
+    if (timer->interval_ms > 0 && !wrapper->firing_timer_cleared && !failed) {
+        timer->deadline_ms = get_time_ms() + timer->interval_ms;
+        if (timer_push(ctx, wrapper, timer) == 0) {
+            return 0;
+        }
+        failed = 1;
+    }
+    timer_free(ctx, timer);
+    return failed ? -1 : 0;
+}
+
+static JSValue js_queue_microtask_job(JSContext *ctx, int argc, JSValueConst *argv) {
+    return JS_Call(ctx, argv[0], JS_UNDEFINED, 0, NULL);
+}
+
+static JSValue js_queue_microtask(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    if (argc < 1 || !JS_IsFunction(ctx, argv[0])) {
+        return JS_ThrowTypeError(ctx, "callback is not a function");
+    }
+    if (JS_EnqueueJob(ctx, js_queue_microtask_job, 1, argv) < 0) {
+        return JS_EXCEPTION;
+    }
+    return JS_UNDEFINED;
+}
+
+static int pending_fetch_free_entry(st_data_t key, st_data_t value, st_data_t arg) {
+    pending_fetch_free((JSContext *)arg, (PendingFetch *)value);
+    return ST_DELETE;
+}
+
+static VALUE fetch_cancel(VALUE executor) {
+    return rb_funcall(executor, rb_intern("cancel"), 0);
+}
+
+// Drop the Promises of requests still in flight when an eval ends early
+// (timeout, interrupt) and stop the requests. Called with the GVL held.
+static void fetch_abandon(ContextWrapper *wrapper) {
+    st_foreach(wrapper->pending_fetches, pending_fetch_free_entry, (st_data_t)wrapper->ctx);
+
+    if (!NIL_P(wrapper->rb_http_executor)) {
+        int state = 0;
+        rb_protect(fetch_cancel, wrapper->rb_http_executor, &state);
+        if (state) {
+            // Typically a pending Thread#raise delivered while cancelling:
+            // hand it to eval_finish, which raises it as an interrupt
+            VALUE exception = rb_errinfo();
+            if (!rb_obj_is_kind_of(exception, rb_eException)) {
+                rb_jump_tag(state);  // Thread#kill
+            }
+            rb_set_errinfo(Qnil);
+            if (NIL_P(wrapper->pending_ruby_exception)) {
+                wrapper->pending_ruby_exception = exception;
+            }
+            wrapper->interrupted = 1;
+        }
+    }
+}
+
+struct js_fetch_args {
+    JSContext *ctx;
+    int argc;
+    JSValueConst *argv;
+    JSValue ret;
+};
+
+// fetch() implementation, called with the GVL held (see js_fetch)
+static void *js_fetch_with_gvl(void *ptr) {
+    struct js_fetch_args *fetch_args = (struct js_fetch_args *)ptr;
+    JSContext *ctx = fetch_args->ctx;
+    int argc = fetch_args->argc;
+    JSValueConst *argv = fetch_args->argv;
+    ContextWrapper *wrapper = current_wrapper;
+
+    // Parse arguments
+    if (argc < 1) {
+        fetch_args->ret = JS_ThrowTypeError(ctx, "fetch() requires at least 1 argument (url)");
+        return NULL;
+    }
 
     // Get URL
     const char *url = JS_ToCString(ctx, argv[0]);
     if (!url) {
-        return JS_ThrowTypeError(ctx, "fetch() url must be a string");
+        fetch_args->ret = JS_ThrowTypeError(ctx, "fetch() url must be a string");
+        return NULL;
     }
 
     // Parse options (second argument)
@@ -223,16 +1569,26 @@ static JSValue js_fetch(JSContext *ctx, JSValueConst this_val, int argc, JSValue
     VALUE rb_method = method_str ? rb_str_new2(method_str) : rb_str_new2("GET");
     VALUE rb_body = body_str ? rb_str_new2(body_str) : Qnil;
 
+    // With an executor, requests run concurrently and fetch() returns a
+    // Promise; a bare callback runs each request synchronously
+    int concurrent = !NIL_P(wrapper->rb_http_executor);
     struct http_callback_args args = {
-        .callback = wrapper->rb_http_callback,
+        .callback = concurrent ? wrapper->rb_http_executor : wrapper->rb_http_callback,
         .method = rb_method,
         .url = rb_url,
         .body = rb_body,
-        .headers = rb_headers
+        .headers = rb_headers,
+        .status = 200,
+        .status_text = Qnil,
+        .response_body = Qnil,
+        .response_headers = Qnil,
+        .response_header_keys = Qnil
     };
 
     int state = 0;
-    VALUE rb_response = rb_protect(http_callback_wrapper, (VALUE)&args, &state);
+    VALUE rb_response = rb_protect(concurrent ? http_start_wrapper : http_callback_wrapper,
+                                   (VALUE)&args, &state);
+    RB_GC_GUARD(rb_response);
 
     // Free C strings
     JS_FreeCString(ctx, url);
@@ -244,189 +1600,587 @@ static JSValue js_fetch(JSContext *ctx, JSValueConst this_val, int argc, JSValue
         VALUE exception = rb_errinfo();
         rb_set_errinfo(Qnil);  // Clear the error
 
-        // Store the exception to re-raise after JS execution completes
-        // We cannot call rb_exc_raise here because it would longjmp
-        // out of QuickJS's call stack, leaving objects in an inconsistent state
-        wrapper->pending_ruby_exception = exception;
-
         // Return a JavaScript exception so QuickJS can clean up properly
-        return JS_ThrowInternalError(ctx, "HTTP request failed");
+        fetch_args->ret = http_throw_failed(ctx, wrapper, exception);
+        return NULL;
     }
 
-    // Extract response fields from Ruby hash
-    VALUE rb_status = rb_hash_aref(rb_response, ID2SYM(rb_intern("status")));
-    VALUE rb_status_text = rb_hash_aref(rb_response, ID2SYM(rb_intern("statusText")));
-    VALUE rb_response_body = rb_hash_aref(rb_response, ID2SYM(rb_intern("body")));
-    VALUE rb_response_headers = rb_hash_aref(rb_response, ID2SYM(rb_intern("headers")));
-
-    int status = NIL_P(rb_status) ? 200 : NUM2INT(rb_status);
-    const char *status_text = NIL_P(rb_status_text) ? "OK" : StringValueCStr(rb_status_text);
-    const char *response_body = NIL_P(rb_response_body) ? "" : StringValueCStr(rb_response_body);
+    if (concurrent) {
+        // Settled by fetch_dispatch from the eval's job loop
+        fetch_args->ret = fetch_promise_new(ctx, wrapper, args.request_id);
+    } else {
+        fetch_args->ret = http_response_to_js(ctx, &args);
+    }
+    return NULL;
+}
 
-    // Create Response object
-    JSValue response_obj = JS_NewObject(ctx);
+// fetch() implementation
+static JSValue js_fetch(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    ContextWrapper *wrapper = current_wrapper;
+    if (!wrapper) {
+        return JS_ThrowTypeError(ctx, "fetch() called outside sandbox context");
+    }
 
-    // Add properties
-    JS_SetPropertyStr(ctx, response_obj, "status", JS_NewInt32(ctx, status));
-    JS_SetPropertyStr(ctx, response_obj, "statusText", JS_NewString(ctx, status_text));
-    JS_SetPropertyStr(ctx, response_obj, "ok", JS_NewBool(ctx, status >= 200 && status < 300));
-    JS_SetPropertyStr(ctx, response_obj, "body", JS_NewString(ctx, response_body));
+    if (NIL_P(wrapper->rb_http_callback) && NIL_P(wrapper->rb_http_executor)) {
+        return JS_ThrowTypeError(ctx, "fetch() is not enabled - HTTP callback not configured");
+    }
 
-    // Add headers object - convert Ruby hash to JS object
-    JSValue headers_obj = JS_NewObject(ctx);
-    if (!NIL_P(rb_response_headers) && TYPE(rb_response_headers) == T_HASH) {
-        VALUE rb_keys = rb_funcall(rb_response_headers, rb_intern("keys"), 0);
-        long keys_len = RARRAY_LEN(rb_keys);
-        for (long i = 0; i < keys_len; i++) {
-            VALUE rb_key = rb_ary_entry(rb_keys, i);
-            VALUE rb_val = rb_hash_aref(rb_response_headers, rb_key);
-            const char *key_str = StringValueCStr(rb_key);
-            const char *val_str = StringValueCStr(rb_val);
-            JS_SetPropertyStr(ctx, headers_obj, key_str, JS_NewString(ctx, val_str));
-        }
+    if (wrapper->discarding) {
+        return JS_ThrowInternalError(ctx, "fetch() called while the sandbox is being reset");
     }
-    JS_SetPropertyStr(ctx, response_obj, "headers", headers_obj);
 
-    return response_obj;
+    // The HTTP callback is Ruby code: re-acquire the GVL for the whole call
+    struct js_fetch_args fetch_args = { ctx, argc, argv, JS_UNDEFINED };
+    with_gvl(wrapper, js_fetch_with_gvl, &fetch_args);
+    return fetch_args.ret;
 }
 
 // Forward declaration
 static VALUE js_to_ruby(JSContext *ctx, JSValue val);
 static JSValue ruby_to_js(JSContext *ctx, VALUE rb_val);
 
-// Convert JavaScript value to Ruby value
-static VALUE js_to_ruby(JSContext *ctx, JSValue val) {
-    // Null
-    if (JS_IsNull(val)) {
-        return Qnil;
-    }
+// Class IDs of ArrayBuffer and Uint8Array, used to convert binary data.
+// QuickJS does not export its built-in class enum, so they are read from
+// instances when the first context is created.
+static JSClassID js_array_buffer_class_id;
+static JSClassID js_uint8_array_class_id;
 
-    // Undefined
-    if (JS_IsUndefined(val)) {
-        return Qnil;
-    }
+// The constructor reads (buffer, byteOffset, length) regardless of argc
+static JSValue new_uint8_array(JSContext *ctx, JSValue buffer, size_t len) {
+    JSValue args[3] = { buffer, JS_NewInt32(ctx, 0), JS_NewInt64(ctx, (int64_t)len) };
+    return JS_NewTypedArray(ctx, 3, args, JS_TYPED_ARRAY_UINT8);
+}
 
-    // Boolean
-    if (JS_IsBool(val)) {
-        return JS_ToBool(ctx, val) ? Qtrue : Qfalse;
+static void lookup_binary_class_ids(JSContext *ctx) {
+    if (js_uint8_array_class_id) {
+        return;
+    }
+    JSValue buffer = JS_NewArrayBufferCopy(ctx, NULL, 0);
+    JSValue array = new_uint8_array(ctx, buffer, 0);
+    if (!JS_IsException(buffer) && !JS_IsException(array)) {
+        js_array_buffer_class_id = JS_GetClassID(buffer);
+        js_uint8_array_class_id = JS_GetClassID(array);
     }
+    JS_FreeValue(ctx, JS_GetException(ctx));
+    JS_FreeValue(ctx, array);
+    JS_FreeValue(ctx, buffer);
+}
 
-    // Number
-    if (JS_IsNumber(val)) {
-        double d;
-        if (JS_ToFloat64(ctx, &d, val) == 0) {
-            // Check if it's an integer
-            if (d == (int64_t)d && d >= FIXNUM_MIN && d <= FIXNUM_MAX) {
-                return LONG2FIX((long)d);
-            }
-            return DBL2NUM(d);
+static VALUE binary_str_new(const uint8_t *buf, size_t len) {
+    VALUE rb_str = rb_str_new((const char *)buf, len);
+    rb_enc_associate_index(rb_str, rb_ascii8bit_encindex());
+    return rb_str;
+}
+
+// Copy the bytes of an ArrayBuffer or Uint8Array into a binary String.
+// Returns Qundef if val is neither.
+static VALUE js_binary_to_ruby(JSContext *ctx, JSValue val) {
+    JSClassID class_id = JS_GetClassID(val);
+    size_t size;
+
+    if (class_id == js_array_buffer_class_id) {
+        uint8_t *buf = JS_GetArrayBuffer(ctx, &size, val);
+        if (!buf) {
+            // Detached
+            JS_FreeValue(ctx, JS_GetException(ctx));
+            return binary_str_new(NULL, 0);
         }
+        return binary_str_new(buf, size);
     }
 
-    // String
-    if (JS_IsString(val)) {
-        const char *str = JS_ToCString(ctx, val);
-        if (str) {
-            VALUE rb_str = rb_str_new2(str);
-            rb_enc_associate(rb_str, rb_utf8_encoding());
-            JS_FreeCString(ctx, str);
-            return rb_str;
+    if (class_id == js_uint8_array_class_id) {
+        size_t offset, length;
+        JSValue buffer = JS_GetTypedArrayBuffer(ctx, val, &offset, &length, NULL);
+        if (JS_IsException(buffer)) {
+            JS_FreeValue(ctx, JS_GetException(ctx));
+            return binary_str_new(NULL, 0);
         }
+        uint8_t *buf = JS_GetArrayBuffer(ctx, &size, buffer);
+        VALUE rb_str;
+        if (!buf || offset > size || length > size - offset) {
+            JS_FreeValue(ctx, JS_GetException(ctx));
+            rb_str = binary_str_new(NULL, 0);
+        } else {
+            rb_str = binary_str_new(buf + offset, length);
+        }
+        JS_FreeValue(ctx, buffer);
+        return rb_str;
     }
 
-    // Array
-    if (JS_IsArray(ctx, val)) {
-        VALUE rb_array = rb_ary_new();
-        JSValue len_val = JS_GetPropertyStr(ctx, val, "length");
-        uint32_t len = 0;
-        JS_ToUint32(ctx, &len, len_val);
-        JS_FreeValue(ctx, len_val);
+    return Qundef;
+}
 
-        for (uint32_t i = 0; i < len; i++) {
-            JSValue elem = JS_GetPropertyUint32(ctx, val, i);
-            VALUE rb_elem = js_to_ruby(ctx, elem);
-            rb_ary_push(rb_array, rb_elem);
-            JS_FreeValue(ctx, elem);
-        }
-        return rb_array;
+// Bytes of an ArrayBuffer, typed array or DataView. The pointer is valid
+// as long as val is. Returns NULL with a pending TypeError for other values.
+static const uint8_t *js_binary_bytes(JSContext *ctx, JSValueConst val, size_t *plen) {
+    if (JS_GetClassID(val) == js_array_buffer_class_id) {
+        return JS_GetArrayBuffer(ctx, plen, val);
     }
 
-    // Object
-    if (JS_IsObject(val)) {
-        VALUE rb_hash = rb_hash_new();
-        JSPropertyEnum *props;
-        uint32_t prop_count;
-
-        if (JS_GetOwnPropertyNames(ctx, &props, &prop_count, val,
-                                   JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY) == 0) {
-            for (uint32_t i = 0; i < prop_count; i++) {
-                JSAtom atom = props[i].atom;
-                const char *key = JS_AtomToCString(ctx, atom);
-
-                if (key) {
-                    JSValue prop_val = JS_GetProperty(ctx, val, atom);
-                    VALUE rb_val = js_to_ruby(ctx, prop_val);
-                    VALUE rb_key = rb_str_new2(key);
-                    rb_enc_associate(rb_key, rb_utf8_encoding());
-                    rb_hash_aset(rb_hash, rb_key, rb_val);
-                    JS_FreeValue(ctx, prop_val);
-                    JS_FreeCString(ctx, key);
-                }
-                JS_FreeAtom(ctx, atom);
-            }
-            js_free(ctx, props);
-        }
-        return rb_hash;
+    size_t offset, length, size;
+    JSValue buffer = JS_GetTypedArrayBuffer(ctx, val, &offset, &length, NULL);
+    if (JS_IsException(buffer)) {
+        JS_FreeValue(ctx, JS_GetException(ctx));
+        JS_ThrowTypeError(ctx, "expected an ArrayBuffer or a view of one");
+        return NULL;
     }
-
-    return Qnil;
+    uint8_t *buf = JS_GetArrayBuffer(ctx, &size, buffer);
+    JS_FreeValue(ctx, buffer);
+    if (!buf) {
+        return NULL;
+    }
+    if (offset > size || length > size - offset) {
+        JS_ThrowRangeError(ctx, "view is out of bounds");
+        return NULL;
+    }
+    *plen = length;
+    return buf + offset;
 }
 
-// Helper struct for hash iteration
-struct hash_iter_data {
-    JSContext *ctx;
-    JSValue obj;
-    int has_error;
-};
-
-// Callback for hash iteration
-static int hash_foreach_cb(VALUE key, VALUE val, VALUE arg) {
-    struct hash_iter_data *data = (struct hash_iter_data *)arg;
+// fetch.decodeUTF8(bytes): String decoded from UTF-8 bytes, invalid
+// sequences becoming U+FFFD. Backs TextDecoder (polyfills/text_encoding.js).
+static JSValue js_decode_utf8(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    size_t len = 0;
+    const uint8_t *buf = js_binary_bytes(ctx, argc > 0 ? argv[0] : JS_UNDEFINED, &len);
+    if (!buf) {
+        return JS_EXCEPTION;
+    }
+    return JS_NewStringLen(ctx, (const char *)buf, len);
+}
 
-    if (data->has_error) {
-        return ST_STOP;
+// fetch.encodeUTF8(string): ArrayBuffer of the UTF-8 encoding of a string.
+// Backs TextEncoder (polyfills/text_encoding.js).
+static JSValue js_encode_utf8(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    size_t len;
+    const char *str = JS_ToCStringLen(ctx, &len, argc > 0 ? argv[0] : JS_UNDEFINED);
+    if (!str) {
+        return JS_EXCEPTION;
     }
+    JSValue buffer = JS_NewArrayBufferCopy(ctx, (const uint8_t *)str, len);
+    JS_FreeCString(ctx, str);
+    return buffer;
+}
 
-    // Convert key to string (symbols and strings are common)
-    const char *key_str;
-    VALUE key_str_val;
+// A JavaScript object kept alive for Ruby (QuickJS::Handle). Handles are
+// linked into their sandbox so reset and free can invalidate them.
+typedef struct SandboxHandle {
+    VALUE sandbox;
+    ContextWrapper *wrapper;  // NULL once the handle has been invalidated
+    JSValue val;
+    struct SandboxHandle *prev;
+    struct SandboxHandle *next;
+} SandboxHandle;
+
+static void handle_unlink(SandboxHandle *handle) {
+    if (handle->prev) {
+        handle->prev->next = handle->next;
+    } else {
+        handle->wrapper->handles = handle->next;
+    }
+    if (handle->next) {
+        handle->next->prev = handle->prev;
+    }
+    handle->prev = handle->next = NULL;
+}
+
+static void handle_mark(void *ptr) {
+    SandboxHandle *handle = (SandboxHandle *)ptr;
+    rb_gc_mark(handle->sandbox);
+}
+
+// Ruby may collect a handle while another thread runs JavaScript in its
+// sandbox, so the value is only released at the sandbox's next eval_begin
+static void handle_free(void *ptr) {
+    SandboxHandle *handle = (SandboxHandle *)ptr;
+    ContextWrapper *wrapper = handle->wrapper;
+    if (wrapper) {
+        handle_unlink(handle);
+        if (wrapper->released_len == wrapper->released_capa) {
+            size_t capa = wrapper->released_capa ? wrapper->released_capa * 2 : 16;
+            JSValue *values = realloc(wrapper->released_values, capa * sizeof(JSValue));
+            if (values) {
+                wrapper->released_values = values;
+                wrapper->released_capa = capa;
+            }
+        }
+        // On allocation failure the value leaks until the runtime is freed
+        if (wrapper->released_len < wrapper->released_capa) {
+            wrapper->released_values[wrapper->released_len++] = handle->val;
+        }
+    }
+    free(handle);
+}
+
+static size_t handle_memsize(const void *ptr) {
+    return sizeof(SandboxHandle);
+}
+
+static const rb_data_type_t handle_type = {
+    "QuickJS::Handle",
+    {handle_mark, handle_free, handle_memsize,},
+    NULL, NULL,
+    RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+// Free the values of handles Ruby has collected. Requires an idle sandbox.
+static void handles_release(ContextWrapper *wrapper) {
+    for (size_t i = 0; i < wrapper->released_len; i++) {
+        JS_FreeValue(wrapper->ctx, wrapper->released_values[i]);
+    }
+    wrapper->released_len = 0;
+}
+
+// Drop the values of all live handles before their context goes away;
+// using an invalidated handle raises QuickJS::Error
+static void handles_invalidate(ContextWrapper *wrapper) {
+    SandboxHandle *handle = wrapper->handles;
+    while (handle) {
+        SandboxHandle *next = handle->next;
+        if (wrapper->ctx) {
+            JS_FreeValue(wrapper->ctx, handle->val);
+        }
+        handle->val = JS_UNDEFINED;
+        handle->wrapper = NULL;
+        handle->prev = handle->next = NULL;
+        handle = next;
+    }
+    wrapper->handles = NULL;
+    if (wrapper->ctx) {
+        handles_release(wrapper);
+    }
+    wrapper->released_len = 0;
+}
+
+// State shared by one js_to_ruby conversion
+typedef struct {
+    JSContext *ctx;
+    st_table *keys;  // Atom -> frozen key String, so repeated record shapes share keys
+    VALUE key_list;  // Keeps the cached keys reachable during the conversion
+} JSToRubyState;
+
+static VALUE js_to_ruby_value(JSToRubyState *state, JSValue val);
+
+static VALUE js_string_to_ruby(JSContext *ctx, JSValueConst val) {
+    size_t len;
+    const char *str = JS_ToCStringLen(ctx, &len, val);
+    if (!str) {
+        return Qnil;
+    }
+    VALUE rb_str = rb_utf8_str_new(str, len);
+    JS_FreeCString(ctx, str);
+    return rb_str;
+}
+
+// Ruby Hash key for a property atom. Keys are frozen (and interned where
+// supported) so Hash#[]= does not copy them. Returns Qnil if the atom
+// cannot be converted.
+static VALUE js_key_to_ruby(JSToRubyState *state, JSAtom atom) {
+    if (!state->keys) {
+        state->keys = st_init_numtable();
+        state->key_list = rb_ary_new();
+    }
+
+    st_data_t cached;
+    if (st_lookup(state->keys, (st_data_t)atom, &cached)) {
+        return (VALUE)cached;
+    }
+
+    size_t len;
+    const char *key = JS_AtomToCStringLen(state->ctx, &len, atom);
+    if (!key) {
+        return Qnil;
+    }
+#ifdef HAVE_RB_ENC_INTERNED_STR
+    VALUE rb_key = rb_enc_interned_str(key, len, rb_utf8_encoding());
+#else
+    VALUE rb_key = rb_obj_freeze(rb_utf8_str_new(key, len));
+#endif
+    JS_FreeCString(state->ctx, key);
+
+    // Hold the atom so its ID is not reused for another name mid-conversion
+    st_insert(state->keys, (st_data_t)JS_DupAtom(state->ctx, atom), (st_data_t)rb_key);
+    rb_ary_push(state->key_list, rb_key);
+    return rb_key;
+}
+
+static int js_key_free_entry(st_data_t key, st_data_t value, st_data_t arg) {
+    JS_FreeAtom((JSContext *)arg, (JSAtom)key);
+    return ST_DELETE;
+}
+
+static VALUE js_array_to_ruby(JSToRubyState *state, JSValue val) {
+    JSContext *ctx = state->ctx;
+    JSValue *values;
+    uint32_t count;
+    uint32_t len = 0;
+
+    if (JS_GetFastArray(ctx, val, &values, &count)) {
+        len = count;
+    } else {
+        JSValue len_val = JS_GetPropertyStr(ctx, val, "length");
+        JS_ToUint32(ctx, &len, len_val);
+        JS_FreeValue(ctx, len_val);
+    }
+
+    VALUE rb_array = rb_ary_new_capa(len);
+    for (uint32_t i = 0; i < len; i++) {
+        // Read the dense backing store directly, re-fetching it for every
+        // element: converting an element can run getters that modify the array
+        JSValue elem;
+        if (JS_GetFastArray(ctx, val, &values, &count) && i < count) {
+            elem = JS_DupValue(ctx, values[i]);
+        } else {
+            elem = JS_GetPropertyUint32(ctx, val, i);
+        }
+        rb_ary_push(rb_array, js_to_ruby_value(state, elem));
+        JS_FreeValue(ctx, elem);
+    }
+    return rb_array;
+}
+
+static VALUE js_object_to_ruby(JSToRubyState *state, JSValue val) {
+    JSContext *ctx = state->ctx;
+    JSPropertyEnum *props;
+    uint32_t prop_count;
+
+    if (JS_GetOwnPropertyNames(ctx, &props, &prop_count, val,
+                               JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY) != 0) {
+        return rb_hash_new();
+    }
+
+#ifdef HAVE_RB_HASH_NEW_CAPA
+    VALUE rb_hash = rb_hash_new_capa(prop_count);
+#else
+    VALUE rb_hash = rb_hash_new();
+#endif
+    for (uint32_t i = 0; i < prop_count; i++) {
+        JSAtom atom = props[i].atom;
+        VALUE rb_key = js_key_to_ruby(state, atom);
+
+        if (!NIL_P(rb_key)) {
+            JSValue prop_val = JS_GetProperty(ctx, val, atom);
+            rb_hash_aset(rb_hash, rb_key, js_to_ruby_value(state, prop_val));
+            JS_FreeValue(ctx, prop_val);
+        }
+        JS_FreeAtom(ctx, atom);
+    }
+    js_free(ctx, props);
+    return rb_hash;
+}
+
+static VALUE js_to_ruby_value(JSToRubyState *state, JSValue val) {
+    JSContext *ctx = state->ctx;
+
+    // Null
+    if (JS_IsNull(val)) {
+        return Qnil;
+    }
+
+    // Undefined
+    if (JS_IsUndefined(val)) {
+        return Qnil;
+    }
+
+    // Boolean
+    if (JS_IsBool(val)) {
+        return JS_ToBool(ctx, val) ? Qtrue : Qfalse;
+    }
+
+    // Number
+    if (JS_IsNumber(val)) {
+        double d;
+        if (JS_ToFloat64(ctx, &d, val) == 0) {
+            // Check if it's an integer
+            if (d == (int64_t)d && d >= FIXNUM_MIN && d <= FIXNUM_MAX) {
+                return LONG2FIX((long)d);
+            }
+            return DBL2NUM(d);
+        }
+    }
+
+    // String
+    if (JS_IsString(val)) {
+        return js_string_to_ruby(ctx, val);
+    }
+
+    // ArrayBuffer / Uint8Array -> binary String
+    if (JS_IsObject(val)) {
+        VALUE rb_binary = js_binary_to_ruby(ctx, val);
+        if (rb_binary != Qundef) {
+            return rb_binary;
+        }
+    }
+
+    // Array
+    if (JS_IsArray(ctx, val)) {
+        return js_array_to_ruby(state, val);
+    }
+
+    // Object
+    if (JS_IsObject(val)) {
+        return js_object_to_ruby(state, val);
+    }
+
+    return Qnil;
+}
+
+// Convert JavaScript value to Ruby value
+static VALUE js_to_ruby(JSContext *ctx, JSValue val) {
+    JSToRubyState state = { ctx, NULL, Qnil };
+    VALUE result = js_to_ruby_value(&state, val);
+
+    if (state.keys) {
+        st_foreach(state.keys, js_key_free_entry, (st_data_t)ctx);
+        st_free_table(state.keys);
+    }
+    RB_GC_GUARD(state.key_list);
+    return result;
+}
+
+// Wrap an object in a QuickJS::Handle. Takes ownership of `val`.
+static VALUE new_handle(VALUE sandbox, ContextWrapper *wrapper, JSValue val) {
+    SandboxHandle *handle;
+    VALUE obj = TypedData_Make_Struct(rb_cHandle, SandboxHandle, &handle_type, handle);
+    handle->sandbox = sandbox;
+    handle->wrapper = wrapper;
+    handle->val = val;
+    handle->prev = NULL;
+    handle->next = wrapper->handles;
+    if (wrapper->handles) {
+        wrapper->handles->prev = handle;
+    }
+    wrapper->handles = handle;
+    return obj;
+}
+
+// Like js_to_ruby, but objects and arrays become Handles converted on
+// access. Takes ownership of `val`.
+static VALUE js_to_ruby_lazy(VALUE sandbox, ContextWrapper *wrapper, JSValue val) {
+    if (JS_IsObject(val)) {
+        VALUE rb_binary = js_binary_to_ruby(wrapper->ctx, val);
+        if (rb_binary == Qundef) {
+            return new_handle(sandbox, wrapper, val);
+        }
+        JS_FreeValue(wrapper->ctx, val);
+        return rb_binary;
+    }
+
+    VALUE rb_val = js_to_ruby(wrapper->ctx, val);
+    JS_FreeValue(wrapper->ctx, val);
+    return rb_val;
+}
 
-    if (TYPE(key) == T_SYMBOL) {
-        key_str = rb_id2name(SYM2ID(key));
-    } else if (TYPE(key) == T_STRING) {
-        key_str = StringValueCStr(key);
+// State shared by one ruby_to_js conversion
+typedef struct {
+    JSContext *ctx;
+    st_table *atoms;  // Symbol or frozen String key -> atom, for repeated record shapes
+    int raised;  // rb_protect state of a Ruby exception, re-raised by ruby_to_js
+} RubyToJSState;
+
+static JSValue ruby_to_js_value(RubyToJSState *state, VALUE rb_val);
+
+static VALUE ruby_to_s_body(VALUE val) {
+    VALUE str = rb_funcall(val, rb_intern("to_s"), 0);
+    StringValue(str);
+    return str;
+}
+
+static VALUE ruby_to_s_cstr_body(VALUE val) {
+    VALUE str = ruby_to_s_body(val);
+    StringValueCStr(str);
+    return str;
+}
+
+// Call #to_s (or another Ruby method) without unwinding through the
+// conversion, which would leak the values built so far: returns Qnil and
+// records the exception, for ruby_to_js to raise once they are freed.
+static VALUE ruby_to_js_protect(RubyToJSState *state, VALUE (*func)(VALUE), VALUE val) {
+    VALUE str = rb_protect(func, val, &state->raised);
+    return state->raised ? Qnil : str;
+}
+
+// Property atom for a Ruby Hash key. Returns JS_ATOM_NULL on failure; the
+// caller owns the returned atom.
+static JSAtom ruby_key_to_atom(RubyToJSState *state, VALUE key) {
+    JSContext *ctx = state->ctx;
+    int cacheable = SYMBOL_P(key) || (RB_TYPE_P(key, T_STRING) && OBJ_FROZEN(key));
+
+    st_data_t cached;
+    if (cacheable && state->atoms && st_lookup(state->atoms, (st_data_t)key, &cached)) {
+        return JS_DupAtom(ctx, (JSAtom)cached);
+    }
+
+    // Convert key to string (symbols and strings are common)
+    VALUE key_str;
+    if (SYMBOL_P(key)) {
+        key_str = rb_sym2str(key);
+    } else if (RB_TYPE_P(key, T_STRING)) {
+        key_str = key;
     } else {
         // Convert other types to string
-        key_str_val = rb_funcall(key, rb_intern("to_s"), 0);
-        key_str = StringValueCStr(key_str_val);
+        key_str = ruby_to_js_protect(state, ruby_to_s_body, key);
+        if (NIL_P(key_str)) {
+            return JS_ATOM_NULL;
+        }
     }
+    JSAtom atom = JS_NewAtomLen(ctx, RSTRING_PTR(key_str), RSTRING_LEN(key_str));
+    RB_GC_GUARD(key_str);
 
-    // Convert value
-    JSValue js_val = ruby_to_js(data->ctx, val);
+    if (cacheable && atom != JS_ATOM_NULL) {
+        if (!state->atoms) {
+            state->atoms = st_init_numtable();
+        }
+        st_insert(state->atoms, (st_data_t)key, (st_data_t)JS_DupAtom(ctx, atom));
+    }
+    return atom;
+}
+
+static int ruby_key_free_entry(st_data_t key, st_data_t value, st_data_t arg) {
+    JS_FreeAtom((JSContext *)arg, (JSAtom)value);
+    return ST_DELETE;
+}
+
+// Helper struct for hash iteration
+struct hash_iter_data {
+    RubyToJSState *state;
+    JSValue obj;
+    int has_error;
+};
+
+// Callback for hash iteration
+static int hash_foreach_cb(VALUE key, VALUE val, VALUE arg) {
+    struct hash_iter_data *data = (struct hash_iter_data *)arg;
+    JSContext *ctx = data->state->ctx;
+
+    JSAtom atom = ruby_key_to_atom(data->state, key);
+    if (atom == JS_ATOM_NULL) {
+        data->has_error = 1;
+        return ST_STOP;
+    }
 
+    // Convert value
+    JSValue js_val = ruby_to_js_value(data->state, val);
     if (JS_IsException(js_val)) {
+        JS_FreeAtom(ctx, atom);
         data->has_error = 1;
         return ST_STOP;
     }
 
-    // Set property
-    JS_SetPropertyStr(data->ctx, data->obj, key_str, js_val);
+    // Define (rather than set) the property, so keys such as "__proto__"
+    // become plain data properties
+    int ret = JS_DefinePropertyValue(ctx, data->obj, atom, js_val, JS_PROP_C_W_E);
+    JS_FreeAtom(ctx, atom);
+    if (ret < 0) {
+        data->has_error = 1;
+        return ST_STOP;
+    }
 
     return ST_CONTINUE;
 }
 
-// Convert Ruby value to JavaScript value
-static JSValue ruby_to_js(JSContext *ctx, VALUE rb_val) {
+static JSValue ruby_to_js_value(RubyToJSState *state, VALUE rb_val) {
+    JSContext *ctx = state->ctx;
+
     // nil -> null
     if (NIL_P(rb_val)) {
         return JS_NULL;
@@ -461,10 +2215,21 @@ static JSValue ruby_to_js(JSContext *ctx, VALUE rb_val) {
         return JS_NewFloat64(ctx, val);
     }
 
+    // Binary String -> Uint8Array (copied: JavaScript may write to it)
+    if (type == T_STRING && ENCODING_GET(rb_val) == rb_ascii8bit_encindex()) {
+        JSValue buffer = JS_NewArrayBufferCopy(ctx, (const uint8_t *)RSTRING_PTR(rb_val),
+                                               RSTRING_LEN(rb_val));
+        if (JS_IsException(buffer)) {
+            return buffer;
+        }
+        JSValue array = new_uint8_array(ctx, buffer, RSTRING_LEN(rb_val));
+        JS_FreeValue(ctx, buffer);
+        return array;
+    }
+
     // String -> string
     if (type == T_STRING) {
-        const char *str = StringValueCStr(rb_val);
-        return JS_NewString(ctx, str);
+        return JS_NewStringLen(ctx, RSTRING_PTR(rb_val), RSTRING_LEN(rb_val));
     }
 
     // Symbol -> string
@@ -478,13 +2243,13 @@ static JSValue ruby_to_js(JSContext *ctx, VALUE rb_val) {
         long len = RARRAY_LEN(rb_val);
         JSValue arr = JS_NewArray(ctx);
 
-        for (long i = 0; i < len; i++) {
-            VALUE elem = rb_ary_entry(rb_val, i);
-            JSValue js_elem = ruby_to_js(ctx, elem);
+        for (long i = 0; i < len && i < RARRAY_LEN(rb_val); i++) {
+            JSValue js_elem = ruby_to_js_value(state, RARRAY_AREF(rb_val, i));
             if (JS_IsException(js_elem)) {
                 JS_FreeValue(ctx, arr);
                 return js_elem;
             }
+            // Appending in order keeps the array in QuickJS's fast (dense) form
             JS_SetPropertyUint32(ctx, arr, i, js_elem);
         }
 
@@ -496,7 +2261,7 @@ static JSValue ruby_to_js(JSContext *ctx, VALUE rb_val) {
         JSValue obj = JS_NewObject(ctx);
 
         struct hash_iter_data data = {
-            .ctx = ctx,
+            .state = state,
             .obj = obj,
             .has_error = 0
         };
@@ -511,151 +2276,916 @@ static JSValue ruby_to_js(JSContext *ctx, VALUE rb_val) {
         return obj;
     }
 
-    // Fallback: convert to string
-    VALUE str_val = rb_funcall(rb_val, rb_intern("to_s"), 0);
-    const char *str = StringValueCStr(str_val);
-    return JS_NewString(ctx, str);
-}
-
-// Ruby C API helper functions
-static void sandbox_free(void *ptr) {
-    ContextWrapper *wrapper = (ContextWrapper *)ptr;
-    if (wrapper) {
-        if (wrapper->ctx) {
-            // Free context first
-            JS_FreeContext(wrapper->ctx);
-            wrapper->ctx = NULL;
-        }
-        if (wrapper->rt) {
-            JS_FreeRuntime(wrapper->rt);
-            wrapper->rt = NULL;
-        }
-        if (wrapper->console_output) {
-            free(wrapper->console_output);
-            wrapper->console_output = NULL;
+    // Handle into this sandbox -> the object it refers to
+    if (rb_typeddata_is_kind_of(rb_val, &handle_type)) {
+        SandboxHandle *handle = (SandboxHandle *)RTYPEDDATA_DATA(rb_val);
+        if (handle->wrapper && handle->wrapper->ctx == ctx) {
+            return JS_DupValue(ctx, handle->val);
         }
-        free(wrapper);
     }
-}
 
-static size_t sandbox_memsize(const void *ptr) {
-    const ContextWrapper *wrapper = (const ContextWrapper *)ptr;
-    return sizeof(ContextWrapper) + (wrapper ? wrapper->mem_limit : 0);
+    // Fallback: convert to string
+    VALUE str_val = ruby_to_js_protect(state, ruby_to_s_cstr_body, rb_val);
+    if (NIL_P(str_val)) {
+        return JS_EXCEPTION;
+    }
+    return JS_NewString(ctx, RSTRING_PTR(str_val));
 }
 
-static const rb_data_type_t sandbox_type = {
-    "QuickJS::NativeSandbox",
-    {NULL, sandbox_free, sandbox_memsize,},
-    NULL, NULL,
-    RUBY_TYPED_FREE_IMMEDIATELY,
-};
+// Convert Ruby value to JavaScript value
+static JSValue ruby_to_js(JSContext *ctx, VALUE rb_val) {
+    RubyToJSState state = { ctx, NULL, 0 };
+    JSValue result = ruby_to_js_value(&state, rb_val);
 
-// Allocate function for Ruby object
-static VALUE sandbox_alloc(VALUE klass) {
-    ContextWrapper *wrapper = malloc(sizeof(ContextWrapper));
-    memset(wrapper, 0, sizeof(ContextWrapper));
-    return TypedData_Wrap_Struct(klass, &sandbox_type, wrapper);
+    if (state.atoms) {
+        st_foreach(state.atoms, ruby_key_free_entry, (st_data_t)ctx);
+        st_free_table(state.atoms);
+    }
+    if (state.raised) {
+        // The partly converted value is freed: raise the #to_s exception
+        JS_FreeValue(ctx, result);
+        rb_jump_tag(state.raised);
+    }
+    return result;
 }
 
-// Initialize sandbox
-static VALUE sandbox_initialize(VALUE self, VALUE options) {
-    ContextWrapper *wrapper;
-    TypedData_Get_Struct(self, ContextWrapper, &sandbox_type, wrapper);
+// Host functions (Sandbox#define_function): JavaScript functions that call
+// a Ruby callable. The function data is the callable's index in
+// wrapper->host_functions, so the functions can be recreated after reset.
 
-    // Get options
-    VALUE rb_mem_limit = rb_hash_aref(options, ID2SYM(rb_intern("memory_limit")));
-    VALUE rb_timeout = rb_hash_aref(options, ID2SYM(rb_intern("timeout_ms")));
-    VALUE rb_console_max = rb_hash_aref(options, ID2SYM(rb_intern("console_log_max_size")));
+// Calls with up to this many arguments pass them without allocating
+#define HOST_FUNCTION_INLINE_ARGS 8
 
-    wrapper->mem_limit = NIL_P(rb_mem_limit) ? 1000000 : NUM2SIZET(rb_mem_limit);
-    wrapper->timeout_ms = NIL_P(rb_timeout) ? 5000 : NUM2LL(rb_timeout);
-    wrapper->console_max_size = NIL_P(rb_console_max) ? 10000 : NUM2SIZET(rb_console_max);
-    wrapper->rb_http_callback = Qnil;
-    wrapper->pending_ruby_exception = Qnil;
+struct host_call_args {
+    ContextWrapper *wrapper;
+    JSContext *ctx;
+    int32_t index;
+    int argc;
+    JSValueConst *argv;
+    JSValue ret;
+};
 
-    // Initialize console output buffer
-    wrapper->console_output_capacity = 1024;
-    wrapper->console_output = malloc(wrapper->console_output_capacity);
-    wrapper->console_output[0] = '\0';
-    wrapper->console_output_len = 0;
-    wrapper->console_truncated = 0;
+static VALUE host_function_body(VALUE ptr) {
+    struct host_call_args *args = (struct host_call_args *)ptr;
+    VALUE callable = RARRAY_AREF(args->wrapper->host_functions, args->index);
 
-    // Create runtime
-    wrapper->rt = JS_NewRuntime();
-    if (!wrapper->rt) {
-        rb_raise(rb_eRuntimeError, "Failed to create JavaScript runtime");
+    VALUE inline_argv[HOST_FUNCTION_INLINE_ARGS];
+    VALUE argv_buf = 0;
+    VALUE *call_argv = inline_argv;
+    if (args->argc > HOST_FUNCTION_INLINE_ARGS) {
+        call_argv = ALLOCV_N(VALUE, argv_buf, args->argc);
     }
-
-    JS_SetInterruptHandler(wrapper->rt, interrupt_handler, wrapper);
-
-    // Create context
-    wrapper->ctx = JS_NewContext(wrapper->rt);
-    if (!wrapper->ctx) {
-        JS_FreeRuntime(wrapper->rt);
-        wrapper->rt = NULL;
-        rb_raise(rb_eRuntimeError, "Failed to create JavaScript context");
+    for (int i = 0; i < args->argc; i++) {
+        call_argv[i] = js_to_ruby(args->ctx, args->argv[i]);
     }
 
-    // Set up console object
-    JSValue global = JS_GetGlobalObject(wrapper->ctx);
-    JSValue console = JS_NewObject(wrapper->ctx);
-    JS_SetPropertyStr(wrapper->ctx, console, "log",
-                     JS_NewCFunction(wrapper->ctx, js_console_log, "log", 1));
-    JS_SetPropertyStr(wrapper->ctx, console, "error",
-                     JS_NewCFunction(wrapper->ctx, js_console_log, "error", 1));
-    JS_SetPropertyStr(wrapper->ctx, console, "warn",
-                     JS_NewCFunction(wrapper->ctx, js_console_log, "warn", 1));
-    JS_SetPropertyStr(wrapper->ctx, global, "console", console);
+    VALUE result;
+    if (rb_obj_is_proc(callable)) {
+        result = rb_proc_call_with_block(callable, args->argc, call_argv, Qnil);
+    } else {
+        result = rb_funcallv(callable, id_call, args->argc, call_argv);
+    }
+    ALLOCV_END(argv_buf);
 
-    // Always add fetch() function to global scope (will error if HTTP not enabled)
-    JS_SetPropertyStr(wrapper->ctx, global, "fetch",
-                     JS_NewCFunction(wrapper->ctx, js_fetch, "fetch", 2));
+    args->ret = ruby_to_js(args->ctx, result);
+    return Qnil;
+}
 
-    JS_FreeValue(wrapper->ctx, global);
+// Host function call, with the GVL held (see js_host_function)
+static void *host_function_with_gvl(void *ptr) {
+    struct host_call_args *args = (struct host_call_args *)ptr;
 
-    // Set memory limit AFTER context is created and initialized
-    // This ensures QuickJS has enough memory to initialize its internal structures
-    JS_SetMemoryLimit(wrapper->rt, wrapper->mem_limit);
+    int state = 0;
+    rb_protect(host_function_body, (VALUE)args, &state);
+    if (state) {
+        VALUE exception = rb_errinfo();
+        rb_set_errinfo(Qnil);
+        if (NIL_P(exception)) {
+            // throw/break out of the block
+            exception = rb_exc_new_cstr(rb_eQuickJSError, "Ruby function exited without returning");
+        }
 
-    return self;
+        // Re-raised once JavaScript has unwound, like fetch() errors
+        args->wrapper->pending_ruby_exception = exception;
+        VALUE name = RARRAY_AREF(args->wrapper->host_function_names, args->index);
+        args->ret = JS_ThrowInternalError(args->ctx, "%s() raised %s",
+                                          RSTRING_PTR(name), rb_obj_classname(exception));
+    }
+    return NULL;
 }
 
-// Evaluate JavaScript code
-static VALUE sandbox_eval(VALUE self, VALUE code) {
-    ContextWrapper *wrapper;
+static JSValue js_host_function(JSContext *ctx, JSValueConst this_val, int argc,
+                                JSValueConst *argv, int magic, JSValue *func_data) {
+    ContextWrapper *wrapper = current_wrapper;
+    if (!wrapper) {
+        return JS_ThrowTypeError(ctx, "Ruby function called outside sandbox context");
+    }
+
+    if (wrapper->discarding) {
+        return JS_ThrowInternalError(ctx, "Ruby function called while the sandbox is being reset");
+    }
+
+    struct host_call_args args = {
+        wrapper, ctx, JS_VALUE_GET_INT(func_data[0]), argc, argv, JS_UNDEFINED
+    };
+    with_gvl(wrapper, host_function_with_gvl, &args);
+    return args.ret;
+}
+
+// Create host function `index` as a global of the current context.
+// Returns 0 on success, -1 on allocation failure.
+static int install_host_function(ContextWrapper *wrapper, long index) {
+    JSContext *ctx = wrapper->ctx;
+    VALUE name = RARRAY_AREF(wrapper->host_function_names, index);
+
+    JSValue data = JS_NewInt32(ctx, (int32_t)index);
+    JSValue func = JS_NewCFunctionData(ctx, js_host_function, 0, 0, 1, &data);
+    if (JS_IsException(func)) {
+        return -1;
+    }
+    JS_DefinePropertyValueStr(ctx, func, "name",
+                              JS_NewStringLen(ctx, RSTRING_PTR(name), RSTRING_LEN(name)),
+                              JS_PROP_CONFIGURABLE);
+
+    JSValue global = JS_GetGlobalObject(ctx);
+    int ret = JS_SetPropertyStr(ctx, global, RSTRING_PTR(name), func);
+    JS_FreeValue(ctx, global);
+    return ret < 0 ? -1 : 0;
+}
+
+// JS_ReadObject trusts bytecode (a malformed buffer corrupts memory), so only
+// Strings returned by compile in this process are read back. They are
+// recorded by identity; the weak map drops them once they are collected.
+static VALUE bytecode_register(VALUE bytecode) {
+    rb_funcall(compiled_bytecode, rb_intern("[]="), 2, bytecode, Qtrue);
+    return bytecode;
+}
+
+static int bytecode_registered(VALUE bytecode) {
+    return RTEST(rb_funcall(compiled_bytecode, rb_intern("key?"), 1, bytecode));
+}
+
+static void bytecode_check(VALUE bytecode) {
+    StringValue(bytecode);
+    if (!bytecode_registered(bytecode)) {
+        rb_raise(rb_eArgError, "bytecode was not produced by compile in this process");
+    }
+}
+
+struct module_load_args {
+    ContextWrapper *wrapper;
+    JSContext *ctx;
+    const char *name;
+    JSValue compiled;  // Module compiled on a cache miss, JS_UNDEFINED otherwise
+    int failed;  // A JavaScript exception is pending
+    JSModuleDef *module;
+};
+
+// Block passed to the module loader on a cache miss: compile the module
+// source and return its bytecode for the cache
+static VALUE module_compile_block(RB_BLOCK_CALL_FUNC_ARGLIST(source, data)) {
+    struct module_load_args *args = (struct module_load_args *)data;
+
+    StringValue(source);
+    JSValue module = JS_Eval(args->ctx, RSTRING_PTR(source), RSTRING_LEN(source), args->name,
+                             JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
+    if (JS_IsException(module)) {
+        args->failed = 1;
+        return Qnil;
+    }
+
+    size_t size = 0;
+    uint8_t *buf = JS_WriteObject(args->ctx, &size, module, JS_WRITE_OBJ_BYTECODE);
+    if (!buf) {
+        JS_FreeValue(args->ctx, module);
+        args->failed = 1;
+        return Qnil;
+    }
+    JS_FreeValue(args->ctx, args->compiled);
+    args->compiled = module;
+
+    VALUE bytecode = rb_str_new((const char *)buf, size);
+    js_free(args->ctx, buf);
+    return bytecode_register(rb_obj_freeze(bytecode));
+}
+
+static VALUE module_load_body(VALUE ptr) {
+    struct module_load_args *args = (struct module_load_args *)ptr;
+    VALUE name = rb_utf8_str_new_cstr(args->name);
+    VALUE bytecode = rb_block_call(args->wrapper->module_loader, id_call, 1, &name,
+                                   module_compile_block, (VALUE)args);
+    if (args->failed) {
+        return Qnil;
+    }
+    if (NIL_P(bytecode)) {
+        JS_ThrowReferenceError(args->ctx, "could not load module '%s'", args->name);
+        args->failed = 1;
+        return Qnil;
+    }
+
+    JSValue module = args->compiled;
+    if (JS_IsUndefined(module)) {
+        // Cache hit: the module has not been compiled in this context
+        StringValue(bytecode);
+        if (!bytecode_registered(bytecode)) {
+            JS_ThrowTypeError(args->ctx, "bytecode of module '%s' was not compiled in this process",
+                              args->name);
+            args->failed = 1;
+            return Qnil;
+        }
+        module = JS_ReadObject(args->ctx, (const uint8_t *)RSTRING_PTR(bytecode),
+                               RSTRING_LEN(bytecode), JS_READ_OBJ_BYTECODE);
+        if (JS_IsException(module)) {
+            args->failed = 1;
+            return Qnil;
+        }
+        if (JS_VALUE_GET_TAG(module) != JS_TAG_MODULE) {
+            JS_FreeValue(args->ctx, module);
+            JS_ThrowTypeError(args->ctx, "bytecode of module '%s' is not a module", args->name);
+            args->failed = 1;
+            return Qnil;
+        }
+    }
+    args->compiled = JS_UNDEFINED;
+
+    // The context's list of loaded modules keeps the module
+    args->module = JS_VALUE_GET_PTR(module);
+    JS_FreeValue(args->ctx, module);
+    return Qnil;
+}
+
+// Module loader, with the GVL held (see module_loader)
+static void *module_load_with_gvl(void *ptr) {
+    struct module_load_args *args = (struct module_load_args *)ptr;
+
+    int state = 0;
+    rb_protect(module_load_body, (VALUE)args, &state);
+    JS_FreeValue(args->ctx, args->compiled);
+    if (state) {
+        VALUE exception = rb_errinfo();
+        rb_set_errinfo(Qnil);
+        if (NIL_P(exception)) {
+            exception = rb_exc_new_cstr(rb_eQuickJSError, "Module resolver exited without returning");
+        }
+
+        // Re-raised once JavaScript has unwound, like host function errors
+        args->wrapper->pending_ruby_exception = exception;
+        JS_ThrowInternalError(args->ctx, "loading module '%s' raised %s",
+                              args->name, rb_obj_classname(exception));
+        args->module = NULL;
+    }
+    return NULL;
+}
+
+// Load an imported module (the name is already resolved against the
+// importing module). The loader is set on the runtime, which a shared
+// runtime's sandboxes have in common, so it serves the running sandbox:
+// its module_loader (set by Sandbox.new(module_resolver:)) is called as
+// module_loader.call(name) { |source| bytecode } and returns the module's
+// bytecode from the process-wide cache, yielding its source to compile it
+// on a miss, or nil when there is no such module.
+static JSModuleDef *module_loader(JSContext *ctx, const char *name, void *opaque,
+                                  JSValueConst attributes) {
+    ContextWrapper *wrapper = current_wrapper;
+    if (!wrapper || wrapper->discarding || NIL_P(wrapper->module_loader)) {
+        JS_ThrowReferenceError(ctx, "could not load module '%s'", name);
+        return NULL;
+    }
+
+    struct module_load_args args = { wrapper, ctx, name, JS_UNDEFINED, 0, NULL };
+    with_gvl(wrapper, module_load_with_gvl, &args);
+    return args.module;
+}
+
+// Ruby C API helper functions
+static int script_cache_free_entry(st_data_t key, st_data_t value, st_data_t arg) {
+    JSContext *ctx = (JSContext *)arg;
+    JS_FreeValue(ctx, JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, (void *)value));
+    return ST_DELETE;
+}
+
+// Release the cached functions. Must run before the context is freed, since
+// each function holds a reference to it.
+static void script_cache_clear(ContextWrapper *wrapper) {
+    if (wrapper->script_cache && wrapper->ctx) {
+        st_foreach(wrapper->script_cache, script_cache_free_entry, (st_data_t)wrapper->ctx);
+    }
+}
+
+static int call_path_free_entry(st_data_t key, st_data_t value, st_data_t arg) {
+    JSRuntime *rt = (JSRuntime *)arg;
+    CallPath *path = (CallPath *)value;
+    for (int i = 0; i < path->len; i++) {
+        JS_FreeAtomRT(rt, path->atoms[i]);
+    }
+    free(path);
+    free((char *)key);
+    return ST_DELETE;
+}
+
+// Atoms belong to the runtime, so resolved paths survive reset
+static void call_paths_clear(ContextWrapper *wrapper) {
+    if (wrapper->call_paths && wrapper->rt) {
+        st_foreach(wrapper->call_paths, call_path_free_entry, (st_data_t)wrapper->rt);
+    }
+}
+
+// Free the context and the runtime. An arena runtime is dropped with its
+// arena in one go, without finalizing objects one by one: everything it
+// allocated lives in the arena, and none of its classes hold resources
+// outside of it.
+// A sandbox of a shared runtime only frees its context; what the
+// context's objects still hold is left to the runtime's GC.
+static void runtime_free(ContextWrapper *wrapper) {
+    if (wrapper->rt) {
+        profile_clear(wrapper);
+    }
+    if (wrapper->arena) {
+        // Everything the runtime allocated goes with the arena
+        arena_destroy(wrapper->arena);
+        wrapper->arena = NULL;
+        wrapper->timers = NULL;
+        wrapper->timer_count = 0;
+        wrapper->timer_capacity = 0;
+    } else {
+        if (wrapper->ctx) {
+            timers_clear(wrapper);
+            JS_FreeContext(wrapper->ctx);
+        }
+        if (wrapper->rt && !wrapper->shared) {
+            JS_FreeRuntime(wrapper->rt);
+        }
+    }
+    wrapper->ctx = NULL;
+    wrapper->rt = NULL;
+    wrapper->heap_size = 0;
+}
+
+static void shared_runtime_release(SharedRuntime *runtime) {
+    if (--runtime->refs == 0) {
+        if (runtime->rt) {
+            JS_FreeRuntime(runtime->rt);
+        }
+        free(runtime);
+    }
+}
+
+static void sandbox_free(void *ptr);
+
+// The runtime is no longer running code of any sandbox: free the sandboxes
+// collected in the meantime
+static void shared_runtime_idle(SharedRuntime *runtime) {
+    runtime->current = NULL;
+    while (runtime->zombies) {
+        ContextWrapper *wrapper = runtime->zombies;
+        runtime->zombies = wrapper->next_zombie;
+        sandbox_free(wrapper);
+    }
+}
+
+static void sandbox_free(void *ptr) {
+    ContextWrapper *wrapper = (ContextWrapper *)ptr;
+    if (wrapper) {
+        // While a sibling runs (maybe on another thread, without the GVL),
+        // the shared runtime must not be touched
+        if (wrapper->shared && wrapper->shared->current) {
+            wrapper->next_zombie = wrapper->shared->zombies;
+            wrapper->shared->zombies = wrapper;
+            return;
+        }
+        handles_invalidate(wrapper);
+        free(wrapper->released_values);
+        if (wrapper->pending_fetches) {
+            // Requests still in flight only exist after a non-local exit;
+            // their executor threads finish on their own
+            st_foreach(wrapper->pending_fetches, pending_fetch_free_entry, (st_data_t)wrapper->ctx);
+            st_free_table(wrapper->pending_fetches);
+            wrapper->pending_fetches = NULL;
+        }
+        pthread_mutex_destroy(&wrapper->fetch_mutex);
+        pthread_cond_destroy(&wrapper->fetch_cond);
+        if (wrapper->call_paths) {
+            call_paths_clear(wrapper);
+            st_free_table(wrapper->call_paths);
+            wrapper->call_paths = NULL;
+        }
+        if (wrapper->script_cache) {
+            script_cache_clear(wrapper);
+            st_free_table(wrapper->script_cache);
+            wrapper->script_cache = NULL;
+        }
+        runtime_free(wrapper);
+        if (wrapper->shared) {
+            if (wrapper->account->blocks == 0) {
+                free(wrapper->account);
+            } else {
+                wrapper->account->orphaned = 1;
+            }
+            shared_runtime_release(wrapper->shared);
+        }
+        // What the runtime still holds is no longer this object's
+        if (wrapper->reported_heap_size > 0) {
+            rb_gc_adjust_memory_usage(-(ssize_t)wrapper->reported_heap_size);
+        }
+        if (wrapper->console_output) {
+            free(wrapper->console_output);
+            wrapper->console_output = NULL;
+        }
+        free(wrapper->console_batch);
+        free(wrapper);
+    }
+}
+
+static int script_cache_mark_entry(st_data_t key, st_data_t value, st_data_t arg) {
+    rb_gc_mark((VALUE)key);
+    return ST_CONTINUE;
+}
+
+// Mark Ruby objects referenced from C so GC keeps them alive
+static void sandbox_mark(void *ptr) {
+    ContextWrapper *wrapper = (ContextWrapper *)ptr;
+    if (wrapper) {
+        rb_gc_mark(wrapper->rb_http_callback);
+        rb_gc_mark(wrapper->module_loader);
+        rb_gc_mark(wrapper->console_sink);
+        rb_gc_mark(wrapper->rb_http_executor);
+        rb_gc_mark(wrapper->pending_ruby_exception);
+        rb_gc_mark(wrapper->lazy_sandbox);
+        rb_gc_mark(wrapper->host_functions);
+        rb_gc_mark(wrapper->host_function_names);
+        // Cache keys are compared by identity, so they must not be collected
+        // (and their address reused) while cached
+        if (wrapper->script_cache) {
+            st_foreach(wrapper->script_cache, script_cache_mark_entry, 0);
+        }
+    }
+}
+
+static size_t sandbox_memsize(const void *ptr) {
+    const ContextWrapper *wrapper = (const ContextWrapper *)ptr;
+    if (!wrapper) {
+        return 0;
+    }
+    return sizeof(ContextWrapper) + heap_bytes(wrapper) +
+           wrapper->console_output_capacity + wrapper->console_batch_capacity;
+}
+
+static const rb_data_type_t sandbox_type = {
+    "QuickJS::NativeSandbox",
+    {sandbox_mark, sandbox_free, sandbox_memsize,},
+    NULL, NULL,
+    RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static void runtime_free_ptr(void *ptr) {
+    shared_runtime_release((SharedRuntime *)ptr);
+}
+
+static size_t runtime_memsize(const void *ptr) {
+    const SharedRuntime *runtime = (const SharedRuntime *)ptr;
+    return sizeof(SharedRuntime) + runtime->heap_size;
+}
+
+static const rb_data_type_t runtime_type = {
+    "QuickJS::NativeRuntime",
+    {NULL, runtime_free_ptr, runtime_memsize,},
+    NULL, NULL,
+    RUBY_TYPED_FREE_IMMEDIATELY,
+};
+
+static VALUE runtime_alloc(VALUE klass) {
+    SharedRuntime *runtime = calloc(1, sizeof(SharedRuntime));
+    if (!runtime) {
+        rb_raise(rb_eNoMemError, "Failed to allocate runtime");
+    }
+    runtime->refs = 1;
+    return TypedData_Wrap_Struct(klass, &runtime_type, runtime);
+}
+
+// Initialize a runtime for sandboxes to share. Options: memory_limit
+// (for all of its sandboxes together), gc_threshold.
+static VALUE runtime_initialize(VALUE self, VALUE options) {
+    SharedRuntime *runtime;
+    TypedData_Get_Struct(self, SharedRuntime, &runtime_type, runtime);
+
+    VALUE rb_mem_limit = rb_hash_aref(options, ID2SYM(rb_intern("memory_limit")));
+    VALUE rb_gc_threshold = rb_hash_aref(options, ID2SYM(rb_intern("gc_threshold")));
+
+    runtime->rt = JS_NewRuntime2(&shared_malloc_funcs, runtime);
+    if (!runtime->rt) {
+        rb_raise(rb_eRuntimeError, "Failed to create JavaScript runtime");
+    }
+    JS_SetInterruptHandler(runtime->rt, shared_interrupt_handler, runtime);
+    JS_SetModuleLoaderFunc2(runtime->rt, NULL, module_loader, NULL, NULL);
+    if (!NIL_P(rb_gc_threshold)) {
+        JS_SetGCThreshold(runtime->rt, NUM2SIZET(rb_gc_threshold));
+    }
+    if (!NIL_P(rb_mem_limit)) {
+        JS_SetMemoryLimit(runtime->rt, NUM2SIZET(rb_mem_limit));
+    }
+    return self;
+}
+
+// Allocate function for Ruby object
+static VALUE sandbox_alloc(VALUE klass) {
+    ContextWrapper *wrapper = malloc(sizeof(ContextWrapper));
+    memset(wrapper, 0, sizeof(ContextWrapper));
+    wrapper->rb_http_callback = Qnil;
+    wrapper->rb_http_executor = Qnil;
+    wrapper->module_loader = Qnil;
+    wrapper->console_sink = Qnil;
+    wrapper->pending_ruby_exception = Qnil;
+    wrapper->lazy_sandbox = Qnil;
+    wrapper->host_functions = Qnil;
+    wrapper->host_function_names = Qnil;
+    wrapper->script_cache = st_init_numtable();
+    wrapper->call_paths = st_init_strtable();
+    wrapper->pending_fetches = st_init_numtable();
+    pthread_mutex_init(&wrapper->fetch_mutex, NULL);
+    pthread_cond_init(&wrapper->fetch_cond, NULL);
+    return TypedData_Wrap_Struct(klass, &sandbox_type, wrapper);
+}
+
+// Create the JavaScript context with the sandbox globals (console, fetch,
+// and the native Headers, URL and URLSearchParams classes).
+// Returns 0 on success, -1 if the context could not be created.
+static int create_context(ContextWrapper *wrapper) {
+    wrapper->ctx = JS_NewContext(wrapper->rt);
+    if (!wrapper->ctx) {
+        return -1;
+    }
+
+    lookup_binary_class_ids(wrapper->ctx);
+
+    // Set up console object
+    JSValue global = JS_GetGlobalObject(wrapper->ctx);
+    JSValue console = JS_NewObject(wrapper->ctx);
+    for (int level = 0; level < CONSOLE_LEVEL_COUNT; level++) {
+        const char *name = console_level_names[level];
+        JS_SetPropertyStr(wrapper->ctx, console, name,
+                          JS_NewCFunctionMagic(wrapper->ctx, js_console_log, name, 1,
+                                               JS_CFUNC_generic_magic, level));
+    }
+    JS_SetPropertyStr(wrapper->ctx, global, "console", console);
+
+    // Always add fetch() function to global scope (will error if HTTP not enabled)
+    JSValue fetch = JS_NewCFunction(wrapper->ctx, js_fetch, "fetch", 2);
+    // Native UTF-8 conversions, taken off fetch by the text encoding polyfill
+    JS_DefinePropertyValueStr(wrapper->ctx, fetch, "decodeUTF8",
+                              JS_NewCFunction(wrapper->ctx, js_decode_utf8, "decodeUTF8", 1),
+                              JS_PROP_CONFIGURABLE);
+    JS_DefinePropertyValueStr(wrapper->ctx, fetch, "encodeUTF8",
+                              JS_NewCFunction(wrapper->ctx, js_encode_utf8, "encodeUTF8", 1),
+                              JS_PROP_CONFIGURABLE);
+    JS_SetPropertyStr(wrapper->ctx, global, "fetch", fetch);
+
+    // Timers (see js_set_timer) and queueMicrotask
+    JS_SetPropertyStr(wrapper->ctx, global, "setTimeout",
+                      JS_NewCFunctionMagic(wrapper->ctx, js_set_timer, "setTimeout", 2,
+                                           JS_CFUNC_generic_magic, 0));
+    JS_SetPropertyStr(wrapper->ctx, global, "setInterval",
+                      JS_NewCFunctionMagic(wrapper->ctx, js_set_timer, "setInterval", 2,
+                                           JS_CFUNC_generic_magic, 1));
+    JS_SetPropertyStr(wrapper->ctx, global, "clearTimeout",
+                      JS_NewCFunction(wrapper->ctx, js_clear_timer, "clearTimeout", 1));
+    JS_SetPropertyStr(wrapper->ctx, global, "clearInterval",
+                      JS_NewCFunction(wrapper->ctx, js_clear_timer, "clearInterval", 1));
+    JS_SetPropertyStr(wrapper->ctx, global, "queueMicrotask",
+                      JS_NewCFunction(wrapper->ctx, js_queue_microtask, "queueMicrotask", 1));
+
+    JS_FreeValue(wrapper->ctx, global);
+
+    if (web_api_install(wrapper->ctx) < 0) {
+        JS_FreeContext(wrapper->ctx);
+        wrapper->ctx = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int create_host_functions(ContextWrapper *wrapper) {
+    int ret = 0;
+    if (!NIL_P(wrapper->host_functions)) {
+        for (long i = 0; ret == 0 && i < RARRAY_LEN(wrapper->host_functions); i++) {
+            ret = install_host_function(wrapper, i);
+        }
+    }
+    return ret;
+}
+
+// Create the sandbox's context in its shared runtime, charging the
+// context's own objects to the sandbox. Like create_runtime, the context
+// is built before the sandbox's share of the memory limit applies.
+static int create_shared_context(ContextWrapper *wrapper) {
+    wrapper->rt = wrapper->shared->rt;
+    wrapper->shared->current = wrapper;
+    wrapper->account->limit = SIZE_MAX;
+    int ret = create_context(wrapper);
+    if (ret == 0) {
+        ret = create_host_functions(wrapper);
+    }
+    shared_runtime_idle(wrapper->shared);
+    if (ret != 0) {
+        runtime_free(wrapper);
+        return -1;
+    }
+    wrapper->account->limit = wrapper->mem_limit;
+    return 0;
+}
+
+// Create the runtime and its context, with the sandbox's host functions
+static int create_runtime(ContextWrapper *wrapper) {
+    if (wrapper->shared) {
+        return create_shared_context(wrapper);
+    }
+    if (wrapper->use_arena) {
+        // First chunk sized for the memory limit (capped by the arena)
+        wrapper->arena = arena_new(wrapper->mem_limit);
+        if (!wrapper->arena) {
+            return -1;
+        }
+    }
+    wrapper->rt = JS_NewRuntime2(wrapper->arena ? &sandbox_arena_malloc_funcs : &sandbox_malloc_funcs, wrapper);
+    if (!wrapper->rt) {
+        runtime_free(wrapper);
+        return -1;
+    }
+
+    JS_SetInterruptHandler(wrapper->rt, interrupt_handler, wrapper);
+    JS_SetModuleLoaderFunc2(wrapper->rt, NULL, module_loader, NULL, NULL);
+
+    if (wrapper->gc_policy == GC_THRESHOLD && wrapper->gc_threshold > 0) {
+        JS_SetGCThreshold(wrapper->rt, wrapper->gc_threshold);
+    }
+
+    // Build the context without the memory limit in place: QuickJS needs
+    // room for its internal structures first
+    int ret = create_context(wrapper);
+    if (ret == 0) {
+        ret = create_host_functions(wrapper);
+    }
+    if (ret != 0) {
+        runtime_free(wrapper);
+        return -1;
+    }
+    JS_SetMemoryLimit(wrapper->rt, wrapper->mem_limit);
+    return 0;
+}
+
+// Initialize sandbox
+static VALUE sandbox_initialize(VALUE self, VALUE options) {
+    ContextWrapper *wrapper;
+    TypedData_Get_Struct(self, ContextWrapper, &sandbox_type, wrapper);
+
+    // Get options
+    VALUE rb_mem_limit = rb_hash_aref(options, ID2SYM(rb_intern("memory_limit")));
+    VALUE rb_timeout = rb_hash_aref(options, ID2SYM(rb_intern("timeout_ms")));
+    VALUE rb_console_max = rb_hash_aref(options, ID2SYM(rb_intern("console_log_max_size")));
+    VALUE rb_console_sink = rb_hash_aref(options, ID2SYM(rb_intern("console_sink")));
+    VALUE rb_console_flush_size = rb_hash_aref(options, ID2SYM(rb_intern("console_flush_size")));
+    VALUE rb_gc = rb_hash_aref(options, ID2SYM(rb_intern("gc")));
+    VALUE rb_gc_threshold = rb_hash_aref(options, ID2SYM(rb_intern("gc_threshold")));
+    VALUE rb_gc_interval = rb_hash_aref(options, ID2SYM(rb_intern("gc_interval")));
+    VALUE rb_detailed_metrics = rb_hash_aref(options, ID2SYM(rb_intern("detailed_metrics")));
+    VALUE rb_allocator = rb_hash_aref(options, ID2SYM(rb_intern("allocator")));
+    VALUE rb_runtime = rb_hash_aref(options, ID2SYM(rb_intern("runtime")));
+
+    // In a shared runtime, memory_limit is the sandbox's share (none by default)
+    wrapper->mem_limit = NIL_P(rb_mem_limit) ? (NIL_P(rb_runtime) ? 1000000 : SIZE_MAX) : NUM2SIZET(rb_mem_limit);
+    wrapper->timeout_ms = NIL_P(rb_timeout) ? 5000 : NUM2LL(rb_timeout);
+    wrapper->console_max_size = NIL_P(rb_console_max) ? 10000 : NUM2SIZET(rb_console_max);
+    wrapper->console_flush_size = NIL_P(rb_console_flush_size) ? 4096 : NUM2SIZET(rb_console_flush_size);
+    wrapper->gc_interval = NIL_P(rb_gc_interval) ? 100 : NUM2LL(rb_gc_interval);
+    wrapper->detailed_metrics = RTEST(rb_detailed_metrics);
+    wrapper->gc_threshold = NIL_P(rb_gc_threshold) ? 0 : NUM2SIZET(rb_gc_threshold);
+
+    if (NIL_P(rb_gc) || rb_gc == ID2SYM(rb_intern("always"))) {
+        wrapper->gc_policy = GC_ALWAYS;
+    } else if (rb_gc == ID2SYM(rb_intern("threshold"))) {
+        wrapper->gc_policy = GC_THRESHOLD;
+    } else if (rb_gc == ID2SYM(rb_intern("never"))) {
+        wrapper->gc_policy = GC_NEVER;
+    } else if (rb_gc == ID2SYM(rb_intern("every_n"))) {
+        wrapper->gc_policy = GC_EVERY_N;
+    } else {
+        rb_raise(rb_eArgError, "Invalid gc policy: %" PRIsVALUE, rb_inspect(rb_gc));
+    }
+    if (wrapper->gc_interval < 1) {
+        rb_raise(rb_eArgError, "gc_interval must be at least 1");
+    }
+    if (NIL_P(rb_allocator) || rb_allocator == ID2SYM(rb_intern("system"))) {
+        wrapper->use_arena = 0;
+    } else if (rb_allocator == ID2SYM(rb_intern("arena"))) {
+        wrapper->use_arena = 1;
+    } else {
+        rb_raise(rb_eArgError, "Invalid allocator: %" PRIsVALUE, rb_inspect(rb_allocator));
+    }
+    if (!NIL_P(rb_runtime)) {
+        SharedRuntime *runtime;
+        TypedData_Get_Struct(rb_runtime, SharedRuntime, &runtime_type, runtime);
+        if (!runtime->rt) {
+            rb_raise(rb_eQuickJSError, "Runtime is not initialized");
+        }
+        if (runtime->current) {
+            rb_raise(rb_eQuickJSError, "Runtime is already executing JavaScript");
+        }
+        if (wrapper->use_arena) {
+            rb_raise(rb_eArgError, "allocator: :arena cannot be used with a shared runtime");
+        }
+        wrapper->account = calloc(1, sizeof(MemoryAccount));
+        if (!wrapper->account) {
+            rb_raise(rb_eNoMemError, "Failed to allocate sandbox");
+        }
+        wrapper->shared = runtime;
+        runtime->refs++;
+    }
+
+    wrapper->rb_http_callback = Qnil;
+    wrapper->pending_ruby_exception = Qnil;
+    if (!NIL_P(rb_console_sink) && !rb_respond_to(rb_console_sink, id_call)) {
+        rb_raise(rb_eArgError, "console_sink must respond to call");
+    }
+    wrapper->console_sink = rb_console_sink;
+
+    // Initialize console output buffer
+    wrapper->console_output_capacity = 1024;
+    wrapper->console_output = malloc(wrapper->console_output_capacity);
+    wrapper->console_output[0] = '\0';
+    wrapper->console_output_len = 0;
+    wrapper->console_truncated = 0;
+
+    if (create_runtime(wrapper) != 0) {
+        rb_raise(rb_eRuntimeError, "Failed to create JavaScript runtime");
+    }
+    heap_report(wrapper);
+
+    return self;
+}
+
+// Fetch the wrapper for a sandbox that is not currently executing
+// JavaScript. Runtimes are single-threaded: while one Ruby thread runs
+// code in a sandbox (with the GVL released), others must not touch it.
+static ContextWrapper *get_idle_wrapper(VALUE self) {
+    ContextWrapper *wrapper;
     TypedData_Get_Struct(self, ContextWrapper, &sandbox_type, wrapper);
 
+    if (!wrapper->ctx) {
+        rb_raise(rb_eQuickJSError, "Sandbox is not initialized");
+    }
+
+    if (wrapper->busy) {
+        rb_raise(rb_eQuickJSError, "Sandbox is already executing JavaScript");
+    }
+
+    if (wrapper->shared && wrapper->shared->current) {
+        rb_raise(rb_eQuickJSError, "Runtime is already executing JavaScript in another sandbox");
+    }
+
+    // The sandbox may be used from a different thread than the one it was
+    // created on; refresh the stack limit used for overflow detection.
+    update_stack_limit(wrapper->rt);
+
+    return wrapper;
+}
+
+// Reset per-eval state before running JavaScript
+static void eval_begin(ContextWrapper *wrapper) {
+    if (wrapper->released_len) {
+        handles_release(wrapper);
+    }
+
     // Reset console output and pending exception
     wrapper->console_output_len = 0;
     wrapper->console_output[0] = '\0';
     wrapper->console_truncated = 0;
     wrapper->timed_out = 0;
+    wrapper->interrupted = 0;
+    wrapper->killed = 0;
     wrapper->pending_ruby_exception = Qnil;
+    wrapper->lazy_sandbox = Qnil;
 
     // Set start time
     wrapper->start_time_ms = get_time_ms();
 
-    // Set current wrapper for console.log
+    // Start the per-eval metrics
+    wrapper->eval_wall_start_ms = get_time_ms_precise();
+    wrapper->eval_cpu_start_ms = get_thread_cpu_time_ms();
+    if (wrapper->shared) {
+        // Frees made while other sandboxes ran
+        wrapper->heap_size = wrapper->account->size;
+    }
+    wrapper->eval_allocated_bytes_start = wrapper->allocated_bytes;
+    wrapper->peak_heap_size = wrapper->heap_size;
+    JS_GetGCStats(wrapper->rt, &wrapper->eval_gc_count_start, &wrapper->eval_gc_time_start_ns);
+    wrapper->job_count = 0;
+    wrapper->interrupt_checks = 0;
+
+    // Samples left by an eval that raised before its profile was collected
+    profile_clear(wrapper);
+    wrapper->profile_interval_ms = wrapper->profile_request_ms;
+    wrapper->profile_request_ms = 0;
+    wrapper->profile_next_sample_ms = wrapper->eval_wall_start_ms + wrapper->profile_interval_ms;
+
+    // Mark the sandbox as in use and set current wrapper for console.log
+    wrapper->busy = 1;
     current_wrapper = wrapper;
+    if (wrapper->shared) {
+        wrapper->shared->current = wrapper;
+    }
+}
 
-    // Evaluate code
-    const char *code_str = StringValueCStr(code);
-    JSValue result = JS_Eval(wrapper->ctx, code_str, strlen(code_str), "<eval>",
-                            JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_ASYNC);
+// Jobs left by a timed-out or interrupted eval of a shared runtime would
+// run in whichever of its sandboxes evaluates next: drop them like reset
+// does (see sandbox_reset_context)
+static void shared_discard_jobs(ContextWrapper *wrapper) {
+    int discarding = wrapper->discarding;
+    wrapper->discarding = 1;
+    JSContext *ctx1;
+    while (JS_ExecutePendingJob(wrapper->rt, &ctx1) != 0) {
+        JS_FreeValue(ctx1, JS_GetException(ctx1));
+    }
+    wrapper->discarding = discarding;
+}
+
+// Clear per-eval state once JavaScript is done running. Console lines
+// still batched are flushed first (a raising sink sets interrupted).
+// A shared runtime stays with this sandbox (see eval_release).
+static void eval_stop(ContextWrapper *wrapper) {
+    if (wrapper->shared && JS_IsJobPending(wrapper->rt)) {
+        shared_discard_jobs(wrapper);
+    }
+    // Also frees the array of timers that all fired: it must not outlive
+    // the runtime (an arena is dropped with everything allocated in it)
+    timers_clear(wrapper);
+    console_flush(wrapper);
+    current_wrapper = NULL;
+    wrapper->busy = 0;
+    if (wrapper->pending_fetches->num_entries > 0) {
+        fetch_abandon(wrapper);
+    }
+    heap_report(wrapper);
+}
+
+// Let the other sandboxes of a shared runtime run. Converting a result can
+// still run getters, so until then the runtime keeps enforcing this
+// sandbox's timeout and charging its memory.
+static void eval_release(ContextWrapper *wrapper) {
+    if (wrapper->shared) {
+        shared_runtime_idle(wrapper->shared);
+    }
+}
+
+// eval_stop and eval_release at once, when nothing is left to convert
+static void eval_end(ContextWrapper *wrapper) {
+    eval_stop(wrapper);
+    eval_release(wrapper);
+}
 
+// Drain pending jobs and unwrap the (async) result.
+// Pure QuickJS work: safe to call without the GVL.
+static JSValue eval_settle(ContextWrapper *wrapper, JSValue result) {
     // Execute pending jobs (Promise callbacks, etc.)
     // This is required for async/await and Promise-based code to work
     JSContext *ctx1;
-    int job_count = 0;
-    while (JS_ExecutePendingJob(wrapper->rt, &ctx1) > 0) {
-        job_count++;
-        // Check for timeout during job execution
-        if (wrapper->timeout_ms > 0) {
-            int64_t elapsed = get_time_ms() - wrapper->start_time_ms;
-            if (elapsed > wrapper->timeout_ms) {
-                wrapper->timed_out = 1;
+    for (;;) {
+        while (!wrapper->interrupted && JS_ExecutePendingJob(wrapper->rt, &ctx1) > 0) {
+            wrapper->job_count++;
+            // Check for timeout during job execution
+            if (wrapper->timeout_ms > 0) {
+                int64_t elapsed = get_time_ms() - wrapper->start_time_ms;
+                if (elapsed > wrapper->timeout_ms) {
+                    wrapper->timed_out = 1;
+                    break;
+                }
+            }
+        }
+
+        if (wrapper->interrupted || wrapper->timed_out) {
+            break;
+        }
+
+        // Out of jobs: run the next timer that is due, or sleep until one
+        // is or a fetch() in flight settles its Promise. Timers do not run
+        // once evaluation has thrown.
+        int timers = wrapper->timer_count > 0 && !JS_IsException(result);
+        if (timers && wrapper->timers[0]->deadline_ms <= get_time_ms()) {
+            if (timer_fire(wrapper) < 0) {
+                JS_FreeValue(wrapper->ctx, result);
+                result = JS_EXCEPTION;
                 break;
             }
+            continue;
+        }
+        if (!timers && wrapper->pending_fetches->num_entries == 0) {
+            break;
+        }
+        int ret = event_wait(wrapper, timers ? wrapper->timers[0]->deadline_ms : -1);
+        if (ret < 0) {
+            break;
+        }
+        if (ret == 0) {
+            with_gvl(wrapper, fetch_dispatch_with_gvl, wrapper);
         }
     }
 
@@ -679,132 +3209,1009 @@ static VALUE sandbox_eval(VALUE self, VALUE code) {
                 }
                 JS_FreeAtom(wrapper->ctx, value_atom);
             }
-            // Continue loop to check if unwrapped value is also a Promise
-        } else if (state == JS_PROMISE_REJECTED) {
-            // Get the rejection reason and convert to exception
-            JSValue reason = JS_PromiseResult(wrapper->ctx, result);
-            JS_FreeValue(wrapper->ctx, result);
-            JS_Throw(wrapper->ctx, reason);
-            result = JS_EXCEPTION;
-            break;
+            // Continue loop to check if unwrapped value is also a Promise
+        } else if (state == JS_PROMISE_REJECTED) {
+            // Get the rejection reason and convert to exception
+            JSValue reason = JS_PromiseResult(wrapper->ctx, result);
+            JS_FreeValue(wrapper->ctx, result);
+            JS_Throw(wrapper->ctx, reason);
+            result = JS_EXCEPTION;
+            break;
+        } else {
+            // Still pending, break out
+            break;
+        }
+    }
+
+    return result;
+}
+
+// Convert a settled result to a QuickJS::Result, or to the matching QuickJS
+// error (returned, not raised) with *failed set. Takes ownership of `result`.
+static VALUE eval_convert(ContextWrapper *wrapper, JSValue result, int *failed) {
+    *failed = 1;
+
+    // Prepare console output for all return paths
+    VALUE console_output = rb_str_new(wrapper->console_output, wrapper->console_output_len);
+    rb_enc_associate(console_output, rb_utf8_encoding());
+    VALUE console_truncated = wrapper->console_truncated ? Qtrue : Qfalse;
+
+    // Check for timeout
+    if (wrapper->timed_out) {
+        JS_FreeValue(wrapper->ctx, result);
+        VALUE argv[3] = {
+            rb_str_new2("JavaScript execution timeout exceeded"),
+            console_output,
+            console_truncated
+        };
+        return rb_class_new_instance(3, argv, rb_eQuickJSTimeoutError);
+    }
+
+    // Check for exception
+    if (JS_IsException(result)) {
+        JSValue exception = JS_GetException(wrapper->ctx);
+
+        // Check if there's a pending Ruby exception (from HTTP callback)
+        // This must be re-raised AFTER QuickJS has cleaned up
+        if (wrapper->pending_ruby_exception != Qnil) {
+            VALUE pending = wrapper->pending_ruby_exception;
+            wrapper->pending_ruby_exception = Qnil;
+
+            JS_FreeValue(wrapper->ctx, exception);
+
+            // Re-create the Ruby exception with console output
+            VALUE exc_class = rb_obj_class(pending);
+            VALUE message = rb_funcall(pending, rb_intern("message"), 0);
+
+            // Check if this is one of our HTTP error classes
+            if (exc_class == rb_eQuickJSHTTPBlockedError ||
+                exc_class == rb_eQuickJSHTTPLimitError ||
+                exc_class == rb_eQuickJSHTTPError) {
+                // Create new exception with console output
+                VALUE argv[3] = { message, console_output, console_truncated };
+                return rb_class_new_instance(3, argv, exc_class);
+            } else {
+                // Re-raise original exception
+                return pending;
+            }
+        }
+
+        // Regular JavaScript exception handling
+        // Try to get error message - QuickJS provides js_error_to_string
+        const char *exception_str = JS_ToCString(wrapper->ctx, exception);
+
+        VALUE rb_message;
+        VALUE rb_stack;
+        int is_syntax = 0;
+
+        if (exception_str) {
+            // Check if it's a syntax error
+            is_syntax = (strncmp(exception_str, "SyntaxError", 11) == 0);
+            rb_message = rb_str_new2(exception_str);
+            rb_stack = rb_str_new2("");  // Will try to get stack separately
+            JS_FreeCString(wrapper->ctx, exception_str);
+        } else {
+            rb_message = rb_str_new2("Unknown JavaScript error");
+            rb_stack = rb_str_new2("");
+        }
+
+        // Try to get stack trace if available
+        if (JS_IsObject(exception)) {
+            JSValue stack_val = JS_GetPropertyStr(wrapper->ctx, exception, "stack");
+            if (!JS_IsUndefined(stack_val) && !JS_IsNull(stack_val)) {
+                const char *stack = JS_ToCString(wrapper->ctx, stack_val);
+                if (stack) {
+                    rb_stack = rb_str_new2(stack);
+                    JS_FreeCString(wrapper->ctx, stack);
+                }
+            }
+            JS_FreeValue(wrapper->ctx, stack_val);
+        }
+
+        JS_FreeValue(wrapper->ctx, exception);
+
+        if (is_syntax) {
+            VALUE argv[4] = { rb_message, rb_stack, console_output, console_truncated };
+            return rb_class_new_instance(4, argv, rb_eQuickJSSyntaxError);
+        } else {
+            VALUE argv[4] = { rb_message, rb_stack, console_output, console_truncated };
+            return rb_class_new_instance(4, argv, rb_eQuickJSJavascriptError);
+        }
+    }
+
+    // Convert result to Ruby
+    VALUE rb_result;
+    if (NIL_P(wrapper->lazy_sandbox)) {
+        rb_result = js_to_ruby(wrapper->ctx, result);
+        JS_FreeValue(wrapper->ctx, result);
+    } else {
+        rb_result = js_to_ruby_lazy(wrapper->lazy_sandbox, wrapper, result);
+    }
+
+    // Return Result object
+    *failed = 0;
+    VALUE rb_http_requests = rb_ary_new();  // Empty array for HTTP requests (tracked by Ruby layer)
+    VALUE argv[4] = { rb_result, console_output, console_truncated, rb_http_requests };
+    return rb_class_new_instance(4, argv, rb_cResult);
+}
+
+// Execution metrics of the eval started by eval_begin
+// GC passes since eval_begin, those QuickJS ran while allocating included
+static void metrics_set_gc_stats(ContextWrapper *wrapper, VALUE metrics) {
+    int64_t count, time_ns;
+    JS_GetGCStats(wrapper->rt, &count, &time_ns);
+    rb_hash_aset(metrics, ID2SYM(rb_intern("gc_count")), LL2NUM(count - wrapper->eval_gc_count_start));
+    rb_hash_aset(metrics, ID2SYM(rb_intern("gc_time_ms")),
+                 DBL2NUM((double)(time_ns - wrapper->eval_gc_time_start_ns) / 1000000.0));
+}
+
+static VALUE eval_metrics(ContextWrapper *wrapper) {
+    VALUE metrics = rb_hash_new();
+    rb_hash_aset(metrics, ID2SYM(rb_intern("wall_time_ms")),
+                 DBL2NUM(get_time_ms_precise() - wrapper->eval_wall_start_ms));
+    rb_hash_aset(metrics, ID2SYM(rb_intern("cpu_time_ms")),
+                 DBL2NUM(get_thread_cpu_time_ms() - wrapper->eval_cpu_start_ms));
+    rb_hash_aset(metrics, ID2SYM(rb_intern("allocated_bytes")),
+                 ULL2NUM(wrapper->allocated_bytes - wrapper->eval_allocated_bytes_start));
+    rb_hash_aset(metrics, ID2SYM(rb_intern("peak_memory_bytes")), SIZET2NUM(wrapper->peak_heap_size));
+    rb_hash_aset(metrics, ID2SYM(rb_intern("memory_bytes")), SIZET2NUM(wrapper->heap_size));
+    if (wrapper->detailed_metrics) {
+        JSMemoryUsage usage;
+        JS_ComputeMemoryUsage(wrapper->rt, &usage);
+        rb_hash_aset(metrics, ID2SYM(rb_intern("object_count")), LL2NUM(usage.obj_count));
+        rb_hash_aset(metrics, ID2SYM(rb_intern("shape_count")), LL2NUM(usage.shape_count));
+    }
+    rb_hash_aset(metrics, ID2SYM(rb_intern("job_count")), LL2NUM(wrapper->job_count));
+    rb_hash_aset(metrics, ID2SYM(rb_intern("interrupt_checks")), LL2NUM(wrapper->interrupt_checks));
+    metrics_set_gc_stats(wrapper, metrics);
+    return metrics;
+}
+
+// Convert a settled result like eval_convert, attaching the eval's metrics
+// to the Result or QuickJS error. Must be called with the GVL held, after
+// eval_stop.
+static VALUE eval_outcome(ContextWrapper *wrapper, JSValue result, int *failed) {
+    VALUE outcome = eval_convert(wrapper, result, failed);
+    if ((!*failed || rb_obj_is_kind_of(outcome, rb_eQuickJSError)) && !OBJ_FROZEN(outcome)) {
+        rb_ivar_set(outcome, rb_intern("@metrics"), eval_metrics(wrapper));
+        if (wrapper->profile_interval_ms > 0) {
+            rb_ivar_set(outcome, rb_intern("@profile"), profile_collapse(wrapper));
+        }
+    }
+    wrapper->profile_interval_ms = 0;
+    return outcome;
+}
+
+struct eval_outcome_args {
+    ContextWrapper *wrapper;
+    JSValue result;
+    int failed;
+};
+
+static VALUE eval_outcome_body(VALUE ptr) {
+    struct eval_outcome_args *args = (struct eval_outcome_args *)ptr;
+    return eval_outcome(args->wrapper, args->result, &args->failed);
+}
+
+static VALUE eval_release_ensure(VALUE ptr) {
+    eval_release((ContextWrapper *)ptr);
+    return Qnil;
+}
+
+// eval_outcome, then eval_release even if the conversion raises
+static VALUE eval_outcome_released(ContextWrapper *wrapper, JSValue result, int *failed) {
+    if (!wrapper->shared) {
+        return eval_outcome(wrapper, result, failed);
+    }
+    struct eval_outcome_args args = { wrapper, result, 1 };
+    VALUE outcome = rb_ensure(eval_outcome_body, (VALUE)&args, eval_release_ensure, (VALUE)wrapper);
+    *failed = args.failed;
+    return outcome;
+}
+
+// Fields of JSMemoryUsage reported by Sandbox#memory_usage
+#define MEMORY_USAGE_FIELD(name) { #name, offsetof(JSMemoryUsage, name) }
+static const struct {
+    const char *name;
+    size_t offset;
+} memory_usage_fields[] = {
+    MEMORY_USAGE_FIELD(malloc_size),
+    MEMORY_USAGE_FIELD(malloc_limit),
+    MEMORY_USAGE_FIELD(memory_used_size),
+    MEMORY_USAGE_FIELD(malloc_count),
+    MEMORY_USAGE_FIELD(memory_used_count),
+    MEMORY_USAGE_FIELD(atom_count),
+    MEMORY_USAGE_FIELD(atom_size),
+    MEMORY_USAGE_FIELD(str_count),
+    MEMORY_USAGE_FIELD(str_size),
+    MEMORY_USAGE_FIELD(obj_count),
+    MEMORY_USAGE_FIELD(obj_size),
+    MEMORY_USAGE_FIELD(prop_count),
+    MEMORY_USAGE_FIELD(prop_size),
+    MEMORY_USAGE_FIELD(shape_count),
+    MEMORY_USAGE_FIELD(shape_size),
+    MEMORY_USAGE_FIELD(js_func_count),
+    MEMORY_USAGE_FIELD(js_func_size),
+    MEMORY_USAGE_FIELD(js_func_code_size),
+    MEMORY_USAGE_FIELD(js_func_pc2line_count),
+    MEMORY_USAGE_FIELD(js_func_pc2line_size),
+    MEMORY_USAGE_FIELD(c_func_count),
+    MEMORY_USAGE_FIELD(array_count),
+    MEMORY_USAGE_FIELD(fast_array_count),
+    MEMORY_USAGE_FIELD(fast_array_elements),
+    MEMORY_USAGE_FIELD(binary_object_count),
+    MEMORY_USAGE_FIELD(binary_object_size),
+};
+#undef MEMORY_USAGE_FIELD
+
+// Breakdown of the runtime's heap (walks the whole heap). malloc_limit is
+// -1 when there is no limit. Arena sandboxes also report the bytes their
+// arena holds as :arena_reserved_size.
+static VALUE memory_usage_hash(JSRuntime *rt) {
+    JSMemoryUsage usage;
+    JS_ComputeMemoryUsage(rt, &usage);
+
+    VALUE hash = rb_hash_new();
+    for (size_t i = 0; i < sizeof(memory_usage_fields) / sizeof(memory_usage_fields[0]); i++) {
+        int64_t value = *(const int64_t *)((const char *)&usage + memory_usage_fields[i].offset);
+        rb_hash_aset(hash, ID2SYM(rb_intern(memory_usage_fields[i].name)), LL2NUM(value));
+    }
+    return hash;
+}
+
+// For a sandbox of a shared runtime, the breakdown covers the whole
+// runtime, and :sandbox_malloc_size is the part charged to the sandbox.
+static VALUE sandbox_memory_usage(VALUE self) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    VALUE hash = memory_usage_hash(wrapper->rt);
+    if (wrapper->shared) {
+        rb_hash_aset(hash, ID2SYM(rb_intern("sandbox_malloc_size")), SIZET2NUM(wrapper->account->size));
+    }
+    if (wrapper->arena) {
+        rb_hash_aset(hash, ID2SYM(rb_intern("arena_reserved_size")),
+                     SIZET2NUM(arena_reserved_bytes(wrapper->arena)));
+    }
+    return hash;
+}
+
+// Runtime#memory_usage
+static VALUE runtime_memory_usage(VALUE self) {
+    SharedRuntime *runtime;
+    TypedData_Get_Struct(self, SharedRuntime, &runtime_type, runtime);
+    if (!runtime->rt) {
+        rb_raise(rb_eQuickJSError, "Runtime is not initialized");
+    }
+    if (runtime->current) {
+        rb_raise(rb_eQuickJSError, "Runtime is already executing JavaScript");
+    }
+    return memory_usage_hash(runtime->rt);
+}
+
+// Run the GC pass the sandbox's policy calls for after `evals` evaluations.
+// Cleans up temporary objects created during evaluation, which matters
+// most for fetch() responses and other complex objects.
+static void eval_collect_garbage(ContextWrapper *wrapper, int64_t evals) {
+    wrapper->evals_since_gc += evals;
+
+    switch (wrapper->gc_policy) {
+        case GC_ALWAYS:
+            break;
+        case GC_EVERY_N:
+            if (wrapper->evals_since_gc < wrapper->gc_interval) {
+                return;
+            }
+            break;
+        case GC_THRESHOLD:
+        case GC_NEVER:
+            return;
+    }
+
+    JS_RunGC(wrapper->rt);
+    wrapper->evals_since_gc = 0;
+    heap_report(wrapper);
+}
+
+// Record the GC passes of the eval on its Result (or error) and its
+// metrics, which are then complete and frozen. `last` counts the pass (if
+// any) that ran after the eval, which follows its metrics.
+static void result_set_gc_stats(ContextWrapper *wrapper, VALUE result, int last) {
+    VALUE metrics = rb_attr_get(result, rb_intern("@metrics"));
+    if (!RB_TYPE_P(metrics, T_HASH)) {
+        return;
+    }
+    if (!OBJ_FROZEN(result)) {
+        if (last) {
+            metrics_set_gc_stats(wrapper, metrics);
+        }
+        if (rb_obj_is_kind_of(result, rb_cResult)) {
+            rb_ivar_set(result, rb_intern("@gc_count"), rb_hash_aref(metrics, ID2SYM(rb_intern("gc_count"))));
+            rb_ivar_set(result, rb_intern("@gc_time_ms"), rb_hash_aref(metrics, ID2SYM(rb_intern("gc_time_ms"))));
+        }
+    }
+    rb_obj_freeze(metrics);
+}
+
+// The pass (if any) after a batch is recorded on its last item
+static void batch_set_gc_stats(ContextWrapper *wrapper, VALUE results) {
+    long len = RARRAY_LEN(results);
+    for (long i = 0; i < len; i++) {
+        result_set_gc_stats(wrapper, RARRAY_AREF(results, i), i == len - 1);
+    }
+}
+
+// Ruby interrupted the thread while JavaScript was running: discard the
+// result and let Ruby process the interrupt (raise, kill, signal...)
+static void eval_raise_interrupted(ContextWrapper *wrapper, JSValue result) {
+    JS_FreeValue(wrapper->ctx, result);
+    JS_FreeValue(wrapper->ctx, JS_GetException(wrapper->ctx));
+    rb_thread_check_ints();
+    if (wrapper->killed) {
+        wrapper->killed = 0;
+        rb_thread_kill(rb_thread_current());
+    }
+
+    // Delivering fetch() results failed (see fetch_dispatch_with_gvl)
+    if (!NIL_P(wrapper->pending_ruby_exception)) {
+        VALUE exception = wrapper->pending_ruby_exception;
+        wrapper->pending_ruby_exception = Qnil;
+        rb_exc_raise(exception);
+    }
+    rb_raise(rb_eQuickJSError, "JavaScript execution interrupted");
+}
+
+// Convert a settled result to a QuickJS::Result, raising the matching
+// QuickJS error on failure. Must be called with the GVL held.
+// Takes ownership of `result`.
+static VALUE eval_finish(ContextWrapper *wrapper, JSValue result) {
+    // Clear current wrapper
+    eval_stop(wrapper);
+
+    if (wrapper->interrupted) {
+        eval_release(wrapper);
+        eval_raise_interrupted(wrapper, result);
+    }
+
+    int failed;
+    VALUE outcome = eval_outcome_released(wrapper, result, &failed);
+
+    eval_collect_garbage(wrapper, 1);
+    result_set_gc_stats(wrapper, outcome, 1);
+
+    if (failed) {
+        rb_exc_raise(outcome);
+    }
+    return outcome;
+}
+
+// JavaScript entry point executed by eval_run without the GVL
+typedef JSValue (*eval_run_func)(ContextWrapper *wrapper, void *data);
+
+struct eval_run_args {
+    ContextWrapper *wrapper;
+    eval_run_func func;
+    void *data;
+    JSValue result;
+    int ran;
+};
+
+// Replace a settled result with its JSON.stringify output (a string, or
+// undefined for values JSON cannot represent). Runs without the GVL
+// since toJSON methods are user code.
+static JSValue eval_stringify(ContextWrapper *wrapper, JSValue result) {
+    if (JS_IsException(result) || wrapper->timed_out || wrapper->interrupted) {
+        return result;
+    }
+    JSValue json = JS_JSONStringify(wrapper->ctx, result, JS_UNDEFINED, JS_UNDEFINED);
+    JS_FreeValue(wrapper->ctx, result);
+    return json;
+}
+
+static void *eval_run_without_gvl(void *ptr) {
+    struct eval_run_args *args = (struct eval_run_args *)ptr;
+    ContextWrapper *wrapper = args->wrapper;
+
+    wrapper->gvl_released = 1;
+    args->result = eval_settle(wrapper, args->func(wrapper, args->data));
+    if (wrapper->json_output) {
+        args->result = eval_stringify(wrapper, args->result);
+    }
+    wrapper->gvl_released = 0;
+    args->ran = 1;
+
+    return NULL;
+}
+
+// Unblock function: Ruby calls this (from another thread) when the
+// evaluating thread is interrupted; the interrupt handler then stops JS.
+static void eval_unblock(void *ptr) {
+    ContextWrapper *wrapper = (ContextWrapper *)ptr;
+    wrapper->interrupted = 1;
+
+    // Wake up event_wait
+    pthread_mutex_lock(&wrapper->fetch_mutex);
+    pthread_cond_signal(&wrapper->fetch_cond);
+    pthread_mutex_unlock(&wrapper->fetch_mutex);
+}
+
+static VALUE eval_check_ints(VALUE unused) {
+    rb_thread_check_ints();
+    return Qnil;
+}
+
+// Run `func` and the pending job loop without the GVL so other Ruby
+// threads keep running. Returns the settled result, to be converted by
+// eval_finish (or eval_outcome) with the GVL re-acquired.
+static JSValue eval_execute(ContextWrapper *wrapper, eval_run_func func, void *data) {
+    struct eval_run_args args = { wrapper, func, data, JS_UNDEFINED, 0 };
+
+    eval_begin(wrapper);
+
+    // The _gvl2 variant does not process Ruby interrupts on return, which
+    // would longjmp out before eval_finish cleans up.
+    rb_thread_call_without_gvl2(eval_run_without_gvl, &args, eval_unblock, wrapper);
+    while (!args.ran) {
+        // An interrupt was already pending, so nothing was executed. A timer
+        // interrupt only hands the GVL to another thread: process it and
+        // retry. Anything else raises, and is re-raised after cleanup.
+        int state = 0;
+        rb_protect(eval_check_ints, Qnil, &state);
+        if (state) {
+            VALUE exception = rb_errinfo();
+            rb_set_errinfo(Qnil);
+            if (rb_obj_is_kind_of(exception, rb_eException)) {
+                wrapper->pending_ruby_exception = exception;
+            } else {
+                wrapper->killed = 1;
+            }
+            wrapper->interrupted = 1;
+            break;
+        }
+        rb_thread_call_without_gvl2(eval_run_without_gvl, &args, eval_unblock, wrapper);
+    }
+
+    return args.result;
+}
+
+static VALUE eval_run(ContextWrapper *wrapper, eval_run_func func, void *data) {
+    return eval_finish(wrapper, eval_execute(wrapper, func, data));
+}
+
+// Finish one item of a batch: the item's error (if any) is returned in
+// place of its Result, and GC is left to the end of the batch. An interrupt
+// aborts the whole batch.
+static VALUE eval_batch_item(ContextWrapper *wrapper, JSValue result) {
+    eval_stop(wrapper);
+    if (wrapper->interrupted) {
+        eval_release(wrapper);
+        eval_raise_interrupted(wrapper, result);
+    }
+
+    int failed;
+    return eval_outcome_released(wrapper, result, &failed);
+}
+
+struct eval_code_args {
+    const char *code;
+    size_t len;
+};
+
+// Another thread can modify the caller's String while the GVL is released
+// for the eval: read a frozen String in place, or else a private copy
+// (NUL-terminated, as JS_Eval requires)
+static VALUE stable_string(VALUE str) {
+    if (OBJ_FROZEN(str)) {
+        return str;
+    }
+    return rb_obj_freeze(rb_str_new(RSTRING_PTR(str), RSTRING_LEN(str)));
+}
+
+static JSValue eval_code_func(ContextWrapper *wrapper, void *data) {
+    struct eval_code_args *args = (struct eval_code_args *)data;
+    return JS_Eval(wrapper->ctx, args->code, args->len, "<eval>",
+                   JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_ASYNC);
+}
+
+// Evaluate JavaScript code. With `lazy`, an object result is returned as
+// a Handle instead of being converted.
+static VALUE sandbox_eval(int argc, VALUE *argv, VALUE self) {
+    VALUE code, lazy, profile_interval;
+    rb_scan_args(argc, argv, "12", &code, &lazy, &profile_interval);
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    StringValueCStr(code);
+    code = stable_string(code);
+    struct eval_code_args args = { RSTRING_PTR(code), RSTRING_LEN(code) };
+
+    // Sample the call stack every profile_interval milliseconds
+    if (!NIL_P(profile_interval)) {
+        double interval = NUM2DBL(profile_interval);
+        if (!(interval > 0)) {
+            rb_raise(rb_eArgError, "profile interval must be positive");
+        }
+        wrapper->profile_request_ms = interval;
+    }
+
+    JSValue result = eval_execute(wrapper, eval_code_func, &args);
+    wrapper->lazy_sandbox = RTEST(lazy) ? self : Qnil;
+    RB_GC_GUARD(code);
+    return eval_finish(wrapper, result);
+}
+
+struct eval_module_args {
+    const char *code;
+    size_t len;
+    const char *name;
+    JSValue module;  // Kept to read the namespace once evaluation settles
+};
+
+static JSValue eval_module_func(ContextWrapper *wrapper, void *data) {
+    struct eval_module_args *args = (struct eval_module_args *)data;
+    JSValue module = JS_Eval(wrapper->ctx, args->code, args->len, args->name,
+                             JS_EVAL_TYPE_MODULE | JS_EVAL_FLAG_COMPILE_ONLY);
+    if (JS_IsException(module)) {
+        return module;
+    }
+    args->module = JS_DupValue(wrapper->ctx, module);
+    // Loads the imports, then returns a Promise settled by the module's
+    // (possibly asynchronous) evaluation
+    return JS_EvalFunction(wrapper->ctx, module);
+}
+
+// Evaluate code as an ES module named `name`. Imports are loaded through
+// the sandbox's module_loader; the result is the module's namespace.
+static VALUE sandbox_eval_module(VALUE self, VALUE code, VALUE name) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    StringValueCStr(code);
+    StringValueCStr(name);
+    code = stable_string(code);
+    name = stable_string(name);
+    struct eval_module_args args = { RSTRING_PTR(code), RSTRING_LEN(code), RSTRING_PTR(name), JS_UNDEFINED };
+
+    JSValue result = eval_execute(wrapper, eval_module_func, &args);
+    if (!JS_IsUndefined(args.module)) {
+        if (!JS_IsException(result) && !wrapper->interrupted) {
+            JS_FreeValue(wrapper->ctx, result);
+            result = JS_GetModuleNamespace(wrapper->ctx, JS_VALUE_GET_PTR(args.module));
+        }
+        JS_FreeValue(wrapper->ctx, args.module);
+    }
+    RB_GC_GUARD(code);
+    RB_GC_GUARD(name);
+    return eval_finish(wrapper, result);
+}
+
+// Set the module loader (see module_loader)
+static VALUE sandbox_set_module_loader(VALUE self, VALUE loader) {
+    ContextWrapper *wrapper;
+    TypedData_Get_Struct(self, ContextWrapper, &sandbox_type, wrapper);
+
+    wrapper->module_loader = loader;
+
+    return Qnil;
+}
+
+// Evaluate JavaScript code, returning the result as JSON text
+static VALUE sandbox_eval_json(VALUE self, VALUE code) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    StringValueCStr(code);
+    code = stable_string(code);
+    struct eval_code_args args = { RSTRING_PTR(code), RSTRING_LEN(code) };
+
+    wrapper->json_output = 1;
+    JSValue result = eval_execute(wrapper, eval_code_func, &args);
+    wrapper->json_output = 0;
+
+    RB_GC_GUARD(code);
+    return eval_finish(wrapper, result);
+}
+
+// Compile JavaScript code to bytecode without running it.
+// Returns a binary String that can be passed to eval_bytecode on any
+// sandbox in this process (QuickJS bytecode is not portable across builds).
+// Other Strings, even with the same bytes, are refused (see bytecode_register).
+static VALUE sandbox_compile(VALUE self, VALUE code) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    const char *code_str = StringValueCStr(code);
+
+    eval_begin(wrapper);
+
+    // Use the same flags as eval so compiled code behaves identically
+    JSValue func = JS_Eval(wrapper->ctx, code_str, strlen(code_str), "<eval>",
+                          JS_EVAL_TYPE_GLOBAL | JS_EVAL_FLAG_ASYNC | JS_EVAL_FLAG_COMPILE_ONLY);
+    if (JS_IsException(func)) {
+        // Raises SyntaxError (with console output) via the regular error path
+        return eval_finish(wrapper, func);
+    }
+
+    size_t size = 0;
+    uint8_t *buf = JS_WriteObject(wrapper->ctx, &size, func, JS_WRITE_OBJ_BYTECODE);
+    JS_FreeValue(wrapper->ctx, func);
+    eval_end(wrapper);
+
+    if (!buf) {
+        JS_FreeValue(wrapper->ctx, JS_GetException(wrapper->ctx));
+        rb_raise(rb_eQuickJSMemoryLimitError, "Failed to serialize compiled bytecode");
+    }
+
+    VALUE rb_bytecode = rb_str_new((const char *)buf, size);
+    js_free(wrapper->ctx, buf);
+    return bytecode_register(rb_obj_freeze(rb_bytecode));
+}
+
+struct eval_bytecode_args {
+    const uint8_t *buf;
+    size_t len;
+};
+
+static JSValue eval_bytecode_func(ContextWrapper *wrapper, void *data) {
+    struct eval_bytecode_args *args = (struct eval_bytecode_args *)data;
+    JSValue func = JS_ReadObject(wrapper->ctx, args->buf, args->len, JS_READ_OBJ_BYTECODE);
+    if (JS_IsException(func)) {
+        return func;
+    }
+    return JS_EvalFunction(wrapper->ctx, func);
+}
+
+// Evaluate bytecode produced by compile (skips parsing entirely)
+static VALUE sandbox_eval_bytecode(VALUE self, VALUE bytecode) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    // Registered bytecode is frozen
+    bytecode_check(bytecode);
+    struct eval_bytecode_args args = {
+        (const uint8_t *)RSTRING_PTR(bytecode), RSTRING_LEN(bytecode)
+    };
+
+    VALUE result = eval_run(wrapper, eval_bytecode_func, &args);
+    RB_GC_GUARD(bytecode);
+    return result;
+}
+
+static JSValue run_script_func(ContextWrapper *wrapper, void *data) {
+    JSValue func = *(JSValue *)data;
+    // JS_EvalFunction consumes a reference; the cache keeps its own
+    return JS_EvalFunction(wrapper->ctx, JS_DupValue(wrapper->ctx, func));
+}
+
+// Run bytecode produced by compile, keeping the function object it is read
+// into so running the same script again skips deserialization as well as
+// parsing. Entries are keyed by the identity of the (frozen) bytecode String.
+static VALUE sandbox_run_script(VALUE self, VALUE bytecode) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    StringValue(bytecode);
+    if (!OBJ_FROZEN(bytecode)) {
+        rb_raise(rb_eArgError, "bytecode must be frozen");
+    }
+    bytecode_check(bytecode);
+
+    st_data_t cached;
+    JSValue func;
+    if (st_lookup(wrapper->script_cache, (st_data_t)bytecode, &cached)) {
+        func = JS_MKPTR(JS_TAG_FUNCTION_BYTECODE, (void *)cached);
+    } else {
+        eval_begin(wrapper);
+        func = JS_ReadObject(wrapper->ctx, (const uint8_t *)RSTRING_PTR(bytecode),
+                             RSTRING_LEN(bytecode), JS_READ_OBJ_BYTECODE);
+        if (JS_IsException(func)) {
+            return eval_finish(wrapper, func);
+        }
+        eval_end(wrapper);
+        if (JS_VALUE_GET_TAG(func) != JS_TAG_FUNCTION_BYTECODE) {
+            JS_FreeValue(wrapper->ctx, func);
+            rb_raise(rb_eArgError, "bytecode is not a compiled script");
+        }
+
+        if (wrapper->script_cache->num_entries >= SCRIPT_CACHE_MAX_ENTRIES) {
+            script_cache_clear(wrapper);
+        }
+        st_insert(wrapper->script_cache, (st_data_t)bytecode,
+                  (st_data_t)JS_VALUE_GET_PTR(func));
+    }
+
+    VALUE result = eval_run(wrapper, run_script_func, &func);
+    RB_GC_GUARD(bytecode);
+    return result;
+}
+
+// Look up (or split and cache) the atoms for a dotted function path
+static CallPath *resolve_call_path(ContextWrapper *wrapper, VALUE name) {
+    const char *name_str = StringValueCStr(name);
+    st_data_t cached;
+    if (st_lookup(wrapper->call_paths, (st_data_t)name_str, &cached)) {
+        return (CallPath *)cached;
+    }
+
+    int segments = 1;
+    for (const char *c = name_str; *c; c++) {
+        if (*c == '.') segments++;
+    }
+
+    CallPath *path = malloc(sizeof(CallPath) + segments * sizeof(JSAtom));
+    path->len = 0;
+    const char *start = name_str;
+    for (int i = 0; i < segments; i++) {
+        const char *end = strchr(start, '.');
+        size_t len = end ? (size_t)(end - start) : strlen(start);
+        JSAtom atom = len > 0 ? JS_NewAtomLen(wrapper->ctx, start, len) : JS_ATOM_NULL;
+        if (atom == JS_ATOM_NULL) {
+            for (int j = 0; j < path->len; j++) {
+                JS_FreeAtom(wrapper->ctx, path->atoms[j]);
+            }
+            free(path);
+            if (len == 0) {
+                rb_raise(rb_eArgError, "Invalid function name: %s", name_str);
+            }
+            JS_FreeValue(wrapper->ctx, JS_GetException(wrapper->ctx));
+            rb_raise(rb_eQuickJSMemoryLimitError, "Out of memory resolving function name");
+        }
+        path->atoms[path->len++] = atom;
+        start = end + 1;
+    }
+
+    if (wrapper->call_paths->num_entries >= CALL_PATH_CACHE_MAX_ENTRIES) {
+        call_paths_clear(wrapper);
+    }
+    st_insert(wrapper->call_paths, (st_data_t)strdup(name_str), (st_data_t)path);
+    return path;
+}
+
+struct call_args {
+    ContextWrapper *wrapper;
+    CallPath *path;
+    VALUE rb_args;
+    long capacity;  // Size of argv
+    int argc;  // Number of converted arguments in argv
+    JSValue *argv;
+};
+
+static JSValue call_func(ContextWrapper *wrapper, void *data) {
+    struct call_args *args = (struct call_args *)data;
+    JSContext *ctx = wrapper->ctx;
+
+    // Resolve on every call rather than caching the function itself, so a
+    // function reassigned by later code is picked up. A plain global function
+    // gets an undefined `this`, like a regular fn() call; a method gets its
+    // parent object.
+    JSValue this_obj = JS_UNDEFINED;
+    JSValue func = JS_GetGlobalObject(ctx);
+    for (int i = 0; i < args->path->len; i++) {
+        JSValue parent = func;
+        func = JS_GetProperty(ctx, parent, args->path->atoms[i]);
+        if (i == args->path->len - 1 && i > 0) {
+            this_obj = parent;
         } else {
-            // Still pending, break out
-            break;
+            JS_FreeValue(ctx, parent);
+        }
+        if (JS_IsException(func)) {
+            JS_FreeValue(ctx, this_obj);
+            return func;
         }
     }
 
-    // Clear current wrapper
-    current_wrapper = NULL;
+    JSValue ret;
+    if (JS_IsFunction(ctx, func)) {
+        ret = JS_Call(ctx, func, this_obj, args->argc, args->argv);
+    } else {
+        const char *name = JS_AtomToCString(ctx, args->path->atoms[args->path->len - 1]);
+        ret = JS_ThrowTypeError(ctx, "%s is not a function", name ? name : "value");
+        JS_FreeCString(ctx, name);
+    }
+    JS_FreeValue(ctx, func);
+    JS_FreeValue(ctx, this_obj);
+    return ret;
+}
 
-    // Prepare console output for all return paths
-    VALUE console_output = rb_str_new(wrapper->console_output, wrapper->console_output_len);
-    rb_enc_associate(console_output, rb_utf8_encoding());
-    VALUE console_truncated = wrapper->console_truncated ? Qtrue : Qfalse;
+static VALUE call_body(VALUE ptr) {
+    struct call_args *args = (struct call_args *)ptr;
+    for (long i = 0; i < args->capacity && i < RARRAY_LEN(args->rb_args); i++) {
+        args->argv[i] = ruby_to_js(args->wrapper->ctx, RARRAY_AREF(args->rb_args, i));
+        args->argc++;
+    }
+    return eval_run(args->wrapper, call_func, args);
+}
 
-    // Check for timeout
-    if (wrapper->timed_out) {
-        JS_FreeValue(wrapper->ctx, result);
-        VALUE argv[3] = {
-            rb_str_new2("JavaScript execution timeout exceeded"),
-            console_output,
-            console_truncated
-        };
-        rb_exc_raise(rb_class_new_instance(3, argv, rb_eQuickJSTimeoutError));
+static VALUE call_cleanup(VALUE ptr) {
+    struct call_args *args = (struct call_args *)ptr;
+    for (int i = 0; i < args->argc; i++) {
+        JS_FreeValue(args->wrapper->ctx, args->argv[i]);
     }
+    return Qnil;
+}
 
-    // Check for exception
-    if (JS_IsException(result)) {
-        JSValue exception = JS_GetException(wrapper->ctx);
+// Call a global function (or a method reached through a dotted path, with
+// `this` bound to its parent object) with arguments converted directly
+// from Ruby, without parsing any code.
+static VALUE sandbox_call(VALUE self, VALUE name, VALUE rb_args) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
 
-        // Check if there's a pending Ruby exception (from HTTP callback)
-        // This must be re-raised AFTER QuickJS has cleaned up
-        if (wrapper->pending_ruby_exception != Qnil) {
-            VALUE pending = wrapper->pending_ruby_exception;
-            wrapper->pending_ruby_exception = Qnil;
+    Check_Type(rb_args, T_ARRAY);
+    CallPath *path = resolve_call_path(wrapper, name);
 
-            // Free the JS exception and run GC to clean up
-            JS_FreeValue(wrapper->ctx, exception);
-            JS_RunGC(wrapper->rt);
+    long capacity = RARRAY_LEN(rb_args);
+    VALUE argv_buf = 0;
+    JSValue *argv = ALLOCV_N(JSValue, argv_buf, capacity);
+    struct call_args args = { wrapper, path, rb_args, capacity, 0, argv };
 
-            // Now re-raise the Ruby exception with console output
-            VALUE exc_class = rb_obj_class(pending);
-            VALUE message = rb_funcall(pending, rb_intern("message"), 0);
+    // The arguments are freed even if conversion or the call raises
+    VALUE result = rb_ensure(call_body, (VALUE)&args, call_cleanup, (VALUE)&args);
+    ALLOCV_END(argv_buf);
+    return result;
+}
 
-            // Check if this is one of our HTTP error classes
-            if (exc_class == rb_eQuickJSHTTPBlockedError ||
-                exc_class == rb_eQuickJSHTTPLimitError ||
-                exc_class == rb_eQuickJSHTTPError) {
-                // Create new exception with console output
-                VALUE argv[3] = { message, console_output, console_truncated };
-                VALUE new_exception = rb_class_new_instance(3, argv, exc_class);
-                rb_exc_raise(new_exception);
-            } else {
-                // Re-raise original exception
-                rb_exc_raise(pending);
-            }
-        }
+// Evaluate several scripts back to back. Each script gets its own timeout
+// and console output; errors are returned in place of the script's Result
+// instead of being raised. GC runs once, after the last script.
+static VALUE sandbox_eval_batch(VALUE self, VALUE codes) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    Check_Type(codes, T_ARRAY);
+    // Work on copies so the caller cannot change the array or its
+    // Strings mid-batch
+    codes = rb_ary_dup(codes);
+    long len = RARRAY_LEN(codes);
+    for (long i = 0; i < len; i++) {
+        VALUE code = RARRAY_AREF(codes, i);
+        StringValueCStr(code);
+        rb_ary_store(codes, i, stable_string(code));
+    }
 
-        // Regular JavaScript exception handling
-        // Try to get error message - QuickJS provides js_error_to_string
-        const char *exception_str = JS_ToCString(wrapper->ctx, exception);
+    VALUE results = rb_ary_new_capa(len);
+    for (long i = 0; i < len; i++) {
+        VALUE code = RARRAY_AREF(codes, i);
+        struct eval_code_args args = { RSTRING_PTR(code), RSTRING_LEN(code) };
+        rb_ary_push(results, eval_batch_item(wrapper, eval_execute(wrapper, eval_code_func, &args)));
+    }
 
-        VALUE rb_message;
-        VALUE rb_stack;
-        int is_syntax = 0;
+    eval_collect_garbage(wrapper, len);
+    batch_set_gc_stats(wrapper, results);
+    RB_GC_GUARD(codes);
+    return results;
+}
 
-        if (exception_str) {
-            // Check if it's a syntax error
-            is_syntax = (strncmp(exception_str, "SyntaxError", 11) == 0);
-            rb_message = rb_str_new2(exception_str);
-            rb_stack = rb_str_new2("");  // Will try to get stack separately
-            JS_FreeCString(wrapper->ctx, exception_str);
-        } else {
-            rb_message = rb_str_new2("Unknown JavaScript error");
-            rb_stack = rb_str_new2("");
-        }
+struct call_batch_args {
+    struct call_args call;
+    VALUE args_list;
+    VALUE results;
+};
 
-        // Try to get stack trace if available
-        if (JS_IsObject(exception)) {
-            JSValue stack_val = JS_GetPropertyStr(wrapper->ctx, exception, "stack");
-            if (!JS_IsUndefined(stack_val) && !JS_IsNull(stack_val)) {
-                const char *stack = JS_ToCString(wrapper->ctx, stack_val);
-                if (stack) {
-                    rb_stack = rb_str_new2(stack);
-                    JS_FreeCString(wrapper->ctx, stack);
-                }
-            }
-            JS_FreeValue(wrapper->ctx, stack_val);
+static VALUE call_batch_body(VALUE ptr) {
+    struct call_batch_args *batch = (struct call_batch_args *)ptr;
+    struct call_args *args = &batch->call;
+    ContextWrapper *wrapper = args->wrapper;
+
+    for (long i = 0; i < RARRAY_LEN(batch->args_list); i++) {
+        args->rb_args = RARRAY_AREF(batch->args_list, i);
+        for (long j = 0; j < args->capacity && j < RARRAY_LEN(args->rb_args); j++) {
+            args->argv[j] = ruby_to_js(wrapper->ctx, RARRAY_AREF(args->rb_args, j));
+            args->argc++;
         }
 
-        JS_FreeValue(wrapper->ctx, exception);
+        JSValue result = eval_execute(wrapper, call_func, args);
+        call_cleanup((VALUE)args);
+        args->argc = 0;
 
-        if (is_syntax) {
-            VALUE argv[4] = { rb_message, rb_stack, console_output, console_truncated };
-            rb_exc_raise(rb_class_new_instance(4, argv, rb_eQuickJSSyntaxError));
-        } else {
-            VALUE argv[4] = { rb_message, rb_stack, console_output, console_truncated };
-            rb_exc_raise(rb_class_new_instance(4, argv, rb_eQuickJSJavascriptError));
+        rb_ary_push(batch->results, eval_batch_item(wrapper, result));
+    }
+    return batch->results;
+}
+
+// Call one function once per argument list, with the same per-call
+// isolation as eval_batch
+static VALUE sandbox_call_batch(VALUE self, VALUE name, VALUE args_list) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    Check_Type(args_list, T_ARRAY);
+    long len = RARRAY_LEN(args_list);
+    long capacity = 0;
+    for (long i = 0; i < len; i++) {
+        VALUE item = RARRAY_AREF(args_list, i);
+        Check_Type(item, T_ARRAY);
+        if (RARRAY_LEN(item) > capacity) {
+            capacity = RARRAY_LEN(item);
         }
     }
+    args_list = rb_ary_dup(args_list);
+    CallPath *path = resolve_call_path(wrapper, name);
+
+    VALUE argv_buf = 0;
+    JSValue *argv = ALLOCV_N(JSValue, argv_buf, capacity);
+    struct call_batch_args batch = {
+        { wrapper, path, Qnil, capacity, 0, argv },
+        args_list,
+        rb_ary_new_capa(len)
+    };
 
-    // Convert result to Ruby
-    VALUE rb_result = js_to_ruby(wrapper->ctx, result);
-    JS_FreeValue(wrapper->ctx, result);
+    // Arguments of the running call are freed even if conversion raises or
+    // the batch is interrupted
+    VALUE results = rb_ensure(call_batch_body, (VALUE)&batch, call_cleanup, (VALUE)&batch.call);
+    ALLOCV_END(argv_buf);
 
-    // Run garbage collection to clean up any temporary objects created during evaluation
-    // This is especially important for fetch() responses and other complex objects
-    JS_RunGC(wrapper->rt);
+    eval_collect_garbage(wrapper, len);
+    batch_set_gc_stats(wrapper, results);
+    RB_GC_GUARD(args_list);
+    return results;
+}
 
-    // Return Result object
-    VALUE rb_http_requests = rb_ary_new();  // Empty array for HTTP requests (tracked by Ruby layer)
-    VALUE argv[4] = { rb_result, console_output, console_truncated, rb_http_requests };
-    return rb_class_new_instance(4, argv, rb_cResult);
+// Serialize the named global variables into a binary snapshot.
+// Only data (objects, arrays, primitives, dates, ArrayBuffers) can be
+// serialized; functions raise a JavascriptError. Shared references and
+// cycles are preserved via JS_WRITE_OBJ_REFERENCE.
+static VALUE sandbox_dump_globals(VALUE self, VALUE names) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    Check_Type(names, T_ARRAY);
+    long len = RARRAY_LEN(names);
+    for (long i = 0; i < len; i++) {
+        VALUE name = rb_ary_entry(names, i);
+        StringValueCStr(name);
+    }
+
+    eval_begin(wrapper);
+
+    JSValue global = JS_GetGlobalObject(wrapper->ctx);
+    JSValue snapshot = JS_NewObject(wrapper->ctx);
+    for (long i = 0; i < len; i++) {
+        const char *var_name = RSTRING_PTR(rb_ary_entry(names, i));
+        JS_SetPropertyStr(wrapper->ctx, snapshot, var_name,
+                          JS_GetPropertyStr(wrapper->ctx, global, var_name));
+    }
+    JS_FreeValue(wrapper->ctx, global);
+
+    size_t size = 0;
+    uint8_t *buf = JS_WriteObject(wrapper->ctx, &size, snapshot, JS_WRITE_OBJ_REFERENCE);
+    JS_FreeValue(wrapper->ctx, snapshot);
+    if (!buf) {
+        // Raises JavascriptError (e.g. "unsupported object class") via the regular error path
+        return eval_finish(wrapper, JS_EXCEPTION);
+    }
+    eval_end(wrapper);
+
+    VALUE rb_snapshot = rb_str_new((const char *)buf, size);
+    js_free(wrapper->ctx, buf);
+    return rb_obj_freeze(rb_snapshot);
+}
+
+// Restore global variables from a snapshot produced by dump_globals
+static VALUE sandbox_load_globals(VALUE self, VALUE snapshot) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    StringValue(snapshot);
+
+    eval_begin(wrapper);
+
+    JSValue obj = JS_ReadObject(wrapper->ctx, (const uint8_t *)RSTRING_PTR(snapshot),
+                                RSTRING_LEN(snapshot), JS_READ_OBJ_REFERENCE);
+    if (JS_IsException(obj)) {
+        return eval_finish(wrapper, obj);
+    }
+
+    JSValue global = JS_GetGlobalObject(wrapper->ctx);
+    JSPropertyEnum *props;
+    uint32_t prop_count;
+    if (JS_GetOwnPropertyNames(wrapper->ctx, &props, &prop_count, obj,
+                               JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY) == 0) {
+        for (uint32_t i = 0; i < prop_count; i++) {
+            JSValue val = JS_GetProperty(wrapper->ctx, obj, props[i].atom);
+            JS_SetProperty(wrapper->ctx, global, props[i].atom, val);
+            JS_FreeAtom(wrapper->ctx, props[i].atom);
+        }
+        js_free(wrapper->ctx, props);
+    }
+    JS_FreeValue(wrapper->ctx, global);
+    JS_FreeValue(wrapper->ctx, obj);
+    eval_end(wrapper);
+
+    return Qnil;
 }
 
 // Set a global variable
 static VALUE sandbox_set_variable(VALUE self, VALUE name, VALUE value) {
-    ContextWrapper *wrapper;
-    TypedData_Get_Struct(self, ContextWrapper, &sandbox_type, wrapper);
+    ContextWrapper *wrapper = get_idle_wrapper(self);
 
     const char *var_name = StringValueCStr(name);
 
@@ -813,15 +4220,200 @@ static VALUE sandbox_set_variable(VALUE self, VALUE name, VALUE value) {
         rb_raise(rb_eArgError, "Variable name cannot be empty");
     }
 
-    JSValue global = JS_GetGlobalObject(wrapper->ctx);
+    // Converted first: ruby_to_js raises when a #to_s does
     JSValue js_val = ruby_to_js(wrapper->ctx, value);
+    JSValue global = JS_GetGlobalObject(wrapper->ctx);
+
+    JS_SetPropertyStr(wrapper->ctx, global, var_name, js_val);
+    JS_FreeValue(wrapper->ctx, global);
+
+    return Qnil;
+}
 
+// Set a global variable from JSON text, parsed by the engine
+static VALUE sandbox_set_variable_json(VALUE self, VALUE name, VALUE json) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    const char *var_name = StringValueCStr(name);
+
+    // Validate variable name is not empty
+    if (var_name == NULL || strlen(var_name) == 0) {
+        rb_raise(rb_eArgError, "Variable name cannot be empty");
+    }
+
+    // JS_ParseJSON needs a NUL-terminated buffer
+    const char *json_str = StringValueCStr(json);
+
+    eval_begin(wrapper);
+    JSValue js_val = JS_ParseJSON(wrapper->ctx, json_str, RSTRING_LEN(json), "<json>");
+    if (JS_IsException(js_val)) {
+        // Raises SyntaxError (with console output) via the regular error path
+        eval_finish(wrapper, js_val);
+    }
+    eval_end(wrapper);
+    RB_GC_GUARD(json);
+
+    JSValue global = JS_GetGlobalObject(wrapper->ctx);
     JS_SetPropertyStr(wrapper->ctx, global, var_name, js_val);
     JS_FreeValue(wrapper->ctx, global);
 
     return Qnil;
 }
 
+// Handle whose sandbox can run JavaScript now
+static SandboxHandle *get_live_handle(VALUE self, ContextWrapper **wrapper) {
+    SandboxHandle *handle;
+    TypedData_Get_Struct(self, SandboxHandle, &handle_type, handle);
+
+    if (!handle->wrapper) {
+        rb_raise(rb_eQuickJSError, "Handle is no longer valid (its sandbox was reset or freed)");
+    }
+
+    *wrapper = get_idle_wrapper(handle->sandbox);
+    return handle;
+}
+
+// Read one property (index for Integer keys), converting it the way
+// eval(lazy: true) converts a result. Getters and Proxy traps run with the
+// sandbox's timeout.
+static VALUE handle_aref(VALUE self, VALUE key) {
+    ContextWrapper *wrapper;
+    SandboxHandle *handle = get_live_handle(self, &wrapper);
+    JSContext *ctx = wrapper->ctx;
+
+    uint32_t index = 0;
+    VALUE key_str = Qnil;
+    if (FIXNUM_P(key) && FIX2LONG(key) >= 0 && FIX2LONG(key) < UINT32_MAX) {
+        index = (uint32_t)FIX2LONG(key);
+    } else {
+        key_str = SYMBOL_P(key) ? rb_sym2str(key) : rb_String(key);
+    }
+
+    eval_begin(wrapper);
+    JSValue val;
+    if (NIL_P(key_str)) {
+        val = JS_GetPropertyUint32(ctx, handle->val, index);
+    } else {
+        JSAtom atom = JS_NewAtomLen(ctx, RSTRING_PTR(key_str), RSTRING_LEN(key_str));
+        val = atom == JS_ATOM_NULL ? JS_EXCEPTION : JS_GetProperty(ctx, handle->val, atom);
+        JS_FreeAtom(ctx, atom);
+    }
+    eval_end(wrapper);
+    RB_GC_GUARD(key_str);
+
+    if (JS_IsException(val)) {
+        // Raises the getter's error via the regular error path
+        eval_finish(wrapper, val);
+    }
+    return js_to_ruby_lazy(handle->sandbox, wrapper, val);
+}
+
+// Own enumerable property names, in JavaScript order
+static VALUE handle_keys(VALUE self) {
+    ContextWrapper *wrapper;
+    SandboxHandle *handle = get_live_handle(self, &wrapper);
+    JSContext *ctx = wrapper->ctx;
+    JSPropertyEnum *props;
+    uint32_t prop_count;
+
+    eval_begin(wrapper);
+    int ret = JS_GetOwnPropertyNames(ctx, &props, &prop_count, handle->val,
+                                     JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY);
+    eval_end(wrapper);
+    if (ret != 0) {
+        eval_finish(wrapper, JS_EXCEPTION);
+    }
+
+    VALUE keys = rb_ary_new_capa(prop_count);
+    for (uint32_t i = 0; i < prop_count; i++) {
+        size_t len;
+        const char *key = JS_AtomToCStringLen(ctx, &len, props[i].atom);
+        if (key) {
+            rb_ary_push(keys, rb_utf8_str_new(key, len));
+            JS_FreeCString(ctx, key);
+        }
+    }
+    JS_FreePropertyEnum(ctx, props, prop_count);
+    return keys;
+}
+
+static VALUE handle_array_p(VALUE self) {
+    ContextWrapper *wrapper;
+    SandboxHandle *handle = get_live_handle(self, &wrapper);
+
+    int ret = JS_IsArray(wrapper->ctx, handle->val);
+    if (ret < 0) {
+        // Revoked Proxy
+        JS_FreeValue(wrapper->ctx, JS_GetException(wrapper->ctx));
+    }
+    return ret > 0 ? Qtrue : Qfalse;
+}
+
+static VALUE handle_to_ruby_body(VALUE ptr) {
+    SandboxHandle *handle = (SandboxHandle *)ptr;
+    return js_to_ruby(handle->wrapper->ctx, handle->val);
+}
+
+static VALUE handle_to_ruby_ensure(VALUE ptr) {
+    eval_end((ContextWrapper *)ptr);
+    return Qnil;
+}
+
+// Convert the whole value, like eval without lazy
+static VALUE handle_to_ruby(VALUE self) {
+    ContextWrapper *wrapper;
+    SandboxHandle *handle = get_live_handle(self, &wrapper);
+
+    eval_begin(wrapper);
+    return rb_ensure(handle_to_ruby_body, (VALUE)handle, handle_to_ruby_ensure, (VALUE)wrapper);
+}
+
+static VALUE handle_valid_p(VALUE self) {
+    SandboxHandle *handle;
+    TypedData_Get_Struct(self, SandboxHandle, &handle_type, handle);
+    return handle->wrapper ? Qtrue : Qfalse;
+}
+
+// Expose a Ruby callable as a global JavaScript function. Defining a name
+// again replaces its callable.
+static VALUE sandbox_define_function(VALUE self, VALUE name, VALUE callable) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    const char *func_name = StringValueCStr(name);
+    if (strlen(func_name) == 0) {
+        rb_raise(rb_eArgError, "Function name cannot be empty");
+    }
+
+    if (NIL_P(wrapper->host_functions)) {
+        wrapper->host_functions = rb_ary_new();
+        wrapper->host_function_names = rb_ary_new();
+    }
+
+    long index = RARRAY_LEN(wrapper->host_function_names);
+    for (long i = 0; i < RARRAY_LEN(wrapper->host_function_names); i++) {
+        if (rb_str_equal(RARRAY_AREF(wrapper->host_function_names, i), name) == Qtrue) {
+            index = i;
+            break;
+        }
+    }
+    if (index > INT32_MAX) {
+        rb_raise(rb_eArgError, "Too many functions defined");
+    }
+    if (index == RARRAY_LEN(wrapper->host_function_names)) {
+        rb_ary_push(wrapper->host_function_names, rb_str_new_frozen(name));
+        rb_ary_push(wrapper->host_functions, callable);
+    } else {
+        rb_ary_store(wrapper->host_functions, index, callable);
+    }
+
+    if (install_host_function(wrapper, index) != 0) {
+        JS_FreeValue(wrapper->ctx, JS_GetException(wrapper->ctx));
+        rb_raise(rb_eQuickJSMemoryLimitError, "Out of memory defining function");
+    }
+
+    return Qnil;
+}
+
 // Set HTTP callback
 static VALUE sandbox_set_http_callback(VALUE self, VALUE callback) {
     ContextWrapper *wrapper;
@@ -832,23 +4424,161 @@ static VALUE sandbox_set_http_callback(VALUE self, VALUE callback) {
     return Qnil;
 }
 
+// Set the HTTP executor; fetch() then starts requests with
+// executor.start(method, url, options) and returns a Promise
+static VALUE sandbox_set_http_executor(VALUE self, VALUE executor) {
+    ContextWrapper *wrapper;
+    TypedData_Get_Struct(self, ContextWrapper, &sandbox_type, wrapper);
+
+    wrapper->rb_http_executor = executor;
+
+    return Qnil;
+}
+
+// Called by the executor (from its request threads) when a request
+// completes, to wake up the eval waiting in event_wait. Safe to call
+// while an eval is running.
+static VALUE sandbox_fetch_ready(VALUE self) {
+    ContextWrapper *wrapper;
+    TypedData_Get_Struct(self, ContextWrapper, &sandbox_type, wrapper);
+
+    pthread_mutex_lock(&wrapper->fetch_mutex);
+    wrapper->fetch_completions++;
+    pthread_cond_signal(&wrapper->fetch_cond);
+    pthread_mutex_unlock(&wrapper->fetch_mutex);
+
+    return Qnil;
+}
+
+// Drop the whole runtime of an arena sandbox and create a new one: the
+// arena is released in one go instead of collecting the old context.
+static void sandbox_reset_arena(ContextWrapper *wrapper) {
+    handles_invalidate(wrapper);
+    script_cache_clear(wrapper);
+    call_paths_clear(wrapper);
+    st_foreach(wrapper->pending_fetches, pending_fetch_free_entry, (st_data_t)wrapper->ctx);
+    runtime_free(wrapper);
+
+    if (create_runtime(wrapper) != 0) {
+        rb_raise(rb_eRuntimeError, "Failed to create JavaScript runtime");
+    }
+    update_stack_limit(wrapper->rt);
+}
+
+// Replace the context with a fresh one, keeping the runtime (atom table,
+// shapes, class registrations) and its allocations warm
+static void sandbox_reset_context(ContextWrapper *wrapper) {
+    // Jobs left over from a timed-out or interrupted eval still reference the
+    // old context and would otherwise run during the next eval. QuickJS has
+    // no API to drop them, so run them with the interrupt handler aborting
+    // immediately and fetch() disabled.
+    eval_begin(wrapper);
+    wrapper->discarding = 1;
+    JSContext *ctx1;
+    while (JS_ExecutePendingJob(wrapper->rt, &ctx1) != 0) {
+        JS_FreeValue(wrapper->ctx, JS_GetException(wrapper->ctx));
+    }
+    wrapper->discarding = 0;
+    eval_end(wrapper);
+
+    handles_invalidate(wrapper);
+    script_cache_clear(wrapper);
+    JS_FreeContext(wrapper->ctx);
+    wrapper->ctx = NULL;
+    // Collect the old context's cycles now so they don't count against the
+    // memory limit of the next eval
+    JS_RunGC(wrapper->rt);
+
+    // Like create_runtime, build the context without the memory limit in place
+    int ret;
+    if (wrapper->shared) {
+        ret = create_shared_context(wrapper);
+    } else {
+        JS_SetMemoryLimit(wrapper->rt, (size_t)-1);
+        ret = create_context(wrapper);
+        if (ret == 0) {
+            ret = create_host_functions(wrapper);
+        }
+        JS_SetMemoryLimit(wrapper->rt, wrapper->mem_limit);
+    }
+    if (ret != 0) {
+        rb_raise(rb_eRuntimeError, "Failed to create JavaScript context");
+    }
+}
+
+// Reset the sandbox to a fresh global scope
+static VALUE sandbox_reset(VALUE self) {
+    ContextWrapper *wrapper = get_idle_wrapper(self);
+
+    if (wrapper->use_arena) {
+        sandbox_reset_arena(wrapper);
+    } else {
+        sandbox_reset_context(wrapper);
+    }
+    heap_report(wrapper);
+
+    wrapper->console_output_len = 0;
+    wrapper->console_output[0] = '\0';
+    wrapper->console_truncated = 0;
+    wrapper->pending_ruby_exception = Qnil;
+
+    return Qnil;
+}
+
 // Module initialization
 void Init_quickjs_native(void) {
     // Get reference to QuickJS module (should already exist from Ruby files)
     rb_cQuickJS = rb_const_get(rb_cObject, rb_intern("QuickJS"));
+    id_call = rb_intern("call");
+    VALUE weak_map = rb_const_get(rb_const_get(rb_cObject, rb_intern("ObjectSpace")), rb_intern("WeakMap"));
+    compiled_bytecode = rb_class_new_instance(0, NULL, weak_map);
+    rb_gc_register_mark_object(compiled_bytecode);
 
     // Define NativeSandbox class
     rb_cSandbox = rb_define_class_under(rb_cQuickJS, "NativeSandbox", rb_cObject);
     rb_define_alloc_func(rb_cSandbox, sandbox_alloc);
     rb_define_method(rb_cSandbox, "initialize", sandbox_initialize, 1);
-    rb_define_method(rb_cSandbox, "eval", sandbox_eval, 1);
+    rb_define_method(rb_cSandbox, "eval", sandbox_eval, -1);
+    rb_define_method(rb_cSandbox, "eval_json", sandbox_eval_json, 1);
+    rb_define_method(rb_cSandbox, "eval_module", sandbox_eval_module, 2);
+    rb_define_method(rb_cSandbox, "module_loader=", sandbox_set_module_loader, 1);
+    rb_define_method(rb_cSandbox, "memory_usage", sandbox_memory_usage, 0);
+
+    // Define NativeRuntime class (JSRuntime shared by sandboxes)
+    VALUE rb_cRuntime = rb_define_class_under(rb_cQuickJS, "NativeRuntime", rb_cObject);
+    rb_define_alloc_func(rb_cRuntime, runtime_alloc);
+    rb_define_method(rb_cRuntime, "initialize", runtime_initialize, 1);
+    rb_define_method(rb_cRuntime, "memory_usage", runtime_memory_usage, 0);
+    rb_define_method(rb_cSandbox, "compile", sandbox_compile, 1);
+    rb_define_method(rb_cSandbox, "eval_bytecode", sandbox_eval_bytecode, 1);
+    rb_define_method(rb_cSandbox, "run_script", sandbox_run_script, 1);
+    rb_define_method(rb_cSandbox, "call", sandbox_call, 2);
+    rb_define_method(rb_cSandbox, "eval_batch", sandbox_eval_batch, 1);
+    rb_define_method(rb_cSandbox, "call_batch", sandbox_call_batch, 2);
     rb_define_method(rb_cSandbox, "set_variable", sandbox_set_variable, 2);
+    rb_define_method(rb_cSandbox, "set_variable_json", sandbox_set_variable_json, 2);
+    rb_define_method(rb_cSandbox, "define_function", sandbox_define_function, 2);
+    rb_define_method(rb_cSandbox, "dump_globals", sandbox_dump_globals, 1);
+    rb_define_method(rb_cSandbox, "load_globals", sandbox_load_globals, 1);
     rb_define_method(rb_cSandbox, "http_callback=", sandbox_set_http_callback, 1);
+    rb_define_method(rb_cSandbox, "http_executor=", sandbox_set_http_executor, 1);
+    rb_define_method(rb_cSandbox, "fetch_ready", sandbox_fetch_ready, 0);
+    rb_define_method(rb_cSandbox, "reset", sandbox_reset, 0);
 
     // Get reference to Result class (defined in result.rb)
     rb_cResult = rb_const_get(rb_cQuickJS, rb_intern("Result"));
 
+    // Define QuickJS::Handle class (see lib/quickjs/handle.rb)
+    rb_cHandle = rb_define_class_under(rb_cQuickJS, "Handle", rb_cObject);
+    rb_undef_alloc_func(rb_cHandle);
+    rb_define_method(rb_cHandle, "[]", handle_aref, 1);
+    rb_define_method(rb_cHandle, "keys", handle_keys, 0);
+    rb_define_method(rb_cHandle, "array?", handle_array_p, 0);
+    rb_define_method(rb_cHandle, "to_ruby", handle_to_ruby, 0);
+    rb_define_method(rb_cHandle, "valid?", handle_valid_p, 0);
+
     // Get references to error classes (defined in errors.rb)
+    rb_eQuickJSError = rb_const_get(rb_cQuickJS, rb_intern("Error"));
     rb_eQuickJSSyntaxError = rb_const_get(rb_cQuickJS, rb_intern("SyntaxError"));
     rb_eQuickJSJavascriptError = rb_const_get(rb_cQuickJS, rb_intern("JavascriptError"));
     rb_eQuickJSMemoryLimitError = rb_const_get(rb_cQuickJS, rb_intern("MemoryLimitError"));
@@ -0,0 +1,3160 @@
+/*
+ * Native Web APIs for the sandbox: Headers (Fetch Standard), URL and
+ * URLSearchParams (URL Standard)
+ *
+ * The classes are created per context on first access to their globals
+ * (see web_api_install), so sandboxes that never use them don't carry
+ * their prototypes.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cutils.h"
+#include "libunicode.h"
+#include "quickjs.h"
+#include "web_api.h"
+
+static JSClassID js_headers_class_id;
+static JSClassID js_url_class_id;
+static JSClassID js_url_search_params_class_id;
+
+// Symbol.iterator. Well-known symbols are predefined atoms with the same
+// value in every runtime, so the atom read from the first context is kept.
+static JSAtom web_symbol_iterator;
+
+enum {
+    WEB_CLASS_HEADERS,
+    WEB_CLASS_URL,
+    WEB_CLASS_URL_SEARCH_PARAMS,
+    WEB_CLASS_COUNT
+};
+
+static JSValue web_class_proto(JSContext *ctx, int index);
+
+static inline BOOL is_ascii_alpha(int c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static inline BOOL is_ascii_digit(int c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline BOOL is_ascii_alnum(int c) {
+    return is_ascii_alpha(c) || is_ascii_digit(c);
+}
+
+static inline int ascii_lower(int c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+static void web_dbuf_init(JSContext *ctx, DynBuf *b) {
+    dbuf_init2(b, JS_GetRuntime(ctx), (DynBufReallocFunc *)js_realloc_rt);
+}
+
+// String with the contents of b, which is freed
+static JSValue web_dbuf_to_js(JSContext *ctx, DynBuf *b) {
+    JSValue ret;
+    if (dbuf_error(b)) {
+        ret = JS_ThrowOutOfMemory(ctx);
+    } else if (b->size == 0) {
+        ret = JS_NewString(ctx, "");
+    } else {
+        ret = JS_NewStringLen(ctx, (const char *)b->buf, b->size);
+    }
+    dbuf_free(b);
+    return ret;
+}
+
+// Append UTF-8 text, replacing invalid sequences with U+FFFD the way the
+// WHATWG UTF-8 decoder does. JS_ToCStringLen encodes lone surrogates as
+// 3-byte sequences; with from_js each becomes one U+FFFD, as in the
+// USVString conversion.
+static void web_utf8_append(DynBuf *out, const uint8_t *s, size_t len, BOOL from_js) {
+    static const uint8_t replacement[3] = { 0xef, 0xbf, 0xbd };
+    size_t i = 0;
+
+    while (i < len) {
+        if (s[i] < 0x80) {
+            size_t start = i;
+            while (i < len && s[i] < 0x80) {
+                i++;
+            }
+            dbuf_put(out, s + start, i - start);
+            continue;
+        }
+
+        uint8_t b = s[i], lower = 0x80, upper = 0xbf;
+        int needed = 0;
+        if (b >= 0xc2 && b <= 0xdf) {
+            needed = 1;
+        } else if (b >= 0xe0 && b <= 0xef) {
+            needed = 2;
+            if (b == 0xe0) {
+                lower = 0xa0;
+            } else if (b == 0xed) {
+                if (from_js && i + 2 < len && s[i + 1] >= 0xa0 && (s[i + 2] & 0xc0) == 0x80) {
+                    dbuf_put(out, replacement, 3);
+                    i += 3;
+                    continue;
+                }
+                upper = 0x9f;
+            }
+        } else if (b >= 0xf0 && b <= 0xf4) {
+            needed = 3;
+            if (b == 0xf0) {
+                lower = 0x90;
+            } else if (b == 0xf4) {
+                upper = 0x8f;
+            }
+        }
+
+        size_t j = i + 1;
+        int seen = 0;
+        while (seen < needed && j < len && s[j] >= lower && s[j] <= upper) {
+            lower = 0x80;
+            upper = 0xbf;
+            j++;
+            seen++;
+        }
+        if (needed == 0 || seen < needed) {
+            dbuf_put(out, replacement, 3);
+        } else {
+            dbuf_put(out, s + i, j - i);
+        }
+        i = j;
+    }
+}
+
+// UTF-8 text allocated in the runtime, NUL-terminated
+typedef struct {
+    char *ptr;
+    size_t len;
+} WebString;
+
+// Take over the contents of b
+static int web_string_from_dbuf(JSContext *ctx, DynBuf *b, WebString *out) {
+    if (dbuf_putc(b, '\0') || dbuf_error(b)) {
+        dbuf_free(b);
+        JS_ThrowOutOfMemory(ctx);
+        return -1;
+    }
+    out->ptr = (char *)b->buf;
+    out->len = b->size - 1;
+    return 0;
+}
+
+// ToString(val) as a USVString (lone surrogates replaced)
+static int web_to_usv(JSContext *ctx, JSValueConst val, WebString *out) {
+    size_t len;
+    const char *str = JS_ToCStringLen(ctx, &len, val);
+    if (!str) {
+        return -1;
+    }
+    DynBuf b;
+    web_dbuf_init(ctx, &b);
+    web_utf8_append(&b, (const uint8_t *)str, len, TRUE);
+    JS_FreeCString(ctx, str);
+    return web_string_from_dbuf(ctx, &b, out);
+}
+
+static int web_string_dup(JSContext *ctx, const WebString *s, WebString *out) {
+    out->ptr = js_malloc(ctx, s->len + 1);
+    if (!out->ptr) {
+        return -1;
+    }
+    memcpy(out->ptr, s->ptr, s->len + 1);
+    out->len = s->len;
+    return 0;
+}
+
+static void web_string_free(JSRuntime *rt, WebString *s) {
+    js_free_rt(rt, s->ptr);
+    s->ptr = NULL;
+    s->len = 0;
+}
+
+static BOOL web_string_eq(const WebString *a, const WebString *b) {
+    return a->len == b->len && memcmp(a->ptr, b->ptr, a->len) == 0;
+}
+
+static JSValue web_string_to_js(JSContext *ctx, const WebString *s) {
+    return JS_NewStringLen(ctx, s->ptr, s->len);
+}
+
+typedef struct {
+    WebString name;
+    WebString value;
+} WebPair;
+
+// Ordered name/value list backing Headers and URLSearchParams
+typedef struct {
+    WebPair *pairs;
+    size_t count;
+    size_t capacity;
+} WebPairList;
+
+// Append a pair, taking ownership of name and value
+static int pair_list_push(JSContext *ctx, WebPairList *list, WebString name, WebString value) {
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 4;
+        WebPair *pairs = js_realloc(ctx, list->pairs, capacity * sizeof(*pairs));
+        if (!pairs) {
+            web_string_free(JS_GetRuntime(ctx), &name);
+            web_string_free(JS_GetRuntime(ctx), &value);
+            return -1;
+        }
+        list->pairs = pairs;
+        list->capacity = capacity;
+    }
+    list->pairs[list->count].name = name;
+    list->pairs[list->count].value = value;
+    list->count++;
+    return 0;
+}
+
+static void pair_list_remove(JSRuntime *rt, WebPairList *list, size_t index) {
+    web_string_free(rt, &list->pairs[index].name);
+    web_string_free(rt, &list->pairs[index].value);
+    memmove(list->pairs + index, list->pairs + index + 1,
+            (list->count - index - 1) * sizeof(*list->pairs));
+    list->count--;
+}
+
+static void pair_list_clear(JSRuntime *rt, WebPairList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        web_string_free(rt, &list->pairs[i].name);
+        web_string_free(rt, &list->pairs[i].value);
+    }
+    list->count = 0;
+}
+
+static void pair_list_free(JSRuntime *rt, WebPairList *list) {
+    pair_list_clear(rt, list);
+    js_free_rt(rt, list->pairs);
+    list->pairs = NULL;
+    list->capacity = 0;
+}
+
+static int pair_list_copy(JSContext *ctx, WebPairList *dst, const WebPairList *src) {
+    for (size_t i = 0; i < src->count; i++) {
+        WebString name, value;
+        if (web_string_dup(ctx, &src->pairs[i].name, &name)) {
+            return -1;
+        }
+        if (web_string_dup(ctx, &src->pairs[i].value, &value)) {
+            web_string_free(JS_GetRuntime(ctx), &name);
+            return -1;
+        }
+        if (pair_list_push(ctx, dst, name, value)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// What keys(), values() and entries() iterate over
+typedef enum {
+    WEB_ITER_KEYS,
+    WEB_ITER_VALUES,
+    WEB_ITER_ENTRIES
+} WebIterKind;
+
+static JSValue web_iter_item(JSContext *ctx, WebIterKind kind, const WebString *name,
+                             const char *value, size_t value_len) {
+    if (kind == WEB_ITER_KEYS) {
+        return web_string_to_js(ctx, name);
+    }
+    if (kind == WEB_ITER_VALUES) {
+        return JS_NewStringLen(ctx, value, value_len);
+    }
+
+    JSValue entry = JS_NewArray(ctx);
+    if (JS_IsException(entry)) {
+        return entry;
+    }
+    JSValue name_val = web_string_to_js(ctx, name);
+    if (JS_IsException(name_val) ||
+        JS_DefinePropertyValueUint32(ctx, entry, 0, name_val, JS_PROP_C_W_E) < 0) {
+        JS_FreeValue(ctx, entry);
+        return JS_EXCEPTION;
+    }
+    JSValue value_val = JS_NewStringLen(ctx, value, value_len);
+    if (JS_IsException(value_val) ||
+        JS_DefinePropertyValueUint32(ctx, entry, 1, value_val, JS_PROP_C_W_E) < 0) {
+        JS_FreeValue(ctx, entry);
+        return JS_EXCEPTION;
+    }
+    return entry;
+}
+
+// An iterator over the elements of array (which is consumed)
+static JSValue web_array_iterator(JSContext *ctx, JSValue array) {
+    if (JS_IsException(array)) {
+        return array;
+    }
+    JSValue method = JS_GetProperty(ctx, array, web_symbol_iterator);
+    JSValue iterator = JS_IsException(method) ? JS_EXCEPTION : JS_Call(ctx, method, array, 0, NULL);
+    JS_FreeValue(ctx, method);
+    JS_FreeValue(ctx, array);
+    return iterator;
+}
+
+typedef int WebForOfFunc(JSContext *ctx, JSValueConst value, void *opaque);
+
+// for (const value of obj) fn(value), where method is obj[Symbol.iterator].
+// Returns -1 with a pending exception.
+static int web_for_of(JSContext *ctx, JSValueConst obj, JSValueConst method,
+                      WebForOfFunc *fn, void *opaque) {
+    JSValue iterator = JS_Call(ctx, method, obj, 0, NULL);
+    if (JS_IsException(iterator)) {
+        return -1;
+    }
+    JSValue next = JS_GetPropertyStr(ctx, iterator, "next");
+    int ret = -1;
+    if (JS_IsException(next)) {
+        goto out;
+    }
+
+    for (;;) {
+        JSValue result = JS_Call(ctx, next, iterator, 0, NULL);
+        if (JS_IsException(result)) {
+            goto out;
+        }
+        if (!JS_IsObject(result)) {
+            JS_FreeValue(ctx, result);
+            JS_ThrowTypeError(ctx, "iterator result is not an object");
+            goto out;
+        }
+        JSValue done_val = JS_GetPropertyStr(ctx, result, "done");
+        int done = JS_IsException(done_val) ? -1 : JS_ToBool(ctx, done_val);
+        JS_FreeValue(ctx, done_val);
+        if (done) {
+            JS_FreeValue(ctx, result);
+            ret = done < 0 ? -1 : 0;
+            goto out;
+        }
+        JSValue value = JS_GetPropertyStr(ctx, result, "value");
+        JS_FreeValue(ctx, result);
+        if (JS_IsException(value)) {
+            goto out;
+        }
+        int status = fn(ctx, value, opaque);
+        JS_FreeValue(ctx, value);
+        if (status < 0) {
+            goto out;
+        }
+    }
+
+out:
+    JS_FreeValue(ctx, next);
+    JS_FreeValue(ctx, iterator);
+    return ret;
+}
+
+// The first two values of a [name, value] initializer item, and how many
+// it had
+typedef struct {
+    JSValue values[2];
+    int count;
+} WebPairValues;
+
+static int collect_pair_value(JSContext *ctx, JSValueConst value, void *opaque) {
+    WebPairValues *pair = opaque;
+    if (pair->count < 2) {
+        pair->values[pair->count] = JS_DupValue(ctx, value);
+    }
+    pair->count++;
+    return 0;
+}
+
+static int web_get_pair(JSContext *ctx, JSValueConst item, WebPairValues *pair) {
+    pair->values[0] = JS_UNDEFINED;
+    pair->values[1] = JS_UNDEFINED;
+    pair->count = 0;
+
+    JSValue method = JS_IsObject(item) ? JS_GetProperty(ctx, item, web_symbol_iterator) : JS_UNDEFINED;
+    if (JS_IsException(method)) {
+        return -1;
+    }
+    int ret;
+    if (!JS_IsFunction(ctx, method)) {
+        JS_ThrowTypeError(ctx, "The provided value cannot be converted to a sequence.");
+        ret = -1;
+    } else {
+        ret = web_for_of(ctx, item, method, collect_pair_value, pair);
+    }
+    JS_FreeValue(ctx, method);
+    return ret;
+}
+
+static void web_pair_values_free(JSContext *ctx, WebPairValues *pair) {
+    JS_FreeValue(ctx, pair->values[0]);
+    JS_FreeValue(ctx, pair->values[1]);
+}
+
+typedef int WebRecordFunc(JSContext *ctx, JSValueConst name, JSValueConst value, void *opaque);
+
+// fn(key, obj[key]) for the own enumerable string keys of obj
+static int web_for_each_record(JSContext *ctx, JSValueConst obj, WebRecordFunc *fn, void *opaque) {
+    JSPropertyEnum *tab;
+    uint32_t len;
+    if (JS_GetOwnPropertyNames(ctx, &tab, &len, obj, JS_GPN_STRING_MASK | JS_GPN_ENUM_ONLY)) {
+        return -1;
+    }
+
+    int ret = 0;
+    for (uint32_t i = 0; i < len && ret == 0; i++) {
+        JSValue name = JS_AtomToString(ctx, tab[i].atom);
+        JSValue value = JS_GetProperty(ctx, obj, tab[i].atom);
+        if (JS_IsException(name) || JS_IsException(value)) {
+            ret = -1;
+        } else {
+            ret = fn(ctx, name, value, opaque);
+        }
+        JS_FreeValue(ctx, name);
+        JS_FreeValue(ctx, value);
+    }
+    JS_FreePropertyEnum(ctx, tab, len);
+    return ret;
+}
+
+// Instance of a class for `new`, with the prototype of new_target so
+// subclasses work
+static JSValue web_new_object(JSContext *ctx, JSValueConst new_target, JSClassID class_id) {
+    JSValue proto = JS_GetPropertyStr(ctx, new_target, "prototype");
+    if (JS_IsException(proto)) {
+        return proto;
+    }
+    if (!JS_IsObject(proto)) {
+        JS_FreeValue(ctx, proto);
+        proto = JS_GetClassProto(ctx, class_id);
+    }
+    JSValue obj = JS_NewObjectProtoClass(ctx, proto, class_id);
+    JS_FreeValue(ctx, proto);
+    return obj;
+}
+
+// Headers (https://fetch.spec.whatwg.org/#headers-class)
+
+typedef struct {
+    WebPairList list;  // Header list: lowercased names, in insertion order
+} WebHeaders;
+
+static void js_headers_finalizer(JSRuntime *rt, JSValue val) {
+    WebHeaders *headers = JS_GetOpaque(val, js_headers_class_id);
+    if (headers) {
+        pair_list_free(rt, &headers->list);
+        js_free_rt(rt, headers);
+    }
+}
+
+static BOOL is_token_char(uint8_t c) {
+    return is_ascii_alnum(c) || (c != '\0' && strchr("!#$%&'*+-.^_`|~", c) != NULL);
+}
+
+static BOOL is_http_whitespace(uint8_t c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Header name, checked to be an HTTP token and lowercased
+static int headers_name(JSContext *ctx, JSValueConst val, WebString *out) {
+    if (web_to_usv(ctx, val, out)) {
+        return -1;
+    }
+    BOOL valid = out->len > 0;
+    for (size_t i = 0; i < out->len && valid; i++) {
+        valid = is_token_char(out->ptr[i]);
+    }
+    if (!valid) {
+        JS_ThrowTypeError(ctx, "Invalid character in header field name: \"%s\"", out->ptr);
+        web_string_free(JS_GetRuntime(ctx), out);
+        return -1;
+    }
+    for (size_t i = 0; i < out->len; i++) {
+        out->ptr[i] = ascii_lower(out->ptr[i]);
+    }
+    return 0;
+}
+
+// Header value without leading and trailing whitespace
+static int headers_value(JSContext *ctx, JSValueConst val, WebString *out) {
+    if (web_to_usv(ctx, val, out)) {
+        return -1;
+    }
+    size_t start = 0, end = out->len;
+    while (start < end && is_http_whitespace(out->ptr[start])) {
+        start++;
+    }
+    while (end > start && is_http_whitespace(out->ptr[end - 1])) {
+        end--;
+    }
+    for (size_t i = start; i < end; i++) {
+        char c = out->ptr[i];
+        if (c == '\0' || c == '\n' || c == '\r') {
+            JS_ThrowTypeError(ctx, "Invalid header value");
+            web_string_free(JS_GetRuntime(ctx), out);
+            return -1;
+        }
+    }
+    memmove(out->ptr, out->ptr + start, end - start);
+    out->len = end - start;
+    out->ptr[out->len] = '\0';
+    return 0;
+}
+
+static int headers_append(JSContext *ctx, WebHeaders *headers, JSValueConst name_val, JSValueConst value_val) {
+    WebString name, value;
+    if (headers_name(ctx, name_val, &name)) {
+        return -1;
+    }
+    if (headers_value(ctx, value_val, &value)) {
+        web_string_free(JS_GetRuntime(ctx), &name);
+        return -1;
+    }
+    return pair_list_push(ctx, &headers->list, name, value);
+}
+
+static int headers_append_item(JSContext *ctx, JSValueConst item, void *opaque) {
+    WebPairValues pair;
+    int ret = web_get_pair(ctx, item, &pair);
+    if (ret == 0 && pair.count != 2) {
+        JS_ThrowTypeError(ctx, "Headers constructor: expected name/value pair to be length 2, found %d", pair.count);
+        ret = -1;
+    }
+    if (ret == 0) {
+        ret = headers_append(ctx, opaque, pair.values[0], pair.values[1]);
+    }
+    web_pair_values_free(ctx, &pair);
+    return ret;
+}
+
+static int headers_append_entry(JSContext *ctx, JSValueConst name, JSValueConst value, void *opaque) {
+    return headers_append(ctx, opaque, name, value);
+}
+
+// Fill from another Headers, a sequence of [name, value] pairs or a record
+static int headers_fill(JSContext *ctx, WebHeaders *headers, JSValueConst init) {
+    if (JS_IsUndefined(init) || JS_IsNull(init)) {
+        return 0;
+    }
+    if (!JS_IsObject(init)) {
+        JS_ThrowTypeError(ctx, "Failed to construct 'Headers': The provided value is not of type "
+                               "'(record<ByteString, ByteString> or sequence<sequence<ByteString>>)'");
+        return -1;
+    }
+
+    WebHeaders *other = JS_GetOpaque(init, js_headers_class_id);
+    if (other) {
+        return pair_list_copy(ctx, &headers->list, &other->list);
+    }
+
+    JSValue method = JS_GetProperty(ctx, init, web_symbol_iterator);
+    if (JS_IsException(method)) {
+        return -1;
+    }
+    int ret;
+    if (JS_IsUndefined(method) || JS_IsNull(method)) {
+        ret = web_for_each_record(ctx, init, headers_append_entry, headers);
+    } else if (!JS_IsFunction(ctx, method)) {
+        JS_ThrowTypeError(ctx, "Failed to construct 'Headers': The object must have a callable @@iterator property.");
+        ret = -1;
+    } else {
+        ret = web_for_of(ctx, init, method, headers_append_item, headers);
+    }
+    JS_FreeValue(ctx, method);
+    return ret;
+}
+
+static JSValue js_headers_constructor(JSContext *ctx, JSValueConst new_target, int argc, JSValueConst *argv) {
+    JSValue obj = web_new_object(ctx, new_target, js_headers_class_id);
+    if (JS_IsException(obj)) {
+        return obj;
+    }
+    WebHeaders *headers = js_mallocz(ctx, sizeof(*headers));
+    if (!headers) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    JS_SetOpaque(obj, headers);
+
+    if (argc > 0 && headers_fill(ctx, headers, argv[0])) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    return obj;
+}
+
+static JSValue js_headers_append(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebHeaders *headers = JS_GetOpaque2(ctx, this_val, js_headers_class_id);
+    if (!headers || headers_append(ctx, headers, argv[0], argv[1])) {
+        return JS_EXCEPTION;
+    }
+    return JS_UNDEFINED;
+}
+
+static JSValue js_headers_delete(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebHeaders *headers = JS_GetOpaque2(ctx, this_val, js_headers_class_id);
+    WebString name;
+    if (!headers || headers_name(ctx, argv[0], &name)) {
+        return JS_EXCEPTION;
+    }
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    for (size_t i = headers->list.count; i-- > 0;) {
+        if (web_string_eq(&headers->list.pairs[i].name, &name)) {
+            pair_list_remove(rt, &headers->list, i);
+        }
+    }
+    web_string_free(rt, &name);
+    return JS_UNDEFINED;
+}
+
+// Values of a header combined with ", ", or null
+static JSValue js_headers_get(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebHeaders *headers = JS_GetOpaque2(ctx, this_val, js_headers_class_id);
+    WebString name;
+    if (!headers || headers_name(ctx, argv[0], &name)) {
+        return JS_EXCEPTION;
+    }
+
+    DynBuf b;
+    web_dbuf_init(ctx, &b);
+    BOOL found = FALSE;
+    for (size_t i = 0; i < headers->list.count; i++) {
+        const WebPair *pair = &headers->list.pairs[i];
+        if (web_string_eq(&pair->name, &name)) {
+            if (found) {
+                dbuf_putstr(&b, ", ");
+            }
+            dbuf_put(&b, (const uint8_t *)pair->value.ptr, pair->value.len);
+            found = TRUE;
+        }
+    }
+    web_string_free(JS_GetRuntime(ctx), &name);
+
+    if (!found) {
+        dbuf_free(&b);
+        return JS_NULL;
+    }
+    return web_dbuf_to_js(ctx, &b);
+}
+
+static JSValue js_headers_get_set_cookie(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebHeaders *headers = JS_GetOpaque2(ctx, this_val, js_headers_class_id);
+    if (!headers) {
+        return JS_EXCEPTION;
+    }
+    JSValue array = JS_NewArray(ctx);
+    uint32_t index = 0;
+    for (size_t i = 0; i < headers->list.count && !JS_IsException(array); i++) {
+        const WebPair *pair = &headers->list.pairs[i];
+        if (pair->name.len == 10 && memcmp(pair->name.ptr, "set-cookie", 10) == 0) {
+            JSValue value = web_string_to_js(ctx, &pair->value);
+            if (JS_IsException(value) ||
+                JS_DefinePropertyValueUint32(ctx, array, index++, value, JS_PROP_C_W_E) < 0) {
+                JS_FreeValue(ctx, array);
+                array = JS_EXCEPTION;
+            }
+        }
+    }
+    return array;
+}
+
+static JSValue js_headers_has(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebHeaders *headers = JS_GetOpaque2(ctx, this_val, js_headers_class_id);
+    WebString name;
+    if (!headers || headers_name(ctx, argv[0], &name)) {
+        return JS_EXCEPTION;
+    }
+    BOOL found = FALSE;
+    for (size_t i = 0; i < headers->list.count && !found; i++) {
+        found = web_string_eq(&headers->list.pairs[i].name, &name);
+    }
+    web_string_free(JS_GetRuntime(ctx), &name);
+    return JS_NewBool(ctx, found);
+}
+
+// Replace the first header of that name, removing the others
+static JSValue js_headers_set(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebHeaders *headers = JS_GetOpaque2(ctx, this_val, js_headers_class_id);
+    WebString name, value;
+    if (!headers || headers_name(ctx, argv[0], &name)) {
+        return JS_EXCEPTION;
+    }
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    if (headers_value(ctx, argv[1], &value)) {
+        web_string_free(rt, &name);
+        return JS_EXCEPTION;
+    }
+
+    size_t first = headers->list.count;
+    for (size_t i = headers->list.count; i-- > 0;) {
+        if (web_string_eq(&headers->list.pairs[i].name, &name)) {
+            if (first < headers->list.count) {
+                pair_list_remove(rt, &headers->list, first);
+            }
+            first = i;
+        }
+    }
+    if (first < headers->list.count) {
+        WebPair *pair = &headers->list.pairs[first];
+        web_string_free(rt, &pair->value);
+        pair->value = value;
+        web_string_free(rt, &name);
+        return JS_UNDEFINED;
+    }
+    if (pair_list_push(ctx, &headers->list, name, value)) {
+        return JS_EXCEPTION;
+    }
+    return JS_UNDEFINED;
+}
+
+typedef struct {
+    const WebPair *pair;
+    size_t index;
+} WebSortItem;
+
+static int compare_header_names(const void *a, const void *b) {
+    const WebSortItem *x = a, *y = b;
+    size_t len = min_int(x->pair->name.len, y->pair->name.len);
+    int cmp = memcmp(x->pair->name.ptr, y->pair->name.ptr, len);
+    if (cmp == 0 && x->pair->name.len != y->pair->name.len) {
+        cmp = x->pair->name.len < y->pair->name.len ? -1 : 1;
+    }
+    if (cmp == 0) {
+        cmp = x->index < y->index ? -1 : 1;
+    }
+    return cmp;
+}
+
+// The headers as iterated over: sorted by name, with the values of each
+// name combined (except Set-Cookie, whose values stay separate)
+static JSValue headers_sorted(JSContext *ctx, WebHeaders *headers, WebIterKind kind, uint32_t *pcount) {
+    size_t count = headers->list.count;
+    WebSortItem *items = js_malloc(ctx, (count ? count : 1) * sizeof(*items));
+    if (!items) {
+        return JS_EXCEPTION;
+    }
+    for (size_t i = 0; i < count; i++) {
+        items[i].pair = &headers->list.pairs[i];
+        items[i].index = i;
+    }
+    qsort(items, count, sizeof(*items), compare_header_names);
+
+    JSValue array = JS_NewArray(ctx);
+    DynBuf value;
+    web_dbuf_init(ctx, &value);
+    uint32_t index = 0;
+    for (size_t i = 0; i < count && !JS_IsException(array);) {
+        const WebString *name = &items[i].pair->name;
+        BOOL set_cookie = name->len == 10 && memcmp(name->ptr, "set-cookie", 10) == 0;
+        value.size = 0;
+        dbuf_put(&value, (const uint8_t *)items[i].pair->value.ptr, items[i].pair->value.len);
+        for (i++; !set_cookie && i < count && web_string_eq(&items[i].pair->name, name); i++) {
+            dbuf_putstr(&value, ", ");
+            dbuf_put(&value, (const uint8_t *)items[i].pair->value.ptr, items[i].pair->value.len);
+        }
+
+        JSValue item = dbuf_error(&value)
+            ? JS_ThrowOutOfMemory(ctx)
+            : web_iter_item(ctx, kind, name, (const char *)value.buf, value.size);
+        if (JS_IsException(item) ||
+            JS_DefinePropertyValueUint32(ctx, array, index++, item, JS_PROP_C_W_E) < 0) {
+            JS_FreeValue(ctx, array);
+            array = JS_EXCEPTION;
+        }
+    }
+    dbuf_free(&value);
+    js_free(ctx, items);
+    if (pcount) {
+        *pcount = index;
+    }
+    return array;
+}
+
+static JSValue js_headers_for_each(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebHeaders *headers = JS_GetOpaque2(ctx, this_val, js_headers_class_id);
+    if (!headers) {
+        return JS_EXCEPTION;
+    }
+    if (!JS_IsFunction(ctx, argv[0])) {
+        return JS_ThrowTypeError(ctx, "Headers.forEach: callback is not a function");
+    }
+    JSValueConst this_arg = argc > 1 ? argv[1] : JS_UNDEFINED;
+
+    uint32_t count;
+    JSValue entries = headers_sorted(ctx, headers, WEB_ITER_ENTRIES, &count);
+    if (JS_IsException(entries)) {
+        return entries;
+    }
+    JSValue ret = JS_UNDEFINED;
+    for (uint32_t i = 0; i < count && !JS_IsException(ret); i++) {
+        JSValue entry = JS_GetPropertyUint32(ctx, entries, i);
+        JSValue args[3] = {
+            JS_GetPropertyUint32(ctx, entry, 1),
+            JS_GetPropertyUint32(ctx, entry, 0),
+            JS_DupValue(ctx, this_val)
+        };
+        ret = JS_Call(ctx, argv[0], this_arg, 3, (JSValueConst *)args);
+        if (!JS_IsException(ret)) {
+            JS_FreeValue(ctx, ret);
+            ret = JS_UNDEFINED;
+        }
+        for (int j = 0; j < 3; j++) {
+            JS_FreeValue(ctx, args[j]);
+        }
+        JS_FreeValue(ctx, entry);
+    }
+    JS_FreeValue(ctx, entries);
+    return ret;
+}
+
+static JSValue js_headers_iterator(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
+    WebHeaders *headers = JS_GetOpaque2(ctx, this_val, js_headers_class_id);
+    if (!headers) {
+        return JS_EXCEPTION;
+    }
+    return web_array_iterator(ctx, headers_sorted(ctx, headers, magic, NULL));
+}
+
+static const JSCFunctionListEntry js_headers_proto_funcs[] = {
+    JS_CFUNC_DEF("append", 2, js_headers_append),
+    JS_CFUNC_DEF("delete", 1, js_headers_delete),
+    JS_CFUNC_DEF("get", 1, js_headers_get),
+    JS_CFUNC_DEF("getSetCookie", 0, js_headers_get_set_cookie),
+    JS_CFUNC_DEF("has", 1, js_headers_has),
+    JS_CFUNC_DEF("set", 2, js_headers_set),
+    JS_CFUNC_DEF("forEach", 1, js_headers_for_each),
+    JS_CFUNC_MAGIC_DEF("keys", 0, js_headers_iterator, WEB_ITER_KEYS),
+    JS_CFUNC_MAGIC_DEF("values", 0, js_headers_iterator, WEB_ITER_VALUES),
+    JS_CFUNC_MAGIC_DEF("entries", 0, js_headers_iterator, WEB_ITER_ENTRIES),
+    JS_ALIAS_DEF("[Symbol.iterator]", "entries"),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "Headers", JS_PROP_CONFIGURABLE),
+};
+
+// application/x-www-form-urlencoded
+// (https://url.spec.whatwg.org/#application/x-www-form-urlencoded)
+
+static void percent_encode_byte(DynBuf *out, uint8_t c) {
+    static const char hex[] = "0123456789ABCDEF";
+    uint8_t encoded[3] = { '%', hex[c >> 4], hex[c & 15] };
+    dbuf_put(out, encoded, 3);
+}
+
+static void percent_decode(DynBuf *out, const uint8_t *s, size_t len, BOOL plus_as_space) {
+    for (size_t i = 0; i < len; i++) {
+        if (s[i] == '%' && i + 2 < len && from_hex(s[i + 1]) >= 0 && from_hex(s[i + 2]) >= 0) {
+            dbuf_putc(out, from_hex(s[i + 1]) * 16 + from_hex(s[i + 2]));
+            i += 2;
+        } else if (s[i] == '+' && plus_as_space) {
+            dbuf_putc(out, ' ');
+        } else {
+            dbuf_putc(out, s[i]);
+        }
+    }
+}
+
+static void form_encode(DynBuf *out, const WebString *s) {
+    for (size_t i = 0; i < s->len; i++) {
+        uint8_t c = s->ptr[i];
+        if (is_ascii_alnum(c) || c == '*' || c == '-' || c == '.' || c == '_') {
+            dbuf_putc(out, c);
+        } else if (c == ' ') {
+            dbuf_putc(out, '+');
+        } else {
+            percent_encode_byte(out, c);
+        }
+    }
+}
+
+static int form_decode(JSContext *ctx, const uint8_t *s, size_t len, WebString *out) {
+    DynBuf bytes, text;
+    web_dbuf_init(ctx, &bytes);
+    web_dbuf_init(ctx, &text);
+    percent_decode(&bytes, s, len, TRUE);
+    web_utf8_append(&text, bytes.buf, bytes.size, FALSE);
+    if (dbuf_error(&bytes)) {
+        dbuf_set_error(&text);
+    }
+    dbuf_free(&bytes);
+    return web_string_from_dbuf(ctx, &text, out);
+}
+
+static void search_params_serialize(DynBuf *out, const WebPairList *list) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (i > 0) {
+            dbuf_putc(out, '&');
+        }
+        form_encode(out, &list->pairs[i].name);
+        dbuf_putc(out, '=');
+        form_encode(out, &list->pairs[i].value);
+    }
+}
+
+static int search_params_parse(JSContext *ctx, WebPairList *list, const uint8_t *s, size_t len) {
+    size_t start = 0;
+    while (start < len) {
+        const uint8_t *sequence = s + start;
+        const uint8_t *amp = memchr(sequence, '&', len - start);
+        size_t sequence_len = amp ? (size_t)(amp - sequence) : len - start;
+
+        if (sequence_len > 0) {
+            const uint8_t *eq = memchr(sequence, '=', sequence_len);
+            size_t name_len = eq ? (size_t)(eq - sequence) : sequence_len;
+            WebString name, value;
+            if (form_decode(ctx, sequence, name_len, &name)) {
+                return -1;
+            }
+            if (form_decode(ctx, eq ? eq + 1 : sequence + sequence_len,
+                            eq ? sequence_len - name_len - 1 : 0, &value)) {
+                web_string_free(JS_GetRuntime(ctx), &name);
+                return -1;
+            }
+            if (pair_list_push(ctx, list, name, value)) {
+                return -1;
+            }
+        }
+        start += sequence_len + 1;
+    }
+    return 0;
+}
+
+// URL records (https://url.spec.whatwg.org/#concept-url)
+
+// The path is kept serialized: "/" followed by each segment, or the opaque
+// path itself
+typedef struct {
+    DynBuf scheme;  // Lowercase, without the trailing ":"
+    DynBuf username;
+    DynBuf password;
+    DynBuf host;    // Serialized (with brackets around IPv6 addresses)
+    DynBuf path;
+    DynBuf query;
+    DynBuf fragment;
+    int port;       // -1 for null
+    BOOL has_host;
+    BOOL has_query;
+    BOOL has_fragment;
+    BOOL opaque_path;
+} URLRecord;
+
+// Results of url_parse
+#define URL_FAILURE -1    // Not a valid URL
+#define URL_NO_MEMORY -2
+
+typedef enum {
+    URL_STATE_NONE,
+    URL_STATE_SCHEME_START,
+    URL_STATE_SCHEME,
+    URL_STATE_NO_SCHEME,
+    URL_STATE_SPECIAL_RELATIVE_OR_AUTHORITY,
+    URL_STATE_PATH_OR_AUTHORITY,
+    URL_STATE_RELATIVE,
+    URL_STATE_RELATIVE_SLASH,
+    URL_STATE_SPECIAL_AUTHORITY_SLASHES,
+    URL_STATE_SPECIAL_AUTHORITY_IGNORE_SLASHES,
+    URL_STATE_AUTHORITY,
+    URL_STATE_HOST,
+    URL_STATE_HOSTNAME,
+    URL_STATE_PORT,
+    URL_STATE_FILE,
+    URL_STATE_FILE_SLASH,
+    URL_STATE_FILE_HOST,
+    URL_STATE_PATH_START,
+    URL_STATE_PATH,
+    URL_STATE_OPAQUE_PATH,
+    URL_STATE_QUERY,
+    URL_STATE_FRAGMENT
+} URLState;
+
+static void url_record_init(JSContext *ctx, URLRecord *url) {
+    memset(url, 0, sizeof(*url));
+    web_dbuf_init(ctx, &url->scheme);
+    web_dbuf_init(ctx, &url->username);
+    web_dbuf_init(ctx, &url->password);
+    web_dbuf_init(ctx, &url->host);
+    web_dbuf_init(ctx, &url->path);
+    web_dbuf_init(ctx, &url->query);
+    web_dbuf_init(ctx, &url->fragment);
+    url->port = -1;
+}
+
+static void url_record_free(URLRecord *url) {
+    dbuf_free(&url->scheme);
+    dbuf_free(&url->username);
+    dbuf_free(&url->password);
+    dbuf_free(&url->host);
+    dbuf_free(&url->path);
+    dbuf_free(&url->query);
+    dbuf_free(&url->fragment);
+}
+
+static BOOL url_record_error(URLRecord *url) {
+    return dbuf_error(&url->scheme) || dbuf_error(&url->username) || dbuf_error(&url->password) ||
+           dbuf_error(&url->host) || dbuf_error(&url->path) || dbuf_error(&url->query) ||
+           dbuf_error(&url->fragment);
+}
+
+static void buf_set(DynBuf *b, const void *data, size_t len) {
+    b->size = 0;
+    if (len > 0) {
+        dbuf_put(b, data, len);
+    }
+}
+
+static void buf_copy(DynBuf *dst, const DynBuf *src) {
+    buf_set(dst, src->buf, src->size);
+}
+
+static BOOL buf_eq(const DynBuf *b, const char *s) {
+    size_t len = strlen(s);
+    return b->size == len && (len == 0 || memcmp(b->buf, s, len) == 0);
+}
+
+static int url_record_copy(JSContext *ctx, URLRecord *dst, const URLRecord *src) {
+    url_record_init(ctx, dst);
+    buf_copy(&dst->scheme, &src->scheme);
+    buf_copy(&dst->username, &src->username);
+    buf_copy(&dst->password, &src->password);
+    buf_copy(&dst->host, &src->host);
+    buf_copy(&dst->path, &src->path);
+    buf_copy(&dst->query, &src->query);
+    buf_copy(&dst->fragment, &src->fragment);
+    dst->port = src->port;
+    dst->has_host = src->has_host;
+    dst->has_query = src->has_query;
+    dst->has_fragment = src->has_fragment;
+    dst->opaque_path = src->opaque_path;
+    if (url_record_error(dst)) {
+        url_record_free(dst);
+        return -1;
+    }
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    int port;
+} special_schemes[] = {
+    { "ftp", 21 },
+    { "file", -1 },
+    { "http", 80 },
+    { "https", 443 },
+    { "ws", 80 },
+    { "wss", 443 },
+};
+
+static int special_scheme_index(const DynBuf *scheme) {
+    for (size_t i = 0; i < countof(special_schemes); i++) {
+        if (buf_eq(scheme, special_schemes[i].name)) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static BOOL url_is_special(const URLRecord *url) {
+    return special_scheme_index(&url->scheme) >= 0;
+}
+
+static int url_default_port(const URLRecord *url) {
+    int index = special_scheme_index(&url->scheme);
+    return index < 0 ? -1 : special_schemes[index].port;
+}
+
+static BOOL url_has_credentials(const URLRecord *url) {
+    return url->username.size > 0 || url->password.size > 0;
+}
+
+static BOOL url_cannot_have_credentials(const URLRecord *url) {
+    return !url->has_host || url->host.size == 0 || buf_eq(&url->scheme, "file");
+}
+
+// Potentially strip trailing spaces from an opaque path
+static void url_strip_trailing_spaces(URLRecord *url) {
+    if (!url->opaque_path || url->has_fragment || url->has_query) {
+        return;
+    }
+    while (url->path.size > 0 && url->path.buf[url->path.size - 1] == ' ') {
+        url->path.size--;
+    }
+}
+
+// Percent-encode sets (https://url.spec.whatwg.org/#percent-encoded-bytes)
+typedef enum {
+    ENCODE_C0_CONTROL,
+    ENCODE_FRAGMENT,
+    ENCODE_QUERY,
+    ENCODE_SPECIAL_QUERY,
+    ENCODE_PATH,
+    ENCODE_USERINFO
+} URLEncodeSet;
+
+static BOOL url_should_encode(uint8_t c, URLEncodeSet set) {
+    if (c < 0x20 || c > 0x7e) {
+        return TRUE;
+    }
+    switch (set) {
+    case ENCODE_C0_CONTROL:
+        return FALSE;
+    case ENCODE_FRAGMENT:
+        return c == ' ' || c == '"' || c == '<' || c == '>' || c == '`';
+    case ENCODE_SPECIAL_QUERY:
+        if (c == '\'') {
+            return TRUE;
+        }
+        return c == ' ' || c == '"' || c == '#' || c == '<' || c == '>';
+    case ENCODE_USERINFO:
+        if (c == '/' || c == ':' || c == ';' || c == '=' || c == '@' || (c >= '[' && c <= '^') || c == '|') {
+            return TRUE;
+        }
+        // fall through
+    case ENCODE_PATH:
+        if (c == '?' || c == '`' || c == '{' || c == '}') {
+            return TRUE;
+        }
+        // fall through
+    case ENCODE_QUERY:
+        return c == ' ' || c == '"' || c == '#' || c == '<' || c == '>';
+    }
+    return FALSE;
+}
+
+static void url_encode(DynBuf *out, uint8_t c, URLEncodeSet set) {
+    if (url_should_encode(c, set)) {
+        percent_encode_byte(out, c);
+    } else {
+        dbuf_putc(out, c);
+    }
+}
+
+static BOOL is_forbidden_host_code_point(uint8_t c) {
+    return c == '\0' || c == '\t' || c == '\n' || c == '\r' || c == ' ' || c == '#' || c == '/' ||
+           c == ':' || c == '<' || c == '>' || c == '?' || c == '@' || c == '[' || c == '\\' ||
+           c == ']' || c == '^' || c == '|';
+}
+
+static BOOL is_forbidden_domain_code_point(uint8_t c) {
+    return is_forbidden_host_code_point(c) || c <= 0x1f || c == '%' || c == 0x7f;
+}
+
+// IPv4 number (https://url.spec.whatwg.org/#ipv4-number-parser): decimal,
+// 0x-prefixed hexadecimal or 0-prefixed octal. Large values saturate at 2^32.
+static int ipv4_number(const uint8_t *s, size_t len, uint64_t *out) {
+    int radix = 10;
+    if (len == 0) {
+        return -1;
+    }
+    if (len >= 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {
+        radix = 16;
+        s += 2;
+        len -= 2;
+    } else if (len >= 2 && s[0] == '0') {
+        radix = 8;
+        s++;
+        len--;
+    }
+
+    uint64_t value = 0;
+    for (size_t i = 0; i < len; i++) {
+        int digit = from_hex(s[i]);
+        if (digit < 0 || digit >= radix) {
+            return -1;
+        }
+        value = value * radix + digit;
+        if (value > ((uint64_t)1 << 32)) {
+            value = (uint64_t)1 << 32;
+        }
+    }
+    *out = value;
+    return 0;
+}
+
+// Does the last label look like a number, making the host an IPv4 address
+static BOOL ends_in_a_number(const uint8_t *s, size_t len) {
+    if (len > 0 && s[len - 1] == '.') {
+        len--;
+    }
+    size_t start = len;
+    while (start > 0 && s[start - 1] != '.') {
+        start--;
+    }
+
+    BOOL digits = start < len;
+    for (size_t i = start; i < len && digits; i++) {
+        digits = is_ascii_digit(s[i]);
+    }
+    uint64_t value;
+    return digits || ipv4_number(s + start, len - start, &value) == 0;
+}
+
+static int ipv4_parse(const uint8_t *s, size_t len, uint32_t *out) {
+    uint64_t numbers[4];
+    int count = 0;
+
+    if (len > 0 && s[len - 1] == '.') {
+        len--;
+    }
+    for (size_t start = 0;;) {
+        size_t end = start;
+        while (end < len && s[end] != '.') {
+            end++;
+        }
+        if (count == 4 || ipv4_number(s + start, end - start, &numbers[count]) < 0) {
+            return -1;
+        }
+        count++;
+        if (end >= len) {
+            break;
+        }
+        start = end + 1;
+    }
+
+    for (int i = 0; i < count - 1; i++) {
+        if (numbers[i] > 255) {
+            return -1;
+        }
+    }
+    if (numbers[count - 1] >= (uint64_t)1 << (8 * (5 - count))) {
+        return -1;
+    }
+    uint64_t ipv4 = numbers[count - 1];
+    for (int i = 0; i < count - 1; i++) {
+        ipv4 += numbers[i] << (8 * (3 - i));
+    }
+    *out = (uint32_t)ipv4;
+    return 0;
+}
+
+// https://url.spec.whatwg.org/#concept-ipv6-parser
+static int ipv6_parse(const uint8_t *s, size_t len, uint16_t address[8]) {
+#define AT(i) ((i) < len ? (int)s[i] : -1)
+    int piece_index = 0, compress = -1;
+    size_t p = 0;
+
+    memset(address, 0, 8 * sizeof(address[0]));
+    if (AT(p) == ':') {
+        if (AT(p + 1) != ':') {
+            return -1;
+        }
+        p += 2;
+        compress = ++piece_index;
+    }
+
+    while (AT(p) != -1) {
+        if (piece_index == 8) {
+            return -1;
+        }
+        if (AT(p) == ':') {
+            if (compress >= 0) {
+                return -1;
+            }
+            p++;
+            compress = ++piece_index;
+            continue;
+        }
+
+        int value = 0, length = 0;
+        while (length < 4 && from_hex(AT(p)) >= 0) {
+            value = value * 16 + from_hex(AT(p));
+            p++;
+            length++;
+        }
+
+        if (AT(p) == '.') {
+            // Trailing IPv4 address
+            if (length == 0 || piece_index > 6) {
+                return -1;
+            }
+            p -= length;
+            int numbers_seen = 0;
+            while (AT(p) != -1) {
+                int ipv4_piece = -1;
+                if (numbers_seen > 0) {
+                    if (AT(p) != '.' || numbers_seen >= 4) {
+                        return -1;
+                    }
+                    p++;
+                }
+                if (!is_ascii_digit(AT(p))) {
+                    return -1;
+                }
+                while (is_ascii_digit(AT(p))) {
+                    int number = AT(p) - '0';
+                    if (ipv4_piece < 0) {
+                        ipv4_piece = number;
+                    } else if (ipv4_piece == 0) {
+                        return -1;
+                    } else {
+                        ipv4_piece = ipv4_piece * 10 + number;
+                    }
+                    if (ipv4_piece > 255) {
+                        return -1;
+                    }
+                    p++;
+                }
+                address[piece_index] = address[piece_index] * 0x100 + ipv4_piece;
+                numbers_seen++;
+                if (numbers_seen == 2 || numbers_seen == 4) {
+                    piece_index++;
+                }
+            }
+            if (numbers_seen != 4) {
+                return -1;
+            }
+            break;
+        } else if (AT(p) == ':') {
+            p++;
+            if (AT(p) == -1) {
+                return -1;
+            }
+        } else if (AT(p) != -1) {
+            return -1;
+        }
+        address[piece_index++] = value;
+    }
+#undef AT
+
+    if (compress >= 0) {
+        int swaps = piece_index - compress;
+        piece_index = 7;
+        while (piece_index != 0 && swaps > 0) {
+            uint16_t piece = address[piece_index];
+            address[piece_index] = address[compress + swaps - 1];
+            address[compress + swaps - 1] = piece;
+            piece_index--;
+            swaps--;
+        }
+    } else if (piece_index != 8) {
+        return -1;
+    }
+    return 0;
+}
+
+// Compressing the first longest run of zero pieces
+static void ipv6_serialize(DynBuf *out, const uint16_t address[8]) {
+    int compress = -1, longest = 1;
+    for (int i = 0; i < 8;) {
+        int j = i;
+        while (j < 8 && address[j] == 0) {
+            j++;
+        }
+        if (j - i > longest) {
+            longest = j - i;
+            compress = i;
+        }
+        i = j > i ? j : i + 1;
+    }
+
+    BOOL ignore0 = FALSE;
+    for (int i = 0; i < 8; i++) {
+        if (ignore0 && address[i] == 0) {
+            continue;
+        }
+        ignore0 = FALSE;
+        if (compress == i) {
+            dbuf_putstr(out, i == 0 ? "::" : ":");
+            ignore0 = TRUE;
+            continue;
+        }
+        dbuf_printf(out, "%x", address[i]);
+        if (i != 7) {
+            dbuf_putc(out, ':');
+        }
+    }
+}
+
+// Punycode (RFC 3492)
+static uint32_t punycode_adapt(uint32_t delta, uint32_t points, BOOL first) {
+    delta = first ? delta / 700 : delta / 2;
+    delta += delta / points;
+    uint32_t k = 0;
+    while (delta > ((36 - 1) * 26) / 2) {
+        delta /= 36 - 1;
+        k += 36;
+    }
+    return k + (36 * delta) / (delta + 38);
+}
+
+static int punycode_encode(DynBuf *out, const uint32_t *input, size_t len) {
+    uint32_t n = 128, delta = 0, bias = 72;
+    size_t basic = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (input[i] < 0x80) {
+            dbuf_putc(out, input[i]);
+            basic++;
+        }
+    }
+    if (basic > 0) {
+        dbuf_putc(out, '-');
+    }
+
+    for (size_t h = basic; h < len;) {
+        uint32_t m = UINT32_MAX;
+        for (size_t i = 0; i < len; i++) {
+            if (input[i] >= n && input[i] < m) {
+                m = input[i];
+            }
+        }
+        if ((uint64_t)(m - n) * (h + 1) > UINT32_MAX - delta) {
+            return -1;
+        }
+        delta += (m - n) * (h + 1);
+        n = m;
+
+        for (size_t i = 0; i < len; i++) {
+            if (input[i] < n && ++delta == 0) {
+                return -1;
+            }
+            if (input[i] != n) {
+                continue;
+            }
+            uint32_t q = delta;
+            for (uint32_t k = 36;; k += 36) {
+                uint32_t t = k <= bias ? 1 : k >= bias + 26 ? 26 : k - bias;
+                if (q < t) {
+                    break;
+                }
+                uint32_t digit = t + (q - t) % (36 - t);
+                dbuf_putc(out, digit < 26 ? 'a' + digit : '0' + digit - 26);
+                q = (q - t) / (36 - t);
+            }
+            dbuf_putc(out, q < 26 ? 'a' + q : '0' + q - 26);
+            bias = punycode_adapt(delta, h + 1, h == basic);
+            delta = 0;
+            h++;
+        }
+        delta++;
+        n++;
+    }
+    return 0;
+}
+
+// Lowercase a label, Punycode-encoding it if it is not ASCII. This covers
+// the common cases of UTS #46 processing without its mapping tables.
+static int domain_label_to_ascii(JSContext *ctx, DynBuf *out, const uint8_t *s, size_t len) {
+    size_t i = 0;
+    while (i < len && s[i] < 0x80) {
+        i++;
+    }
+    if (i == len) {
+        for (i = 0; i < len; i++) {
+            dbuf_putc(out, ascii_lower(s[i]));
+        }
+        return 0;
+    }
+
+    DynBuf points;
+    web_dbuf_init(ctx, &points);
+    BOOL ascii = TRUE;
+    int ret = 0;
+    for (const uint8_t *p = s, *end = s + len; p < end && ret == 0;) {
+        int c = unicode_from_utf8(p, end - p, &p);
+        if (c < 0) {
+            ret = -1;
+            break;
+        }
+        uint32_t lower[LRE_CC_RES_LEN_MAX];
+        int count = lre_case_conv(lower, c, 1);
+        for (int k = 0; k < count; k++) {
+            dbuf_put_u32(&points, lower[k]);
+            ascii = ascii && lower[k] < 0x80;
+        }
+    }
+
+    const uint32_t *cps = (const uint32_t *)points.buf;
+    size_t count = points.size / sizeof(uint32_t);
+    if (ret == 0 && dbuf_error(&points)) {
+        dbuf_set_error(out);
+    } else if (ret == 0 && ascii) {
+        for (i = 0; i < count; i++) {
+            dbuf_putc(out, cps[i]);
+        }
+    } else if (ret == 0) {
+        dbuf_putstr(out, "xn--");
+        ret = punycode_encode(out, cps, count);
+    }
+    dbuf_free(&points);
+    return ret;
+}
+
+static int domain_to_ascii(JSContext *ctx, DynBuf *out, const uint8_t *s, size_t len) {
+    for (size_t start = 0;;) {
+        const uint8_t *dot = memchr(s + start, '.', len - start);
+        size_t end = dot ? (size_t)(dot - s) : len;
+        if (domain_label_to_ascii(ctx, out, s + start, end - start) < 0) {
+            return -1;
+        }
+        if (!dot) {
+            break;
+        }
+        dbuf_putc(out, '.');
+        start = end + 1;
+    }
+    return out->size > 0 ? 0 : -1;
+}
+
+// https://url.spec.whatwg.org/#concept-host-parser
+static int url_parse_host(JSContext *ctx, DynBuf *out, const uint8_t *s, size_t len, BOOL is_opaque) {
+    out->size = 0;
+
+    if (len > 0 && s[0] == '[') {
+        uint16_t address[8];
+        if (s[len - 1] != ']' || ipv6_parse(s + 1, len - 2, address) < 0) {
+            return -1;
+        }
+        dbuf_putc(out, '[');
+        ipv6_serialize(out, address);
+        dbuf_putc(out, ']');
+        return 0;
+    }
+
+    if (is_opaque) {
+        for (size_t i = 0; i < len; i++) {
+            if (is_forbidden_host_code_point(s[i])) {
+                return -1;
+            }
+        }
+        for (size_t i = 0; i < len; i++) {
+            url_encode(out, s[i], ENCODE_C0_CONTROL);
+        }
+        return 0;
+    }
+
+    DynBuf domain;
+    web_dbuf_init(ctx, &domain);
+    percent_decode(&domain, s, len, FALSE);
+    int ret = dbuf_error(&domain) ? -1 : domain_to_ascii(ctx, out, domain.buf, domain.size);
+    dbuf_free(&domain);
+    if (ret < 0) {
+        return -1;
+    }
+
+    for (size_t i = 0; i < out->size; i++) {
+        if (is_forbidden_domain_code_point(out->buf[i])) {
+            return -1;
+        }
+    }
+    if (ends_in_a_number(out->buf, out->size)) {
+        uint32_t ipv4;
+        if (ipv4_parse(out->buf, out->size, &ipv4) < 0) {
+            return -1;
+        }
+        out->size = 0;
+        dbuf_printf(out, "%u.%u.%u.%u", ipv4 >> 24, (ipv4 >> 16) & 0xff, (ipv4 >> 8) & 0xff, ipv4 & 0xff);
+    }
+    return 0;
+}
+
+static BOOL is_windows_drive_letter(const uint8_t *s, size_t len, BOOL normalized) {
+    return len == 2 && is_ascii_alpha(s[0]) && (s[1] == ':' || (!normalized && s[1] == '|'));
+}
+
+static BOOL starts_with_windows_drive_letter(const uint8_t *s, size_t len) {
+    return len >= 2 && is_windows_drive_letter(s, 2, FALSE) &&
+           (len == 2 || s[2] == '/' || s[2] == '\\' || s[2] == '?' || s[2] == '#');
+}
+
+// Whether the first path segment is a normalized Windows drive letter
+static BOOL path_starts_with_drive_letter(const DynBuf *path) {
+    return path->size >= 3 && is_windows_drive_letter(path->buf + 1, 2, TRUE) &&
+           (path->size == 3 || path->buf[3] == '/');
+}
+
+// Remove the last path segment
+static void url_shorten_path(URLRecord *url) {
+    DynBuf *path = &url->path;
+    if (buf_eq(&url->scheme, "file") && path->size == 3 && path_starts_with_drive_letter(path)) {
+        return;
+    }
+    while (path->size > 0 && path->buf[--path->size] != '/') {
+    }
+}
+
+// Length of a leading "." or "%2e" (case-insensitive) in s, or 0
+static size_t dot_length(const uint8_t *s, size_t len) {
+    if (len >= 1 && s[0] == '.') {
+        return 1;
+    }
+    if (len >= 3 && s[0] == '%' && s[1] == '2' && (s[2] == 'e' || s[2] == 'E')) {
+        return 3;
+    }
+    return 0;
+}
+
+static BOOL is_single_dot_segment(const DynBuf *b) {
+    size_t dot = dot_length(b->buf, b->size);
+    return dot > 0 && dot == b->size;
+}
+
+static BOOL is_double_dot_segment(const DynBuf *b) {
+    size_t first = dot_length(b->buf, b->size);
+    if (first == 0) {
+        return FALSE;
+    }
+    size_t second = dot_length(b->buf + first, b->size - first);
+    return second > 0 && first + second == b->size;
+}
+
+static void url_copy_authority(URLRecord *url, const URLRecord *base) {
+    buf_copy(&url->username, &base->username);
+    buf_copy(&url->password, &base->password);
+    buf_copy(&url->host, &base->host);
+    url->has_host = base->has_host;
+    url->port = base->port;
+}
+
+static void url_copy_query(URLRecord *url, const URLRecord *base) {
+    buf_copy(&url->query, &base->query);
+    url->has_query = base->has_query;
+}
+
+static void url_set_empty(DynBuf *b, BOOL *present) {
+    b->size = 0;
+    *present = TRUE;
+}
+
+// Basic URL parser (https://url.spec.whatwg.org/#concept-basic-url-parser).
+// Without a state override url must be freshly initialized; with one, url
+// is modified in place and may be partly updated when parsing fails.
+// Returns 0, URL_FAILURE or URL_NO_MEMORY.
+static int url_parse(JSContext *ctx, URLRecord *url, const uint8_t *input, size_t input_len,
+                     const URLRecord *base, URLState state_override) {
+    DynBuf in, buf;
+    web_dbuf_init(ctx, &in);
+    web_dbuf_init(ctx, &buf);
+
+    // Strip surrounding C0 controls and spaces, remove tabs and newlines
+    const uint8_t *start = input, *end = input + input_len;
+    if (!state_override) {
+        while (start < end && *start <= ' ') {
+            start++;
+        }
+        while (end > start && end[-1] <= ' ') {
+            end--;
+        }
+    }
+    while (start < end) {
+        const uint8_t *run = start;
+        while (start < end && *start != '\t' && *start != '\n' && *start != '\r') {
+            start++;
+        }
+        web_utf8_append(&in, run, start - run, TRUE);
+        if (start < end) {
+            start++;
+        }
+    }
+
+    const uint8_t *s = in.buf;
+    ptrdiff_t n = in.size, p;
+    URLState state = state_override ? state_override : URL_STATE_SCHEME_START;
+    BOOL special = url_is_special(url);
+    BOOL at_sign_seen = FALSE, inside_brackets = FALSE, password_token_seen = FALSE;
+    int ret = URL_FAILURE;
+
+#define NEXT_IS(ch) (p + 1 < n && s[p + 1] == (ch))
+    for (p = 0;; p++) {
+        int c = p < n ? s[p] : -1;
+
+        switch (state) {
+        case URL_STATE_NONE:
+        case URL_STATE_SCHEME_START:
+            if (is_ascii_alpha(c)) {
+                dbuf_putc(&buf, ascii_lower(c));
+                state = URL_STATE_SCHEME;
+            } else if (!state_override) {
+                state = URL_STATE_NO_SCHEME;
+                p--;
+            } else {
+                goto fail;
+            }
+            break;
+
+        case URL_STATE_SCHEME:
+            if (is_ascii_alnum(c) || c == '+' || c == '-' || c == '.') {
+                dbuf_putc(&buf, ascii_lower(c));
+            } else if (c == ':') {
+                if (state_override) {
+                    BOOL buffer_special = special_scheme_index(&buf) >= 0;
+                    if (special != buffer_special ||
+                        ((url_has_credentials(url) || url->port >= 0) && buf_eq(&buf, "file")) ||
+                        (buf_eq(&url->scheme, "file") && url->has_host && url->host.size == 0)) {
+                        goto done;
+                    }
+                }
+                buf_copy(&url->scheme, &buf);
+                special = url_is_special(url);
+                if (state_override) {
+                    if (url->port >= 0 && url->port == url_default_port(url)) {
+                        url->port = -1;
+                    }
+                    goto done;
+                }
+                buf.size = 0;
+                if (buf_eq(&url->scheme, "file")) {
+                    state = URL_STATE_FILE;
+                } else if (special && base && base->scheme.size == url->scheme.size &&
+                           memcmp(base->scheme.buf, url->scheme.buf, url->scheme.size) == 0) {
+                    state = URL_STATE_SPECIAL_RELATIVE_OR_AUTHORITY;
+                } else if (special) {
+                    state = URL_STATE_SPECIAL_AUTHORITY_SLASHES;
+                } else if (NEXT_IS('/')) {
+                    state = URL_STATE_PATH_OR_AUTHORITY;
+                    p++;
+                } else {
+                    url->path.size = 0;
+                    url->opaque_path = TRUE;
+                    state = URL_STATE_OPAQUE_PATH;
+                }
+            } else if (!state_override) {
+                buf.size = 0;
+                state = URL_STATE_NO_SCHEME;
+                p = -1;
+            } else {
+                goto fail;
+            }
+            break;
+
+        case URL_STATE_NO_SCHEME:
+            if (!base || (base->opaque_path && c != '#')) {
+                goto fail;
+            }
+            if (base->opaque_path) {
+                buf_copy(&url->scheme, &base->scheme);
+                special = url_is_special(url);
+                buf_copy(&url->path, &base->path);
+                url->opaque_path = TRUE;
+                url_copy_query(url, base);
+                url_set_empty(&url->fragment, &url->has_fragment);
+                state = URL_STATE_FRAGMENT;
+            } else {
+                state = buf_eq(&base->scheme, "file") ? URL_STATE_FILE : URL_STATE_RELATIVE;
+                p--;
+            }
+            break;
+
+        case URL_STATE_SPECIAL_RELATIVE_OR_AUTHORITY:
+            if (c == '/' && NEXT_IS('/')) {
+                state = URL_STATE_SPECIAL_AUTHORITY_IGNORE_SLASHES;
+                p++;
+            } else {
+                state = URL_STATE_RELATIVE;
+                p--;
+            }
+            break;
+
+        case URL_STATE_PATH_OR_AUTHORITY:
+            if (c == '/') {
+                state = URL_STATE_AUTHORITY;
+            } else {
+                state = URL_STATE_PATH;
+                p--;
+            }
+            break;
+
+        case URL_STATE_RELATIVE:
+            buf_copy(&url->scheme, &base->scheme);
+            special = url_is_special(url);
+            if (c == '/' || (special && c == '\\')) {
+                state = URL_STATE_RELATIVE_SLASH;
+            } else {
+                url_copy_authority(url, base);
+                buf_copy(&url->path, &base->path);
+                url_copy_query(url, base);
+                if (c == '?') {
+                    url_set_empty(&url->query, &url->has_query);
+                    state = URL_STATE_QUERY;
+                } else if (c == '#') {
+                    url_set_empty(&url->fragment, &url->has_fragment);
+                    state = URL_STATE_FRAGMENT;
+                } else if (c != -1) {
+                    url->query.size = 0;
+                    url->has_query = FALSE;
+                    url_shorten_path(url);
+                    state = URL_STATE_PATH;
+                    p--;
+                }
+            }
+            break;
+
+        case URL_STATE_RELATIVE_SLASH:
+            if (special && (c == '/' || c == '\\')) {
+                state = URL_STATE_SPECIAL_AUTHORITY_IGNORE_SLASHES;
+            } else if (c == '/') {
+                state = URL_STATE_AUTHORITY;
+            } else {
+                url_copy_authority(url, base);
+                state = URL_STATE_PATH;
+                p--;
+            }
+            break;
+
+        case URL_STATE_SPECIAL_AUTHORITY_SLASHES:
+            state = URL_STATE_SPECIAL_AUTHORITY_IGNORE_SLASHES;
+            if (c == '/' && NEXT_IS('/')) {
+                p++;
+            } else {
+                p--;
+            }
+            break;
+
+        case URL_STATE_SPECIAL_AUTHORITY_IGNORE_SLASHES:
+            if (c != '/' && c != '\\') {
+                state = URL_STATE_AUTHORITY;
+                p--;
+            }
+            break;
+
+        case URL_STATE_AUTHORITY:
+            if (c == '@') {
+                if (at_sign_seen) {
+                    // An earlier "@" was part of the credentials
+                    dbuf_put(&buf, (const uint8_t *)"%40", 3);
+                    if (!dbuf_error(&buf)) {
+                        memmove(buf.buf + 3, buf.buf, buf.size - 3);
+                        memcpy(buf.buf, "%40", 3);
+                    }
+                }
+                at_sign_seen = TRUE;
+                for (size_t i = 0; i < buf.size; i++) {
+                    if (buf.buf[i] == ':' && !password_token_seen) {
+                        password_token_seen = TRUE;
+                        continue;
+                    }
+                    url_encode(password_token_seen ? &url->password : &url->username, buf.buf[i], ENCODE_USERINFO);
+                }
+                buf.size = 0;
+            } else if (c == -1 || c == '/' || c == '?' || c == '#' || (special && c == '\\')) {
+                if (at_sign_seen && buf.size == 0) {
+                    goto fail;
+                }
+                p -= (ptrdiff_t)buf.size + 1;
+                buf.size = 0;
+                state = URL_STATE_HOST;
+            } else {
+                dbuf_putc(&buf, c);
+            }
+            break;
+
+        case URL_STATE_HOST:
+        case URL_STATE_HOSTNAME:
+            if (state_override && buf_eq(&url->scheme, "file")) {
+                p--;
+                state = URL_STATE_FILE_HOST;
+            } else if (c == ':' && !inside_brackets) {
+                if (buf.size == 0 || state_override == URL_STATE_HOSTNAME ||
+                    url_parse_host(ctx, &url->host, buf.buf, buf.size, !special) < 0) {
+                    goto fail;
+                }
+                url->has_host = TRUE;
+                buf.size = 0;
+                state = URL_STATE_PORT;
+            } else if (c == -1 || c == '/' || c == '?' || c == '#' || (special && c == '\\')) {
+                p--;
+                if (special && buf.size == 0) {
+                    goto fail;
+                }
+                if (state_override && buf.size == 0 && (url_has_credentials(url) || url->port >= 0)) {
+                    goto fail;
+                }
+                if (url_parse_host(ctx, &url->host, buf.buf, buf.size, !special) < 0) {
+                    goto fail;
+                }
+                url->has_host = TRUE;
+                buf.size = 0;
+                state = URL_STATE_PATH_START;
+                if (state_override) {
+                    goto done;
+                }
+            } else {
+                if (c == '[') {
+                    inside_brackets = TRUE;
+                } else if (c == ']') {
+                    inside_brackets = FALSE;
+                }
+                dbuf_putc(&buf, c);
+            }
+            break;
+
+        case URL_STATE_PORT:
+            if (is_ascii_digit(c)) {
+                dbuf_putc(&buf, c);
+            } else if (c == -1 || c == '/' || c == '?' || c == '#' || (special && c == '\\') || state_override) {
+                if (buf.size > 0) {
+                    int port = 0;
+                    for (size_t i = 0; i < buf.size; i++) {
+                        port = port * 10 + (buf.buf[i] - '0');
+                        if (port > 65535) {
+                            goto fail;
+                        }
+                    }
+                    url->port = port == url_default_port(url) ? -1 : port;
+                    buf.size = 0;
+                }
+                if (state_override) {
+                    goto done;
+                }
+                state = URL_STATE_PATH_START;
+                p--;
+            } else {
+                goto fail;
+            }
+            break;
+
+        case URL_STATE_FILE:
+            buf_set(&url->scheme, "file", 4);
+            special = TRUE;
+            url_set_empty(&url->host, &url->has_host);
+            if (c == '/' || c == '\\') {
+                state = URL_STATE_FILE_SLASH;
+            } else if (base && buf_eq(&base->scheme, "file")) {
+                buf_copy(&url->host, &base->host);
+                url->has_host = base->has_host;
+                buf_copy(&url->path, &base->path);
+                url_copy_query(url, base);
+                if (c == '?') {
+                    url_set_empty(&url->query, &url->has_query);
+                    state = URL_STATE_QUERY;
+                } else if (c == '#') {
+                    url_set_empty(&url->fragment, &url->has_fragment);
+                    state = URL_STATE_FRAGMENT;
+                } else if (c != -1) {
+                    url->query.size = 0;
+                    url->has_query = FALSE;
+                    if (!starts_with_windows_drive_letter(s + p, n - p)) {
+                        url_shorten_path(url);
+                    } else {
+                        url->path.size = 0;
+                    }
+                    state = URL_STATE_PATH;
+                    p--;
+                }
+            } else {
+                state = URL_STATE_PATH;
+                p--;
+            }
+            break;
+
+        case URL_STATE_FILE_SLASH:
+            if (c == '/' || c == '\\') {
+                state = URL_STATE_FILE_HOST;
+            } else {
+                if (base && buf_eq(&base->scheme, "file")) {
+                    buf_copy(&url->host, &base->host);
+                    url->has_host = base->has_host;
+                    if (!starts_with_windows_drive_letter(s + p, n - p) &&
+                        path_starts_with_drive_letter(&base->path)) {
+                        dbuf_put(&url->path, base->path.buf, 3);
+                    }
+                }
+                state = URL_STATE_PATH;
+                p--;
+            }
+            break;
+
+        case URL_STATE_FILE_HOST:
+            if (c == -1 || c == '/' || c == '\\' || c == '?' || c == '#') {
+                p--;
+                if (!state_override && is_windows_drive_letter(buf.buf, buf.size, FALSE)) {
+                    // Kept in buf as the first path segment
+                    state = URL_STATE_PATH;
+                } else if (buf.size == 0) {
+                    url_set_empty(&url->host, &url->has_host);
+                    if (state_override) {
+                        goto done;
+                    }
+                    state = URL_STATE_PATH_START;
+                } else {
+                    if (url_parse_host(ctx, &url->host, buf.buf, buf.size, FALSE) < 0) {
+                        goto fail;
+                    }
+                    url->has_host = TRUE;
+                    if (buf_eq(&url->host, "localhost")) {
+                        url->host.size = 0;
+                    }
+                    if (state_override) {
+                        goto done;
+                    }
+                    buf.size = 0;
+                    state = URL_STATE_PATH_START;
+                }
+            } else {
+                dbuf_putc(&buf, c);
+            }
+            break;
+
+        case URL_STATE_PATH_START:
+            if (special) {
+                state = URL_STATE_PATH;
+                if (c != '/' && c != '\\') {
+                    p--;
+                }
+            } else if (!state_override && c == '?') {
+                url_set_empty(&url->query, &url->has_query);
+                state = URL_STATE_QUERY;
+            } else if (!state_override && c == '#') {
+                url_set_empty(&url->fragment, &url->has_fragment);
+                state = URL_STATE_FRAGMENT;
+            } else if (c != -1) {
+                state = URL_STATE_PATH;
+                if (c != '/') {
+                    p--;
+                }
+            } else if (state_override && !url->has_host) {
+                dbuf_putc(&url->path, '/');
+            }
+            break;
+
+        case URL_STATE_PATH:
+            if (c == -1 || c == '/' || (special && c == '\\') || (!state_override && (c == '?' || c == '#'))) {
+                BOOL slash = c == '/' || (special && c == '\\');
+                if (is_double_dot_segment(&buf)) {
+                    url_shorten_path(url);
+                    if (!slash) {
+                        dbuf_putc(&url->path, '/');
+                    }
+                } else if (is_single_dot_segment(&buf)) {
+                    if (!slash) {
+                        dbuf_putc(&url->path, '/');
+                    }
+                } else {
+                    if (buf_eq(&url->scheme, "file") && url->path.size == 0 &&
+                        is_windows_drive_letter(buf.buf, buf.size, FALSE)) {
+                        buf.buf[1] = ':';
+                    }
+                    dbuf_putc(&url->path, '/');
+                    dbuf_put(&url->path, buf.buf, buf.size);
+                }
+                buf.size = 0;
+                if (c == '?') {
+                    url_set_empty(&url->query, &url->has_query);
+                    state = URL_STATE_QUERY;
+                } else if (c == '#') {
+                    url_set_empty(&url->fragment, &url->has_fragment);
+                    state = URL_STATE_FRAGMENT;
+                }
+            } else {
+                url_encode(&buf, c, ENCODE_PATH);
+            }
+            break;
+
+        case URL_STATE_OPAQUE_PATH:
+            if (c == '?') {
+                url_set_empty(&url->query, &url->has_query);
+                state = URL_STATE_QUERY;
+            } else if (c == '#') {
+                url_set_empty(&url->fragment, &url->has_fragment);
+                state = URL_STATE_FRAGMENT;
+            } else if (c != -1) {
+                url_encode(&url->path, c, ENCODE_C0_CONTROL);
+            }
+            break;
+
+        case URL_STATE_QUERY:
+            if (!state_override && c == '#') {
+                url_set_empty(&url->fragment, &url->has_fragment);
+                state = URL_STATE_FRAGMENT;
+            } else if (c != -1) {
+                url_encode(&url->query, c, special ? ENCODE_SPECIAL_QUERY : ENCODE_QUERY);
+            }
+            break;
+
+        case URL_STATE_FRAGMENT:
+            if (c != -1) {
+                url_encode(&url->fragment, c, ENCODE_FRAGMENT);
+            }
+            break;
+        }
+
+        if (p >= n) {
+            break;
+        }
+    }
+#undef NEXT_IS
+
+done:
+    ret = 0;
+fail:
+    if (dbuf_error(&in) || dbuf_error(&buf) || url_record_error(url)) {
+        ret = URL_NO_MEMORY;
+    }
+    dbuf_free(&in);
+    dbuf_free(&buf);
+    return ret;
+}
+
+// URL serializer (https://url.spec.whatwg.org/#concept-url-serializer)
+static void url_serialize(DynBuf *out, const URLRecord *url) {
+    dbuf_put(out, url->scheme.buf, url->scheme.size);
+    dbuf_putc(out, ':');
+    if (url->has_host) {
+        dbuf_putstr(out, "//");
+        if (url_has_credentials(url)) {
+            dbuf_put(out, url->username.buf, url->username.size);
+            if (url->password.size > 0) {
+                dbuf_putc(out, ':');
+                dbuf_put(out, url->password.buf, url->password.size);
+            }
+            dbuf_putc(out, '@');
+        }
+        dbuf_put(out, url->host.buf, url->host.size);
+        if (url->port >= 0) {
+            dbuf_printf(out, ":%d", url->port);
+        }
+    } else if (!url->opaque_path && url->path.size > 1 && url->path.buf[1] == '/') {
+        // Keeps an empty first segment from reading as a host
+        dbuf_putstr(out, "/.");
+    }
+    dbuf_put(out, url->path.buf, url->path.size);
+    if (url->has_query) {
+        dbuf_putc(out, '?');
+        dbuf_put(out, url->query.buf, url->query.size);
+    }
+    if (url->has_fragment) {
+        dbuf_putc(out, '#');
+        dbuf_put(out, url->fragment.buf, url->fragment.size);
+    }
+}
+
+// https://url.spec.whatwg.org/#concept-url-origin
+static void url_serialize_origin(JSContext *ctx, DynBuf *out, const URLRecord *url) {
+    if (buf_eq(&url->scheme, "blob")) {
+        URLRecord path_url;
+        url_record_init(ctx, &path_url);
+        int ret = url_parse(ctx, &path_url, url->path.buf, url->path.size, NULL, URL_STATE_NONE);
+        if (ret == URL_NO_MEMORY) {
+            dbuf_set_error(out);
+        } else if (ret == 0 && (buf_eq(&path_url.scheme, "http") || buf_eq(&path_url.scheme, "https"))) {
+            url_serialize_origin(ctx, out, &path_url);
+        } else {
+            dbuf_putstr(out, "null");
+        }
+        url_record_free(&path_url);
+        return;
+    }
+
+    if (!url_is_special(url) || buf_eq(&url->scheme, "file")) {
+        dbuf_putstr(out, "null");
+        return;
+    }
+    dbuf_put(out, url->scheme.buf, url->scheme.size);
+    dbuf_putstr(out, "://");
+    dbuf_put(out, url->host.buf, url->host.size);
+    if (url->port >= 0) {
+        dbuf_printf(out, ":%d", url->port);
+    }
+}
+
+// URL (https://url.spec.whatwg.org/#url-class) and URLSearchParams
+// (https://url.spec.whatwg.org/#interface-urlsearchparams)
+
+// The record of a URL object. The URL's searchParams object holds a
+// reference too, so either object can be finalized first.
+typedef struct {
+    int ref_count;
+    URLRecord record;
+    JSValue search_params;  // Owned by the URL object; created on first read
+} WebURL;
+
+typedef struct {
+    WebPairList list;
+    WebURL *url;  // URL whose query the list reflects, or NULL
+} WebSearchParams;
+
+static void web_url_release(JSRuntime *rt, WebURL *url) {
+    if (--url->ref_count == 0) {
+        url_record_free(&url->record);
+        js_free_rt(rt, url);
+    }
+}
+
+static void js_url_finalizer(JSRuntime *rt, JSValue val) {
+    WebURL *url = JS_GetOpaque(val, js_url_class_id);
+    if (url) {
+        JS_FreeValueRT(rt, url->search_params);
+        url->search_params = JS_UNDEFINED;
+        web_url_release(rt, url);
+    }
+}
+
+static void js_url_gc_mark(JSRuntime *rt, JSValueConst val, JS_MarkFunc *mark_func) {
+    WebURL *url = JS_GetOpaque(val, js_url_class_id);
+    if (url) {
+        JS_MarkValue(rt, url->search_params, mark_func);
+    }
+}
+
+static void js_url_search_params_finalizer(JSRuntime *rt, JSValue val) {
+    WebSearchParams *params = JS_GetOpaque(val, js_url_search_params_class_id);
+    if (params) {
+        pair_list_free(rt, &params->list);
+        if (params->url) {
+            web_url_release(rt, params->url);
+        }
+        js_free_rt(rt, params);
+    }
+}
+
+// Parse the list from the URL's query again, after it was replaced
+static int url_sync_search_params(JSContext *ctx, WebURL *url) {
+    if (JS_IsUndefined(url->search_params)) {
+        return 0;
+    }
+    WebSearchParams *params = JS_GetOpaque(url->search_params, js_url_search_params_class_id);
+    pair_list_clear(JS_GetRuntime(ctx), &params->list);
+    if (!url->record.has_query) {
+        return 0;
+    }
+    return search_params_parse(ctx, &params->list, url->record.query.buf, url->record.query.size);
+}
+
+// Write the list back to the URL's query, after it changed
+static int search_params_update(JSContext *ctx, WebSearchParams *params) {
+    if (!params->url) {
+        return 0;
+    }
+    URLRecord *record = &params->url->record;
+    record->query.size = 0;
+    search_params_serialize(&record->query, &params->list);
+    record->has_query = record->query.size > 0;
+    if (!record->has_query) {
+        url_strip_trailing_spaces(record);
+    }
+    if (dbuf_error(&record->query)) {
+        dbuf_free(&record->query);
+        web_dbuf_init(ctx, &record->query);
+        record->has_query = FALSE;
+        JS_ThrowOutOfMemory(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+static int search_params_append(JSContext *ctx, WebSearchParams *params, JSValueConst name_val, JSValueConst value_val) {
+    WebString name, value;
+    if (web_to_usv(ctx, name_val, &name)) {
+        return -1;
+    }
+    if (web_to_usv(ctx, value_val, &value)) {
+        web_string_free(JS_GetRuntime(ctx), &name);
+        return -1;
+    }
+    return pair_list_push(ctx, &params->list, name, value);
+}
+
+static int search_params_append_item(JSContext *ctx, JSValueConst item, void *opaque) {
+    WebPairValues pair;
+    int ret = web_get_pair(ctx, item, &pair);
+    if (ret == 0 && pair.count != 2) {
+        JS_ThrowTypeError(ctx, "Failed to construct 'URLSearchParams': Sequence initializer must only contain pair elements");
+        ret = -1;
+    }
+    if (ret == 0) {
+        ret = search_params_append(ctx, opaque, pair.values[0], pair.values[1]);
+    }
+    web_pair_values_free(ctx, &pair);
+    return ret;
+}
+
+static int search_params_append_entry(JSContext *ctx, JSValueConst name, JSValueConst value, void *opaque) {
+    return search_params_append(ctx, opaque, name, value);
+}
+
+// Fill from another URLSearchParams, a sequence of pairs, a record or a
+// query string
+static int search_params_fill(JSContext *ctx, WebSearchParams *params, JSValueConst init) {
+    if (JS_IsUndefined(init)) {
+        return 0;
+    }
+
+    if (JS_IsObject(init)) {
+        WebSearchParams *other = JS_GetOpaque(init, js_url_search_params_class_id);
+        if (other) {
+            return pair_list_copy(ctx, &params->list, &other->list);
+        }
+        JSValue method = JS_GetProperty(ctx, init, web_symbol_iterator);
+        if (JS_IsException(method)) {
+            return -1;
+        }
+        int ret;
+        if (JS_IsUndefined(method) || JS_IsNull(method)) {
+            ret = web_for_each_record(ctx, init, search_params_append_entry, params);
+        } else if (!JS_IsFunction(ctx, method)) {
+            JS_ThrowTypeError(ctx, "Failed to construct 'URLSearchParams': The object must have a callable @@iterator property.");
+            ret = -1;
+        } else {
+            ret = web_for_of(ctx, init, method, search_params_append_item, params);
+        }
+        JS_FreeValue(ctx, method);
+        return ret;
+    }
+
+    WebString query;
+    if (web_to_usv(ctx, init, &query)) {
+        return -1;
+    }
+    size_t skip = query.len > 0 && query.ptr[0] == '?';
+    int ret = search_params_parse(ctx, &params->list, (const uint8_t *)query.ptr + skip, query.len - skip);
+    web_string_free(JS_GetRuntime(ctx), &query);
+    return ret;
+}
+
+static JSValue js_url_search_params_constructor(JSContext *ctx, JSValueConst new_target, int argc, JSValueConst *argv) {
+    JSValue obj = web_new_object(ctx, new_target, js_url_search_params_class_id);
+    if (JS_IsException(obj)) {
+        return obj;
+    }
+    WebSearchParams *params = js_mallocz(ctx, sizeof(*params));
+    if (!params) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    JS_SetOpaque(obj, params);
+
+    if (argc > 0 && search_params_fill(ctx, params, argv[0])) {
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    return obj;
+}
+
+static JSValue js_url_search_params_append(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebSearchParams *params = JS_GetOpaque2(ctx, this_val, js_url_search_params_class_id);
+    if (!params || search_params_append(ctx, params, argv[0], argv[1]) || search_params_update(ctx, params)) {
+        return JS_EXCEPTION;
+    }
+    return JS_UNDEFINED;
+}
+
+// The name argument and, when given, the value argument of delete() and has()
+static int search_params_match_args(JSContext *ctx, int argc, JSValueConst *argv,
+                                    WebString *name, WebString *value, BOOL *has_value) {
+    if (web_to_usv(ctx, argv[0], name)) {
+        return -1;
+    }
+    *has_value = argc > 1 && !JS_IsUndefined(argv[1]);
+    if (*has_value && web_to_usv(ctx, argv[1], value)) {
+        web_string_free(JS_GetRuntime(ctx), name);
+        return -1;
+    }
+    return 0;
+}
+
+static BOOL search_params_matches(const WebPair *pair, const WebString *name, const WebString *value, BOOL has_value) {
+    return web_string_eq(&pair->name, name) && (!has_value || web_string_eq(&pair->value, value));
+}
+
+static JSValue js_url_search_params_delete(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebSearchParams *params = JS_GetOpaque2(ctx, this_val, js_url_search_params_class_id);
+    WebString name, value;
+    BOOL has_value;
+    if (!params || search_params_match_args(ctx, argc, argv, &name, &value, &has_value)) {
+        return JS_EXCEPTION;
+    }
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    for (size_t i = params->list.count; i-- > 0;) {
+        if (search_params_matches(&params->list.pairs[i], &name, &value, has_value)) {
+            pair_list_remove(rt, &params->list, i);
+        }
+    }
+    web_string_free(rt, &name);
+    if (has_value) {
+        web_string_free(rt, &value);
+    }
+    return search_params_update(ctx, params) ? JS_EXCEPTION : JS_UNDEFINED;
+}
+
+static JSValue js_url_search_params_get(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebSearchParams *params = JS_GetOpaque2(ctx, this_val, js_url_search_params_class_id);
+    WebString name;
+    if (!params || web_to_usv(ctx, argv[0], &name)) {
+        return JS_EXCEPTION;
+    }
+    JSValue ret = JS_NULL;
+    for (size_t i = 0; i < params->list.count; i++) {
+        if (web_string_eq(&params->list.pairs[i].name, &name)) {
+            ret = web_string_to_js(ctx, &params->list.pairs[i].value);
+            break;
+        }
+    }
+    web_string_free(JS_GetRuntime(ctx), &name);
+    return ret;
+}
+
+static JSValue js_url_search_params_get_all(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebSearchParams *params = JS_GetOpaque2(ctx, this_val, js_url_search_params_class_id);
+    WebString name;
+    if (!params || web_to_usv(ctx, argv[0], &name)) {
+        return JS_EXCEPTION;
+    }
+    JSValue array = JS_NewArray(ctx);
+    uint32_t index = 0;
+    for (size_t i = 0; i < params->list.count && !JS_IsException(array); i++) {
+        if (web_string_eq(&params->list.pairs[i].name, &name)) {
+            JSValue value = web_string_to_js(ctx, &params->list.pairs[i].value);
+            if (JS_IsException(value) ||
+                JS_DefinePropertyValueUint32(ctx, array, index++, value, JS_PROP_C_W_E) < 0) {
+                JS_FreeValue(ctx, array);
+                array = JS_EXCEPTION;
+            }
+        }
+    }
+    web_string_free(JS_GetRuntime(ctx), &name);
+    return array;
+}
+
+static JSValue js_url_search_params_has(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebSearchParams *params = JS_GetOpaque2(ctx, this_val, js_url_search_params_class_id);
+    WebString name, value;
+    BOOL has_value;
+    if (!params || search_params_match_args(ctx, argc, argv, &name, &value, &has_value)) {
+        return JS_EXCEPTION;
+    }
+    BOOL found = FALSE;
+    for (size_t i = 0; i < params->list.count && !found; i++) {
+        found = search_params_matches(&params->list.pairs[i], &name, &value, has_value);
+    }
+    web_string_free(JS_GetRuntime(ctx), &name);
+    if (has_value) {
+        web_string_free(JS_GetRuntime(ctx), &value);
+    }
+    return JS_NewBool(ctx, found);
+}
+
+// Replace the first pair with that name, removing the others
+static JSValue js_url_search_params_set(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebSearchParams *params = JS_GetOpaque2(ctx, this_val, js_url_search_params_class_id);
+    WebString name, value;
+    if (!params || web_to_usv(ctx, argv[0], &name)) {
+        return JS_EXCEPTION;
+    }
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    if (web_to_usv(ctx, argv[1], &value)) {
+        web_string_free(rt, &name);
+        return JS_EXCEPTION;
+    }
+
+    size_t first = params->list.count;
+    for (size_t i = params->list.count; i-- > 0;) {
+        if (web_string_eq(&params->list.pairs[i].name, &name)) {
+            if (first < params->list.count) {
+                pair_list_remove(rt, &params->list, first);
+            }
+            first = i;
+        }
+    }
+    if (first < params->list.count) {
+        WebPair *pair = &params->list.pairs[first];
+        web_string_free(rt, &pair->value);
+        pair->value = value;
+        web_string_free(rt, &name);
+    } else if (pair_list_push(ctx, &params->list, name, value)) {
+        return JS_EXCEPTION;
+    }
+    return search_params_update(ctx, params) ? JS_EXCEPTION : JS_UNDEFINED;
+}
+
+// Compare UTF-8 strings by their UTF-16 code units, as JavaScript sorts
+static int compare_utf16(const WebString *a, const WebString *b) {
+    const uint8_t *p = (const uint8_t *)a->ptr, *p_end = p + a->len;
+    const uint8_t *q = (const uint8_t *)b->ptr, *q_end = q + b->len;
+    while (p < p_end && q < q_end) {
+        int c1 = *p < 0x80 ? *p++ : unicode_from_utf8(p, p_end - p, &p);
+        int c2 = *q < 0x80 ? *q++ : unicode_from_utf8(q, q_end - q, &q);
+        if (c1 < 0 || c2 < 0) {
+            // Not reached: the strings are valid UTF-8
+            return c1 < c2 ? -1 : 1;
+        }
+        if (c1 != c2) {
+            uint32_t u1 = c1 >= 0x10000 ? get_hi_surrogate(c1) : (uint32_t)c1;
+            uint32_t u2 = c2 >= 0x10000 ? get_hi_surrogate(c2) : (uint32_t)c2;
+            if (u1 != u2) {
+                return u1 < u2 ? -1 : 1;
+            }
+            return c1 < c2 ? -1 : 1;
+        }
+    }
+    return (p < p_end) - (q < q_end);
+}
+
+typedef struct {
+    WebPair pair;
+    size_t index;
+} WebSortPair;
+
+static int compare_search_params(const void *a, const void *b) {
+    const WebSortPair *x = a, *y = b;
+    int cmp = compare_utf16(&x->pair.name, &y->pair.name);
+    if (cmp == 0) {
+        cmp = x->index < y->index ? -1 : 1;
+    }
+    return cmp;
+}
+
+// Stable sort by name
+static JSValue js_url_search_params_sort(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebSearchParams *params = JS_GetOpaque2(ctx, this_val, js_url_search_params_class_id);
+    if (!params) {
+        return JS_EXCEPTION;
+    }
+    size_t count = params->list.count;
+    if (count > 1) {
+        WebSortPair *items = js_malloc(ctx, count * sizeof(*items));
+        if (!items) {
+            return JS_EXCEPTION;
+        }
+        for (size_t i = 0; i < count; i++) {
+            items[i].pair = params->list.pairs[i];
+            items[i].index = i;
+        }
+        qsort(items, count, sizeof(*items), compare_search_params);
+        for (size_t i = 0; i < count; i++) {
+            params->list.pairs[i] = items[i].pair;
+        }
+        js_free(ctx, items);
+    }
+    return search_params_update(ctx, params) ? JS_EXCEPTION : JS_UNDEFINED;
+}
+
+static JSValue js_url_search_params_to_string(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebSearchParams *params = JS_GetOpaque2(ctx, this_val, js_url_search_params_class_id);
+    if (!params) {
+        return JS_EXCEPTION;
+    }
+    DynBuf b;
+    web_dbuf_init(ctx, &b);
+    search_params_serialize(&b, &params->list);
+    return web_dbuf_to_js(ctx, &b);
+}
+
+static JSValue js_url_search_params_for_each(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    WebSearchParams *params = JS_GetOpaque2(ctx, this_val, js_url_search_params_class_id);
+    if (!params) {
+        return JS_EXCEPTION;
+    }
+    if (!JS_IsFunction(ctx, argv[0])) {
+        return JS_ThrowTypeError(ctx, "URLSearchParams.forEach: callback is not a function");
+    }
+    JSValueConst this_arg = argc > 1 ? argv[1] : JS_UNDEFINED;
+
+    // The callback may change the list: it is read again at each step
+    for (size_t i = 0; i < params->list.count; i++) {
+        JSValue args[3] = {
+            web_string_to_js(ctx, &params->list.pairs[i].value),
+            web_string_to_js(ctx, &params->list.pairs[i].name),
+            JS_DupValue(ctx, this_val)
+        };
+        JSValue ret = JS_IsException(args[0]) || JS_IsException(args[1])
+            ? JS_EXCEPTION
+            : JS_Call(ctx, argv[0], this_arg, 3, (JSValueConst *)args);
+        for (int j = 0; j < 3; j++) {
+            JS_FreeValue(ctx, args[j]);
+        }
+        if (JS_IsException(ret)) {
+            return ret;
+        }
+        JS_FreeValue(ctx, ret);
+    }
+    return JS_UNDEFINED;
+}
+
+static JSValue js_url_search_params_iterator(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
+    WebSearchParams *params = JS_GetOpaque2(ctx, this_val, js_url_search_params_class_id);
+    if (!params) {
+        return JS_EXCEPTION;
+    }
+    JSValue array = JS_NewArray(ctx);
+    for (size_t i = 0; i < params->list.count && !JS_IsException(array); i++) {
+        const WebPair *pair = &params->list.pairs[i];
+        JSValue item = web_iter_item(ctx, magic, &pair->name, pair->value.ptr, pair->value.len);
+        if (JS_IsException(item) ||
+            JS_DefinePropertyValueUint32(ctx, array, i, item, JS_PROP_C_W_E) < 0) {
+            JS_FreeValue(ctx, array);
+            array = JS_EXCEPTION;
+        }
+    }
+    return web_array_iterator(ctx, array);
+}
+
+static JSValue js_url_search_params_get_size(JSContext *ctx, JSValueConst this_val) {
+    WebSearchParams *params = JS_GetOpaque2(ctx, this_val, js_url_search_params_class_id);
+    if (!params) {
+        return JS_EXCEPTION;
+    }
+    return JS_NewInt64(ctx, (int64_t)params->list.count);
+}
+
+static const JSCFunctionListEntry js_url_search_params_proto_funcs[] = {
+    JS_CFUNC_DEF("append", 2, js_url_search_params_append),
+    JS_CFUNC_DEF("delete", 1, js_url_search_params_delete),
+    JS_CFUNC_DEF("get", 1, js_url_search_params_get),
+    JS_CFUNC_DEF("getAll", 1, js_url_search_params_get_all),
+    JS_CFUNC_DEF("has", 1, js_url_search_params_has),
+    JS_CFUNC_DEF("set", 2, js_url_search_params_set),
+    JS_CFUNC_DEF("sort", 0, js_url_search_params_sort),
+    JS_CFUNC_DEF("toString", 0, js_url_search_params_to_string),
+    JS_CFUNC_DEF("forEach", 1, js_url_search_params_for_each),
+    JS_CFUNC_MAGIC_DEF("keys", 0, js_url_search_params_iterator, WEB_ITER_KEYS),
+    JS_CFUNC_MAGIC_DEF("values", 0, js_url_search_params_iterator, WEB_ITER_VALUES),
+    JS_CFUNC_MAGIC_DEF("entries", 0, js_url_search_params_iterator, WEB_ITER_ENTRIES),
+    JS_ALIAS_DEF("[Symbol.iterator]", "entries"),
+    JS_CGETSET_DEF("size", js_url_search_params_get_size, NULL),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "URLSearchParams", JS_PROP_CONFIGURABLE),
+};
+
+// Components of a URL, the magic of its accessors
+enum {
+    URL_HREF,
+    URL_ORIGIN,
+    URL_PROTOCOL,
+    URL_USERNAME,
+    URL_PASSWORD,
+    URL_HOST,
+    URL_HOSTNAME,
+    URL_PORT,
+    URL_PATHNAME,
+    URL_SEARCH,
+    URL_HASH
+};
+
+// Parse url against an optional base. Returns 0, URL_FAILURE with *error
+// set to the message for a TypeError, or -2 with a pending exception.
+static int url_parse_args(JSContext *ctx, URLRecord *url, JSValueConst input, JSValueConst base_val,
+                          const char **error) {
+    URLRecord base;
+    BOOL has_base = !JS_IsUndefined(base_val);
+    size_t len;
+    const char *str;
+    int ret;
+
+    url_record_init(ctx, url);
+    if (has_base) {
+        str = JS_ToCStringLen(ctx, &len, base_val);
+        if (!str) {
+            return -2;
+        }
+        url_record_init(ctx, &base);
+        ret = url_parse(ctx, &base, (const uint8_t *)str, len, NULL, URL_STATE_NONE);
+        JS_FreeCString(ctx, str);
+        if (ret < 0) {
+            url_record_free(&base);
+            if (ret == URL_NO_MEMORY) {
+                JS_ThrowOutOfMemory(ctx);
+                return -2;
+            }
+            *error = "Invalid base URL";
+            return URL_FAILURE;
+        }
+    }
+
+    str = JS_ToCStringLen(ctx, &len, input);
+    if (!str) {
+        ret = -2;
+    } else {
+        ret = url_parse(ctx, url, (const uint8_t *)str, len, has_base ? &base : NULL, URL_STATE_NONE);
+        JS_FreeCString(ctx, str);
+        if (ret == URL_NO_MEMORY) {
+            JS_ThrowOutOfMemory(ctx);
+            ret = -2;
+        } else if (ret == URL_FAILURE) {
+            *error = "Invalid URL";
+        }
+    }
+    if (has_base) {
+        url_record_free(&base);
+    }
+    if (ret < 0) {
+        url_record_free(url);
+    }
+    return ret;
+}
+
+// Attach a parsed record to a new URL object (the record is taken over)
+static JSValue url_wrap(JSContext *ctx, JSValue obj, URLRecord *record) {
+    if (JS_IsException(obj)) {
+        url_record_free(record);
+        return obj;
+    }
+    WebURL *url = js_mallocz(ctx, sizeof(*url));
+    if (!url) {
+        url_record_free(record);
+        JS_FreeValue(ctx, obj);
+        return JS_EXCEPTION;
+    }
+    url->ref_count = 1;
+    url->record = *record;
+    url->search_params = JS_UNDEFINED;
+    JS_SetOpaque(obj, url);
+    return obj;
+}
+
+static JSValue js_url_constructor(JSContext *ctx, JSValueConst new_target, int argc, JSValueConst *argv) {
+    URLRecord record;
+    const char *error;
+    int ret = url_parse_args(ctx, &record, argv[0], argc > 1 ? argv[1] : JS_UNDEFINED, &error);
+    if (ret == URL_FAILURE) {
+        return JS_ThrowTypeError(ctx, "%s", error);
+    }
+    if (ret < 0) {
+        return JS_EXCEPTION;
+    }
+    return url_wrap(ctx, web_new_object(ctx, new_target, js_url_class_id), &record);
+}
+
+static JSValue js_url_can_parse(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    URLRecord record;
+    const char *error;
+    int ret = url_parse_args(ctx, &record, argv[0], argc > 1 ? argv[1] : JS_UNDEFINED, &error);
+    if (ret == -2) {
+        return JS_EXCEPTION;
+    }
+    if (ret == 0) {
+        url_record_free(&record);
+    }
+    return JS_NewBool(ctx, ret == 0);
+}
+
+// URL.parse(url, base): like the constructor, but null for invalid URLs
+static JSValue js_url_parse(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    URLRecord record;
+    const char *error;
+    int ret = url_parse_args(ctx, &record, argv[0], argc > 1 ? argv[1] : JS_UNDEFINED, &error);
+    if (ret == URL_FAILURE) {
+        return JS_NULL;
+    }
+    if (ret < 0) {
+        return JS_EXCEPTION;
+    }
+    JSValue proto = web_class_proto(ctx, WEB_CLASS_URL);
+    if (JS_IsException(proto)) {
+        url_record_free(&record);
+        return proto;
+    }
+    JSValue obj = JS_NewObjectProtoClass(ctx, proto, js_url_class_id);
+    JS_FreeValue(ctx, proto);
+    return url_wrap(ctx, obj, &record);
+}
+
+static JSValue js_url_create_object_url(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    return JS_ThrowTypeError(ctx, "URL.createObjectURL is not supported in this environment");
+}
+
+static JSValue js_url_revoke_object_url(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    return JS_UNDEFINED;
+}
+
+static JSValue js_url_get(JSContext *ctx, JSValueConst this_val, int magic) {
+    WebURL *url = JS_GetOpaque2(ctx, this_val, js_url_class_id);
+    if (!url) {
+        return JS_EXCEPTION;
+    }
+    const URLRecord *record = &url->record;
+    DynBuf b;
+    web_dbuf_init(ctx, &b);
+
+    switch (magic) {
+    case URL_HREF:
+        url_serialize(&b, record);
+        break;
+    case URL_ORIGIN:
+        url_serialize_origin(ctx, &b, record);
+        break;
+    case URL_PROTOCOL:
+        dbuf_put(&b, record->scheme.buf, record->scheme.size);
+        dbuf_putc(&b, ':');
+        break;
+    case URL_USERNAME:
+        dbuf_put(&b, record->username.buf, record->username.size);
+        break;
+    case URL_PASSWORD:
+        dbuf_put(&b, record->password.buf, record->password.size);
+        break;
+    case URL_HOST:
+    case URL_HOSTNAME:
+        dbuf_put(&b, record->host.buf, record->host.size);
+        if (magic == URL_HOST && record->has_host && record->port >= 0) {
+            dbuf_printf(&b, ":%d", record->port);
+        }
+        break;
+    case URL_PORT:
+        if (record->port >= 0) {
+            dbuf_printf(&b, "%d", record->port);
+        }
+        break;
+    case URL_PATHNAME:
+        dbuf_put(&b, record->path.buf, record->path.size);
+        break;
+    case URL_SEARCH:
+        if (record->query.size > 0) {
+            dbuf_putc(&b, '?');
+            dbuf_put(&b, record->query.buf, record->query.size);
+        }
+        break;
+    case URL_HASH:
+        if (record->fragment.size > 0) {
+            dbuf_putc(&b, '#');
+            dbuf_put(&b, record->fragment.buf, record->fragment.size);
+        }
+        break;
+    }
+    return web_dbuf_to_js(ctx, &b);
+}
+
+// Run the basic URL parser with a state override on a copy of the record,
+// keeping the copy unless parsing fails. clear names the component set to
+// the empty string first.
+static int url_update(JSContext *ctx, URLRecord *record, const uint8_t *s, size_t len,
+                      URLState state_override, int clear) {
+    URLRecord copy;
+    if (url_record_copy(ctx, &copy, record)) {
+        JS_ThrowOutOfMemory(ctx);
+        return -1;
+    }
+    if (clear == URL_PATHNAME) {
+        copy.path.size = 0;
+    } else if (clear == URL_SEARCH) {
+        url_set_empty(&copy.query, &copy.has_query);
+    } else if (clear == URL_HASH) {
+        url_set_empty(&copy.fragment, &copy.has_fragment);
+    }
+
+    int ret = url_parse(ctx, &copy, s, len, NULL, state_override);
+    if (ret == URL_NO_MEMORY) {
+        url_record_free(&copy);
+        JS_ThrowOutOfMemory(ctx);
+        return -1;
+    }
+    if (ret == 0) {
+        url_record_free(record);
+        *record = copy;
+    } else {
+        url_record_free(&copy);
+    }
+    return 0;
+}
+
+static JSValue js_url_set(JSContext *ctx, JSValueConst this_val, JSValueConst val, int magic) {
+    WebURL *url = JS_GetOpaque2(ctx, this_val, js_url_class_id);
+    if (!url) {
+        return JS_EXCEPTION;
+    }
+    URLRecord *record = &url->record;
+    size_t len;
+    const char *str = JS_ToCStringLen(ctx, &len, val);
+    if (!str) {
+        return JS_EXCEPTION;
+    }
+    const uint8_t *s = (const uint8_t *)str;
+    int ret = 0;
+
+    switch (magic) {
+    case URL_HREF: {
+        URLRecord parsed;
+        url_record_init(ctx, &parsed);
+        ret = url_parse(ctx, &parsed, s, len, NULL, URL_STATE_NONE);
+        if (ret == 0) {
+            url_record_free(record);
+            *record = parsed;
+            ret = url_sync_search_params(ctx, url);
+        } else {
+            url_record_free(&parsed);
+            if (ret == URL_FAILURE) {
+                JS_ThrowTypeError(ctx, "Invalid URL");
+            } else {
+                JS_ThrowOutOfMemory(ctx);
+            }
+        }
+        break;
+    }
+    case URL_PROTOCOL: {
+        DynBuf input;
+        web_dbuf_init(ctx, &input);
+        dbuf_put(&input, s, len);
+        dbuf_putc(&input, ':');
+        if (dbuf_error(&input)) {
+            JS_ThrowOutOfMemory(ctx);
+            ret = -1;
+        } else {
+            ret = url_update(ctx, record, input.buf, input.size, URL_STATE_SCHEME_START, -1);
+        }
+        dbuf_free(&input);
+        break;
+    }
+    case URL_USERNAME:
+    case URL_PASSWORD:
+        if (!url_cannot_have_credentials(record)) {
+            DynBuf *target = magic == URL_USERNAME ? &record->username : &record->password;
+            DynBuf input;
+            web_dbuf_init(ctx, &input);
+            web_utf8_append(&input, s, len, TRUE);
+            target->size = 0;
+            for (size_t i = 0; i < input.size; i++) {
+                url_encode(target, input.buf[i], ENCODE_USERINFO);
+            }
+            if (dbuf_error(&input)) {
+                dbuf_set_error(target);
+            }
+            dbuf_free(&input);
+        }
+        break;
+    case URL_HOST:
+    case URL_HOSTNAME:
+        if (!record->opaque_path) {
+            ret = url_update(ctx, record, s, len, magic == URL_HOST ? URL_STATE_HOST : URL_STATE_HOSTNAME, -1);
+        }
+        break;
+    case URL_PORT:
+        if (url_cannot_have_credentials(record)) {
+            break;
+        }
+        if (len == 0) {
+            record->port = -1;
+        } else {
+            ret = url_update(ctx, record, s, len, URL_STATE_PORT, -1);
+        }
+        break;
+    case URL_PATHNAME:
+        if (!record->opaque_path) {
+            ret = url_update(ctx, record, s, len, URL_STATE_PATH_START, URL_PATHNAME);
+        }
+        break;
+    case URL_SEARCH:
+    case URL_HASH: {
+        BOOL search = magic == URL_SEARCH;
+        if (len == 0) {
+            DynBuf *component = search ? &record->query : &record->fragment;
+            component->size = 0;
+            *(search ? &record->has_query : &record->has_fragment) = FALSE;
+            url_strip_trailing_spaces(record);
+        } else {
+            size_t skip = s[0] == (search ? '?' : '#');
+            ret = url_update(ctx, record, s + skip, len - skip,
+                             search ? URL_STATE_QUERY : URL_STATE_FRAGMENT, magic);
+        }
+        if (ret == 0 && search) {
+            ret = url_sync_search_params(ctx, url);
+        }
+        break;
+    }
+    }
+    JS_FreeCString(ctx, str);
+
+    if (ret == 0 && url_record_error(record)) {
+        JS_ThrowOutOfMemory(ctx);
+        ret = -1;
+    }
+    return ret < 0 ? JS_EXCEPTION : JS_UNDEFINED;
+}
+
+static JSValue js_url_get_search_params(JSContext *ctx, JSValueConst this_val) {
+    WebURL *url = JS_GetOpaque2(ctx, this_val, js_url_class_id);
+    if (!url) {
+        return JS_EXCEPTION;
+    }
+    if (JS_IsUndefined(url->search_params)) {
+        JSValue proto = web_class_proto(ctx, WEB_CLASS_URL_SEARCH_PARAMS);
+        if (JS_IsException(proto)) {
+            return proto;
+        }
+        JSValue obj = JS_NewObjectProtoClass(ctx, proto, js_url_search_params_class_id);
+        JS_FreeValue(ctx, proto);
+        if (JS_IsException(obj)) {
+            return obj;
+        }
+        WebSearchParams *params = js_mallocz(ctx, sizeof(*params));
+        if (!params) {
+            JS_FreeValue(ctx, obj);
+            return JS_EXCEPTION;
+        }
+        params->url = url;
+        url->ref_count++;
+        JS_SetOpaque(obj, params);
+        url->search_params = obj;
+        if (url_sync_search_params(ctx, url)) {
+            return JS_EXCEPTION;
+        }
+    }
+    return JS_DupValue(ctx, url->search_params);
+}
+
+static JSValue js_url_to_string(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv) {
+    return js_url_get(ctx, this_val, URL_HREF);
+}
+
+static const JSCFunctionListEntry js_url_proto_funcs[] = {
+    JS_CGETSET_MAGIC_DEF("href", js_url_get, js_url_set, URL_HREF),
+    JS_CGETSET_MAGIC_DEF("origin", js_url_get, NULL, URL_ORIGIN),
+    JS_CGETSET_MAGIC_DEF("protocol", js_url_get, js_url_set, URL_PROTOCOL),
+    JS_CGETSET_MAGIC_DEF("username", js_url_get, js_url_set, URL_USERNAME),
+    JS_CGETSET_MAGIC_DEF("password", js_url_get, js_url_set, URL_PASSWORD),
+    JS_CGETSET_MAGIC_DEF("host", js_url_get, js_url_set, URL_HOST),
+    JS_CGETSET_MAGIC_DEF("hostname", js_url_get, js_url_set, URL_HOSTNAME),
+    JS_CGETSET_MAGIC_DEF("port", js_url_get, js_url_set, URL_PORT),
+    JS_CGETSET_MAGIC_DEF("pathname", js_url_get, js_url_set, URL_PATHNAME),
+    JS_CGETSET_MAGIC_DEF("search", js_url_get, js_url_set, URL_SEARCH),
+    JS_CGETSET_DEF("searchParams", js_url_get_search_params, NULL),
+    JS_CGETSET_MAGIC_DEF("hash", js_url_get, js_url_set, URL_HASH),
+    JS_CFUNC_DEF("toString", 0, js_url_to_string),
+    JS_CFUNC_DEF("toJSON", 0, js_url_to_string),
+    JS_PROP_STRING_DEF("[Symbol.toStringTag]", "URL", JS_PROP_CONFIGURABLE),
+};
+
+static const JSCFunctionListEntry js_url_static_funcs[] = {
+    JS_CFUNC_DEF("canParse", 1, js_url_can_parse),
+    JS_CFUNC_DEF("parse", 1, js_url_parse),
+    JS_CFUNC_DEF("createObjectURL", 1, js_url_create_object_url),
+    JS_CFUNC_DEF("revokeObjectURL", 1, js_url_revoke_object_url),
+};
+
+// Lazily defined classes
+
+typedef struct {
+    const char *name;
+    JSClassID *class_id;
+    JSClassDef def;
+    JSCFunction *constructor;
+    int length;
+    const JSCFunctionListEntry *proto_funcs;
+    int proto_funcs_count;
+    const JSCFunctionListEntry *static_funcs;
+    int static_funcs_count;
+} WebClass;
+
+static const WebClass web_classes[WEB_CLASS_COUNT] = {
+    [WEB_CLASS_HEADERS] = {
+        "Headers", &js_headers_class_id,
+        { "Headers", .finalizer = js_headers_finalizer },
+        (JSCFunction *)js_headers_constructor, 0,
+        js_headers_proto_funcs, countof(js_headers_proto_funcs), NULL, 0
+    },
+    [WEB_CLASS_URL] = {
+        "URL", &js_url_class_id,
+        { "URL", .finalizer = js_url_finalizer, .gc_mark = js_url_gc_mark },
+        (JSCFunction *)js_url_constructor, 1,
+        js_url_proto_funcs, countof(js_url_proto_funcs),
+        js_url_static_funcs, countof(js_url_static_funcs)
+    },
+    [WEB_CLASS_URL_SEARCH_PARAMS] = {
+        "URLSearchParams", &js_url_search_params_class_id,
+        { "URLSearchParams", .finalizer = js_url_search_params_finalizer },
+        (JSCFunction *)js_url_search_params_constructor, 0,
+        js_url_search_params_proto_funcs, countof(js_url_search_params_proto_funcs), NULL, 0
+    },
+};
+
+// Create a class in ctx and replace the accessor standing in for it on the
+// global object. Returns the constructor.
+static JSValue web_define_class(JSContext *ctx, int index) {
+    const WebClass *wc = &web_classes[index];
+    JSValue proto = JS_GetClassProto(ctx, *wc->class_id);
+    if (!JS_IsNull(proto)) {
+        // Already created (URLSearchParams by url.searchParams)
+        JSValue ctor = JS_GetPropertyStr(ctx, proto, "constructor");
+        JS_FreeValue(ctx, proto);
+        return ctor;
+    }
+
+    proto = JS_NewObject(ctx);
+    if (JS_IsException(proto)) {
+        return proto;
+    }
+    JSValue ctor = JS_NewCFunction2(ctx, wc->constructor, wc->name, wc->length, JS_CFUNC_constructor, 0);
+    if (JS_IsException(ctor) ||
+        JS_SetPropertyFunctionList(ctx, proto, wc->proto_funcs, wc->proto_funcs_count) < 0 ||
+        (wc->static_funcs && JS_SetPropertyFunctionList(ctx, ctor, wc->static_funcs, wc->static_funcs_count) < 0) ||
+        JS_SetConstructor(ctx, ctor, proto) < 0) {
+        JS_FreeValue(ctx, ctor);
+        JS_FreeValue(ctx, proto);
+        return JS_EXCEPTION;
+    }
+    JS_SetClassProto(ctx, *wc->class_id, proto);
+
+    // Unless the script has already replaced the accessor itself
+    JSValue global = JS_GetGlobalObject(ctx);
+    JSAtom atom = JS_NewAtom(ctx, wc->name);
+    JSPropertyDescriptor desc;
+    int ret = JS_GetOwnProperty(ctx, &desc, global, atom);
+    if (ret > 0) {
+        if (desc.flags & JS_PROP_GETSET) {
+            ret = JS_DefinePropertyValue(ctx, global, atom, JS_DupValue(ctx, ctor),
+                                         JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+        }
+        JS_FreeValue(ctx, desc.value);
+        JS_FreeValue(ctx, desc.getter);
+        JS_FreeValue(ctx, desc.setter);
+    }
+    JS_FreeAtom(ctx, atom);
+    JS_FreeValue(ctx, global);
+    if (ret < 0) {
+        JS_FreeValue(ctx, ctor);
+        return JS_EXCEPTION;
+    }
+    return ctor;
+}
+
+static JSValue web_class_proto(JSContext *ctx, int index) {
+    JSClassID class_id = *web_classes[index].class_id;
+    JSValue proto = JS_GetClassProto(ctx, class_id);
+    if (JS_IsNull(proto)) {
+        JSValue ctor = web_define_class(ctx, index);
+        if (JS_IsException(ctor)) {
+            return ctor;
+        }
+        JS_FreeValue(ctx, ctor);
+        proto = JS_GetClassProto(ctx, class_id);
+    }
+    return proto;
+}
+
+static JSValue js_web_class_get(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
+    return web_define_class(ctx, magic);
+}
+
+// Assigning the global before the class was created replaces it
+static JSValue js_web_class_set(JSContext *ctx, JSValueConst this_val, int argc, JSValueConst *argv, int magic) {
+    JSValue global = JS_GetGlobalObject(ctx);
+    int ret = JS_DefinePropertyValueStr(ctx, global, web_classes[magic].name, JS_DupValue(ctx, argv[0]),
+                                        JS_PROP_WRITABLE | JS_PROP_CONFIGURABLE);
+    JS_FreeValue(ctx, global);
+    return ret < 0 ? JS_EXCEPTION : JS_UNDEFINED;
+}
+
+int web_api_install(JSContext *ctx) {
+    JSRuntime *rt = JS_GetRuntime(ctx);
+    JSValue global = JS_GetGlobalObject(ctx);
+    int ret = 0;
+
+    if (web_symbol_iterator == JS_ATOM_NULL) {
+        JSValue symbol = JS_GetPropertyStr(ctx, global, "Symbol");
+        JSValue iterator = JS_GetPropertyStr(ctx, symbol, "iterator");
+        web_symbol_iterator = JS_ValueToAtom(ctx, iterator);
+        JS_FreeValue(ctx, iterator);
+        JS_FreeValue(ctx, symbol);
+    }
+
+    for (int i = 0; i < WEB_CLASS_COUNT && ret >= 0; i++) {
+        const WebClass *wc = &web_classes[i];
+        JS_NewClassID(wc->class_id);
+        if (!JS_IsRegisteredClass(rt, *wc->class_id) && JS_NewClass(rt, *wc->class_id, &wc->def) < 0) {
+            ret = -1;
+            break;
+        }
+
+        JSValue getter = JS_NewCFunctionMagic(ctx, js_web_class_get, wc->name, 0, JS_CFUNC_generic_magic, i);
+        JSValue setter = JS_NewCFunctionMagic(ctx, js_web_class_set, wc->name, 1, JS_CFUNC_generic_magic, i);
+        if (JS_IsException(getter) || JS_IsException(setter)) {
+            JS_FreeValue(ctx, getter);
+            JS_FreeValue(ctx, setter);
+            ret = -1;
+            break;
+        }
+        JSAtom atom = JS_NewAtom(ctx, wc->name);
+        ret = JS_DefinePropertyGetSet(ctx, global, atom, getter, setter, JS_PROP_CONFIGURABLE);
+        JS_FreeAtom(ctx, atom);
+    }
+
+    JS_FreeValue(ctx, global);
+    return ret < 0 ? -1 : 0;
+}
@@ -0,0 +1,15 @@
+/*
+ * Native Web APIs for the sandbox: Headers, URL and URLSearchParams
+ */
+
+#ifndef QUICKJS_WEB_API_H
+#define QUICKJS_WEB_API_H
+
+#include "quickjs.h"
+
+// Define Headers, URL and URLSearchParams on the global object of ctx.
+// Each class is created the first time a script reads (or assigns) its
+// global. Returns 0 on success, -1 with a pending exception.
+int web_api_install(JSContext *ctx);
+
+#endif
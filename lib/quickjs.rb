@@ -3,11 +3,20 @@
 require_relative "quickjs/version"
 require_relative "quickjs/errors"
 require_relative "quickjs/result"
+require_relative "quickjs/dns_cache"
 require_relative "quickjs/http_config"
+require_relative "quickjs/http_connection_pool"
+require_relative "quickjs/http_response_cache"
 require_relative "quickjs/http_executor"
 require_relative "quickjs/fetch_polyfill"
 require_relative "quickjs/quickjs_native"
+require_relative "quickjs/handle"
+require_relative "quickjs/script"
+require_relative "quickjs/module_cache"
+require_relative "quickjs/runtime"
 require_relative "quickjs/sandbox"
+require_relative "quickjs/template"
+require_relative "quickjs/pool"
 
 module QuickJS
   # Convenience method for one-shot evaluation
@@ -0,0 +1,121 @@
+# frozen_string_literal: true
+
+require "ipaddr"
+require "resolv"
+
+module QuickJS
+  # DNSCache resolves host names for fetch() and remembers the answers for
+  # their DNS TTL (clamped to min_ttl..max_ttl), so each request does at most
+  # one lookup and repeated requests do none. Failed lookups are remembered
+  # for negative_ttl seconds.
+  #
+  # Entries from the hosts file are kept for max_ttl. The cache is shared by
+  # every sandbox in the process (see DNSCache.shared) and holds at most
+  # max_entries hosts, evicting the least recently added.
+  class DNSCache
+    DEFAULT_MIN_TTL = 1 # seconds
+    DEFAULT_MAX_TTL = 300 # seconds
+    DEFAULT_NEGATIVE_TTL = 5 # seconds
+    DEFAULT_MAX_ENTRIES = 1024
+
+    @shared = nil
+    @shared_mutex = Mutex.new
+
+    class << self
+      # The cache used by HTTPConfig unless given another one
+      #
+      # @return [DNSCache]
+      def shared
+        @shared_mutex.synchronize { @shared ||= new }
+      end
+
+      # Replace the shared cache
+      #
+      # @param cache [DNSCache]
+      def shared=(cache)
+        @shared_mutex.synchronize { @shared = cache }
+      end
+    end
+
+    # @param min_ttl [Numeric] Shortest time an answer is kept, in seconds
+    # @param max_ttl [Numeric] Longest time an answer is kept, in seconds
+    # @param negative_ttl [Numeric] Time a failed lookup is kept, in seconds
+    # @param max_entries [Integer] Maximum number of cached hosts
+    # @param resolver [#call, nil] Called with a host name, returns [address or nil, ttl in seconds]
+    #   (default: hosts file, then DNS)
+    def initialize(min_ttl: DEFAULT_MIN_TTL, max_ttl: DEFAULT_MAX_TTL, negative_ttl: DEFAULT_NEGATIVE_TTL,
+                   max_entries: DEFAULT_MAX_ENTRIES, resolver: nil)
+      raise ArgumentError, "min_ttl (#{min_ttl}) must not exceed max_ttl (#{max_ttl})" if min_ttl > max_ttl
+
+      @min_ttl = min_ttl
+      @max_ttl = max_ttl
+      @negative_ttl = negative_ttl
+      @max_entries = max_entries
+      @resolver = resolver || method(:lookup)
+      @mutex = Mutex.new
+      @entries = {}
+      @hosts = Resolv::Hosts.new
+      @dns = Resolv::DNS.new
+    end
+
+    # Resolve a host name to an IP address. IP literals are returned as is.
+    #
+    # @param host [String]
+    # @return [String, nil] The address, or nil if the host does not resolve
+    def resolve(host)
+      return host.delete_prefix("[").delete_suffix("]") if ip_literal?(host)
+
+      now = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      entry = @mutex.synchronize { @entries[host] }
+      return entry[0] if entry && entry[1] > now
+
+      address, ttl = @resolver.call(host)
+      ttl = address ? ttl.clamp(@min_ttl, @max_ttl) : @negative_ttl
+      @mutex.synchronize do
+        @entries.delete(host)
+        @entries.shift while @entries.size >= @max_entries
+        @entries[host] = [address, now + ttl].freeze
+      end
+      address
+    end
+
+    # Forget all cached answers
+    def clear
+      @mutex.synchronize { @entries.clear }
+      nil
+    end
+
+    # @return [Integer] Number of cached hosts (including failed lookups)
+    def size
+      @mutex.synchronize { @entries.size }
+    end
+
+    private
+
+    def ip_literal?(host)
+      IPAddr.new(host.delete_prefix("[").delete_suffix("]"))
+      true
+    rescue IPAddr::InvalidAddressError
+      false
+    end
+
+    # Default resolver: hosts file, then A and AAAA records
+    def lookup(host)
+      begin
+        return [@hosts.getaddress(host), @max_ttl]
+      rescue Resolv::ResolvError
+        # Not in the hosts file
+      end
+
+      [Resolv::DNS::Resource::IN::A, Resolv::DNS::Resource::IN::AAAA].each do |type|
+        records = @dns.getresources(host, type)
+        next if records.empty?
+
+        return [records.first.address.to_s, records.map(&:ttl).min]
+      end
+      [nil, 0]
+    rescue Resolv::ResolvError, SystemCallError, IOError
+      [nil, 0]
+    end
+  end
+end
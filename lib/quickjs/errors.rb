@@ -2,7 +2,15 @@
 
 module QuickJS
   # Base error class for all QuickJS errors
-  class Error < StandardError; end
+  class Error < StandardError
+    # @return [Hash{Symbol => Numeric}, nil] Execution metrics of the failed
+    #   evaluation (see Result#metrics), when the error was raised by one
+    attr_reader :metrics
+
+    # @return [String, nil] Samples taken before the error when the evaluation
+    #   was profiled (see Result#profile)
+    attr_reader :profile
+  end
 
   # Raised when JavaScript code has a syntax error
   class SyntaxError < Error
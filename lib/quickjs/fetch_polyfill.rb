@@ -2,15 +2,12 @@
 
 module QuickJS
   # JavaScript polyfills for the Fetch API
-  # These provide standard Headers, Request, Response, URL, and URLSearchParams classes
+  # These provide standard Request, Response, TextEncoder and TextDecoder classes.
+  # Headers, URL and URLSearchParams are native (ext/quickjs/web_api.c).
   module FetchPolyfill
     POLYFILLS_DIR = File.expand_path("../../polyfills", __dir__)
 
-    URL_SEARCH_PARAMS = File.read(File.join(POLYFILLS_DIR, "urlsearchparams.js"))
-
-    URL_CLASS = File.read(File.join(POLYFILLS_DIR, "url.js"))
-
-    HEADERS_CLASS = File.read(File.join(POLYFILLS_DIR, "headers.js"))
+    TEXT_ENCODING = File.read(File.join(POLYFILLS_DIR, "text_encoding.js"))
 
     RESPONSE_CLASS = File.read(File.join(POLYFILLS_DIR, "response.js"))
 
@@ -20,12 +17,27 @@ module QuickJS
 
     # Combined polyfill in correct dependency order
     FULL_POLYFILL = [
-      URL_SEARCH_PARAMS,
-      URL_CLASS,
-      HEADERS_CLASS,
+      TEXT_ENCODING,
       RESPONSE_CLASS,
       REQUEST_CLASS,
       FETCH_WRAPPER
     ].join("\n")
+
+    @bytecode = nil
+    @bytecode_mutex = Mutex.new
+
+    # Bytecode for FULL_POLYFILL, compiled once per process
+    #
+    # The first sandbox that needs the polyfill compiles it; every sandbox
+    # created afterwards loads the cached bytecode instead of re-parsing the
+    # source, so creation cost no longer scales with the polyfill size.
+    #
+    # @param native_sandbox [NativeSandbox] Sandbox used to compile on first call
+    # @return [String] Frozen binary String accepted by NativeSandbox#eval_bytecode
+    def self.bytecode(native_sandbox)
+      @bytecode || @bytecode_mutex.synchronize do
+        @bytecode ||= native_sandbox.compile(FULL_POLYFILL)
+      end
+    end
   end
 end
@@ -0,0 +1,73 @@
+# frozen_string_literal: true
+
+module QuickJS
+  # Reference to a JavaScript object or array that stays in its sandbox,
+  # returned as Result#value by Sandbox#eval(code, lazy: true)
+  #
+  # Nothing is converted up front: #[] converts one property at a time (nested
+  # objects and arrays come back as Handles too) and #to_ruby converts the whole
+  # value the way a regular eval would. Reading a property runs its getter, if
+  # any, under the sandbox's timeout.
+  #
+  # A Handle keeps its object alive until the Handle is garbage collected.
+  # Sandbox#reset! invalidates all Handles of the sandbox; using one afterwards
+  # raises QuickJS::Error.
+  #
+  # @example
+  #   order = sandbox.eval("buildOrder()", lazy: true).value
+  #   order["status"]                   # => "paid"
+  #   order.dig("lines", 0, "sku")      # => "A-1"
+  #   order["lines"].to_ruby            # => [{"sku" => "A-1", ...}, ...]
+  class Handle
+    include Enumerable
+
+    # @!method [](key)
+    #   @param key [String, Symbol, Integer] Property name or array index
+    #   @return [Object, Handle, nil] Converted value (nil when missing)
+
+    # @!method keys
+    #   @return [Array<String>] Own enumerable property names
+
+    # @!method array?
+    #   @return [Boolean] Whether the value is a JavaScript array
+
+    # @!method to_ruby
+    #   @return [Hash, Array] The fully converted value
+
+    # @!method valid?
+    #   @return [Boolean] False once the sandbox has been reset or freed
+
+    # Yield each element of an array, or each key and value of an object
+    def each
+      return enum_for(:each) { size } unless block_given?
+
+      if array?
+        size.times { |i| yield self[i] }
+      else
+        keys.each { |key| yield key, self[key] }
+      end
+      self
+    end
+
+    # Read a nested value, converting only the properties on the way
+    def dig(key, *rest)
+      value = self[key]
+      return value if rest.empty? || value.nil?
+      raise TypeError, "#{value.class} does not have #dig method" unless value.respond_to?(:dig)
+
+      value.dig(*rest)
+    end
+
+    # @return [Integer] Array length, or number of keys of an object
+    def size
+      array? ? self["length"] : keys.size
+    end
+    alias length size
+
+    def inspect
+      return "#<#{self.class} (invalid)>" unless valid?
+
+      "#<#{self.class} #{array? ? "array" : "object"}>"
+    end
+  end
+end
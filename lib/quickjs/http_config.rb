@@ -27,7 +27,7 @@ module QuickJS
 
     attr_reader :allowlist, :denylist, :max_requests, :request_timeout,
                 :max_request_size, :max_response_size, :allowed_methods,
-                :block_private_ips, :allowed_ports
+                :block_private_ips, :allowed_ports, :response_cache
 
     def initialize(options = {})
       @allowlist = compile_patterns(options[:allowlist] || [])
@@ -39,6 +39,8 @@ module QuickJS
       @allowed_methods = options[:allowed_methods] || DEFAULT_ALLOWED_METHODS
       @block_private_ips = options.fetch(:block_private_ips, true)
       @allowed_ports = options[:allowed_ports] || DEFAULT_ALLOWED_PORTS
+      @dns_cache = options[:dns_cache] || DNSCache.shared
+      @response_cache = build_response_cache(options[:cache])
 
       validate_list_configuration!
     end
@@ -70,16 +72,17 @@ module QuickJS
       return false unless @block_private_ips
 
       # Resolve hostname to IP if needed
-      ip_str = resolve_to_ip(ip_or_host)
+      ip_str = resolve(ip_or_host)
       return false unless ip_str
 
-      ip = IPAddr.new(ip_str)
+      blocked_address?(ip_str)
+    end
 
-      # Check against blocked ranges
-      BLOCKED_IP_RANGES.any? { |range| range.include?(ip) }
-    rescue IPAddr::InvalidAddressError, SocketError
-      # If we can't parse/resolve, block it to be safe
-      true
+    # Resolve a host name (through the DNS cache)
+    #
+    # @return [String, nil] IP address, or nil if the host does not resolve
+    def resolve(host)
+      @dns_cache.resolve(host)
     end
 
     # Validate a URL before making a request
@@ -97,8 +100,16 @@ module QuickJS
 
       end
 
-      # Check if host resolves to blocked IP
-      raise HTTPBlockedError, "URL resolves to blocked IP address: #{url}" if blocked_ip?(uri.host)
+      # Check if host resolves to blocked IP. The vetted address is returned
+      # so the request connects to it instead of resolving the host again.
+      # A host that does not resolve cannot be vetted, so it is rejected.
+      return unless @block_private_ips
+
+      address = resolve(uri.hostname)
+      raise HTTPError, "Network error: cannot resolve host #{uri.hostname}" unless address
+      raise HTTPBlockedError, "URL resolves to blocked IP address: #{url}" if blocked_address?(address)
+
+      address
     end
 
     # Check if using denylist mode
@@ -116,6 +127,17 @@ module QuickJS
 
     private
 
+    # cache: true, a settings hash, or an HTTPResponseCache
+    def build_response_cache(cache)
+      case cache
+      when nil, false then nil
+      when true then HTTPResponseCache.shared
+      when Hash then HTTPResponseCache.shared(**cache)
+      when HTTPResponseCache then cache
+      else raise ArgumentError, "Invalid cache option: #{cache.inspect}"
+      end
+    end
+
     # Validate that allowlist and denylist are not used together
     def validate_list_configuration!
       return unless @allowlist.any? && @denylist.any?
@@ -138,36 +160,33 @@ module QuickJS
       end
     end
 
-    # Resolve hostname to IP address
-    def resolve_to_ip(host)
-      # If it's already an IP, return it
-      begin
-        IPAddr.new(host)
-        return host
-      rescue IPAddr::InvalidAddressError
-        # Not an IP, continue to DNS resolution
-      end
-
-      # Resolve DNS
-      begin
-        require "resolv"
-        Resolv.getaddress(host)
-      rescue Resolv::ResolvError
-        nil
-      end
+    # Check a resolved address against the blocked ranges
+    def blocked_address?(ip_str)
+      ip = IPAddr.new(ip_str)
+      BLOCKED_IP_RANGES.any? { |range| range.include?(ip) }
+    rescue IPAddr::InvalidAddressError
+      # If we can't parse it, block it to be safe
+      true
     end
   end
 
   class HTTPRequest
     attr_reader :method, :url, :status, :duration_ms, :request_size, :response_size
 
-    def initialize(method:, url:, status: nil, duration_ms: 0, request_size: 0, response_size: 0)
+    def initialize(method:, url:, status: nil, duration_ms: 0, request_size: 0, response_size: 0, cached: false)
       @method = method
       @url = url
       @status = status
       @duration_ms = duration_ms
       @request_size = request_size
       @response_size = response_size
+      @cached = cached
+    end
+
+    # @return [Boolean] true if the response body was served from the response cache
+    #   (fresh, or revalidated with a 304)
+    def cached?
+      @cached
     end
 
     def to_h
@@ -177,7 +196,8 @@ module QuickJS
         status: @status,
         duration_ms: @duration_ms,
         request_size: @request_size,
-        response_size: @response_size
+        response_size: @response_size,
+        cached: @cached
       }
     end
   end
@@ -0,0 +1,203 @@
+# frozen_string_literal: true
+
+require "net/http"
+
+module QuickJS
+  # HTTPConnectionPool keeps Net::HTTP connections open between requests so
+  # repeated fetch() calls to the same origin skip the TCP and TLS handshakes.
+  #
+  # Connections are keyed by scheme, host, port and the IP address they are
+  # pinned to (see HTTPConfig#validate_url!), and shared by every sandbox in
+  # the process (see HTTPConnectionPool.shared); request limits and logging
+  # stay per eval in HTTPExecutor. At most max_per_host
+  # connections per origin are open at once, extra requests wait for one to
+  # be checked in. Connections idle for longer than idle_timeout are closed.
+  #
+  # A kept connection whose socket was closed (by the server, or after
+  # keep_alive_timeout) reconnects on its next request, resuming its TLS
+  # session when the server allows it.
+  class HTTPConnectionPool
+    DEFAULT_MAX_PER_HOST = 8
+    DEFAULT_IDLE_TIMEOUT = 30 # seconds
+    DEFAULT_KEEP_ALIVE_TIMEOUT = 2 # seconds
+
+    @shared = nil
+    @shared_mutex = Mutex.new
+
+    class << self
+      # The pool used by HTTPExecutor unless given another one
+      #
+      # @return [HTTPConnectionPool]
+      def shared
+        @shared_mutex.synchronize { @shared ||= new }
+      end
+
+      # Replace the shared pool (e.g. to change its limits). The previous
+      # pool's idle connections are closed.
+      #
+      # @param pool [HTTPConnectionPool]
+      def shared=(pool)
+        previous = @shared_mutex.synchronize { @shared.tap { @shared = pool } }
+        previous&.close unless previous.equal?(pool)
+      end
+    end
+
+    # Connections of one origin
+    Origin = Struct.new(:idle, :active)
+    private_constant :Origin
+
+    attr_reader :max_per_host, :idle_timeout, :keep_alive_timeout
+
+    # @param max_per_host [Integer] Maximum open connections per scheme/host/port
+    # @param idle_timeout [Numeric] Seconds a connection may stay unused in the pool
+    # @param keep_alive_timeout [Numeric] Seconds an idle socket is trusted to still be open
+    def initialize(max_per_host: DEFAULT_MAX_PER_HOST, idle_timeout: DEFAULT_IDLE_TIMEOUT,
+                   keep_alive_timeout: DEFAULT_KEEP_ALIVE_TIMEOUT)
+      raise ArgumentError, "max_per_host must be at least 1 (got #{max_per_host})" if max_per_host < 1
+
+      @max_per_host = max_per_host
+      @idle_timeout = idle_timeout
+      @keep_alive_timeout = keep_alive_timeout
+      @mutex = Mutex.new
+      @condition = ConditionVariable.new
+      @origins = {}
+      @pid = Process.pid
+    end
+
+    # Perform a request on a pooled connection
+    #
+    # @param uri [URI::HTTP] Request URL (its scheme, host and port select the connection)
+    # @param request [Net::HTTPRequest]
+    # @param timeout_ms [Integer] Open/read timeout, also bounds the wait for a free connection
+    # @param address [String, nil] IP address to connect to instead of resolving the host
+    # @return [Net::HTTPResponse]
+    # @raise [HTTPError] No connection became available in time
+    def request(uri, request, timeout_ms, address: nil)
+      key = [uri.scheme, uri.hostname, uri.port, address].freeze
+
+      # Interrupts (Thread#kill from HTTPExecutor#cancel) are deferred from
+      # taking a connection slot until the ensure clause below covers it
+      Thread.handle_interrupt(Object => :on_blocking) do
+        http, expired = checkout(key, timeout_ms)
+        reusable = false
+        begin
+          Thread.handle_interrupt(Object => :immediate) do
+            expired.each { |connection| finish(connection) }
+            http.open_timeout = timeout_ms / 1000.0
+            http.read_timeout = timeout_ms / 1000.0
+            http.start unless http.started?
+            response = http.request(request)
+            reusable = true
+            response
+          end
+        ensure
+          # Anything else (error, Thread#kill) may leave a half-read response
+          # on the socket, so the connection is discarded
+          checkin(key, http, reusable)
+        end
+      end
+    end
+
+    # @return [Hash] Open connections: {idle:, active:} totals across origins
+    def stats
+      @mutex.synchronize do
+        discard_after_fork
+        {
+          idle: @origins.each_value.sum { |origin| origin.idle.size },
+          active: @origins.each_value.sum(&:active)
+        }
+      end
+    end
+
+    # Close all idle connections
+    def close
+      idle = @mutex.synchronize do
+        @origins.each_value.flat_map { |origin| origin.idle.map(&:first).tap { origin.idle.clear } }
+      end
+      idle.each { |http| finish(http) }
+      nil
+    end
+
+    private
+
+    # Take a connection slot of the origin, waiting while all are in use.
+    # Returns the connection and the expired ones to close.
+    def checkout(key, timeout_ms)
+      deadline = now + (timeout_ms / 1000.0)
+      expired = []
+
+      http = @mutex.synchronize do
+        discard_after_fork
+        origin = (@origins[key] ||= Origin.new([], 0))
+        loop do
+          # Idle connections are ordered by last use: expire the oldest
+          cutoff = now - @idle_timeout
+          expired << origin.idle.shift.first while origin.idle.any? && origin.idle.first[1] < cutoff
+
+          if (entry = origin.idle.pop)
+            origin.active += 1
+            break entry.first
+          end
+          if origin.active < @max_per_host
+            origin.active += 1
+            break nil
+          end
+
+          remaining = deadline - now
+          if remaining <= 0
+            raise HTTPError, "Request timeout: no connection to #{key[1]}:#{key[2]} available " \
+                             "(#{@max_per_host} in use)"
+          end
+          @condition.wait(@mutex, remaining)
+        end
+      end
+
+      [http || new_connection(key), expired]
+    end
+
+    def new_connection(key)
+      scheme, host, port, address = key
+      http = Net::HTTP.new(host, port)
+      http.use_ssl = (scheme == "https")
+      # TLS still verifies the certificate (and sends SNI) for the host
+      http.ipaddr = address if address
+      http.keep_alive_timeout = @keep_alive_timeout
+      http
+    end
+
+    def checkin(key, http, reusable)
+      discard = nil
+      @mutex.synchronize do
+        origin = @origins[key]
+        if origin && @pid == Process.pid
+          origin.active -= 1
+          if reusable && http.started?
+            origin.idle << [http, now]
+          else
+            discard = http
+          end
+          @condition.signal
+        end
+      end
+      finish(discard) if discard
+    end
+
+    # Forked children must not share their parent's sockets
+    def discard_after_fork
+      return if @pid == Process.pid
+
+      @pid = Process.pid
+      @origins = {}
+    end
+
+    def finish(http)
+      http.finish if http.started?
+    rescue StandardError
+      nil # Closing is best effort
+    end
+
+    def now
+      Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    end
+  end
+end
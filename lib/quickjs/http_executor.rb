@@ -5,17 +5,97 @@ require "json"
 
 module QuickJS
   class HTTPExecutor
-    def initialize(config)
+    # @param config [HTTPConfig]
+    # @param connection_pool [HTTPConnectionPool] Keeps connections open across evals and sandboxes
+    def initialize(config, connection_pool: HTTPConnectionPool.shared)
       @config = config
+      @connection_pool = connection_pool
       @request_count = 0
       @http_requests = []
+      @mutex = Mutex.new
+      @last_id = 0
+      @threads = {}
+      @completed = []
     end
 
     attr_reader :http_requests
 
+    # Called (from the request's thread) whenever a request started with
+    # #start completes
+    attr_accessor :on_complete
+
     # Execute an HTTP request from JavaScript
     # Returns a hash with: {status, statusText, headers, body}
     def execute(method, url, options = {})
+      perform(prepare(method, url, options))
+    end
+
+    # Start an HTTP request on its own thread and return its id without
+    # waiting for it. Limits and the allowlist are checked right away and
+    # raise like #execute; the outcome (response hash or exception) is
+    # collected with #take_completed.
+    #
+    # @return [Integer] Request id
+    def start(method, url, options = {})
+      request = prepare(method, url, options)
+
+      @mutex.synchronize do
+        id = (@last_id += 1)
+        @threads[id] = Thread.new do
+          outcome = begin
+            perform(request)
+          rescue StandardError => e
+            e
+          end
+          @mutex.synchronize do
+            @threads.delete(id)
+            @completed << [id, outcome]
+          end
+          @on_complete&.call
+        end
+        id
+      end
+    end
+
+    # @return [Array<Array(Integer, Object)>] Requests completed since the last
+    #   call, as [id, response hash or exception] pairs
+    def take_completed
+      @mutex.synchronize do
+        completed = @completed
+        @completed = []
+        completed
+      end
+    end
+
+    # Start over for a new eval: the request count (checked against
+    # max_requests) and the request log are cleared. Ids keep increasing, so
+    # a request an earlier eval abandoned is never taken for a new one.
+    def reset
+      @mutex.synchronize do
+        @request_count = 0
+        @http_requests = []
+        @completed = []
+      end
+    end
+
+    # Abandon all requests still in flight. Runs to completion even when
+    # called with an interrupt (Thread#raise) pending.
+    def cancel
+      Thread.handle_interrupt(Object => :never) do
+        threads = @mutex.synchronize do
+          @completed = []
+          @threads.values.tap { @threads = {} }
+        end
+        threads.each(&:kill)
+      end
+    end
+
+    private
+
+    Request = Struct.new(:method, :url, :address, :headers, :body, :timeout_ms, :request_size)
+
+    # Validate a request and count it against max_requests
+    def prepare(method, url, options)
       # Validate request count
       if @request_count >= @config.max_requests
         raise HTTPLimitError, "Maximum number of requests (#{@config.max_requests}) exceeded"
@@ -24,8 +104,8 @@ module QuickJS
       # Validate method
       method = @config.validate_method(method)
 
-      # Validate URL
-      @config.validate_url!(url)
+      # Validate URL (resolving its host when private IPs are blocked)
+      address = @config.validate_url!(url)
 
       # Parse options
       headers = options[:headers] || {}
@@ -40,47 +120,70 @@ module QuickJS
 
       # Track request
       @request_count += 1
+
+      Request.new(method, url, address, headers, body, timeout_ms, request_size)
+    end
+
+    def perform(request)
       start_time = Time.now
 
-      begin
-        # Perform the HTTP request
-        response = perform_http_request(method, url, headers, body, timeout_ms)
+      # Perform the HTTP request
+      response, cached = if @config.response_cache && request.method == "GET"
+                           perform_cached(request, @config.response_cache)
+                         else
+                           [perform_http_request(request.method, request.url, request.address, request.headers,
+                                                 request.body, request.timeout_ms), false]
+                         end
+
+      # Validate response size
+      response_size = response[:body].bytesize
+      if response_size > @config.max_response_size
+        raise HTTPLimitError, "Response size (#{response_size}) exceeds limit (#{@config.max_response_size})"
+      end
 
-        # Validate response size
-        response_size = response[:body].bytesize
-        if response_size > @config.max_response_size
-          raise HTTPLimitError, "Response size (#{response_size}) exceeds limit (#{@config.max_response_size})"
-        end
+      duration_ms = ((Time.now - start_time) * 1000).to_i
+
+      # Log the request
+      log = HTTPRequest.new(
+        method: request.method,
+        url: request.url,
+        status: response[:status],
+        duration_ms: duration_ms,
+        request_size: request.request_size,
+        response_size: response_size,
+        cached: cached
+      )
+      @mutex.synchronize { @http_requests << log }
+
+      response
+    end
 
-        duration_ms = ((Time.now - start_time) * 1000).to_i
+    # Serve a GET request from the response cache when possible
+    #
+    # @return [Array(Hash, Boolean)] The response, and whether its body came from the cache
+    def perform_cached(request, cache)
+      key = cache.key(request.url, request.headers)
+      entry = cache.lookup(key)
+      return [entry.response, true] if entry&.fresh?
 
-        # Log the request
-        @http_requests << HTTPRequest.new(
-          method: method,
-          url: url,
-          status: response[:status],
-          duration_ms: duration_ms,
-          request_size: request_size,
-          response_size: response_size
-        )
+      headers = entry ? request.headers.merge(entry.validators) : request.headers
+      response = perform_http_request(request.method, request.url, request.address, headers,
+                                      request.body, request.timeout_ms)
 
-        response
-      end
-    end
+      return [cache.revalidated(key, entry, response).response, true] if entry && response[:status] == 304
 
-    private
+      cache.store(key, response) if response[:body].bytesize <= @config.max_response_size
+      [response, false]
+    end
 
-    def perform_http_request(method, url, headers, body, timeout_ms)
+    def perform_http_request(method, url, address, headers, body, timeout_ms)
       uri = URI.parse(url)
 
-      # Re-validate IP after DNS resolution (prevent DNS rebinding)
-      raise HTTPBlockedError, "URL resolves to blocked IP address: #{url}" if @config.blocked_ip?(uri.host)
-
-      # Create HTTP object
-      http = Net::HTTP.new(uri.host, uri.port)
-      http.use_ssl = (uri.scheme == "https")
-      http.open_timeout = timeout_ms / 1000.0
-      http.read_timeout = timeout_ms / 1000.0
+      # Connect to the address vetted by validate_url!: the host is not
+      # resolved again, which would open a DNS rebinding window. Hosts are
+      # only resolved here when private IPs are allowed (nothing to vet).
+      address ||= @config.resolve(uri.hostname) unless @config.block_private_ips
+      raise HTTPError, "Network error: cannot resolve host #{uri.hostname}" unless address
 
       # Create request
       request = case method
@@ -106,8 +209,8 @@ module QuickJS
       # Set body if present
       request.body = body if body
 
-      # Execute request
-      response = http.request(request)
+      # Execute request on a pooled keep-alive connection
+      response = @connection_pool.request(uri, request, timeout_ms, address: address)
 
       # Build response hash
       response_headers = {}
@@ -0,0 +1,193 @@
+# frozen_string_literal: true
+
+require "time"
+
+module QuickJS
+  # HTTPResponseCache stores fetch() responses following their
+  # Cache-Control and Expires headers, so scripts that fetch the same
+  # resources on every eval skip the network while the responses are fresh.
+  # Stale responses with an ETag or Last-Modified validator are revalidated
+  # with a conditional request, and a 304 reuses the stored body.
+  #
+  # Only successful GET responses are stored, keyed by URL and request
+  # headers. Responses marked no-store or private (this is a shared cache)
+  # are never stored; no-cache ones are revalidated on every use. Responses
+  # without freshness information stay fresh for default_ttl seconds.
+  #
+  # Enabled per sandbox with http: { cache: { max_bytes:, default_ttl: } }.
+  # Sandboxes using the same settings share one cache (see
+  # HTTPResponseCache.shared), which holds at most max_bytes of response
+  # bodies and evicts the least recently used entries.
+  class HTTPResponseCache
+    DEFAULT_MAX_BYTES = 10 * 1_048_576 # 10MB
+    DEFAULT_TTL = 0 # seconds
+
+    # A stored response
+    Entry = Struct.new(:response, :size, :expires_at, :etag, :last_modified) do
+      # @return [Boolean] true while the response can be used without revalidation
+      def fresh?(now = HTTPResponseCache.now)
+        expires_at > now
+      end
+
+      # @return [Hash] Conditional request headers revalidating the response
+      def validators
+        headers = {}
+        headers["If-None-Match"] = etag if etag
+        headers["If-Modified-Since"] = last_modified if last_modified
+        headers
+      end
+    end
+
+    @shared = {}
+    @shared_mutex = Mutex.new
+
+    class << self
+      # The process-wide cache for the given settings
+      #
+      # @return [HTTPResponseCache]
+      def shared(max_bytes: DEFAULT_MAX_BYTES, default_ttl: DEFAULT_TTL)
+        @shared_mutex.synchronize do
+          @shared[[max_bytes, default_ttl]] ||= new(max_bytes: max_bytes, default_ttl: default_ttl)
+        end
+      end
+
+      # @api private
+      def now
+        Process.clock_gettime(Process::CLOCK_MONOTONIC)
+      end
+    end
+
+    attr_reader :max_bytes, :default_ttl
+
+    # @param max_bytes [Integer] Maximum total size of the stored bodies
+    # @param default_ttl [Numeric] Freshness, in seconds, of responses that don't specify one
+    def initialize(max_bytes: DEFAULT_MAX_BYTES, default_ttl: DEFAULT_TTL)
+      raise ArgumentError, "max_bytes must be positive (got #{max_bytes})" unless max_bytes.positive?
+
+      @max_bytes = max_bytes
+      @default_ttl = default_ttl
+      @mutex = Mutex.new
+      @entries = {}
+      @bytes = 0
+    end
+
+    # @param url [String]
+    # @param headers [Hash] Request headers
+    # @return [Array] Cache key of the request
+    def key(url, headers)
+      [url, headers.map { |name, value| [name.to_s.downcase, value.to_s] }.sort].freeze
+    end
+
+    # @return [Entry, nil] The stored response (fresh or not) for the key
+    def lookup(key)
+      @mutex.synchronize do
+        entry = @entries.delete(key)
+        @entries[key] = entry if entry # Most recently used last
+        entry
+      end
+    end
+
+    # Store a response, unless its headers forbid it
+    #
+    # @param response [Hash] Response hash from HTTPExecutor ({status:, statusText:, headers:, body:})
+    # @return [Entry, nil]
+    def store(key, response)
+      return nil unless response[:status] == 200
+
+      headers = response[:headers]
+      directives = cache_control(headers)
+      return nil if directives.key?("no-store") || directives.key?("private")
+
+      etag = headers["etag"]
+      last_modified = headers["last-modified"]
+      lifetime = freshness_lifetime(headers, directives)
+      # Responses that cannot be used now and cannot be revalidated later
+      return nil if lifetime <= 0 && !etag && !last_modified
+
+      size = response[:body].bytesize
+      return nil if size > @max_bytes
+
+      response = response.merge(headers: headers.dup.freeze).freeze
+      entry = Entry.new(response, size, self.class.now + lifetime, etag, last_modified).freeze
+      put(key, entry)
+      entry
+    end
+
+    # Record a 304 Not Modified answer to the conditional request for an entry
+    #
+    # @param response [Hash] The 304 response
+    # @return [Entry] The entry with refreshed headers and freshness
+    def revalidated(key, entry, response)
+      headers = entry.response[:headers].merge(response[:headers])
+      updated = store(key, entry.response.merge(headers: headers))
+      return updated if updated
+
+      # The new headers forbid storing (or reusing) it: serve it this once
+      delete(key)
+      Entry.new(entry.response.merge(headers: headers.freeze).freeze, entry.size, 0, nil, nil).freeze
+    end
+
+    # Forget all stored responses
+    def clear
+      @mutex.synchronize do
+        @entries.clear
+        @bytes = 0
+      end
+      nil
+    end
+
+    # @return [Hash] {entries:, bytes:}
+    def stats
+      @mutex.synchronize { { entries: @entries.size, bytes: @bytes } }
+    end
+
+    private
+
+    def put(key, entry)
+      @mutex.synchronize do
+        previous = @entries.delete(key)
+        @bytes -= previous.size if previous
+        while @bytes + entry.size > @max_bytes
+          _, evicted = @entries.shift
+          @bytes -= evicted.size
+        end
+        @entries[key] = entry
+        @bytes += entry.size
+      end
+    end
+
+    def delete(key)
+      @mutex.synchronize do
+        entry = @entries.delete(key)
+        @bytes -= entry.size if entry
+      end
+    end
+
+    # @return [Hash] Cache-Control directives, names downcased ("max-age" => "60", "no-cache" => nil)
+    def cache_control(headers)
+      headers["cache-control"].to_s.split(",").each_with_object({}) do |directive, directives|
+        name, value = directive.strip.split("=", 2)
+        directives[name.downcase] = value&.delete('"') if name && !name.empty?
+      end
+    end
+
+    # Seconds the response is fresh for (RFC 9111, section 4.2.1)
+    def freshness_lifetime(headers, directives)
+      return 0 if directives.key?("no-cache")
+
+      max_age = directives["s-maxage"] || directives["max-age"]
+      return Integer(max_age, exception: false) || 0 if max_age
+
+      if (expires = headers["expires"])
+        begin
+          date = headers["date"] ? Time.httpdate(headers["date"]) : Time.now
+          return Time.httpdate(expires) - date
+        rescue ArgumentError
+          return 0 # Invalid dates mean already expired
+        end
+      end
+
+      @default_ttl
+    end
+  end
+end
@@ -0,0 +1,60 @@
+# frozen_string_literal: true
+
+module QuickJS
+  # Process-wide cache of compiled ES modules
+  #
+  # Modules imported by Sandbox#eval_module (or import()) are compiled once
+  # per name and source, and every sandbox importing the same module
+  # afterwards reads its bytecode instead of parsing it again. The bytecode
+  # is only read into a context; each sandbox still evaluates the module
+  # once, with its own module state.
+  module ModuleCache
+    # Maximum number of modules kept
+    MAX_ENTRIES = 1000
+
+    @cache = {}
+    @mutex = Mutex.new
+
+    class << self
+      # Return the bytecode for the module, compiling it on a cache miss
+      #
+      # Entries are keyed by the resolved module name and the source (the
+      # bytecode records the name, which relative imports are resolved
+      # against) and evicted oldest first.
+      #
+      # @api private
+      # @param name [String] Resolved module name
+      # @param source [String] JavaScript source of the module
+      # @yieldreturn [String, nil] Frozen bytecode for source, nil if it did not compile
+      # @return [String, nil] Frozen bytecode
+      def bytecode_for(name, source)
+        key = [name.frozen? ? name : name.dup.freeze, source.frozen? ? source : source.dup.freeze]
+        cached = @mutex.synchronize { @cache[key] }
+        return cached if cached
+
+        # Compile outside the lock: a concurrent miss on the same module just
+        # compiles it twice
+        bytecode = yield
+        return nil unless bytecode
+
+        @mutex.synchronize do
+          @cache.delete(@cache.first[0]) if @cache.size >= MAX_ENTRIES
+          @cache[key] = bytecode
+        end
+      end
+
+      # Number of cached modules
+      #
+      # @return [Integer]
+      def size
+        @mutex.synchronize { @cache.size }
+      end
+
+      # Empty the cache
+      def clear
+        @mutex.synchronize { @cache.clear }
+        nil
+      end
+    end
+  end
+end
@@ -0,0 +1,203 @@
+# frozen_string_literal: true
+
+require "etc"
+
+module QuickJS
+  # Pool runs JavaScript on a fixed set of pre-initialized sandboxes, each
+  # owned by a dedicated worker thread.
+  #
+  # Sandboxes release the GVL while JavaScript executes, so the workers run
+  # on separate cores. Jobs are taken from a single shared queue: an idle
+  # worker always picks up the next job, which gives the same load balancing
+  # as work stealing for independent jobs without per-worker queues.
+  #
+  # Sandboxes are reused across jobs, so by default globals defined by one
+  # job are visible to later jobs on the same worker. Pass isolate: true to
+  # reset each sandbox (see Sandbox#reset!) after every job.
+  #
+  # A job that ends its worker thread (an exception other than
+  # StandardError, such as NoMemoryError or an Interrupt delivered with
+  # Thread#raise, or Thread#kill) still completes its Future, with an
+  # Error, and the worker is replaced by one using the same sandbox, reset.
+  # Workers Ruby kills while idle, such as when the process exits without
+  # #shutdown, are not replaced.
+  #
+  # @example
+  #   pool = QuickJS::Pool.new(size: 4, timeout_ms: 100)
+  #   futures = rules.map { |rule| pool.submit(rule, { input: payload }) }
+  #   futures.map { |f| f.value.value }
+  #   pool.shutdown
+  class Pool
+    # Result of a job submitted to a Pool
+    class Future
+      def initialize
+        @mutex = Mutex.new
+        @condition = ConditionVariable.new
+        @done = false
+        @result = nil
+        @error = nil
+      end
+
+      # Wait for the job and return its Result
+      #
+      # @return [Result]
+      # @raise [Error] Whatever QuickJS error the evaluation raised
+      def value
+        wait
+        raise @error if @error
+
+        @result
+      end
+
+      # Wait for the job to finish
+      #
+      # @param timeout [Numeric, nil] Maximum seconds to wait (nil waits forever)
+      # @return [Boolean] true if the job finished
+      def wait(timeout = nil)
+        deadline = timeout && (Process.clock_gettime(Process::CLOCK_MONOTONIC) + timeout)
+        @mutex.synchronize do
+          until @done
+            remaining = deadline && (deadline - Process.clock_gettime(Process::CLOCK_MONOTONIC))
+            break if remaining && remaining <= 0
+
+            @condition.wait(@mutex, remaining)
+          end
+          @done
+        end
+      end
+
+      # @return [Boolean] true if the job has finished (successfully or not)
+      def complete?
+        @mutex.synchronize { @done }
+      end
+
+      # @api private
+      def fulfill(result)
+        complete(result, nil)
+      end
+
+      # @api private
+      def reject(error)
+        complete(nil, error)
+      end
+
+      private
+
+      def complete(result, error)
+        @mutex.synchronize do
+          @result = result
+          @error = error
+          @done = true
+          @condition.broadcast
+        end
+      end
+    end
+
+    attr_reader :size
+
+    # Create a pool of sandboxes
+    #
+    # @param size [Integer] Number of sandboxes and worker threads (default: number of CPUs)
+    # @param isolate [Boolean] Reset the sandbox after every job so jobs cannot see each other's state
+    # @param sandbox_options [Hash] Options passed to Sandbox.new (memory_limit, timeout_ms, http, ...)
+    def initialize(size: Etc.nprocessors, isolate: false, **sandbox_options)
+      raise ArgumentError, "size must be at least 1 (got #{size})" if size < 1
+
+      @size = size
+      @isolate = isolate
+      @queue = Queue.new
+
+      # Create the sandboxes up front so configuration errors raise here
+      sandboxes = Array.new(size) { Sandbox.new(**sandbox_options) }
+      @workers_mutex = Mutex.new
+      @workers = sandboxes.map { |sandbox| start_worker(sandbox) }
+    end
+
+    # Submit JavaScript code for evaluation
+    #
+    # @param code [String] JavaScript code to execute
+    # @param variables [Hash] Global variables to set before evaluating (see Sandbox#set_variable)
+    # @return [Future] Resolves to the Result, or raises the evaluation error
+    # @raise [Error] The pool has been shut down
+    def submit(code, variables = {})
+      future = Future.new
+      @queue << [code, variables, future]
+      future
+    rescue ClosedQueueError
+      raise Error, "Pool has been shut down"
+    end
+
+    # Stop accepting jobs and stop the workers once queued jobs are done
+    #
+    # @param wait [Boolean] Block until all workers have exited
+    def shutdown(wait: true)
+      @queue.close
+      return unless wait
+
+      # Workers replaced while joining are joined as well
+      loop do
+        workers = @workers_mutex.synchronize { @workers.dup }
+        workers.each(&:join)
+        break if @workers_mutex.synchronize { @workers == workers }
+      end
+      nil
+    end
+
+    # @return [Boolean] true once shutdown has been called
+    def shutdown?
+      @queue.closed?
+    end
+
+    private
+
+    def start_worker(sandbox, reset: false)
+      Thread.new do
+        sandbox.reset! if reset
+        work(sandbox)
+      rescue Exception # rubocop:disable Lint/RescueException
+        # Already handed to the job's Future (see #work)
+        nil
+      end
+    end
+
+    # Start a worker in place of the current one, which dies inside a job,
+    # so the pool keeps its size. Its sandbox is reset first: the job may
+    # have stopped anywhere. Nothing is started once the pool is shut down
+    # (the remaining workers finish the queue) or while the process exits
+    # (its main thread has ended and Ruby is killing the other threads).
+    def replace_worker(sandbox)
+      return if @queue.closed? || !Thread.main.alive?
+
+      @workers_mutex.synchronize do
+        @workers[@workers.index(Thread.current)] = start_worker(sandbox, reset: true)
+      end
+    end
+
+    def work(sandbox)
+      while (job = @queue.pop)
+        code, variables, future = job
+        finished = false
+        begin
+          variables.each { |name, value| sandbox.set_variable(name.to_s, value) }
+          future.fulfill(sandbox.eval(code))
+          finished = true
+        rescue StandardError => e
+          future.reject(e)
+          finished = true
+        rescue Exception => e # rubocop:disable Lint/RescueException
+          # Ends the worker (see #start_worker)
+          future.reject(Error.new("Pool worker stopped during the job: #{e.class}: #{e.message}"))
+          raise
+        ensure
+          if finished
+            sandbox.reset! if @isolate
+          else
+            # Thread#kill skips the rescue clauses
+            future.reject(Error.new("Pool worker was killed during the job")) unless future.complete?
+            replace_worker(sandbox)
+          end
+        end
+      end
+    end
+  end
+end
@@ -5,11 +5,49 @@ module QuickJS
   class Result
     attr_reader :value, :console_output, :http_requests
 
+    # @return [Integer] Number of GC passes during this evaluation: those QuickJS
+    #   triggers on its own while allocating, plus the pass the sandbox ran after it
+    #   according to its gc policy
+    attr_reader :gc_count
+
+    # @return [Float] Milliseconds spent in those GC passes
+    attr_reader :gc_time_ms
+
+    # Execution metrics of the evaluation (frozen Hash with Symbol keys):
+    #
+    # - :wall_time_ms - elapsed time, including Promise jobs and result conversion
+    # - :cpu_time_ms - CPU time of the evaluating thread (includes time spent in
+    #   Ruby callbacks such as fetch)
+    # - :allocated_bytes - bytes allocated by the JavaScript heap
+    # - :peak_memory_bytes - high-water mark of the JavaScript heap size
+    # - :memory_bytes - JavaScript heap size at the end of the evaluation
+    # - :object_count, :shape_count - live objects and shapes in the runtime (only
+    #   with Sandbox.new(detailed_metrics: true), as counting walks the whole heap)
+    # - :job_count - pending jobs (Promise reactions) executed
+    # - :interrupt_checks - times QuickJS polled the interrupt handler (roughly
+    #   proportional to the amount of bytecode executed)
+    # - :gc_count, :gc_time_ms - same as the gc_count and gc_time_ms attributes
+    #
+    # @return [Hash{Symbol => Numeric}]
+    attr_reader :metrics
+
+    # Samples taken by Sandbox#eval(profile:), in collapsed-stack format: one
+    # line per distinct call stack, frames from outermost to innermost
+    # separated by ";", followed by the sample count. Feed it to flamegraph.pl
+    # or speedscope. nil when the evaluation was not profiled.
+    #
+    # @return [String, nil]
+    attr_reader :profile
+
     def initialize(value, console_output, console_truncated, http_requests = [])
       @value = value
       @console_output = console_output
       @console_truncated = console_truncated
       @http_requests = http_requests
+      @gc_count = 0
+      @gc_time_ms = 0.0
+      @metrics = {}.freeze
+      @profile = nil
     end
 
     def console_truncated?
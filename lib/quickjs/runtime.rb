@@ -0,0 +1,68 @@
+# frozen_string_literal: true
+
+require "monitor"
+
+module QuickJS
+  # A JavaScript runtime shared by several sandboxes
+  #
+  # Every Sandbox normally has a QuickJS runtime of its own, with its own
+  # atom table, shapes and class tables, which make up most of the few
+  # hundred KB an idle sandbox takes. Sandboxes created with
+  # Runtime#sandbox share this runtime instead: each still gets its own
+  # context (globals, console output, timeout, HTTP settings), so they stay
+  # isolated from one another, but the per-runtime structures exist once.
+  #
+  # The sandboxes of a runtime run JavaScript one at a time: calls from
+  # several threads wait for each other. Jobs a timed-out eval leaves
+  # behind are dropped when it ends, so they never run in another sandbox.
+  # Use separate runtimes (or plain sandboxes) for work that must run in
+  # parallel, and for tenants that must not share memory.
+  #
+  # @example
+  #   runtime = QuickJS::Runtime.new(memory_limit: 64_000_000)
+  #   sandboxes = Array.new(100) { runtime.sandbox(memory_limit: 2_000_000, timeout_ms: 1000) }
+  #   sandboxes.first.eval("1 + 1").value  # => 2
+  class Runtime
+    # Create a runtime
+    #
+    # @param memory_limit [Integer] Memory limit in bytes for all of the runtime's sandboxes
+    #   together (default: 64,000,000)
+    # @param gc_threshold [Integer, nil] Allocation threshold in bytes for QuickJS's own
+    #   collections (default: QuickJS's 256KB); see the gc option of Sandbox.new
+    def initialize(memory_limit: 64_000_000, gc_threshold: nil)
+      if memory_limit < 300_000
+        raise ArgumentError, "memory_limit cannot be less than 300000 bytes (got #{memory_limit})"
+      end
+
+      @native_runtime = NativeRuntime.new(memory_limit: memory_limit, gc_threshold: gc_threshold)
+      @monitor = Monitor.new
+    end
+
+    # Create a sandbox in this runtime
+    #
+    # @param memory_limit [Integer, nil] The sandbox's share of the runtime's memory limit: the
+    #   memory allocated while its code runs and not yet freed (default: nil, no share)
+    # @param options [Hash] Other options of Sandbox.new (timeout_ms, console, http, gc, ...)
+    # @return [Sandbox]
+    def sandbox(memory_limit: nil, **options)
+      Sandbox.new(**options, memory_limit: memory_limit, runtime: self)
+    end
+
+    # Memory used by the runtime, for all of its sandboxes (see Sandbox#memory_usage)
+    #
+    # @return [Hash{Symbol => Integer}]
+    def memory_usage
+      synchronize { @native_runtime.memory_usage }
+    end
+
+    # @api private
+    attr_reader :native_runtime
+
+    # Run the block while no other sandbox of the runtime runs JavaScript
+    #
+    # @api private
+    def synchronize(&block)
+      @monitor.synchronize(&block)
+    end
+  end
+end
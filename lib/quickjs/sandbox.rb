@@ -6,12 +6,53 @@ module QuickJS
   # This class wraps the native C-based sandbox and provides a simpler
   # interface for HTTP configuration.
   class Sandbox
+    # Supported values for the gc option
+    GC_POLICIES = %i[always threshold never every_n].freeze
+
+    # Supported values for the allocator option
+    ALLOCATORS = %i[system arena].freeze
+
+    # Sampling interval of eval(profile: true), in milliseconds
+    DEFAULT_PROFILE_INTERVAL_MS = 1.0
+
     # Create a new JavaScript sandbox
     #
     # @param memory_limit [Integer] Memory limit in bytes (default: 1,000,000 = 1MB)
     # @param timeout_ms [Integer] Execution timeout in milliseconds (default: 5,000)
     # @param console_log_max_size [Integer] Console output limit in bytes (default: 10,000)
+    # @param console [#call, #write, nil] Receive console output as it is produced instead of
+    #   in Result#console_output (which then stays empty, and console_log_max_size does not apply):
+    #   - a callable is called with (level, line) for each line; level is :log, :info, :warn, :error or :debug
+    #   - an IO (anything with #write) is written the lines, newline-terminated
+    #   Lines are batched and passed on whenever console_flush_size bytes have accumulated,
+    #   and at the end of each eval. Errors raised by the sink stop the eval and are re-raised.
+    # @param console_flush_size [Integer] Bytes of console output batched before they are passed to
+    #   console (default: 4096)
     # @param http [Hash, nil] HTTP configuration options (enables fetch() in JavaScript)
+    # @param gc [Symbol] When to run a full GC pass after evaluating code (default: :always):
+    #   - :always - after every eval (once per batch)
+    #   - :every_n - after every gc_interval evals
+    #   - :threshold - never explicitly; QuickJS collects once allocations cross gc_threshold bytes
+    #   - :never - never explicitly; QuickJS collects with its default threshold
+    #   QuickJS always collects on its own while allocating, so memory limits stay effective.
+    # @param gc_interval [Integer] Evals between passes for gc: :every_n (default: 100)
+    # @param gc_threshold [Integer, nil] Allocation threshold in bytes for gc: :threshold (default: QuickJS's 256KB)
+    # @param detailed_metrics [Boolean] Include object and shape counts in Result#metrics (default: false).
+    #   Counting walks the whole JavaScript heap after every eval.
+    # @param allocator [Symbol] Where the JavaScript heap is allocated (default: :system):
+    #   - :system - the system malloc, block by block
+    #   - :arena - a per-sandbox arena, taken from malloc in chunks sized from memory_limit and
+    #     released in one go when the sandbox is freed or reset! (which then also rebuilds the
+    #     runtime). Avoids fragmenting the process heap with many short-lived sandboxes.
+    #   Both count memory against memory_limit the same way.
+    # @param runtime [Runtime, nil] Create the sandbox's context in a shared runtime instead of a
+    #   runtime of its own (see Runtime#sandbox). memory_limit is then the sandbox's share of the
+    #   runtime's memory, and gc_threshold and allocator come from the runtime.
+    # @param module_resolver [#call, Hash{String => String}, nil] Source of the modules scripts
+    #   import (see #eval_module): a callable called with the module name that returns its
+    #   JavaScript source, or nil when there is no such module, or a Hash of sources by name.
+    #   Relative names ("./util.js") are resolved against the importing module's name first;
+    #   other names are passed as written. Compiled modules are shared through ModuleCache.
     #
     # @option http [Array<String>] :allowlist URL patterns to allow (e.g., ['https://api.github.com/**'])
     # @option http [Array<String>] :denylist URL patterns to block (allows all others)
@@ -22,6 +63,9 @@ module QuickJS
     # @option http [Array<String>] :allowed_methods HTTP methods allowed (default: GET, POST, PUT, DELETE, PATCH, HEAD)
     # @option http [Array<Integer>] :allowed_ports Allowed ports (default: [80, 443])
     # @option http [Boolean] :block_private_ips Block private/local IPs (default: true)
+    # @option http [DNSCache] :dns_cache Resolves and caches request hosts (default: DNSCache.shared)
+    # @option http [Hash, true, HTTPResponseCache] :cache Cache GET responses across evals and sandboxes:
+    #   { max_bytes:, default_ttl: } (see HTTPResponseCache)
     #
     # @example Basic usage
     #   sandbox = QuickJS::Sandbox.new
@@ -45,26 +89,66 @@ module QuickJS
     #   )
     #   result = sandbox.eval("fetch('https://safe-api.com/data').body")
     #
-    def initialize(memory_limit: 1_000_000, timeout_ms: 5000, console_log_max_size: 10_000, http: nil)
-      # QuickJS (full version) requires more memory than MicroQuickJS. The minimum
-      # practical value is around 300KB with polyfills, but we recommend at least 1MB for most use cases.
-      if memory_limit < 300_000
+    # @example Streaming console output
+    #   sandbox = QuickJS::Sandbox.new(console: ->(level, line) { puts "[#{level}] #{line}" })
+    #   sandbox = QuickJS::Sandbox.new(console: $stderr)
+    #
+    def initialize(memory_limit: 1_000_000, timeout_ms: 5000, console_log_max_size: 10_000, http: nil,
+                   gc: :always, gc_interval: 100, gc_threshold: nil, detailed_metrics: false,
+                   console: nil, console_flush_size: 4096, allocator: :system, runtime: nil,
+                   module_resolver: nil)
+      if runtime
+        validate_runtime_options(memory_limit, gc_threshold, allocator)
+      elsif memory_limit < 300_000
+        # QuickJS (full version) requires more memory than MicroQuickJS. The minimum
+        # practical value is around 300KB with polyfills, but we recommend at least 1MB for most use cases.
         raise ArgumentError,
               "memory_limit cannot be less than 300000 bytes (got #{memory_limit})"
       end
 
-      @native_sandbox = NativeSandbox.new(
-        memory_limit: memory_limit,
-        timeout_ms: timeout_ms,
-        console_log_max_size: console_log_max_size
-      )
+      unless GC_POLICIES.include?(gc)
+        raise ArgumentError, "gc must be one of #{GC_POLICIES.map(&:inspect).join(', ')} (got #{gc.inspect})"
+      end
+
+      raise ArgumentError, "gc_interval must be at least 1 (got #{gc_interval})" if gc_interval < 1
 
+      unless ALLOCATORS.include?(allocator)
+        raise ArgumentError,
+              "allocator must be one of #{ALLOCATORS.map(&:inspect).join(', ')} (got #{allocator.inspect})"
+      end
+
+      if console_flush_size.negative?
+        raise ArgumentError, "console_flush_size cannot be negative (got #{console_flush_size})"
+      end
+
+      unless module_resolver.nil? || module_resolver.is_a?(Hash) || module_resolver.respond_to?(:call)
+        raise ArgumentError, "module_resolver must be a Hash or respond to #call (got #{module_resolver.class})"
+      end
+
+      @runtime = runtime
       @http_config = nil
       @http_executor = nil
 
-      # Always inject fetch polyfills (Headers, Request, Response classes)
-      # These are useful even without HTTP enabled for code compatibility
-      inject_fetch_polyfills
+      synchronize do
+        @native_sandbox = NativeSandbox.new(
+          memory_limit: memory_limit,
+          timeout_ms: timeout_ms,
+          console_log_max_size: console_log_max_size,
+          console_sink: console && console_sink(console),
+          console_flush_size: console_flush_size,
+          gc: gc,
+          gc_interval: gc_interval,
+          gc_threshold: gc_threshold,
+          detailed_metrics: detailed_metrics,
+          allocator: allocator,
+          runtime: runtime&.native_runtime
+        )
+        @native_sandbox.module_loader = module_loader(module_resolver) if module_resolver
+
+        # Always inject fetch polyfills (Headers, Request, Response classes)
+        # These are useful even without HTTP enabled for code compatibility
+        inject_fetch_polyfills
+      end
 
       setup_http(http) if http
     end
@@ -72,45 +156,364 @@ module QuickJS
     # Evaluate JavaScript code in the sandbox
     #
     # @param code [String] JavaScript code to execute
+    # @param lazy [Boolean] Return an object or array result as a Handle that
+    #   converts properties on access, instead of converting it all up front
+    # @param profile [Boolean, Numeric] Sample the JavaScript call stack while
+    #   the code runs, every millisecond with true or every +profile+
+    #   milliseconds with a number. The samples are in Result#profile (or
+    #   Error#profile when the evaluation fails).
     # @return [Result] Result object with value, console_output, etc.
     # @raise [SyntaxError] Invalid JavaScript syntax
     # @raise [JavascriptError] JavaScript runtime error
     # @raise [MemoryLimitError] Memory limit exceeded
     # @raise [TimeoutError] Execution timeout
     # @raise [HTTPError] HTTP security violation (when HTTP is enabled)
-    def eval(code)
-      reset_http_executor if @http_executor
-      @native_sandbox.eval(code)
+    def eval(code, lazy: false, profile: false)
+      @http_executor&.reset
+      synchronize { @native_sandbox.eval(code, lazy, profile_interval(profile)) }
+    end
+
+    # Evaluate JavaScript code as an ES module
+    #
+    # The module can import others (statically or with import()), which are
+    # loaded through module_resolver once per sandbox, until reset!. Top-level
+    # await is allowed: the module is awaited like an async eval.
+    #
+    # @param code [String] JavaScript module source
+    # @param name [String] Module name, which relative imports are resolved against
+    # @return [Result] Result whose value is a Hash of the module's exports
+    #   ("default" for the default export)
+    # @raise [SyntaxError] Invalid JavaScript syntax
+    # @raise [JavascriptError] JavaScript runtime error, including imports that
+    #   cannot be resolved
+    # @raise [MemoryLimitError] Memory limit exceeded
+    # @raise [TimeoutError] Execution timeout
+    # @raise [HTTPError] HTTP security violation (when HTTP is enabled)
+    #
+    # @example
+    #   sandbox = QuickJS::Sandbox.new(module_resolver: { "math" => "export const double = (x) => x * 2" })
+    #   sandbox.eval_module("import { double } from 'math'; export const answer = double(21)").value
+    #   # => { "answer" => 42 }
+    def eval_module(code, name: "<module>")
+      @http_executor&.reset
+      synchronize { @native_sandbox.eval_module(code, name.to_s) }
+    end
+
+    # Evaluate JavaScript code and return its result as JSON text
+    #
+    # The result is serialized with the engine's JSON.stringify, so no Ruby
+    # objects are built for it. Useful when the result is passed on as JSON
+    # without being inspected in Ruby.
+    #
+    # @param code [String] JavaScript code to execute
+    # @return [Result] Result whose value is the JSON String (nil when the
+    #   result is undefined, a function or a symbol)
+    # @raise [SyntaxError] Invalid JavaScript syntax
+    # @raise [JavascriptError] JavaScript runtime error, including values
+    #   JSON.stringify rejects (circular structures, BigInts)
+    # @raise [MemoryLimitError] Memory limit exceeded
+    # @raise [TimeoutError] Execution timeout
+    # @raise [HTTPError] HTTP security violation (when HTTP is enabled)
+    #
+    # @example
+    #   sandbox.eval_json("({ total: 3, items: [1, 2] })").value  # => '{"total":3,"items":[1,2]}'
+    def eval_json(code)
+      @http_executor&.reset
+      synchronize { @native_sandbox.eval_json(code) }
+    end
+
+    # Memory used by the sandbox's JavaScript runtime, broken down by kind
+    #
+    # Returns the fields of QuickJS's JSMemoryUsage as a Hash with Symbol keys
+    # (sizes in bytes), among them:
+    #
+    # - :malloc_size - bytes allocated by the runtime, counted against memory_limit
+    # - :malloc_limit - the memory limit
+    # - :memory_used_size, :memory_used_count - bytes and allocations QuickJS accounts
+    #   for in the breakdown below
+    # - :atom_*, :str_*, :obj_*, :prop_*, :shape_* - atoms, strings, objects, properties, shapes
+    # - :js_func_*, :c_func_count - bytecode functions (code and line tables) and native functions
+    # - :array_count, :fast_array_count, :fast_array_elements - arrays
+    # - :binary_object_count, :binary_object_size - bytecode loaded into the context (polyfills,
+    #   compiled scripts)
+    # - :arena_reserved_size - bytes held by the arena (allocator: :arena only)
+    #
+    # Computing it walks the whole heap, so it is meant for sizing memory
+    # limits and pools rather than for every eval (see Result#metrics for
+    # cheap per-eval numbers).
+    #
+    # @return [Hash{Symbol => Integer}]
+    def memory_usage
+      synchronize { @native_sandbox.memory_usage }
+    end
+
+    # Call a JavaScript function with arguments from Ruby
+    #
+    # Arguments are converted straight into the call (no global variables are
+    # set and no code is parsed). A dotted name calls a method with `this`
+    # bound to its parent object. If the function returns a Promise, the
+    # result holds its resolved value.
+    #
+    # @param name [String, Symbol] Global function name or dotted path (e.g. "handlers.onEvent")
+    # @param args [Array] Arguments (nil, boolean, number, string, array, or hash)
+    # @return [Result] Result object with value, console_output, etc.
+    # @raise [JavascriptError] The function throws, or name does not resolve to a function
+    # @raise [MemoryLimitError] Memory limit exceeded
+    # @raise [TimeoutError] Execution timeout
+    # @raise [HTTPError] HTTP security violation (when HTTP is enabled)
+    #
+    # @example
+    #   sandbox.eval("function add(a, b) { return a + b; }")
+    #   sandbox.call("add", 5, 3).value  # => 8
+    def call(name, *args)
+      @http_executor&.reset
+      synchronize { @native_sandbox.call(name.to_s, args) }
+    end
+
+    # Evaluate several pieces of code back to back
+    #
+    # Equivalent to calling eval for each item, with the per-eval fixed costs
+    # (GC pass, HTTP executor setup) paid once for the whole batch. Each item
+    # gets its own timeout and console output, and an item that fails does
+    # not stop the others: its error is returned in place of its Result.
+    # HTTP request limits apply to the batch as a whole.
+    #
+    # @param codes [Array<String>] JavaScript code to execute, in order
+    # @return [Array<Result, Error>] One Result (or the error it raised) per item
+    # @raise [Error] The thread was interrupted; the rest of the batch is skipped
+    #
+    # @example
+    #   results = sandbox.eval_batch(["1 + 1", "nope()", "'ok'"])
+    #   results.map { |r| r.is_a?(QuickJS::Error) ? r.class : r.value }
+    #   # => [2, QuickJS::JavascriptError, "ok"]
+    def eval_batch(codes)
+      @http_executor&.reset
+      synchronize { @native_sandbox.eval_batch(codes.to_ary) }
+    end
+
+    # Call a JavaScript function once per argument list
+    #
+    # The batch counterpart of call, with the same semantics as eval_batch.
+    #
+    # @param name [String, Symbol] Global function name or dotted path
+    # @param args_list [Array<Array>] Arguments for each call
+    # @return [Array<Result, Error>] One Result (or the error it raised) per call
+    # @raise [Error] The thread was interrupted; the rest of the batch is skipped
+    #
+    # @example
+    #   sandbox.eval("function add(a, b) { return a + b; }")
+    #   sandbox.call_batch("add", [[1, 2], [3, 4]]).map(&:value)  # => [3, 7]
+    def call_batch(name, args_list)
+      @http_executor&.reset
+      synchronize { @native_sandbox.call_batch(name.to_s, args_list.map(&:to_ary)) }
+    end
+
+    # Compile JavaScript code once for repeated runs
+    #
+    # @param code [String] JavaScript code to compile
+    # @return [Script] Compiled script (see Script#run)
+    # @raise [SyntaxError] Invalid JavaScript syntax
+    #
+    # @example
+    #   script = sandbox.compile("input * 2")
+    #   script.run(sandbox, input: 21).value  # => 42
+    def compile(code)
+      code = code.to_str
+      Script.new(code, Script.bytecode_for(code) { synchronize { @native_sandbox.compile(code) } })
+    end
+
+    # Run a compiled script
+    #
+    # @api private Use Script#run instead
+    # @param script [Script]
+    # @return [Result]
+    def run_script(script)
+      @http_executor&.reset
+      synchronize { @native_sandbox.run_script(script.bytecode) }
     end
 
     # Set a global variable in the sandbox from Ruby
     #
     # @param name [String] Variable name
-    # @param value [Object] Ruby value (nil, boolean, number, string, array, or hash)
+    # @param value [Object] Ruby value (nil, boolean, number, string, array, or hash).
+    #   Binary (ASCII-8BIT) strings become Uint8Arrays.
     def set_variable(name, value)
-      @native_sandbox.set_variable(name, value)
+      synchronize { @native_sandbox.set_variable(name, value) }
+    end
+
+    # Expose a Ruby callable to JavaScript as a global function
+    #
+    # Arguments arrive converted like eval results, and the return value is
+    # converted like a set_variable value. If the callable raises, the
+    # JavaScript call throws an InternalError and the eval re-raises the Ruby
+    # exception once JavaScript has unwound. Defining a name again replaces
+    # its callable. Functions stay defined across reset!.
+    #
+    # @param name [String, Symbol] Global function name
+    # @param callable [#call, nil] Called with the JavaScript arguments
+    #   (defaults to the block)
+    # @return [void]
+    #
+    # @example
+    #   sandbox.define_function("lookup") { |key| PRICES.fetch(key) }
+    #   sandbox.eval("lookup('apple') * 2").value  # => 2.4
+    def define_function(name, callable = nil, &block)
+      callable ||= block
+      raise ArgumentError, "define_function requires a block or callable" unless callable.respond_to?(:call)
+
+      synchronize { @native_sandbox.define_function(name.to_s, callable) }
+      nil
+    end
+
+    # Set a global variable in the sandbox from JSON text
+    #
+    # The JSON is parsed by the engine's JSON.parse, skipping the
+    # intermediate Ruby objects of set_variable(name, JSON.parse(json)).
+    #
+    # @param name [String] Variable name
+    # @param json [String] JSON text
+    # @raise [SyntaxError] Invalid JSON
+    #
+    # @example
+    #   sandbox.set_variable_json("order", '{"id": 1, "lines": []}')
+    #   sandbox.eval("order.id").value  # => 1
+    def set_variable_json(name, json)
+      synchronize { @native_sandbox.set_variable_json(name, json) }
+    end
+
+    # Capture the state a Template needs from this sandbox
+    #
+    # Runs each preload script (so errors surface once, at template creation)
+    # and serializes the named globals.
+    #
+    # @api private Use Template.new instead
+    # @param variable_names [Array<String>] Globals to snapshot
+    # @param preload [Array<String>] JavaScript sources to compile and run
+    # @return [Array(String, Array<String>)] Globals snapshot (or nil) and script bytecode
+    def capture_template(variable_names, preload)
+      synchronize do
+        globals = @native_sandbox.dump_globals(variable_names) unless variable_names.empty?
+        scripts = preload.map do |code|
+          bytecode = @native_sandbox.compile(code)
+          @native_sandbox.eval_bytecode(bytecode)
+          bytecode
+        end
+        [globals, scripts.freeze]
+      end
+    end
+
+    # Apply a Template's preloaded state to this sandbox
+    #
+    # The state is reapplied by reset!.
+    #
+    # @api private Use Template#sandbox instead
+    # @param globals [String, nil] Snapshot produced by NativeSandbox#dump_globals
+    # @param scripts [Array<String>] Bytecode produced by NativeSandbox#compile
+    def load_template(globals, scripts)
+      @template_state = [globals, scripts]
+      synchronize { apply_template_state }
+      self
+    end
+
+    # Reset the sandbox to a clean global scope
+    #
+    # Discards every global defined by evaluated code or set_variable, any
+    # pending Promise jobs, console output and HTTP request counts, and
+    # restores the state the sandbox had right after creation (polyfills and,
+    # for sandboxes created from a Template, its preloaded state).
+    #
+    # The underlying JavaScript runtime (atom table, memory limit, stack
+    # limit) is kept; only the context is rebuilt, and the polyfills and
+    # template scripts are loaded from cached bytecode. Sandboxes created with
+    # allocator: :arena get a new runtime instead, releasing their arena.
+    #
+    # @return [Sandbox] self
+    def reset!
+      synchronize do
+        @native_sandbox.reset
+        inject_fetch_polyfills
+        apply_template_state if @template_state
+      end
+      @http_executor&.reset
+      self
     end
 
+    # The Runtime the sandbox was created in, nil if it has a runtime of its own
+    #
+    # @return [Runtime, nil]
+    attr_reader :runtime
+
     private
 
-    def setup_http(http_options)
-      @http_config = HTTPConfig.new(http_options)
-      @http_executor = HTTPExecutor.new(@http_config)
+    # Run the block holding the lock of the sandbox's Runtime (if any): the
+    # sandboxes of a runtime run JavaScript one at a time
+    def synchronize(&block)
+      @runtime ? @runtime.synchronize(&block) : yield
+    end
+
+    # Sampling interval in milliseconds for eval(profile:), nil to not profile
+    def profile_interval(profile)
+      case profile
+      when false, nil then nil
+      when true then DEFAULT_PROFILE_INTERVAL_MS
+      when Numeric
+        raise ArgumentError, "profile interval must be positive (got #{profile})" unless profile.positive?
 
-      @native_sandbox.http_callback = lambda do |method, url, body, headers|
-        @http_executor.execute(method, url, body: body, headers: headers)
+        profile.to_f
+      else
+        raise ArgumentError, "profile must be true, false or an interval in milliseconds (got #{profile.inspect})"
       end
     end
 
-    def reset_http_executor
-      # Create a fresh executor for each eval to reset request counts
-      @http_executor = HTTPExecutor.new(@http_config)
+    # In a shared runtime, memory_limit is the sandbox's share of the
+    # runtime's memory (nil for none), and the runtime holds the GC threshold
+    def validate_runtime_options(memory_limit, gc_threshold, allocator)
+      unless memory_limit.nil? || memory_limit.positive?
+        raise ArgumentError, "memory_limit must be positive (got #{memory_limit})"
+      end
+      raise ArgumentError, "gc_threshold is set on the Runtime (see Runtime.new)" if gc_threshold
+      raise ArgumentError, "allocator: :arena cannot be used with a shared runtime" if allocator == :arena
+    end
 
-      @native_sandbox.http_callback = lambda do |method, url, body, headers|
-        @http_executor.execute(method, url, body: body, headers: headers)
+    # Callable the native module loader calls with a module name, returning
+    # the module's bytecode (yielding its source to compile it on a miss)
+    def module_loader(resolver)
+      lambda do |name, &compile|
+        source = resolver.is_a?(Hash) ? resolver[name] : resolver.call(name)
+        next nil if source.nil?
+
+        source = source.to_str
+        ModuleCache.bytecode_for(name, source) { compile.call(source) }
       end
     end
 
+    # Callable the native sandbox passes each batch of [level, line] pairs
+    def console_sink(console)
+      if console.respond_to?(:call)
+        ->(lines) { lines.each { |level, line| console.call(level, line) } }
+      elsif console.respond_to?(:write)
+        ->(lines) { console.write(lines.map { |_level, line| "#{line}\n" }.join) }
+      else
+        raise ArgumentError, "console must respond to call or write (got #{console.inspect})"
+      end
+    end
+
+    def apply_template_state
+      globals, scripts = @template_state
+      @native_sandbox.load_globals(globals) if globals
+      scripts.each { |bytecode| @native_sandbox.eval_bytecode(bytecode) }
+    end
+
+    def setup_http(http_options)
+      @http_config = HTTPConfig.new(http_options)
+      # The executor is reset before each eval to restart its request
+      # count. Its requests run concurrently, so fetch() returns a pending
+      # Promise that the eval settles as responses come in.
+      @http_executor = HTTPExecutor.new(@http_config)
+      @http_executor.on_complete = @native_sandbox.method(:fetch_ready)
+      @native_sandbox.http_executor = @http_executor
+    end
+
     def inject_fetch_polyfills
       # Inject the Fetch API polyfills (Headers, Request, Response classes)
       # This wraps the native fetch() to return proper Response objects
@@ -118,7 +521,9 @@ module QuickJS
       # Note: This may fail with very low memory limits (< ~150KB).
       # In that case, the basic fetch() still works but returns plain objects
       # instead of proper Response/Headers/Request instances.
-      @native_sandbox.eval(FetchPolyfill::FULL_POLYFILL)
+      #
+      # The polyfill is compiled once per process and loaded from bytecode here.
+      @native_sandbox.eval_bytecode(FetchPolyfill.bytecode(@native_sandbox))
     rescue JavascriptError, MemoryLimitError
       # Silently continue without polyfills for low-memory sandboxes
       nil
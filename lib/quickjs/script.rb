@@ -0,0 +1,83 @@
+# frozen_string_literal: true
+
+module QuickJS
+  # Script is JavaScript compiled once and run many times.
+  #
+  # Create one with Sandbox#compile. Running a script skips parsing, and each
+  # sandbox keeps the function object the bytecode was read into, so repeated
+  # runs in the same sandbox skip deserialization too.
+  #
+  # Bytecode does not depend on the sandbox that compiled it: a script can be
+  # run in any sandbox, and compiling the same source again (in any sandbox of
+  # the process) returns the bytecode cached by the first compilation.
+  #
+  # @example
+  #   script = sandbox.compile("input.price * input.quantity")
+  #   orders.map { |order| script.run(sandbox, input: order).value }
+  class Script
+    # Maximum number of distinct sources kept in the process-wide bytecode cache
+    CACHE_MAX_ENTRIES = 1000
+
+    @cache = {}
+    @cache_mutex = Mutex.new
+
+    class << self
+      # Return the bytecode for source, compiling it on a cache miss
+      #
+      # Entries are keyed by the source string (looked up by its hash, then
+      # compared by content) and evicted oldest first.
+      #
+      # @api private Use Sandbox#compile instead
+      # @param source [String] JavaScript source
+      # @yieldreturn [String] Frozen bytecode for source
+      # @return [String] Frozen bytecode
+      def bytecode_for(source)
+        cached = @cache_mutex.synchronize { @cache[source] }
+        return cached if cached
+
+        # Compile outside the lock: a concurrent miss on the same source just
+        # compiles it twice
+        bytecode = yield
+        @cache_mutex.synchronize do
+          @cache.delete(@cache.first[0]) if @cache.size >= CACHE_MAX_ENTRIES
+          @cache[source] = bytecode
+        end
+      end
+
+      # Empty the process-wide bytecode cache
+      def clear_cache
+        @cache_mutex.synchronize { @cache.clear }
+        nil
+      end
+    end
+
+    # @return [String] The JavaScript source
+    attr_reader :source
+
+    # @return [String] The compiled bytecode (frozen, binary)
+    attr_reader :bytecode
+
+    # @api private Use Sandbox#compile instead
+    def initialize(source, bytecode)
+      @source = source
+      @bytecode = bytecode
+    end
+
+    # Run the script in a sandbox
+    #
+    # Behaves like sandbox.eval(source), without parsing the source again.
+    #
+    # @param sandbox [Sandbox] Sandbox to run in
+    # @param variables [Hash] Global variables to set first (see Sandbox#set_variable)
+    # @return [Result] Result object with value, console_output, etc.
+    # @raise [JavascriptError] JavaScript runtime error
+    # @raise [MemoryLimitError] Memory limit exceeded
+    # @raise [TimeoutError] Execution timeout
+    # @raise [HTTPError] HTTP security violation (when HTTP is enabled)
+    # @raise [ArgumentError] The bytecode is not a String Sandbox#compile returned
+    def run(sandbox, variables = {})
+      variables.each { |name, value| sandbox.set_variable(name.to_s, value) }
+      sandbox.run_script(self)
+    end
+  end
+end
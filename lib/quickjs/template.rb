@@ -0,0 +1,53 @@
+# frozen_string_literal: true
+
+module QuickJS
+  # Template captures a preloaded sandbox setup once so that new sandboxes
+  # can be created from it without re-parsing shared code.
+  #
+  # Preload scripts are compiled to bytecode a single time, and preload
+  # variables are snapshotted with JS_WriteObject into a binary blob that each
+  # new sandbox reads back directly (no Ruby-to-JS conversion per sandbox).
+  #
+  # QuickJS can only serialize data and bytecode, not live closures or native
+  # functions, so a full global object cannot be cloned: each sandbox still
+  # instantiates the preloaded bytecode, it just never parses it again.
+  class Template
+    attr_reader :options
+
+    # Create a new template
+    #
+    # @param preload [Array<String>] JavaScript sources to run in every sandbox, in order
+    # @param variables [Hash] Global variables to define before the preload scripts run.
+    #   Values must be plain data (see Sandbox#set_variable).
+    # @param options [Hash] Options passed to Sandbox.new (memory_limit, timeout_ms, http, ...)
+    #
+    # @raise [SyntaxError] A preload script has invalid syntax
+    # @raise [JavascriptError] A preload script throws while being validated
+    #
+    # @example
+    #   template = QuickJS::Template.new(
+    #     preload: [File.read("helpers.js")],
+    #     variables: { config: { currency: "EUR" } },
+    #     timeout_ms: 1000
+    #   )
+    #   sandbox = template.sandbox
+    #   sandbox.eval("formatPrice(10)")
+    def initialize(preload: [], variables: {}, **options)
+      @options = options.freeze
+
+      # Run the setup once in a scratch sandbox: this validates the preload
+      # (errors surface here instead of on every sandbox) and produces the
+      # serialized state shared by all sandboxes created from this template.
+      scratch = Sandbox.new(**options.reject { |key, _| key == :http })
+      variables.each { |name, value| scratch.set_variable(name.to_s, value) }
+      @globals, @scripts = scratch.capture_template(variables.keys.map(&:to_s), preload)
+    end
+
+    # Create a new sandbox initialized from this template
+    #
+    # @return [Sandbox]
+    def sandbox
+      Sandbox.new(**@options).load_template(@globals, @scripts)
+    end
+  end
+end
@@ -59,20 +59,19 @@
           }
         }
 
-        // Call native fetch (synchronous, but wrapped in Promise)
-        var nativeResponse = nativeFetch(url, options);
+        // Call native fetch: returns a Promise when requests run
+        // concurrently, the response itself otherwise
+        Promise.resolve(nativeFetch(url, options)).then(function(nativeResponse) {
+          // Convert native response to Response object
+          var responseHeaders = new Headers(nativeResponse.headers || {});
 
-        // Convert native response to Response object
-        var responseHeaders = new Headers(nativeResponse.headers || {});
-
-        var response = new Response(nativeResponse.body, {
-          status: nativeResponse.status,
-          statusText: nativeResponse.statusText,
-          headers: responseHeaders,
-          url: url
-        });
-
-        resolve(response);
+          resolve(new Response(nativeResponse.body, {
+            status: nativeResponse.status,
+            statusText: nativeResponse.statusText,
+            headers: responseHeaders,
+            url: url
+          }));
+        }, reject);
       } catch (error) {
         reject(error);
       }
@@ -13,7 +13,13 @@
     body.bodyUsed = true;
   }
 
+  const DEFAULT_CHUNK_SIZE = 65536;
+
   // Body mixin - shared between Request and Response
+  //
+  // A body is kept as given: text (_bodyText) or bytes (_bodyBuffer, e.g.
+  // the ArrayBuffer of a fetch() response). The other form is only
+  // computed when asked for, so reading bytes never decodes them.
   class BodyMixin {
     constructor() {
       this.bodyUsed = false;
@@ -28,6 +34,10 @@
         this._bodyText = '';
       } else if (typeof body === 'string') {
         this._bodyText = body;
+      } else if (body instanceof ArrayBuffer) {
+        this._bodyBuffer = body;
+      } else if (ArrayBuffer.isView(body)) {
+        this._bodyBuffer = body.buffer.slice(body.byteOffset, body.byteOffset + body.byteLength);
       } else if (body !== undefined && body !== null) {
         this._bodyText = String(body);
       } else {
@@ -41,21 +51,30 @@
       }
     }
 
+    _text() {
+      if (this._bodyText === undefined) {
+        this._bodyText = new TextDecoder().decode(this._bodyBuffer);
+      }
+      return this._bodyText;
+    }
+
+    _buffer() {
+      if (this._bodyBuffer === undefined) {
+        this._bodyBuffer = new TextEncoder().encode(this._bodyText).buffer;
+      }
+      return this._bodyBuffer;
+    }
+
     arrayBuffer() {
-      if (this._bodyText) {
-        const body = this._bodyText;
-        const buf = new ArrayBuffer(body.length);
-        const view = new Uint8Array(buf);
-        for (let i = 0; i < body.length; i++) {
-          view[i] = body.charCodeAt(i) & 0xff;
-        }
-        const isConsumed = consumed(this);
-        if (isConsumed) {
-          return isConsumed;
-        }
-        return Promise.resolve(buf);
+      const rejected = consumed(this);
+      if (rejected) {
+        return rejected;
       }
-      return Promise.reject(new Error('could not read as ArrayBuffer'));
+      return Promise.resolve(this._buffer());
+    }
+
+    bytes() {
+      return this.arrayBuffer().then(buffer => new Uint8Array(buffer));
     }
 
     text() {
@@ -63,12 +82,55 @@
       if (rejected) {
         return rejected;
       }
-      return Promise.resolve(this._bodyText);
+      return Promise.resolve(this._text());
     }
 
     json() {
       return this.text().then(JSON.parse);
     }
+
+    // Read the body in chunks of up to chunkSize bytes, like a
+    // ReadableStream reader: read() resolves to {done, value} where value
+    // is a Uint8Array view of the body (not a copy). Also async iterable.
+    bodyReader(options = {}) {
+      if (this.bodyUsed) {
+        throw new TypeError('Body has already been consumed');
+      }
+      if (!this._noBody) {
+        this.bodyUsed = true;
+      }
+
+      const chunkSize = options.chunkSize === undefined ? DEFAULT_CHUNK_SIZE : Math.floor(options.chunkSize);
+      if (!(chunkSize > 0)) {
+        throw new RangeError('chunkSize must be a positive number');
+      }
+
+      let bytes = new Uint8Array(this._buffer());
+      let offset = 0;
+      const reader = {
+        read() {
+          if (offset >= bytes.length) {
+            return Promise.resolve({ done: true, value: undefined });
+          }
+          const value = bytes.subarray(offset, offset + chunkSize);
+          offset += value.length;
+          return Promise.resolve({ done: false, value: value });
+        },
+        cancel() {
+          bytes = new Uint8Array(0);
+          offset = 0;
+          return Promise.resolve();
+        },
+        releaseLock() {},
+        [Symbol.asyncIterator]() {
+          return {
+            next: () => reader.read(),
+            return: () => reader.cancel().then(() => ({ done: true, value: undefined }))
+          };
+        }
+      };
+      return reader;
+    }
   }
 
   globalThis.Response = class Response extends BodyMixin {
@@ -95,15 +157,19 @@
       this._initBody(bodyInit);
     }
 
+    // The body as text (use bodyReader() or arrayBuffer() for bytes)
     get body() {
-      return this._bodyText;
+      return this._text();
     }
 
     clone() {
       if (this.bodyUsed) {
         throw new TypeError('Cannot clone a Response whose body has been used');
       }
-      return new Response(this._bodyInit, {
+      const body = this._bodyBuffer !== undefined && this._bodyText === undefined
+        ? this._bodyBuffer.slice(0)
+        : this._bodyInit;
+      return new Response(body, {
         status: this.status,
         statusText: this.statusText,
         headers: new Headers(this.headers),
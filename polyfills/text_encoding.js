@@ -0,0 +1,99 @@
+// TextEncoder and TextDecoder (UTF-8 only), backed by the native UTF-8
+// conversions attached to the native fetch function
+// Adapted for QuickJS Ruby gem
+
+(function() {
+  if (typeof TextDecoder !== 'undefined') return;
+
+  var nativeFetch = globalThis.fetch;
+  var decodeUTF8 = nativeFetch && nativeFetch.decodeUTF8;
+  var encodeUTF8 = nativeFetch && nativeFetch.encodeUTF8;
+  if (!decodeUTF8 || !encodeUTF8) return;
+
+  // Only the polyfills get to use them
+  delete nativeFetch.decodeUTF8;
+  delete nativeFetch.encodeUTF8;
+
+  var UTF8_LABELS = ['utf-8', 'utf8', 'unicode-1-1-utf-8'];
+
+  function toBytes(input) {
+    if (input === undefined) {
+      return new Uint8Array(0);
+    }
+    if (input instanceof ArrayBuffer) {
+      return new Uint8Array(input);
+    }
+    if (ArrayBuffer.isView(input)) {
+      return new Uint8Array(input.buffer, input.byteOffset, input.byteLength);
+    }
+    throw new TypeError("Failed to execute 'decode' on 'TextDecoder': The provided value is not of type '(ArrayBuffer or ArrayBufferView)'");
+  }
+
+  // Number of bytes at the end of `bytes` that start a UTF-8 sequence
+  // continuing in the next chunk
+  function incompleteTail(bytes) {
+    var n = bytes.length;
+    for (var i = 1; i <= 3 && i <= n; i++) {
+      var b = bytes[n - i];
+      if ((b & 0xc0) === 0x80) {
+        continue; // Continuation byte
+      }
+      var needed = b >= 0xf0 ? 4 : b >= 0xe0 ? 3 : b >= 0xc0 ? 2 : 1;
+      return needed > i ? i : 0;
+    }
+    return 0;
+  }
+
+  globalThis.TextDecoder = class TextDecoder {
+    constructor(label = 'utf-8', options = {}) {
+      if (UTF8_LABELS.indexOf(String(label).trim().toLowerCase()) === -1) {
+        throw new RangeError("Failed to construct 'TextDecoder': The encoding label provided ('" + label + "') is invalid.");
+      }
+      this.encoding = 'utf-8';
+      this.fatal = false;
+      this.ignoreBOM = !!options.ignoreBOM;
+      this._pending = null;
+      this._started = false;
+    }
+
+    // With {stream: true}, a sequence cut at the end of the input is kept
+    // and decoded with the next call
+    decode(input, options = {}) {
+      var bytes = toBytes(input);
+      if (this._pending) {
+        var joined = new Uint8Array(this._pending.length + bytes.length);
+        joined.set(this._pending);
+        joined.set(bytes, this._pending.length);
+        bytes = joined;
+        this._pending = null;
+      }
+
+      var end = bytes.length;
+      if (options.stream) {
+        end -= incompleteTail(bytes);
+        if (end < bytes.length) {
+          this._pending = bytes.slice(end);
+          bytes = bytes.subarray(0, end);
+        }
+      }
+
+      var text = decodeUTF8(bytes);
+      var started = this._started;
+      this._started = !!options.stream && (started || text.length > 0);
+      if (!started && !this.ignoreBOM && text.charCodeAt(0) === 0xfeff) {
+        text = text.slice(1);
+      }
+      return text;
+    }
+  };
+
+  globalThis.TextEncoder = class TextEncoder {
+    constructor() {
+      this.encoding = 'utf-8';
+    }
+
+    encode(input = '') {
+      return new Uint8Array(encodeUTF8(String(input)));
+    }
+  };
+})();
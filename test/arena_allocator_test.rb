@@ -0,0 +1,94 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+# Sandbox.new(allocator: :arena) (ext/quickjs/arena.c)
+class ArenaAllocatorTest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new(allocator: :arena, memory_limit: 20_000_000)
+  end
+
+  def test_eval
+    result = @sandbox.eval(<<~JS)
+      const objects = Array.from({ length: 5000 }, (_, i) => ({ i, s: 'x'.repeat(i % 300) }));
+      const big = new Uint8Array(100000).fill(7);
+      [objects.length, objects[4999].s.length, big.reduce((a, b) => a + b, 0), JSON.stringify(objects).length > 0]
+    JS
+
+    assert_equal [5000, 199, 700_000, true], result.value
+  end
+
+  def test_growing_and_shrinking_blocks
+    assert_equal 300_000, @sandbox.eval(<<~JS).value
+      let s = '';
+      for (let i = 0; i < 3000; i++) s += 'y'.repeat(100);
+      const a = [];
+      for (let i = 0; i < 100000; i++) a.push(i);
+      a.length = 10;
+      s.length
+    JS
+  end
+
+  def test_memory_limit
+    sandbox = QuickJS::Sandbox.new(allocator: :arena, memory_limit: 2_000_000)
+
+    assert_raises(QuickJS::MemoryLimitError, QuickJS::JavascriptError) do
+      sandbox.eval("const a = []; while (true) a.push('z'.repeat(1000))")
+    end
+    assert_equal 2, sandbox.eval("1 + 1").value
+  end
+
+  def test_memory_is_accounted
+    metrics = @sandbox.eval("globalThis.keep = new Array(10000).fill(0).map((_, i) => ({ i })); 1").metrics
+
+    assert_operator metrics[:memory_bytes], :>, 100_000
+    assert_operator metrics[:peak_memory_bytes], :>=, metrics[:memory_bytes]
+    freed = @sandbox.eval("globalThis.keep = null; 1").metrics
+    assert_operator freed[:memory_bytes], :<, metrics[:memory_bytes]
+  end
+
+  def test_reset_builds_a_new_runtime
+    @sandbox.define_function("double") { |x| x * 2 }
+    handle = @sandbox.eval("({ a: 1 })", lazy: true).value
+    script = @sandbox.compile("typeof leftover + ':' + double(21)")
+    @sandbox.eval("globalThis.leftover = 1; Promise.resolve().then(() => { globalThis.late = 1 })")
+    @sandbox.eval("globalThis.call = { me: () => 'called' }")
+    @sandbox.call("call.me")
+
+    @sandbox.reset!
+
+    assert_equal "undefined:42", script.run(@sandbox).value
+    assert_nil @sandbox.eval("globalThis.late").value
+    assert_raises(QuickJS::Error) { handle["a"] }
+    assert_equal "http://a/", @sandbox.eval("new URL('http://a').href").value
+    @sandbox.eval("globalThis.call = { me: () => 'again' }")
+    assert_equal "again", @sandbox.call("call.me").value
+  end
+
+  def test_reset_after_timeout
+    sandbox = QuickJS::Sandbox.new(allocator: :arena, timeout_ms: 50)
+    assert_raises(QuickJS::TimeoutError) { sandbox.eval("while (true) {}") }
+
+    sandbox.reset!
+    assert_equal 3, sandbox.eval("1 + 2").value
+  end
+
+  def test_timers_after_reset
+    # The timer array of the first eval was allocated in the dropped arena
+    assert_equal 1, @sandbox.eval("setTimeout(() => {}, 0); 1").value
+    @sandbox.reset!
+
+    assert_equal 2, @sandbox.eval("new Promise((done) => setTimeout(() => done(2), 0))").value
+    assert_equal 3, @sandbox.eval("setTimeout(() => {}, 0); setTimeout(() => {}, 0); 3").value
+  end
+
+  def test_many_short_lived_sandboxes
+    50.times do |i|
+      assert_equal i, QuickJS::Sandbox.new(allocator: :arena).eval("[#{i}].map(x => ({ x }))[0].x").value
+    end
+  end
+
+  def test_invalid_allocator
+    assert_raises(QuickJS::ArgumentError) { QuickJS::Sandbox.new(allocator: :jemalloc) }
+  end
+end
@@ -6,8 +6,7 @@ require_relative "../lib/quickjs"
 # Tests for async/await, Promise, setTimeout, setInterval, and Date.now functionality
 #
 # NOTE: The base QuickJS engine does NOT include setTimeout, setInterval, clearTimeout,
-# or clearInterval. These functions are part of the "os" module from quickjs-libc and
-# would require additional integration. The tests below document the current behavior.
+# or clearInterval; the sandbox provides them natively (see timers_test.rb).
 class AsyncTimingTest < Minitest::Test
   def setup
     @sandbox = QuickJS::Sandbox.new(timeout_ms: 10_000)
@@ -372,31 +371,31 @@ class AsyncTimingTest < Minitest::Test
 
   # ==========================================================================
   # setTimeout/setInterval Availability Tests
-  # NOTE: These are NOT available in base QuickJS (require os module from libc)
+  # NOTE: These are NOT available in base QuickJS; the sandbox defines them
   # ==========================================================================
 
-  def test_set_timeout_not_available
+  def test_set_timeout_available
     result = @sandbox.eval("typeof setTimeout")
 
-    assert_equal "undefined", result.value, "setTimeout is not available in base QuickJS"
+    assert_equal "function", result.value, "setTimeout is provided by the sandbox"
   end
 
-  def test_clear_timeout_not_available
+  def test_clear_timeout_available
     result = @sandbox.eval("typeof clearTimeout")
 
-    assert_equal "undefined", result.value, "clearTimeout is not available in base QuickJS"
+    assert_equal "function", result.value, "clearTimeout is provided by the sandbox"
   end
 
-  def test_set_interval_not_available
+  def test_set_interval_available
     result = @sandbox.eval("typeof setInterval")
 
-    assert_equal "undefined", result.value, "setInterval is not available in base QuickJS"
+    assert_equal "function", result.value, "setInterval is provided by the sandbox"
   end
 
-  def test_clear_interval_not_available
+  def test_clear_interval_available
     result = @sandbox.eval("typeof clearInterval")
 
-    assert_equal "undefined", result.value, "clearInterval is not available in base QuickJS"
+    assert_equal "function", result.value, "clearInterval is provided by the sandbox"
   end
 
   # ==========================================================================
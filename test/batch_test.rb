@@ -0,0 +1,121 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "timeout"
+
+class BatchTest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new(timeout_ms: 100)
+  end
+
+  def test_eval_batch_returns_results_in_order
+    results = @sandbox.eval_batch(["1 + 1", "'two'", "[3]"])
+
+    assert(results.all? { |r| r.is_a?(QuickJS::Result) })
+    assert_equal [2, "two", [3]], results.map(&:value)
+  end
+
+  def test_eval_batch_shares_state
+    results = @sandbox.eval_batch(["var n = 1", "n += 1", "n * 10"])
+
+    assert_equal 20, results.last.value
+  end
+
+  def test_eval_batch_isolates_errors
+    results = @sandbox.eval_batch(["1", "throw new Error('boom')", "function (", "3"])
+
+    assert_equal 1, results[0].value
+    assert_instance_of QuickJS::JavascriptError, results[1]
+    assert_match(/boom/, results[1].message)
+    assert_instance_of QuickJS::SyntaxError, results[2]
+    assert_equal 3, results[3].value
+  end
+
+  def test_eval_batch_per_item_timeout
+    results = @sandbox.eval_batch(["while (true) {}", "'after'"])
+
+    assert_instance_of QuickJS::TimeoutError, results[0]
+    assert_equal "after", results[1].value
+  end
+
+  def test_eval_batch_timeout_restarts_for_each_item
+    busy = "(() => { const end = Date.now() + 60; while (Date.now() < end) {} return 'done'; })()"
+
+    results = @sandbox.eval_batch([busy, busy, busy])
+
+    assert_equal %w[done done done], results.map(&:value)
+  end
+
+  def test_eval_batch_console_output_per_item
+    results = @sandbox.eval_batch(["console.log('a')", "1", "console.log('c')"])
+
+    assert_equal ["a\n", "", "c\n"], results.map(&:console_output)
+  end
+
+  def test_eval_batch_error_keeps_console_output
+    results = @sandbox.eval_batch(["console.log('before'); throw new Error('x')"])
+
+    assert_equal "before\n", results[0].console_output
+  end
+
+  def test_eval_batch_empty
+    assert_equal [], @sandbox.eval_batch([])
+  end
+
+  def test_eval_batch_async
+    results = @sandbox.eval_batch(["await Promise.resolve(1)", "Promise.reject(new Error('no'))"])
+
+    assert_equal 1, results[0].value
+    assert_instance_of QuickJS::JavascriptError, results[1]
+  end
+
+  def test_eval_batch_rejects_non_strings
+    assert_raises(TypeError) { @sandbox.eval_batch(["1", 2]) }
+  end
+
+  def test_call_batch
+    @sandbox.eval("function add(a, b) { return a + b; }")
+
+    results = @sandbox.call_batch("add", [[1, 2], [3, 4], [5, 6]])
+
+    assert_equal [3, 7, 11], results.map(&:value)
+  end
+
+  def test_call_batch_with_varying_arity
+    @sandbox.eval("function count(...args) { return args.length; }")
+
+    assert_equal [0, 3, 1], @sandbox.call_batch("count", [[], [1, 2, 3], ["x"]]).map(&:value)
+  end
+
+  def test_call_batch_isolates_errors
+    @sandbox.eval("function check(x) { if (x < 0) throw new Error('negative'); return x; }")
+
+    results = @sandbox.call_batch("check", [[1], [-1], [2]])
+
+    assert_equal 1, results[0].value
+    assert_instance_of QuickJS::JavascriptError, results[1]
+    assert_equal 2, results[2].value
+  end
+
+  def test_call_batch_missing_function
+    results = @sandbox.call_batch("missing", [[1], [2]])
+
+    assert(results.all? { |r| r.is_a?(QuickJS::JavascriptError) })
+  end
+
+  def test_call_batch_with_complex_arguments
+    @sandbox.eval("function total(order) { return order.items.reduce((s, i) => s + i.price, 0); }")
+    orders = [[{ "items" => [{ "price" => 1 }, { "price" => 2 }] }], [{ "items" => [] }]]
+
+    assert_equal [3, 0], @sandbox.call_batch("total", orders).map(&:value)
+  end
+
+  def test_batch_can_be_interrupted
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 5000)
+
+    assert_raises(Timeout::Error) do
+      Timeout.timeout(0.2) { sandbox.eval_batch(["while (true) {}", "1"]) }
+    end
+    assert_equal 1, sandbox.eval("1").value
+  end
+end
@@ -0,0 +1,86 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class BinaryTest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new(memory_limit: 20_000_000)
+  end
+
+  def test_binary_string_becomes_uint8array
+    @sandbox.set_variable("data", "\x00\x01\xFFabc".b)
+
+    assert_equal [true, 6, 0, 255], @sandbox.eval("[data instanceof Uint8Array, data.length, data[0], data[2]]").value
+  end
+
+  def test_uint8array_becomes_binary_string
+    value = @sandbox.eval("new Uint8Array([0, 1, 254, 255])").value
+
+    assert_equal "\x00\x01\xFE\xFF".b, value
+    assert_equal Encoding::BINARY, value.encoding
+  end
+
+  def test_array_buffer_becomes_binary_string
+    value = @sandbox.eval("new Uint8Array([104, 105]).buffer").value
+
+    assert_equal "hi".b, value
+  end
+
+  def test_subarray_uses_its_own_view
+    assert_equal "\x02\x03".b, @sandbox.eval("new Uint8Array([1, 2, 3, 4]).subarray(1, 3)").value
+  end
+
+  def test_round_trip_large_payload
+    payload = Random.new(42).bytes(3 * 1024 * 1024)
+    @sandbox.set_variable("payload", payload)
+
+    assert_equal payload, @sandbox.eval("payload").value
+  end
+
+  def test_javascript_writes_do_not_affect_ruby_string
+    original = "\x01\x02\x03".b.freeze
+    @sandbox.set_variable("buf", original)
+
+    @sandbox.eval("buf[0] = 42")
+
+    assert_equal "\x01\x02\x03".b, original
+    assert_equal "\x2A\x02\x03".b, @sandbox.eval("buf").value
+  end
+
+  def test_binary_values_nested_in_hashes_and_arrays
+    @sandbox.eval("function describe(msg) { return [msg.body.length, msg.parts[0][1]]; }")
+
+    result = @sandbox.call("describe", { "body" => "\xDE\xAD\xBE\xEF".b, "parts" => ["\x00\x07".b] })
+
+    assert_equal [4, 7], result.value
+  end
+
+  def test_nested_binary_results
+    value = @sandbox.eval("({ image: new Uint8Array([1, 2]), list: [new Uint8Array([3])] })").value
+
+    assert_equal({ "image" => "\x01\x02".b, "list" => ["\x03".b] }, value)
+  end
+
+  def test_empty_binary_string
+    @sandbox.set_variable("empty", "".b)
+
+    assert_equal 0, @sandbox.eval("empty.length").value
+    assert_equal "".b, @sandbox.eval("empty").value
+  end
+
+  def test_detached_buffer_becomes_empty_string
+    assert_equal "".b, @sandbox.eval("const b = new ArrayBuffer(8); b.transfer(); b").value
+  end
+
+  def test_utf8_strings_are_still_strings
+    @sandbox.set_variable("text", "héllo")
+
+    assert_equal "string", @sandbox.eval("typeof text").value
+  end
+
+  def test_strings_with_embedded_nul
+    @sandbox.set_variable("text", "a\u0000b")
+
+    assert_equal [3, 0], @sandbox.eval("[text.length, text.charCodeAt(1)]").value
+  end
+end
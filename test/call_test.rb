@@ -0,0 +1,125 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class CallTest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new
+  end
+
+  def test_call_global_function
+    @sandbox.eval("function add(a, b) { return a + b; }")
+
+    result = @sandbox.call("add", 5, 3)
+
+    assert_instance_of QuickJS::Result, result
+    assert_equal 8, result.value
+  end
+
+  def test_call_with_symbol_name
+    @sandbox.eval("function hello() { return 'hi'; }")
+
+    assert_equal "hi", @sandbox.call(:hello).value
+  end
+
+  def test_arguments_are_converted
+    @sandbox.eval("function inspect(...args) { return args.map(a => a === null ? 'null' : typeof a); }")
+
+    result = @sandbox.call("inspect", nil, true, 1, 1.5, "s", [1], { "a" => 1 })
+
+    assert_equal %w[null boolean number number string object object], result.value
+  end
+
+  def test_complex_arguments_round_trip
+    @sandbox.eval("function echo(x) { return x; }")
+    payload = { "user" => { "name" => "Alice", "tags" => %w[a b] }, "count" => 2 }
+
+    assert_equal payload, @sandbox.call("echo", payload).value
+  end
+
+  def test_call_method_binds_this
+    @sandbox.eval(<<~JS)
+      var app = { handlers: { prefix: 'evt:', onEvent(name) { return this.prefix + name; } } };
+    JS
+
+    assert_equal "evt:click", @sandbox.call("app.handlers.onEvent", "click").value
+  end
+
+  def test_global_function_gets_undefined_this_in_strict_mode
+    @sandbox.eval("function who() { 'use strict'; return typeof this; }")
+
+    assert_equal "undefined", @sandbox.call("who").value
+  end
+
+  def test_picks_up_reassigned_function
+    @sandbox.eval("function handler() { return 1; }")
+    assert_equal 1, @sandbox.call("handler").value
+
+    @sandbox.eval("handler = () => 2")
+
+    assert_equal 2, @sandbox.call("handler").value
+  end
+
+  def test_async_function_is_awaited
+    @sandbox.eval("async function load(x) { return await Promise.resolve(x * 2); }")
+
+    assert_equal 42, @sandbox.call("load", 21).value
+  end
+
+  def test_console_output_is_captured
+    @sandbox.eval("function log(msg) { console.log(msg); }")
+
+    assert_equal "hello\n", @sandbox.call("log", "hello").console_output
+  end
+
+  def test_missing_function_raises
+    error = assert_raises(QuickJS::JavascriptError) { @sandbox.call("nope") }
+    assert_match(/nope is not a function/, error.message)
+  end
+
+  def test_missing_parent_raises
+    assert_raises(QuickJS::JavascriptError) { @sandbox.call("missing.fn") }
+  end
+
+  def test_non_function_raises
+    @sandbox.eval("var config = { value: 1 }")
+
+    error = assert_raises(QuickJS::JavascriptError) { @sandbox.call("config.value") }
+    assert_match(/value is not a function/, error.message)
+  end
+
+  def test_thrown_error_raises
+    @sandbox.eval("function fail(msg) { throw new Error(msg); }")
+
+    error = assert_raises(QuickJS::JavascriptError) { @sandbox.call("fail", "boom") }
+    assert_match(/boom/, error.message)
+  end
+
+  def test_invalid_name_raises
+    assert_raises(ArgumentError) { @sandbox.call("") }
+    assert_raises(ArgumentError) { @sandbox.call("a..b") }
+  end
+
+  def test_timeout_applies
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 50)
+    sandbox.eval("function spin() { while (true) {} }")
+
+    assert_raises(QuickJS::TimeoutError) { sandbox.call("spin") }
+    assert_equal 1, sandbox.eval("1").value
+  end
+
+  def test_call_after_reset
+    @sandbox.eval("function f() { return 1; }")
+    @sandbox.call("f")
+    @sandbox.reset!
+    @sandbox.eval("function f() { return 2; }")
+
+    assert_equal 2, @sandbox.call("f").value
+  end
+
+  def test_many_calls_do_not_leak
+    @sandbox.eval("function wrap(x) { return { x: x }; }")
+
+    1000.times { |i| assert_equal({ "x" => [i] }, @sandbox.call("wrap", [i]).value) }
+  end
+end
@@ -0,0 +1,113 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "timeout"
+
+class ConcurrencyTest < Minitest::Test
+  BUSY_LOOP = "(() => { const end = Date.now() + 300; while (Date.now() < end) {} return 'done'; })()"
+
+  def test_ruby_threads_run_while_javascript_executes
+    sandbox = QuickJS::Sandbox.new
+    ticks = 0
+    running = true
+    ticker = Thread.new do
+      while running
+        ticks += 1
+        Thread.pass
+      end
+    end
+
+    assert_equal "done", sandbox.eval(BUSY_LOOP).value
+
+    running = false
+    ticker.join
+
+    # With the GVL held for the whole eval the ticker would barely run
+    assert_operator ticks, :>, 1000
+  end
+
+  def test_sandboxes_evaluate_in_parallel_threads
+    threads = 4.times.map do |i|
+      Thread.new do
+        sandbox = QuickJS::Sandbox.new
+        sandbox.set_variable("n", i)
+        sandbox.eval("let s = 0; for (let j = 0; j < 100000; j++) s += n; s").value
+      end
+    end
+
+    assert_equal [0, 100_000, 200_000, 300_000], threads.map(&:value)
+  end
+
+  def test_ruby_timeout_interrupts_javascript
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 60_000)
+
+    assert_raises(Timeout::Error) do
+      Timeout.timeout(0.2) { sandbox.eval("while (true) {}") }
+    end
+
+    # The sandbox is still usable afterwards
+    assert_equal 2, sandbox.eval("1 + 1").value
+  end
+
+  def test_thread_kill_interrupts_javascript
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 60_000)
+    thread = Thread.new { sandbox.eval("while (true) {}") }
+    sleep 0.1
+
+    thread.kill
+    thread.join
+
+    assert_equal 4, sandbox.eval("2 + 2").value
+  end
+
+  def test_concurrent_use_of_same_sandbox_raises
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 60_000)
+    thread = Thread.new { sandbox.eval("while (true) {}") }
+    sleep 0.1
+
+    error = assert_raises(QuickJS::Error) { sandbox.eval("1") }
+    assert_match(/already executing/, error.message)
+
+    assert_raises(QuickJS::Error) { sandbox.set_variable("x", 1) }
+  ensure
+    thread&.kill
+    thread&.join
+  end
+
+  def test_code_modified_by_another_thread_during_eval
+    # Large enough to take a while to parse, and to be unmapped when freed
+    code = +"/*#{' ' * 4_000_000}*/ 'original'"
+    sandbox = QuickJS::Sandbox.new
+    go = Queue.new
+    mutator = Thread.new do
+      go.pop
+      20.times { |i| code.replace("'replaced' /*#{' ' * (4_000_000 + i)}*/") }
+    end
+    go << true
+
+    assert_equal "original", sandbox.eval(code).value
+    assert_equal ["original"], sandbox.eval_batch([+"/*#{' ' * 4_000_000}*/ 'original'"]).map(&:value)
+    mutator.join
+  end
+
+  def test_fetch_callback_runs_with_gvl_from_other_thread
+    mock = MockHTTPSandbox.new
+    result = Thread.new do
+      mock.create_sandbox.eval("(await fetch('https://example.com/data')).json()").value
+    end.value
+
+    assert_equal({ "message" => "success" }, result)
+    assert_equal "https://example.com/data", mock.requests.first[:url]
+  end
+
+  def test_deep_recursion_in_thread_raises_stack_overflow
+    error = Thread.new do
+      QuickJS::Sandbox.new.eval("function f(n) { return f(n + 1); } f(0)")
+    rescue QuickJS::JavascriptError => e
+      e
+    end.value
+
+    assert_kind_of QuickJS::JavascriptError, error
+    assert_match(/stack overflow/, error.message)
+  end
+end
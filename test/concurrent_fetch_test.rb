@@ -0,0 +1,173 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "socket"
+
+class ConcurrentFetchTest < Minitest::Test
+  # Minimal HTTP server: GET /delay/MS answers "MS" after sleeping MS milliseconds
+  class DelayServer
+    attr_reader :port
+
+    def initialize
+      @server = TCPServer.new("127.0.0.1", 0)
+      @port = @server.addr[1]
+      @thread = Thread.new { loop { Thread.new(@server.accept) { |client| serve(client) } } }
+    end
+
+    def close
+      @thread.kill
+      @server.close
+    end
+
+    private
+
+    def serve(client)
+      request_line = client.gets.to_s
+      while (line = client.gets) && line != "\r\n"; end
+      delay = request_line[%r{/delay/(\d+)}, 1].to_i
+      sleep(delay / 1000.0)
+      body = delay.to_s
+      client.write("HTTP/1.1 200 OK\r\nContent-Length: #{body.bytesize}\r\nConnection: close\r\n\r\n#{body}")
+    rescue IOError, SystemCallError
+      nil
+    ensure
+      client.close
+    end
+  end
+
+  def setup
+    @server = DelayServer.new
+  end
+
+  def teardown
+    @server.close
+  end
+
+  def sandbox(timeout_ms: 5000, **http)
+    QuickJS::Sandbox.new(
+      timeout_ms: timeout_ms,
+      http: {
+        allowlist: ["http://127.0.0.1:#{@server.port}/**"],
+        block_private_ips: false,
+        allowed_ports: [@server.port]
+      }.merge(http)
+    )
+  end
+
+  def url(path)
+    "http://127.0.0.1:#{@server.port}#{path}"
+  end
+
+  def test_fetch_returns_response
+    result = sandbox.eval("(async () => { const r = await fetch('#{url("/delay/0")}'); return [r.status, await r.text()]; })()")
+
+    assert_equal [200, "0"], result.value
+  end
+
+  def test_requests_run_concurrently
+    code = <<~JS
+      Promise.all([200, 200, 200].map(ms => fetch('#{url("/delay/")}' + ms).then(r => r.text())))
+    JS
+
+    started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    result = sandbox.eval(code)
+    elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - started
+
+    assert_equal %w[200 200 200], result.value
+    assert_operator elapsed, :<, 0.5
+  end
+
+  def test_responses_settle_in_completion_order
+    code = <<~JS
+      (async () => {
+        const order = [];
+        await Promise.all([300, 0].map(ms => fetch('#{url("/delay/")}' + ms).then(() => order.push(ms))));
+        return order;
+      })()
+    JS
+
+    assert_equal [0, 300], sandbox.eval(code).value
+  end
+
+  def test_executor_logs_concurrent_requests
+    sb = sandbox
+    sb.eval("Promise.all([fetch('#{url("/delay/10")}'), fetch('#{url("/delay/20")}')])")
+
+    requests = sb.instance_variable_get(:@http_executor).http_requests
+    assert_equal 2, requests.length
+    assert(requests.all? { |request| request.status == 200 })
+  end
+
+  def test_max_requests_is_enforced
+    code = <<~JS
+      (async () => {
+        const first = await fetch('#{url("/delay/0")}');
+        try {
+          await fetch('#{url("/delay/0")}');
+          return 'allowed';
+        } catch (e) {
+          return first.status + ' ' + e.message;
+        }
+      })()
+    JS
+
+    assert_equal "200 HTTP request failed", sandbox(max_requests: 1).eval(code).value
+  end
+
+  def test_uncaught_limit_error_is_reraised
+    code = "Promise.all([fetch('#{url("/delay/0")}'), fetch('#{url("/delay/0")}')])"
+
+    assert_raises(QuickJS::HTTPLimitError) { sandbox(max_requests: 1).eval(code) }
+  end
+
+  def test_blocked_url_rejects
+    assert_raises(QuickJS::HTTPBlockedError) { sandbox.eval("fetch('http://example.com/')") }
+  end
+
+  def test_network_error_rejects
+    sb = sandbox(request_timeout: 100)
+    code = "(async () => { try { await fetch('#{url("/delay/1000")}'); } catch (e) { return e.message; } })()"
+
+    assert_equal "HTTP request failed", sb.eval(code).value
+  end
+
+  def test_timeout_while_waiting
+    sb = sandbox(timeout_ms: 200)
+
+    started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+    assert_raises(QuickJS::TimeoutError) { sb.eval("fetch('#{url("/delay/2000")}')") }
+    assert_operator Process.clock_gettime(Process::CLOCK_MONOTONIC) - started, :<, 1.0
+
+    # The abandoned request does not leak into the next eval
+    assert_equal 2, sb.eval("1 + 1").value
+  end
+
+  def test_thread_interrupt_while_waiting
+    sb = sandbox
+    thread = Thread.new { sb.eval("fetch('#{url("/delay/2000")}')") }
+    thread.report_on_exception = false
+    sleep 0.1
+    thread.raise(RuntimeError, "stop")
+
+    error = assert_raises(RuntimeError) { thread.join }
+    assert_equal "stop", error.message
+    assert_equal "0", sb.eval("(async () => (await fetch('#{url("/delay/0")}')).text())()").value
+  end
+
+  def test_executor_is_reset_for_each_eval
+    sb = sandbox(max_requests: 1)
+    executor = sb.instance_variable_get(:@http_executor)
+    2.times { assert_equal "0", sb.eval("(async () => (await fetch('#{url("/delay/0")}')).text())()").value }
+
+    assert_same executor, sb.instance_variable_get(:@http_executor)
+    assert_equal 1, executor.http_requests.length
+  end
+
+  def test_unawaited_fetch_completes_before_eval_returns
+    sb = sandbox
+    result = sb.eval("fetch('#{url("/delay/50")}'); 'done'")
+
+    assert_equal "done", result.value
+    assert_equal 1, sb.instance_variable_get(:@http_executor).http_requests.length
+  end
+end
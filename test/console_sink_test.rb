@@ -0,0 +1,107 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "stringio"
+
+class ConsoleSinkTest < Minitest::Test
+  # IO that records every write call
+  class RecordingIO < StringIO
+    attr_reader :writes
+
+    def write(*strings)
+      (@writes ||= []) << strings.join
+      super
+    end
+  end
+
+  def test_callable_receives_levels
+    lines = []
+    sandbox = QuickJS::Sandbox.new(console: ->(level, line) { lines << [level, line] })
+    result = sandbox.eval(<<~JS)
+      console.log('a', 1, {});
+      console.info('b');
+      console.warn('c');
+      console.error('d');
+      console.debug('e');
+      42
+    JS
+
+    assert_equal [[:log, "a 1 [object Object]"], [:info, "b"], [:warn, "c"], [:error, "d"], [:debug, "e"]], lines
+    assert_equal 42, result.value
+    assert_equal "", result.console_output
+    refute_predicate result, :console_truncated?
+  end
+
+  def test_io_receives_one_write_per_batch
+    io = RecordingIO.new
+    sandbox = QuickJS::Sandbox.new(console: io)
+    sandbox.eval("for (let i = 0; i < 100; i++) console.log('line ' + i)")
+
+    assert_equal 1, io.writes.size
+    assert_equal (0...100).map { |i| "line #{i}\n" }.join, io.string
+  end
+
+  def test_flush_size_sets_the_batch_size
+    io = RecordingIO.new
+    sandbox = QuickJS::Sandbox.new(console: io, console_flush_size: 0)
+    sandbox.eval("for (let i = 0; i < 5; i++) console.log(i)")
+
+    assert_equal %W[0\n 1\n 2\n 3\n 4\n], io.writes
+  end
+
+  def test_lines_arrive_while_the_eval_runs
+    lines = []
+    sandbox = QuickJS::Sandbox.new(console: ->(_level, line) { lines << line }, console_flush_size: 10)
+    sandbox.define_function("received") { lines.size }
+
+    assert_equal [0, 1], sandbox.eval("const before = received(); console.log('x'.repeat(20)); [before, received()]").value
+  end
+
+  def test_output_is_not_capped
+    io = StringIO.new
+    sandbox = QuickJS::Sandbox.new(console: io, console_log_max_size: 10)
+    sandbox.eval("console.log('y'.repeat(1000))")
+
+    assert_equal 1001, io.string.bytesize
+  end
+
+  def test_lines_are_flushed_when_the_eval_fails
+    lines = []
+    sandbox = QuickJS::Sandbox.new(console: ->(_level, line) { lines << line })
+
+    assert_raises(QuickJS::JavascriptError) { sandbox.eval("console.log('before'); throw new Error('boom')") }
+    assert_raises(QuickJS::TimeoutError) do
+      QuickJS::Sandbox.new(console: ->(_level, line) { lines << line }, timeout_ms: 50)
+                      .eval("console.log('spinning'); while (true) {}")
+    end
+    assert_equal %w[before spinning], lines
+  end
+
+  def test_sink_errors_stop_the_eval
+    sandbox = QuickJS::Sandbox.new(console: ->(_level, _line) { raise IOError, "closed" }, console_flush_size: 0)
+
+    error = assert_raises(IOError) { sandbox.eval("console.log('a'); globalThis.after = true") }
+    assert_equal "closed", error.message
+    assert_nil sandbox.eval("globalThis.after").value
+  end
+
+  def test_sink_is_kept_across_reset
+    lines = []
+    sandbox = QuickJS::Sandbox.new(console: ->(_level, line) { lines << line })
+    sandbox.reset!
+    sandbox.eval("console.log('after reset')")
+
+    assert_equal ["after reset"], lines
+  end
+
+  def test_invalid_sink
+    assert_raises(QuickJS::ArgumentError) { QuickJS::Sandbox.new(console: 42) }
+    assert_raises(QuickJS::ArgumentError) { QuickJS::Sandbox.new(console: $stdout, console_flush_size: -1) }
+  end
+
+  def test_buffered_output_includes_new_levels
+    result = QuickJS::Sandbox.new.eval("console.info('i'); console.debug('d')")
+
+    assert_equal "i\nd\n", result.console_output
+  end
+end
@@ -0,0 +1,138 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "open3"
+
+class DefineFunctionTest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new
+  end
+
+  def test_block_is_called_with_converted_arguments
+    @sandbox.define_function("describe") { |*args| args.map(&:class).map(&:name).join(",") }
+
+    assert_equal "Integer,String,Array,Hash,NilClass",
+                 @sandbox.eval("describe(1, 'a', [1], {a: 1}, null)").value
+  end
+
+  def test_return_value_is_converted
+    @sandbox.define_function("lookup") { |key| { "key" => key, "tags" => %w[a b] } }
+
+    assert_equal ["k", 2], @sandbox.eval("const r = lookup('k'); [r.key, r.tags.length]").value
+  end
+
+  def test_callable_object
+    @sandbox.define_function(:double, ->(n) { n * 2 })
+
+    assert_equal 42, @sandbox.eval("double(21)").value
+  end
+
+  def test_many_arguments
+    @sandbox.define_function("sum") { |*n| n.sum }
+
+    assert_equal 66, @sandbox.eval("sum(1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11)").value
+  end
+
+  def test_function_has_name
+    @sandbox.define_function("lookup") { nil }
+
+    assert_equal ["lookup", "function"], @sandbox.eval("[lookup.name, typeof lookup]").value
+  end
+
+  def test_ruby_exception_is_reraised
+    @sandbox.define_function("fail") { raise KeyError, "missing key" }
+
+    error = assert_raises(KeyError) { @sandbox.eval("fail()") }
+    assert_equal "missing key", error.message
+  end
+
+  def test_ruby_exception_can_be_caught_in_javascript
+    @sandbox.define_function("fail") { raise KeyError, "missing key" }
+
+    assert_equal "fail() raised KeyError", @sandbox.eval("try { fail() } catch (e) { e.message }").value
+  end
+
+  def test_sandbox_stays_usable_after_exception
+    @sandbox.define_function("fail") { raise "boom" }
+    assert_raises(RuntimeError) { @sandbox.eval("fail()") }
+
+    assert_equal 2, @sandbox.eval("1 + 1").value
+  end
+
+  def test_failed_conversion_frees_the_partial_value
+    # A leaked object aborts JS_FreeRuntime, when the sandbox is collected
+    script = <<~RUBY
+      bad = Object.new
+      def bad.to_s = raise("no string")
+      sandbox = QuickJS::Sandbox.new
+      sandbox.define_function("f") { [1, { a: bad }] }
+      begin
+        sandbox.eval("f()")
+      rescue RuntimeError => e
+        puts e.message
+      end
+      begin
+        sandbox.set_variable("x", [{ "a" => [2] }, { bad => 1 }])
+      rescue RuntimeError => e
+        puts e.message
+      end
+      begin
+        sandbox.call("String", [3], { "a" => bad })
+      rescue RuntimeError => e
+        puts e.message
+      end
+      puts sandbox.eval("typeof x").value
+      sandbox = nil
+      GC.start
+    RUBY
+    lib = File.expand_path("../lib", __dir__)
+    out, err, status = Open3.capture3(RbConfig.ruby, "-I", lib, "-rquickjs", "-e", script)
+
+    assert_predicate status, :success?, err
+    assert_equal "no string\nno string\nno string\nundefined\n", out
+  end
+
+  def test_redefining_replaces_callable
+    @sandbox.define_function("version") { 1 }
+    @sandbox.define_function("version") { 2 }
+
+    assert_equal 2, @sandbox.eval("version()").value
+  end
+
+  def test_functions_survive_reset
+    @sandbox.define_function("answer") { 42 }
+    @sandbox.reset!
+
+    assert_equal 42, @sandbox.eval("answer()").value
+  end
+
+  def test_works_from_async_code
+    @sandbox.define_function("lookup") { |key| key.upcase }
+
+    assert_equal "A", @sandbox.eval("await Promise.resolve('a').then(lookup)").value
+  end
+
+  def test_works_in_call_and_batches
+    @sandbox.define_function("inc") { |n| n + 1 }
+    @sandbox.eval("function run(n) { return inc(n) * 10; }")
+
+    assert_equal 20, @sandbox.call("run", 1).value
+    assert_equal [30, 40], @sandbox.call_batch("run", [[2], [3]]).map(&:value)
+  end
+
+  def test_requires_callable
+    assert_raises(QuickJS::ArgumentError) { @sandbox.define_function("nothing") }
+  end
+
+  def test_rejects_empty_name
+    assert_raises(ArgumentError) { @sandbox.define_function("") { nil } }
+  end
+
+  def test_many_calls
+    count = 0
+    @sandbox.define_function("tick") { count += 1 }
+    @sandbox.eval("for (let i = 0; i < 10000; i++) tick()")
+
+    assert_equal 10_000, count
+  end
+end
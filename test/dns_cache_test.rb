@@ -0,0 +1,171 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "socket"
+
+class DNSCacheTest < Minitest::Test
+  # Resolver stub counting lookups
+  class Resolver
+    attr_reader :lookups
+    attr_accessor :answers
+
+    def initialize(answers)
+      @answers = answers
+      @lookups = Hash.new(0)
+    end
+
+    def call(host)
+      @lookups[host] += 1
+      @answers.fetch(host, [nil, 0])
+    end
+  end
+
+  def test_answers_are_cached
+    resolver = Resolver.new("api.example.com" => ["93.184.216.34", 60])
+    cache = QuickJS::DNSCache.new(resolver: resolver)
+
+    3.times { assert_equal "93.184.216.34", cache.resolve("api.example.com") }
+    assert_equal 1, resolver.lookups["api.example.com"]
+  end
+
+  def test_ttl_is_respected
+    resolver = Resolver.new("api.example.com" => ["93.184.216.34", 0])
+    cache = QuickJS::DNSCache.new(resolver: resolver, min_ttl: 0)
+
+    cache.resolve("api.example.com")
+    resolver.answers = { "api.example.com" => ["93.184.216.35", 0] }
+
+    assert_equal "93.184.216.35", cache.resolve("api.example.com")
+    assert_equal 2, resolver.lookups["api.example.com"]
+  end
+
+  def test_ttl_is_clamped
+    resolver = Resolver.new("api.example.com" => ["93.184.216.34", 86_400])
+    cache = QuickJS::DNSCache.new(resolver: resolver, min_ttl: 0, max_ttl: 0)
+
+    2.times { cache.resolve("api.example.com") }
+    assert_equal 2, resolver.lookups["api.example.com"]
+  end
+
+  def test_failed_lookups_are_cached
+    resolver = Resolver.new({})
+    cache = QuickJS::DNSCache.new(resolver: resolver)
+
+    2.times { assert_nil cache.resolve("missing.example.com") }
+    assert_equal 1, resolver.lookups["missing.example.com"]
+
+    expiring = QuickJS::DNSCache.new(resolver: resolver, negative_ttl: 0)
+    2.times { expiring.resolve("gone.example.com") }
+    assert_equal 2, resolver.lookups["gone.example.com"]
+  end
+
+  def test_ip_literals_are_not_looked_up
+    resolver = Resolver.new({})
+    cache = QuickJS::DNSCache.new(resolver: resolver)
+
+    assert_equal "10.0.0.1", cache.resolve("10.0.0.1")
+    assert_equal "::1", cache.resolve("[::1]")
+    assert_empty resolver.lookups
+    assert_equal 0, cache.size
+  end
+
+  def test_max_entries
+    resolver = Resolver.new({})
+    cache = QuickJS::DNSCache.new(resolver: resolver, max_entries: 2)
+
+    %w[a.example b.example c.example].each { |host| cache.resolve(host) }
+    assert_equal 2, cache.size
+
+    cache.resolve("a.example")
+    assert_equal 2, resolver.lookups["a.example"]
+  end
+
+  def test_invalid_ttl_range
+    assert_raises(QuickJS::ArgumentError) { QuickJS::DNSCache.new(min_ttl: 10, max_ttl: 5) }
+  end
+
+  def test_clear
+    resolver = Resolver.new("api.example.com" => ["93.184.216.34", 60])
+    cache = QuickJS::DNSCache.new(resolver: resolver)
+    cache.resolve("api.example.com")
+    cache.clear
+
+    cache.resolve("api.example.com")
+    assert_equal 2, resolver.lookups["api.example.com"]
+  end
+
+  def test_blocked_ip_check_uses_cache
+    resolver = Resolver.new("internal.example.com" => ["10.1.2.3", 60], "public.example.com" => ["93.184.216.34", 60])
+    config = QuickJS::HTTPConfig.new(allowlist: ["https://**"], dns_cache: QuickJS::DNSCache.new(resolver: resolver))
+
+    error = assert_raises(QuickJS::HTTPBlockedError) { config.validate_url!("https://internal.example.com/") }
+    assert_match(/blocked IP/, error.message)
+    assert_equal "93.184.216.34", config.validate_url!("https://public.example.com/")
+    assert config.blocked_ip?("internal.example.com")
+    assert_equal 1, resolver.lookups["internal.example.com"]
+  end
+
+  def test_fetch_resolves_once_and_connects_to_the_vetted_address
+    server = TCPServer.new("127.0.0.1", 0)
+    port = server.addr[1]
+    thread = Thread.new do
+      loop do
+        client = server.accept
+        while (line = client.gets) && line != "\r\n"; end
+        client.write("HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok")
+        client.close
+      end
+    end
+
+    # The name does not exist: only the cache can resolve it
+    resolver = Resolver.new("service.test" => ["127.0.0.1", 60])
+    sandbox = QuickJS::Sandbox.new(http: {
+                                     allowlist: ["http://service.test:#{port}/**"],
+                                     allowed_ports: [port],
+                                     block_private_ips: false,
+                                     dns_cache: QuickJS::DNSCache.new(resolver: resolver)
+                                   })
+
+    2.times { assert_equal "ok", sandbox.eval("fetch('http://service.test:#{port}/').then(r => r.text())").value }
+    assert_equal 1, resolver.lookups["service.test"]
+  ensure
+    thread&.kill
+    server&.close
+  end
+
+  def test_unresolvable_host_rejects
+    sandbox = QuickJS::Sandbox.new(http: {
+                                     allowlist: ["http://missing.test/**"],
+                                     block_private_ips: false,
+                                     dns_cache: QuickJS::DNSCache.new(resolver: Resolver.new({}))
+                                   })
+
+    error = assert_raises(QuickJS::HTTPError) { sandbox.eval("fetch('http://missing.test/')") }
+    assert_match(/cannot resolve host missing.test/, error.message)
+  end
+
+  def test_unresolvable_host_fails_closed_when_private_ips_are_blocked
+    config = QuickJS::HTTPConfig.new(allowlist: ["https://**"],
+                                     dns_cache: QuickJS::DNSCache.new(resolver: Resolver.new({})))
+
+    error = assert_raises(QuickJS::HTTPError) { config.validate_url!("https://missing.test/") }
+    assert_match(/cannot resolve host missing.test/, error.message)
+  end
+
+  def test_fetch_does_not_resolve_a_host_the_check_could_not
+    # Fails for the check, then would resolve to a private address
+    resolver = Resolver.new({})
+    def resolver.call(host)
+      super
+      @lookups[host] > 1 ? ["127.0.0.1", 60] : [nil, 0]
+    end
+    sandbox = QuickJS::Sandbox.new(http: {
+                                     allowlist: ["http://rebind.test/**"],
+                                     dns_cache: QuickJS::DNSCache.new(resolver: resolver, negative_ttl: 0)
+                                   })
+
+    error = assert_raises(QuickJS::HTTPError) { sandbox.eval("fetch('http://rebind.test/')") }
+    assert_match(/cannot resolve host rebind.test/, error.message)
+    assert_equal 1, resolver.lookups["rebind.test"]
+  end
+end
@@ -651,4 +651,50 @@ class FetchPolyfillTest < Minitest::Test
     end
     assert_match(/test error/i, error.message)
   end
+
+  # ============================================================================
+  # Precompiled Polyfill Tests
+  # ============================================================================
+
+  def test_polyfill_bytecode_is_compiled_once
+    first = QuickJS::FetchPolyfill.bytecode(nil)
+
+    QuickJS::Sandbox.new
+
+    assert_same first, QuickJS::FetchPolyfill.bytecode(nil)
+    assert_predicate first, :frozen?
+    assert_equal Encoding::ASCII_8BIT, first.encoding
+  end
+
+  def test_polyfill_classes_available_from_bytecode
+    result = @sandbox.eval(<<~JS)
+      [typeof URL, typeof URLSearchParams, typeof Headers, typeof Request, typeof Response]
+    JS
+    assert_equal %w[function function function function function], result.value
+  end
+
+  def test_native_compile_and_eval_bytecode
+    native = QuickJS::NativeSandbox.new({})
+    bytecode = native.compile("var compiled = 20; compiled + 1")
+
+    assert_equal 21, native.eval_bytecode(bytecode).value
+    assert_equal 20, native.eval("compiled").value
+  end
+
+  def test_native_eval_bytecode_refuses_other_strings
+    native = QuickJS::NativeSandbox.new({})
+    bytecode = native.compile("1")
+
+    assert_raises(ArgumentError) { native.eval_bytecode(bytecode.dup.freeze) }
+    assert_raises(ArgumentError) { native.eval_bytecode("\x02\x01garbage".b) }
+    assert_equal 1, native.eval_bytecode(bytecode).value
+  end
+
+  def test_native_compile_syntax_error
+    native = QuickJS::NativeSandbox.new({})
+
+    assert_raises(QuickJS::SyntaxError) do
+      native.compile("var = ;")
+    end
+  end
 end
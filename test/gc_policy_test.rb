@@ -0,0 +1,96 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class GCPolicyTest < Minitest::Test
+  def test_always_runs_gc_after_each_eval
+    sandbox = QuickJS::Sandbox.new
+
+    result = sandbox.eval("1")
+
+    assert_equal 1, result.gc_count
+    assert_operator result.gc_time_ms, :>=, 0
+  end
+
+  def test_never_skips_explicit_gc
+    sandbox = QuickJS::Sandbox.new(gc: :never)
+
+    results = 5.times.map { sandbox.eval("({ a: [1, 2, 3] })") }
+
+    assert_equal [0] * 5, results.map(&:gc_count)
+    assert_equal({ "a" => [1, 2, 3] }, results.last.value)
+  end
+
+  def test_every_n_runs_gc_periodically
+    sandbox = QuickJS::Sandbox.new(gc: :every_n, gc_interval: 3)
+
+    counts = 9.times.map { sandbox.eval("1").gc_count }
+    passes = counts.each_index.select { |i| counts[i] == 1 }
+
+    # Setup evals (polyfills) count too, so only the spacing is fixed
+    assert_equal 3, passes.length
+    assert_equal [3, 3], passes.each_cons(2).map { |a, b| b - a }
+  end
+
+  def test_threshold_skips_explicit_gc
+    sandbox = QuickJS::Sandbox.new(gc: :threshold, gc_threshold: 512 * 1024)
+
+    assert_equal 0, sandbox.eval("1").gc_count
+  end
+
+  def test_collections_quickjs_triggers_are_counted
+    sandbox = QuickJS::Sandbox.new(gc: :threshold, gc_threshold: 256 * 1024, memory_limit: 20_000_000)
+
+    result = sandbox.eval("for (let i = 0; i < 20000; i++) { const a = { pad: 'x'.repeat(100) }; a.self = a; } 1")
+
+    assert_operator result.gc_count, :>, 0
+    assert_operator result.gc_time_ms, :>, 0
+    assert_equal result.gc_count, result.metrics[:gc_count]
+    assert_equal 0, sandbox.eval("1").gc_count
+  end
+
+  def test_cycles_are_collected_without_explicit_gc
+    # Cyclic garbage is only reclaimed by the cycle collector; QuickJS must
+    # still run it on its own before the memory limit is hit
+    %i[never threshold].each do |policy|
+      sandbox = QuickJS::Sandbox.new(gc: policy, memory_limit: 2_000_000)
+
+      200.times do
+        sandbox.eval("(() => { for (let i = 0; i < 100; i++) { const a = {}; const b = { a }; a.b = b; } })()")
+      end
+
+      assert_equal 2, sandbox.eval("1 + 1").value
+    end
+  end
+
+  def test_errors_still_raise
+    sandbox = QuickJS::Sandbox.new(gc: :never)
+
+    assert_raises(QuickJS::JavascriptError) { sandbox.eval("throw new Error('x')") }
+    assert_equal 1, sandbox.eval("1").value
+  end
+
+  def test_batch_runs_gc_once
+    sandbox = QuickJS::Sandbox.new
+
+    results = sandbox.eval_batch(%w[1 2 3])
+
+    assert_equal [0, 0, 1], results.map(&:gc_count)
+  end
+
+  def test_batch_counts_items_for_every_n
+    sandbox = QuickJS::Sandbox.new(gc: :every_n, gc_interval: 5)
+
+    counts = 5.times.map { sandbox.eval_batch(%w[1 2 3 4 5]).last.gc_count }
+
+    assert_equal [1] * 5, counts
+  end
+
+  def test_invalid_policy
+    assert_raises(QuickJS::ArgumentError) { QuickJS::Sandbox.new(gc: :sometimes) }
+  end
+
+  def test_invalid_interval
+    assert_raises(QuickJS::ArgumentError) { QuickJS::Sandbox.new(gc: :every_n, gc_interval: 0) }
+  end
+end
@@ -0,0 +1,140 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class HandleTest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new
+    @sandbox.eval(<<~JS)
+      globalThis.order = {
+        status: "paid",
+        total: 12.5,
+        lines: [{ sku: "A-1", qty: 2 }, { sku: "B-2", qty: 1 }],
+        meta: null
+      };
+    JS
+  end
+
+  def test_lazy_object_result_is_a_handle
+    value = @sandbox.eval("order", lazy: true).value
+
+    assert_instance_of QuickJS::Handle, value
+    refute value.array?
+    assert value.valid?
+  end
+
+  def test_lazy_primitive_results_are_converted
+    assert_equal 42, @sandbox.eval("42", lazy: true).value
+    assert_equal "hi", @sandbox.eval("'hi'", lazy: true).value
+    assert_nil @sandbox.eval("undefined", lazy: true).value
+    assert_equal "ab".b, @sandbox.eval("new Uint8Array([97, 98])", lazy: true).value
+  end
+
+  def test_property_access
+    order = @sandbox.eval("order", lazy: true).value
+
+    assert_equal "paid", order["status"]
+    assert_equal 12.5, order[:total]
+    assert_nil order["meta"]
+    assert_nil order["missing"]
+    assert_instance_of QuickJS::Handle, order["lines"]
+  end
+
+  def test_array_access
+    lines = @sandbox.eval("order.lines", lazy: true).value
+
+    assert lines.array?
+    assert_equal 2, lines.size
+    assert_equal "B-2", lines[1]["sku"]
+    assert_nil lines[5]
+  end
+
+  def test_dig
+    order = @sandbox.eval("order", lazy: true).value
+
+    assert_equal "A-1", order.dig("lines", 0, "sku")
+    assert_nil order.dig("meta", "anything")
+    assert_raises(TypeError) { order.dig("status", "x") }
+  end
+
+  def test_each_and_enumerable
+    order = @sandbox.eval("order", lazy: true).value
+    lines = order["lines"]
+
+    assert_equal %w[status total lines meta], order.keys
+    assert_equal %w[A-1 B-2], lines.map { |line| line["sku"] }
+    assert_equal({ "status" => "paid", "total" => 12.5 }, order.first(2).to_h)
+  end
+
+  def test_to_ruby
+    lines = @sandbox.eval("order", lazy: true).value["lines"]
+
+    assert_equal [{ "sku" => "A-1", "qty" => 2 }, { "sku" => "B-2", "qty" => 1 }], lines.to_ruby
+  end
+
+  def test_sees_later_changes
+    order = @sandbox.eval("order", lazy: true).value
+    @sandbox.eval("order.status = 'refunded'")
+
+    assert_equal "refunded", order["status"]
+  end
+
+  def test_only_accessed_getters_run
+    value = @sandbox.eval(<<~JS, lazy: true).value
+      globalThis.reads = 0;
+      ({ get cheap() { reads++; return 1; }, get expensive() { reads += 100; return 2; } })
+    JS
+
+    assert_equal 1, value["cheap"]
+    assert_equal 1, @sandbox.eval("reads").value
+  end
+
+  def test_getter_errors_raise
+    value = @sandbox.eval("({ get bad() { throw new Error('nope'); } })", lazy: true).value
+
+    error = assert_raises(QuickJS::JavascriptError) { value["bad"] }
+    assert_match(/nope/, error.message)
+    assert_equal 1, @sandbox.eval("1").value
+  end
+
+  def test_getters_are_subject_to_timeout
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 100)
+    value = sandbox.eval("({ get forever() { while (true) {} } })", lazy: true).value
+
+    assert_raises(QuickJS::TimeoutError) { value["forever"] }
+  end
+
+  def test_handle_can_be_passed_back
+    lines = @sandbox.eval("order.lines", lazy: true).value
+    @sandbox.set_variable("copy", lines)
+
+    assert_equal true, @sandbox.eval("copy === order.lines").value
+  end
+
+  def test_reset_invalidates_handles
+    order = @sandbox.eval("order", lazy: true).value
+    @sandbox.reset!
+
+    refute order.valid?
+    assert_equal "#<QuickJS::Handle (invalid)>", order.inspect
+    assert_raises(QuickJS::Error) { order["status"] }
+    assert_raises(QuickJS::Error) { order.to_ruby }
+  end
+
+  def test_collected_handles_release_their_objects
+    sandbox = QuickJS::Sandbox.new(memory_limit: 10_000_000)
+    20.times do
+      sandbox.eval("new Array(200000).fill(0)", lazy: true)
+      GC.start
+    end
+
+    assert_equal 1, sandbox.eval("1").value
+  end
+
+  def test_handle_outliving_sandbox
+    handle = QuickJS::Sandbox.new.eval("({ a: 1 })", lazy: true).value
+    GC.start
+
+    assert_equal 1, handle["a"]
+  end
+end
@@ -0,0 +1,132 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "socket"
+
+class HTTPConnectionPoolTest < Minitest::Test
+  # Keep-alive HTTP server counting the connections it accepts.
+  # GET /delay/MS answers after sleeping MS milliseconds.
+  class KeepAliveServer
+    attr_reader :port, :connections
+
+    def initialize
+      @server = TCPServer.new("127.0.0.1", 0)
+      @port = @server.addr[1]
+      @connections = 0
+      @thread = Thread.new do
+        loop do
+          client = @server.accept
+          @connections += 1
+          Thread.new { serve(client) }
+        end
+      end
+    end
+
+    def close
+      @thread.kill
+      @server.close
+    end
+
+    private
+
+    def serve(client)
+      while (request_line = client.gets)
+        while (line = client.gets) && line != "\r\n"; end
+        sleep(request_line[%r{/delay/(\d+)}, 1].to_i / 1000.0)
+        client.write("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok")
+      end
+    rescue IOError, SystemCallError
+      nil
+    ensure
+      client.close
+    end
+  end
+
+  def setup
+    @server = KeepAliveServer.new
+  end
+
+  def teardown
+    @server.close
+  end
+
+  def get(pool, path = "/", timeout_ms: 2000)
+    uri = URI("http://127.0.0.1:#{@server.port}#{path}")
+    pool.request(uri, Net::HTTP::Get.new(uri.request_uri), timeout_ms)
+  end
+
+  def test_connections_are_reused
+    pool = QuickJS::HTTPConnectionPool.new
+
+    3.times { assert_equal "ok", get(pool).body }
+
+    assert_equal 1, @server.connections
+    assert_equal({ idle: 1, active: 0 }, pool.stats)
+  end
+
+  def test_per_host_limit
+    pool = QuickJS::HTTPConnectionPool.new(max_per_host: 2)
+
+    Array.new(4) { Thread.new { get(pool, "/delay/50") } }.each(&:join)
+
+    assert_equal 2, @server.connections
+    assert_equal({ idle: 2, active: 0 }, pool.stats)
+  end
+
+  def test_waiting_for_a_connection_times_out
+    pool = QuickJS::HTTPConnectionPool.new(max_per_host: 1)
+    slow = Thread.new { get(pool, "/delay/500") }
+    sleep 0.1
+
+    error = assert_raises(QuickJS::HTTPError) { get(pool, timeout_ms: 50) }
+    assert_match(/no connection/, error.message)
+    slow.join
+  end
+
+  def test_idle_connections_are_evicted
+    pool = QuickJS::HTTPConnectionPool.new(idle_timeout: 0)
+
+    get(pool)
+    get(pool)
+
+    assert_equal 2, @server.connections
+  end
+
+  def test_killed_request_releases_its_connection
+    pool = QuickJS::HTTPConnectionPool.new(max_per_host: 1)
+    thread = Thread.new { get(pool, "/delay/1000") }
+    sleep 0.1
+    thread.kill.join
+
+    assert_equal "ok", get(pool).body
+    assert_equal 2, @server.connections
+  end
+
+  def test_close_drops_idle_connections
+    pool = QuickJS::HTTPConnectionPool.new
+    get(pool)
+    pool.close
+
+    assert_equal({ idle: 0, active: 0 }, pool.stats)
+  end
+
+  def test_sandboxes_share_the_pool
+    pool = QuickJS::HTTPConnectionPool.new
+    previous = QuickJS::HTTPConnectionPool.shared
+    QuickJS::HTTPConnectionPool.shared = pool
+    http = { allowlist: ["http://127.0.0.1:#{@server.port}/**"], block_private_ips: false, allowed_ports: [@server.port] }
+
+    2.times do
+      sandbox = QuickJS::Sandbox.new(http: http)
+      2.times { assert_equal "ok", sandbox.eval("fetch('http://127.0.0.1:#{@server.port}/').then(r => r.text())").value }
+    end
+
+    assert_equal 1, @server.connections
+  ensure
+    QuickJS::HTTPConnectionPool.shared = previous
+  end
+
+  def test_invalid_limit
+    assert_raises(QuickJS::ArgumentError) { QuickJS::HTTPConnectionPool.new(max_per_host: 0) }
+  end
+end
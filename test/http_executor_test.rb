@@ -45,6 +45,19 @@ class TestHTTPExecutor < Minitest::Test
     assert_equal 0, executor.http_requests.size
   end
 
+  def test_http_executor_start_validates_synchronously
+    config = QuickJS::HTTPConfig.new(
+      allowlist: ["https://allowed.com/**"]
+    )
+
+    executor = QuickJS::HTTPExecutor.new(config)
+
+    assert_raises(QuickJS::HTTPBlockedError) do
+      executor.start("GET", "https://blocked.com/data")
+    end
+    assert_empty executor.take_completed
+  end
+
   def test_http_executor_method_validation
     config = QuickJS::HTTPConfig.new(
       allowlist: ["http://localhost:8765/**"],
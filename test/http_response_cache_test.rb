@@ -0,0 +1,213 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "socket"
+require "time"
+
+class HTTPResponseCacheTest < Minitest::Test
+  # HTTP server whose responses carry the caching headers named by the path.
+  # Bodies include a per-path hit counter, so cached bodies are recognizable.
+  class CachingServer
+    attr_reader :port, :hits, :conditional
+
+    def initialize
+      @server = TCPServer.new("127.0.0.1", 0)
+      @port = @server.addr[1]
+      @hits = Hash.new(0)
+      @conditional = []
+      @thread = Thread.new { loop { Thread.new(@server.accept) { |client| serve(client) } } }
+    end
+
+    def close
+      @thread.kill
+      @server.close
+    end
+
+    private
+
+    HEADERS = {
+      "/max-age" => { "Cache-Control" => "public, max-age=60" },
+      "/stale" => { "Cache-Control" => "max-age=0" },
+      "/no-store" => { "Cache-Control" => "no-store, max-age=60" },
+      "/private" => { "Cache-Control" => "private, max-age=60" },
+      "/etag" => { "Cache-Control" => "no-cache", "ETag" => '"v1"' },
+      "/last-modified" => { "Cache-Control" => "max-age=0", "Last-Modified" => "Wed, 21 Oct 2015 07:28:00 GMT" },
+      "/plain" => {}
+    }.freeze
+
+    def serve(client)
+      path = client.gets.to_s.split[1]
+      request_headers = {}
+      while (line = client.gets) && line != "\r\n"
+        name, value = line.chomp.split(": ", 2)
+        request_headers[name.downcase] = value
+      end
+
+      @hits[path] += 1
+      headers = HEADERS.fetch(path) { expires_headers(path) }
+      validators = [request_headers["if-none-match"], request_headers["if-modified-since"]]
+      if validators.any? && validators.compact.all? { |value| headers.value?(value) }
+        @conditional << path
+        respond(client, "304 Not Modified", headers, nil)
+      else
+        respond(client, "200 OK", headers, "#{path} #{@hits[path]}")
+      end
+    ensure
+      client.close
+    end
+
+    def expires_headers(path)
+      return {} unless path == "/expires"
+
+      { "Date" => Time.now.httpdate, "Expires" => (Time.now + 60).httpdate }
+    end
+
+    def respond(client, status, headers, body)
+      lines = headers.map { |name, value| "#{name}: #{value}\r\n" }.join
+      length = body ? "Content-Length: #{body.bytesize}\r\n" : ""
+      client.write("HTTP/1.1 #{status}\r\n#{lines}#{length}Connection: close\r\n\r\n#{body}")
+    end
+  end
+
+  def setup
+    @server = CachingServer.new
+    @cache = QuickJS::HTTPResponseCache.new
+  end
+
+  def teardown
+    @server.close
+  end
+
+  def sandbox(cache: @cache, **http)
+    QuickJS::Sandbox.new(http: {
+      allowlist: ["http://127.0.0.1:#{@server.port}/**"],
+      block_private_ips: false,
+      allowed_ports: [@server.port],
+      cache: cache
+    }.merge(http))
+  end
+
+  def fetch_text(sandbox, path, init = "{}")
+    sandbox.eval("fetch('http://127.0.0.1:#{@server.port}#{path}', #{init}).then(r => r.text())").value
+  end
+
+  def requests(sandbox)
+    sandbox.instance_variable_get(:@http_executor).http_requests
+  end
+
+  def test_fresh_responses_are_served_from_cache
+    sb = sandbox
+
+    assert_equal "/max-age 1", fetch_text(sb, "/max-age")
+    refute_predicate requests(sb).last, :cached?
+    assert_equal "/max-age 1", fetch_text(sb, "/max-age")
+
+    assert_equal 1, @server.hits["/max-age"]
+    assert_predicate requests(sb).last, :cached?
+    assert_equal 200, requests(sb).last.status
+    assert_equal true, requests(sb).last.to_h[:cached]
+  end
+
+  def test_expires_header
+    sb = sandbox
+    2.times { fetch_text(sb, "/expires") }
+
+    assert_equal 1, @server.hits["/expires"]
+  end
+
+  def test_stale_responses_are_fetched_again
+    sb = sandbox
+    fetch_text(sb, "/stale")
+
+    assert_equal "/stale 2", fetch_text(sb, "/stale")
+  end
+
+  def test_no_store_and_private_are_not_stored
+    sb = sandbox
+    2.times { fetch_text(sb, "/no-store") }
+    2.times { fetch_text(sb, "/private") }
+
+    assert_equal 2, @server.hits["/no-store"]
+    assert_equal 2, @server.hits["/private"]
+    assert_equal 0, @cache.stats[:entries]
+  end
+
+  def test_revalidation_with_etag
+    sb = sandbox
+    fetch_text(sb, "/etag")
+
+    assert_equal "/etag 1", fetch_text(sb, "/etag")
+    assert_equal ["/etag"], @server.conditional
+    assert_predicate requests(sb).last, :cached?
+    assert_equal 200, requests(sb).last.status
+  end
+
+  def test_revalidation_with_last_modified
+    sb = sandbox
+    fetch_text(sb, "/last-modified")
+
+    assert_equal "/last-modified 1", fetch_text(sb, "/last-modified")
+    assert_equal ["/last-modified"], @server.conditional
+  end
+
+  def test_default_ttl_applies_without_caching_headers
+    sb = sandbox(cache: QuickJS::HTTPResponseCache.new(default_ttl: 60))
+    2.times { fetch_text(sb, "/plain") }
+    assert_equal 1, @server.hits["/plain"]
+
+    uncached = sandbox
+    2.times { fetch_text(uncached, "/plain") }
+    assert_equal 3, @server.hits["/plain"]
+  end
+
+  def test_request_headers_are_part_of_the_key
+    sb = sandbox
+    fetch_text(sb, "/max-age", "{headers: {Authorization: 'a'}}")
+    fetch_text(sb, "/max-age", "{headers: {Authorization: 'b'}}")
+    fetch_text(sb, "/max-age", "{headers: {authorization: 'a'}}")
+
+    assert_equal 2, @server.hits["/max-age"]
+  end
+
+  def test_only_get_requests_are_cached
+    sb = sandbox
+    2.times { fetch_text(sb, "/max-age", "{method: 'POST'}") }
+
+    assert_equal 2, @server.hits["/max-age"]
+  end
+
+  def test_shared_across_sandboxes_with_the_same_settings
+    settings = { max_bytes: 12_345, default_ttl: 0 }
+    first = sandbox(cache: settings)
+    second = sandbox(cache: settings)
+    fetch_text(first, "/max-age")
+
+    assert_equal "/max-age 1", fetch_text(second, "/max-age")
+    assert_same QuickJS::HTTPResponseCache.shared(**settings), second.instance_variable_get(:@http_config).response_cache
+  ensure
+    QuickJS::HTTPResponseCache.shared(**settings).clear
+  end
+
+  def test_cached_responses_respect_max_response_size
+    fetch_text(sandbox, "/max-age")
+
+    error = assert_raises(QuickJS::HTTPLimitError) { fetch_text(sandbox(max_response_size: 5), "/max-age") }
+    assert_match(/Response size/, error.message)
+  end
+
+  def test_max_bytes_evicts_least_recently_used
+    cache = QuickJS::HTTPResponseCache.new(max_bytes: 20)
+    response = { status: 200, statusText: "OK", headers: { "cache-control" => "max-age=60" }, body: "x" * 8 }
+    %w[a b].each { |url| cache.store(cache.key(url, {}), response) }
+    cache.lookup(cache.key("a", {}))
+    cache.store(cache.key("c", {}), response)
+
+    assert_equal({ entries: 2, bytes: 16 }, cache.stats)
+    assert_nil cache.lookup(cache.key("b", {}))
+    refute_nil cache.lookup(cache.key("a", {}))
+  end
+
+  def test_invalid_cache_option
+    assert_raises(QuickJS::ArgumentError) { QuickJS::HTTPConfig.new(allowlist: ["https://**"], cache: "yes") }
+  end
+end
@@ -0,0 +1,90 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class JSONPassthroughTest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new
+  end
+
+  def test_eval_json_returns_json_text
+    result = @sandbox.eval_json("({ total: 3, items: [1, 'two', null], ok: true })")
+
+    assert_equal '{"total":3,"items":[1,"two",null],"ok":true}', result.value
+    assert_equal Encoding::UTF_8, result.value.encoding
+  end
+
+  def test_eval_json_scalars
+    assert_equal "42", @sandbox.eval_json("40 + 2").value
+    assert_equal '"hé"', @sandbox.eval_json("'hé'").value
+    assert_equal "null", @sandbox.eval_json("null").value
+  end
+
+  def test_eval_json_undefined_is_nil
+    assert_nil @sandbox.eval_json("undefined").value
+    assert_nil @sandbox.eval_json("(() => 1)").value
+  end
+
+  def test_eval_json_uses_to_json
+    assert_equal '"custom"', @sandbox.eval_json("({ toJSON() { return 'custom'; } })").value
+  end
+
+  def test_eval_json_awaits_promises
+    assert_equal "[1,2]", @sandbox.eval_json("await Promise.resolve([1, 2])").value
+  end
+
+  def test_eval_json_keeps_console_output
+    result = @sandbox.eval_json("console.log('hi'); ({})")
+
+    assert_equal "{}", result.value
+    assert_equal "hi\n", result.console_output
+  end
+
+  def test_eval_json_circular_structure_raises
+    error = assert_raises(QuickJS::JavascriptError) do
+      @sandbox.eval_json("const a = {}; a.self = a; a")
+    end
+    assert_match(/circular/i, error.message)
+  end
+
+  def test_eval_json_to_json_is_subject_to_timeout
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 100)
+
+    assert_raises(QuickJS::TimeoutError) do
+      sandbox.eval_json("({ toJSON() { while (true) {} } })")
+    end
+  end
+
+  def test_eval_still_returns_ruby_values_afterwards
+    @sandbox.eval_json("[1]")
+
+    assert_equal [1], @sandbox.eval("[1]").value
+  end
+
+  def test_set_variable_json
+    @sandbox.set_variable_json("order", '{"id": 7, "lines": [{"sku": "a", "qty": 2}], "note": null}')
+
+    assert_equal [7, "a", 2, true], @sandbox.eval("[order.id, order.lines[0].sku, order.lines[0].qty, order.note === null]").value
+  end
+
+  def test_set_variable_json_round_trip
+    json = '{"name":"café","tags":["x","y"],"n":1.5}'
+    @sandbox.set_variable_json("data", json)
+
+    assert_equal json, @sandbox.eval_json("data").value
+  end
+
+  def test_set_variable_json_invalid_json_raises
+    assert_raises(QuickJS::SyntaxError) do
+      @sandbox.set_variable_json("data", "{not json")
+    end
+
+    assert_equal 1, @sandbox.eval("1").value
+  end
+
+  def test_set_variable_json_rejects_empty_name
+    assert_raises(ArgumentError) do
+      @sandbox.set_variable_json("", "{}")
+    end
+  end
+end
@@ -0,0 +1,80 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class MarshallingTest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new(memory_limit: 50_000_000)
+  end
+
+  def test_large_array_round_trip
+    assert_equal (0...50_000).to_a, @sandbox.eval("Array.from({length: 50000}, (_, i) => i)").value
+  end
+
+  def test_records_share_frozen_keys
+    records = @sandbox.eval("Array.from({length: 3}, (_, i) => ({id: i, name: 'n' + i}))").value
+
+    assert_equal [{ "id" => 0, "name" => "n0" }, { "id" => 1, "name" => "n1" }, { "id" => 2, "name" => "n2" }], records
+    keys = records.map { |r| r.keys.first }
+    assert(keys.all?(&:frozen?))
+    assert_equal Encoding::UTF_8, keys.first.encoding
+    assert_same keys[0], keys[1]
+  end
+
+  def test_unicode_keys_and_values
+    value = @sandbox.eval("({'clé': 'naïve', '日本': '語'})").value
+
+    assert_equal({ "clé" => "naïve", "日本" => "語" }, value)
+  end
+
+  def test_strings_keep_embedded_nul
+    value = @sandbox.eval("'a\\u0000b'").value
+
+    assert_equal "a\u0000b", value
+    assert_equal Encoding::UTF_8, value.encoding
+  end
+
+  def test_sparse_array_holes_become_nil
+    assert_equal [1, nil, nil, 4], @sandbox.eval("const a = [1]; a[3] = 4; a").value
+  end
+
+  def test_array_modified_by_getter_during_conversion
+    code = <<~JS
+      const arr = [1, 2, 3];
+      arr[0] = { get x() { arr.length = 1; return 'x'; } };
+      arr
+    JS
+
+    assert_equal [{ "x" => "x" }, nil, nil], @sandbox.eval(code).value
+  end
+
+  def test_array_with_extra_properties
+    assert_equal [1, 2], @sandbox.eval("const a = [1, 2]; a.extra = true; a").value
+  end
+
+  def test_ruby_records_round_trip
+    records = Array.new(100) { |i| { id: i, "name" => "user#{i}", tags: %w[a b] } }
+    @sandbox.set_variable("records", records)
+
+    assert_equal [100, "user42", 42, 2], @sandbox.eval("[records.length, records[42].name, records[42].id, records[99].tags.length]").value
+  end
+
+  def test_non_string_keys_are_stringified
+    @sandbox.set_variable("obj", { 1 => "one", nil => "nil", 2.5 => "float" })
+
+    assert_equal({ "1" => "one", "" => "nil", "2.5" => "float" }, @sandbox.eval("obj").value)
+  end
+
+  def test_unfrozen_string_keys
+    key = +"dynamic"
+    @sandbox.set_variable("obj", [{ key => 1 }, { key.dup => 2 }])
+
+    assert_equal [1, 2], @sandbox.eval("obj.map(o => o.dynamic)").value
+  end
+
+  def test_proto_key_is_a_plain_property
+    @sandbox.set_variable("obj", { "__proto__" => { "polluted" => true } })
+
+    assert_equal [false, true], @sandbox.eval("[obj.polluted === true, Object.hasOwn(obj, '__proto__')]").value
+  end
+end
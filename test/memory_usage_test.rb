@@ -0,0 +1,67 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "objspace"
+
+# Sandbox#memory_usage and the sizes reported to the Ruby GC
+class MemoryUsageTest < Minitest::Test
+  FIELDS = %i[
+    malloc_size malloc_limit memory_used_size malloc_count memory_used_count
+    atom_count atom_size str_count str_size obj_count obj_size prop_count prop_size
+    shape_count shape_size js_func_count js_func_size js_func_code_size
+    js_func_pc2line_count js_func_pc2line_size c_func_count array_count
+    fast_array_count fast_array_elements binary_object_count binary_object_size
+  ].freeze
+
+  def test_breakdown
+    usage = QuickJS::Sandbox.new(memory_limit: 5_000_000).memory_usage
+
+    assert_equal FIELDS, usage.keys
+    assert(usage.values.all?(Integer))
+    assert_equal 5_000_000, usage[:malloc_limit]
+    assert_operator usage[:malloc_size], :>, 0
+    assert_operator usage[:c_func_count], :>, 0
+  end
+
+  def test_breakdown_follows_the_heap
+    sandbox = QuickJS::Sandbox.new(memory_limit: 20_000_000)
+    before = sandbox.memory_usage
+    sandbox.eval("globalThis.items = Array.from({ length: 10000 }, (_, i) => ({ i }))")
+    after = sandbox.memory_usage
+
+    assert_operator after[:obj_count], :>=, before[:obj_count] + 10_000
+    assert_operator after[:fast_array_elements], :>=, before[:fast_array_elements] + 10_000
+    assert_operator after[:malloc_size], :>, before[:malloc_size]
+  end
+
+  def test_memsize_reports_actual_usage
+    sandbox = QuickJS::Sandbox.new(memory_limit: 100_000_000)
+    native = sandbox.instance_variable_get(:@native_sandbox)
+    empty = ObjectSpace.memsize_of(native)
+
+    assert_operator empty, :<, 10_000_000
+    assert_operator empty, :>=, sandbox.memory_usage[:malloc_size]
+
+    sandbox.eval("globalThis.big = 'x'.repeat(5000000)")
+    assert_operator ObjectSpace.memsize_of(native), :>=, empty + 5_000_000
+
+    sandbox.eval("globalThis.big = null")
+    assert_operator ObjectSpace.memsize_of(native), :<, empty + 1_000_000
+  end
+
+  def test_arena_reports_reserved_bytes
+    sandbox = QuickJS::Sandbox.new(allocator: :arena)
+    usage = sandbox.memory_usage
+
+    assert_operator usage[:arena_reserved_size], :>=, usage[:malloc_size]
+    assert_operator ObjectSpace.memsize_of(sandbox.instance_variable_get(:@native_sandbox)),
+                    :>=, usage[:arena_reserved_size]
+  end
+
+  def test_not_available_while_running
+    sandbox = QuickJS::Sandbox.new
+    sandbox.define_function("usage") { sandbox.memory_usage }
+
+    assert_raises(QuickJS::Error) { sandbox.eval("usage()") }
+  end
+end
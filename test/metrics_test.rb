@@ -0,0 +1,107 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class MetricsTest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new(memory_limit: 10_000_000)
+  end
+
+  def test_metrics_are_reported
+    metrics = @sandbox.eval("1 + 1").metrics
+
+    assert_predicate metrics, :frozen?
+    %i[wall_time_ms cpu_time_ms allocated_bytes peak_memory_bytes memory_bytes
+       job_count interrupt_checks gc_count gc_time_ms].each do |key|
+      assert_kind_of Numeric, metrics[key], "missing #{key}"
+    end
+  end
+
+  def test_allocations_scale_with_work
+    small = @sandbox.eval("[1, 2, 3].length").metrics
+    large = @sandbox.eval("const big = []; for (let i = 0; i < 10000; i++) big.push({ i }); big.length").metrics
+
+    assert_operator large[:allocated_bytes], :>, small[:allocated_bytes]
+    assert_operator large[:allocated_bytes], :>, 100_000
+  end
+
+  def test_peak_memory_covers_released_garbage
+    metrics = @sandbox.eval("(() => { let a = new Array(50000).fill(0); a = null; return 1; })()").metrics
+
+    assert_operator metrics[:peak_memory_bytes], :>=, metrics[:memory_bytes]
+    assert_operator metrics[:peak_memory_bytes], :>, 400_000
+  end
+
+  def test_job_count
+    assert_equal 0, @sandbox.eval("1").metrics[:job_count]
+    assert_operator @sandbox.eval("await Promise.resolve(1); await Promise.resolve(2)").metrics[:job_count], :>=, 2
+  end
+
+  def test_interrupt_checks_grow_with_execution
+    metrics = @sandbox.eval("let n = 0; for (let i = 0; i < 1000000; i++) n += i; n").metrics
+
+    assert_operator metrics[:interrupt_checks], :>, 0
+  end
+
+  def test_times
+    metrics = @sandbox.eval("const end = Date.now() + 20; while (Date.now() < end) {}").metrics
+
+    assert_operator metrics[:wall_time_ms], :>=, 15
+    assert_operator metrics[:cpu_time_ms], :>, 0
+  end
+
+  def test_gc_metrics_match_result
+    result = @sandbox.eval("1")
+
+    assert_equal result.gc_count, result.metrics[:gc_count]
+    assert_in_delta result.gc_time_ms, result.metrics[:gc_time_ms]
+  end
+
+  def test_gc_metrics_include_collections_quickjs_triggers
+    sandbox = QuickJS::Sandbox.new(gc: :never, gc_threshold: 256 * 1024, memory_limit: 20_000_000)
+    churn = "for (let i = 0; i < 20000; i++) { const a = { pad: 'x'.repeat(100) }; a.self = a; }"
+
+    error = assert_raises(QuickJS::JavascriptError) { sandbox.eval("#{churn} throw new Error('late')") }
+    assert_operator error.metrics[:gc_count], :>, 0
+    results = sandbox.eval_batch(["1", "#{churn} 2", "3"])
+    assert_equal 0, results.first.metrics[:gc_count]
+    assert_operator results[1].metrics[:gc_count], :>, 0
+    assert_equal results.map(&:gc_count), results.map { |r| r.metrics[:gc_count] }
+  end
+
+  def test_object_counts_require_detailed_metrics
+    refute @sandbox.eval("1").metrics.key?(:object_count)
+
+    sandbox = QuickJS::Sandbox.new(detailed_metrics: true)
+    metrics = sandbox.eval("globalThis.keep = Array.from({ length: 100 }, () => ({})); 1").metrics
+
+    assert_operator metrics[:object_count], :>, 100
+    assert_operator metrics[:shape_count], :>, 0
+  end
+
+  def test_errors_carry_metrics
+    error = assert_raises(QuickJS::JavascriptError) { @sandbox.eval("throw new Error('x')") }
+
+    assert_kind_of Numeric, error.metrics[:wall_time_ms]
+  end
+
+  def test_timeout_carries_metrics
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 30)
+
+    error = assert_raises(QuickJS::TimeoutError) { sandbox.eval("while (true) {}") }
+    assert_operator error.metrics[:wall_time_ms], :>=, 25
+    assert_operator error.metrics[:interrupt_checks], :>, 0
+  end
+
+  def test_batch_items_have_metrics
+    results = @sandbox.eval_batch(["1", "throw 1", "2"])
+
+    assert(results.all? { |r| r.metrics.is_a?(Hash) && r.metrics.frozen? })
+  end
+
+  def test_call_has_metrics
+    @sandbox.eval("function f() { return 1; }")
+
+    assert_kind_of Numeric, @sandbox.call("f").metrics[:wall_time_ms]
+  end
+end
@@ -0,0 +1,127 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class ModuleTest < Minitest::Test
+  LIBRARY = {
+    "math" => "export const double = (x) => x * 2; export default 'math';",
+    "lib/format.js" => "import { double } from 'math'; export const show = (x) => String(double(x));",
+    "lib/index.js" => "export { show } from './format.js';"
+  }.freeze
+
+  def setup
+    QuickJS::ModuleCache.clear
+  end
+
+  def test_exports_are_the_result
+    sandbox = QuickJS::Sandbox.new(module_resolver: LIBRARY)
+    result = sandbox.eval_module("import label, { double } from 'math'; export const answer = double(21); export { label }")
+
+    assert_equal({ "answer" => 42, "label" => "math" }, result.value)
+  end
+
+  def test_relative_imports_resolve_against_the_importer
+    names = []
+    resolver = lambda do |name|
+      names << name
+      LIBRARY[name]
+    end
+    sandbox = QuickJS::Sandbox.new(module_resolver: resolver)
+
+    assert_equal "42", sandbox.eval_module("import { show } from './lib/index.js'; export default show(21)",
+                                           name: "main.js").value["default"]
+    assert_equal %w[lib/index.js lib/format.js math], names
+  end
+
+  def test_modules_are_compiled_once_per_process
+    resolved = Hash.new(0)
+    resolver = lambda do |name|
+      resolved[name] += 1
+      LIBRARY[name]
+    end
+
+    3.times do
+      QuickJS::Sandbox.new(module_resolver: resolver).eval_module("import { double } from 'math'; export const x = double(1)")
+    end
+
+    assert_equal 3, resolved["math"]
+    assert_equal 1, QuickJS::ModuleCache.size
+  end
+
+  def test_cached_modules_keep_their_own_state_per_sandbox
+    library = { "counter" => "export let count = 0; export function bump() { return ++count; }" }
+    code = "import { bump } from 'counter'; export const value = bump()"
+    first = QuickJS::Sandbox.new(module_resolver: library)
+    second = QuickJS::Sandbox.new(module_resolver: library)
+
+    assert_equal 1, first.eval_module(code).value["value"]
+    assert_equal 2, first.eval_module(code).value["value"]
+    assert_equal 1, second.eval_module(code).value["value"]
+  end
+
+  def test_bytecode_not_compiled_in_this_process_is_refused
+    QuickJS::ModuleCache.bytecode_for("math", LIBRARY["math"]) { "\x02garbage".b.freeze }
+
+    error = assert_raises(QuickJS::JavascriptError) do
+      QuickJS::Sandbox.new(module_resolver: LIBRARY).eval_module("import 'math'")
+    end
+    assert_match(/not compiled in this process/, error.message)
+  end
+
+  def test_dynamic_import_from_eval
+    sandbox = QuickJS::Sandbox.new(module_resolver: LIBRARY)
+
+    assert_equal 10, sandbox.eval("import('math').then((m) => m.double(5))").value
+  end
+
+  def test_top_level_await
+    sandbox = QuickJS::Sandbox.new
+
+    assert_equal({ "value" => 3 }, sandbox.eval_module("export const value = await Promise.resolve(3)").value)
+  end
+
+  def test_missing_module
+    error = assert_raises(QuickJS::JavascriptError) do
+      QuickJS::Sandbox.new(module_resolver: {}).eval_module("import 'nope'")
+    end
+    assert_match(/could not load module 'nope'/, error.message)
+    assert_raises(QuickJS::JavascriptError) { QuickJS::Sandbox.new.eval_module("import 'math'") }
+  end
+
+  def test_syntax_errors_are_not_cached
+    sandbox = QuickJS::Sandbox.new(module_resolver: { "broken" => "export const = 1" })
+
+    assert_raises(QuickJS::SyntaxError) { sandbox.eval_module("import 'broken'") }
+    assert_equal 0, QuickJS::ModuleCache.size
+  end
+
+  def test_resolver_errors_are_reraised
+    sandbox = QuickJS::Sandbox.new(module_resolver: ->(_name) { raise IOError, "unreadable" })
+
+    error = assert_raises(IOError) { sandbox.eval_module("import 'math'") }
+    assert_equal "unreadable", error.message
+  end
+
+  def test_reset_unloads_modules
+    library = { "counter" => "export let count = 0; export function bump() { return ++count; }" }
+    code = "import { bump } from 'counter'; export const value = bump()"
+    sandbox = QuickJS::Sandbox.new(module_resolver: library)
+    sandbox.eval_module(code)
+    sandbox.reset!
+
+    assert_equal 1, sandbox.eval_module(code).value["value"]
+  end
+
+  def test_shared_runtime_sandboxes_use_their_own_resolvers
+    runtime = QuickJS::Runtime.new(memory_limit: 16_000_000)
+    first = runtime.sandbox(module_resolver: { "name" => "export default 'first'" })
+    second = runtime.sandbox(module_resolver: { "name" => "export default 'second'" })
+
+    assert_equal "first", first.eval_module("export { default } from 'name'").value["default"]
+    assert_equal "second", second.eval_module("export { default } from 'name'").value["default"]
+  end
+
+  def test_invalid_resolver
+    assert_raises(QuickJS::ArgumentError) { QuickJS::Sandbox.new(module_resolver: "math") }
+  end
+end
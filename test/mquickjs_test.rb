@@ -96,6 +96,18 @@ class TestQuickJS < Minitest::Test
     end
   end
 
+  def test_running_out_of_memory_at_any_point
+    # The limit is reached at a different allocation each time, including
+    # while the backtrace of the previous error is being built
+    100.times do |i|
+      sandbox = QuickJS::Sandbox.new(memory_limit: 1_000_000 + (i * 4099))
+      assert_raises(QuickJS::MemoryLimitError, QuickJS::JavascriptError) do
+        sandbox.eval("(() => { const arr = []; while (true) arr.push(new Array(1000).fill(0)); })()")
+      end
+      assert_equal 2, sandbox.eval("1 + 1").value
+    end
+  end
+
   def test_memory_limit_validation
     # memory_limit cannot be less than 300000 bytes (required for QuickJS stdlib initialization with polyfills)
     error = assert_raises(QuickJS::ArgumentError) do
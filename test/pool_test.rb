@@ -0,0 +1,140 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+require "open3"
+
+class PoolTest < Minitest::Test
+  def setup
+    @pool = QuickJS::Pool.new(size: 2)
+  end
+
+  def teardown
+    @pool.shutdown
+  end
+
+  def test_submit_returns_future_with_result
+    future = @pool.submit("1 + 2")
+
+    assert_equal 3, future.value.value
+    assert_predicate future, :complete?
+  end
+
+  def test_submit_with_variables
+    future = @pool.submit("a * b", { a: 6, b: 7 })
+
+    assert_equal 42, future.value.value
+  end
+
+  def test_many_jobs_are_distributed_and_all_complete
+    futures = 50.times.map { |i| @pool.submit("n + 1", { n: i }) }
+
+    assert_equal (1..50).to_a, futures.map { |f| f.value.value }
+  end
+
+  def test_errors_are_raised_from_future_value
+    future = @pool.submit("throw new Error('boom')")
+
+    error = assert_raises(QuickJS::JavascriptError) { future.value }
+    assert_match(/boom/, error.message)
+  end
+
+  def test_worker_survives_errors
+    @pool.submit("nope(").wait
+
+    assert_equal "ok", @pool.submit("'ok'").value.value
+  end
+
+  def test_job_ended_by_a_non_standard_error_completes_and_the_worker_is_replaced
+    pool = QuickJS::Pool.new(size: 1, timeout_ms: 60_000)
+    future = pool.submit("while (true) {}")
+    worker = running_worker(pool)
+    worker.raise(NoMemoryError, "failed to allocate memory")
+
+    error = assert_raises(QuickJS::Error) { future.value }
+    assert_match(/NoMemoryError: failed to allocate memory/, error.message)
+    assert_equal "ok", pool.submit("'ok'").value.value
+    refute_same worker, pool.instance_variable_get(:@workers).first
+  ensure
+    pool&.shutdown
+  end
+
+  def test_killed_worker_completes_its_job_and_is_replaced
+    pool = QuickJS::Pool.new(size: 1, timeout_ms: 60_000)
+    future = pool.submit("while (true) {}")
+    running_worker(pool).kill
+
+    error = assert_raises(QuickJS::Error) { future.value }
+    assert_match(/killed/, error.message)
+    assert_equal "ok", pool.submit("'ok'").value.value
+  ensure
+    pool&.shutdown
+  end
+
+  def test_exiting_without_shutdown_is_quiet
+    script = <<~RUBY
+      pool = QuickJS::Pool.new(size: 2, timeout_ms: 60_000)
+      puts pool.submit("1 + 1").value.value
+      pool.submit("while (true) {}")
+    RUBY
+    lib = File.expand_path("../lib", __dir__)
+    out, err, status = Open3.capture3(RbConfig.ruby, "-I", lib, "-rquickjs", "-e", script)
+
+    assert_predicate status, :success?
+    assert_equal "2\n", out
+    assert_empty err
+  end
+
+  def test_sandbox_options_are_applied
+    pool = QuickJS::Pool.new(size: 1, timeout_ms: 50)
+
+    assert_raises(QuickJS::TimeoutError) { pool.submit("while (true) {}").value }
+  ensure
+    pool&.shutdown
+  end
+
+  def test_wait_with_timeout
+    pool = QuickJS::Pool.new(size: 1, timeout_ms: 1000)
+    future = pool.submit("(() => { const end = Date.now() + 200; while (Date.now() < end) {} })()")
+
+    refute future.wait(0.01)
+    assert future.wait(5)
+  ensure
+    pool&.shutdown
+  end
+
+  def test_submit_after_shutdown_raises
+    @pool.shutdown
+
+    assert_predicate @pool, :shutdown?
+    assert_raises(QuickJS::Error) { @pool.submit("1") }
+  end
+
+  def test_shutdown_finishes_queued_jobs
+    futures = 10.times.map { |i| @pool.submit(i.to_s) }
+    @pool.shutdown
+
+    assert_equal (0...10).to_a, futures.map { |f| f.value.value }
+  end
+
+  def test_isolate_resets_sandbox_between_jobs
+    pool = QuickJS::Pool.new(size: 1, isolate: true)
+    pool.submit("globalThis.secret = 'tenant-a'", { token: "abc" }).value
+
+    assert_equal %w[undefined undefined], pool.submit("[typeof secret, typeof token]").value.value
+  ensure
+    pool&.shutdown
+  end
+
+  def test_invalid_size
+    assert_raises(QuickJS::ArgumentError) { QuickJS::Pool.new(size: 0) }
+  end
+
+  private
+
+  # The worker of a single-worker pool, once it took the submitted job
+  def running_worker(pool)
+    sleep 0.01 until pool.instance_variable_get(:@queue).empty?
+    sleep 0.05
+    pool.instance_variable_get(:@workers).first
+  end
+end
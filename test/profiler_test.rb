@@ -0,0 +1,69 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+# Sandbox#eval(profile:)
+class ProfilerTest < Minitest::Test
+  HOT_CODE = <<~JS
+    function hot(n) {
+      let x = 0;
+      for (let i = 0; i < n; i++) x += Math.sqrt(i);
+      return x;
+    }
+    function outer() {
+      const start = Date.now();
+      while (Date.now() - start < 50) hot(10000);
+      return 1;
+    }
+    outer()
+  JS
+
+  def setup
+    @sandbox = QuickJS::Sandbox.new(timeout_ms: 5000)
+  end
+
+  def test_hot_function_is_sampled
+    result = @sandbox.eval(HOT_CODE, profile: true)
+
+    assert_equal 1, result.value
+    assert_match(/^<eval> \(<eval>:1\);outer \(<eval>:6\);hot \(<eval>:1\) \d+$/, result.profile)
+  end
+
+  def test_collapsed_stack_format
+    profile = @sandbox.eval(HOT_CODE, profile: 0.5).profile
+
+    assert_predicate profile, :frozen?
+    lines = profile.lines(chomp: true)
+    assert_equal lines.sort, lines
+    lines.each { |line| assert_match(/\A[^;]+(;[^;]+)* \d+\z/, line) }
+    assert_operator lines.sum { |line| line[/\d+\z/].to_i }, :>=, 10
+  end
+
+  def test_anonymous_and_native_frames
+    profile = @sandbox.eval(<<~JS, profile: true).profile
+      const start = Date.now();
+      [1].forEach(() => { while (Date.now() - start < 30) {} });
+    JS
+
+    assert_includes profile, "forEach (native);<anonymous> (<eval>:2)"
+  end
+
+  def test_no_profile_by_default
+    assert_nil @sandbox.eval("1 + 1").profile
+    @sandbox.eval(HOT_CODE, profile: true)
+    assert_nil @sandbox.eval("1 + 1").profile
+  end
+
+  def test_timeout_carries_profile
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 50)
+    error = assert_raises(QuickJS::TimeoutError) { sandbox.eval("function spin() { while (true) {} }\nspin()", profile: true) }
+
+    assert_match(/^<eval> \(<eval>:1\);spin \(<eval>:1\) \d+$/, error.profile)
+  end
+
+  def test_invalid_interval
+    assert_raises(QuickJS::ArgumentError) { @sandbox.eval("1", profile: 0) }
+    assert_raises(QuickJS::ArgumentError) { @sandbox.eval("1", profile: -1) }
+    assert_raises(QuickJS::ArgumentError) { @sandbox.eval("1", profile: "fast") }
+  end
+end
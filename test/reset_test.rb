@@ -0,0 +1,124 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class ResetTest < Minitest::Test
+  def test_reset_clears_globals
+    sandbox = QuickJS::Sandbox.new
+    sandbox.eval("var counter = 1; globalThis.leaked = true; function helper() {}")
+    sandbox.set_variable("user", { "name" => "Alice" })
+
+    sandbox.reset!
+
+    assert_equal "undefined", sandbox.eval("typeof counter").value
+    assert_equal "undefined", sandbox.eval("typeof leaked").value
+    assert_equal "undefined", sandbox.eval("typeof helper").value
+    assert_equal "undefined", sandbox.eval("typeof user").value
+  end
+
+  def test_reset_allows_redeclaring_let_bindings
+    sandbox = QuickJS::Sandbox.new
+    sandbox.eval("let total = 1")
+
+    sandbox.reset!
+
+    assert_equal 2, sandbox.eval("let total = 2; total").value
+  end
+
+  def test_reset_restores_builtins_and_polyfills
+    sandbox = QuickJS::Sandbox.new
+    sandbox.eval("Array.prototype.map = null; globalThis.Headers = undefined")
+
+    sandbox.reset!
+
+    assert_equal [2, 4], sandbox.eval("[1, 2].map(x => x * 2)").value
+    assert_equal "function", sandbox.eval("typeof Headers").value
+    assert_equal "function", sandbox.eval("typeof URL").value
+  end
+
+  def test_reset_returns_self
+    sandbox = QuickJS::Sandbox.new
+
+    assert_same sandbox, sandbox.reset!
+  end
+
+  def test_reset_drops_pending_jobs
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 100)
+    assert_raises(QuickJS::TimeoutError) do
+      sandbox.eval(<<~JS)
+        globalThis.ran = false;
+        Promise.resolve().then(() => { globalThis.ran = true; });
+        while (true) {}
+      JS
+    end
+
+    sandbox.reset!
+
+    assert_equal "undefined", sandbox.eval("typeof ran").value
+  end
+
+  def test_reset_after_timeout
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 100)
+    assert_raises(QuickJS::TimeoutError) { sandbox.eval("while (true) {}") }
+
+    sandbox.reset!
+
+    assert_equal 3, sandbox.eval("1 + 2").value
+  end
+
+  def test_reset_keeps_memory_limit
+    sandbox = QuickJS::Sandbox.new(memory_limit: 1_000_000)
+
+    sandbox.reset!
+
+    assert_raises(QuickJS::MemoryLimitError, QuickJS::JavascriptError) do
+      sandbox.eval("const arr = []; while (true) arr.push(new Array(1000).fill(0));")
+    end
+  end
+
+  def test_reset_clears_console_output
+    sandbox = QuickJS::Sandbox.new
+    sandbox.eval("console.log('before')")
+
+    sandbox.reset!
+
+    assert_equal "", sandbox.eval("1").console_output
+  end
+
+  def test_reset_restores_template_state
+    template = QuickJS::Template.new(
+      variables: { factor: 3 },
+      preload: ["var calls = 0; function scale(x) { calls++; return x * factor; }"]
+    )
+    sandbox = template.sandbox
+    sandbox.eval("scale(1); scale(2); globalThis.extra = 1")
+
+    sandbox.reset!
+
+    assert_equal 0, sandbox.eval("calls").value
+    assert_equal 12, sandbox.eval("scale(4)").value
+    assert_equal "undefined", sandbox.eval("typeof extra").value
+  end
+
+  def test_reset_keeps_http_callback
+    mock = MockHTTPSandbox.new
+    sandbox = mock.create_sandbox
+
+    sandbox.eval("fetch('https://api.example.com/one')")
+    sandbox.reset!
+    sandbox.eval("fetch('https://api.example.com/two')")
+
+    assert_equal ["https://api.example.com/one", "https://api.example.com/two"], mock.requests.map { |r| r[:url] }
+  end
+
+  def test_reset_is_rejected_while_executing
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 2000)
+    thread = Thread.new { sandbox.eval("const end = Date.now() + 300; while (Date.now() < end) {}") }
+    sleep 0.05
+
+    error = assert_raises(QuickJS::Error) { sandbox.reset! }
+    assert_match(/already executing/, error.message)
+  ensure
+    thread&.join
+  end
+end
@@ -0,0 +1,144 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class ResponseBodyTest < Minitest::Test
+  def setup
+    @mock = MockHTTPSandbox.new
+    @sandbox = @mock.create_sandbox
+  end
+
+  def respond_with(body)
+    @mock.queue_response(status: 200, statusText: "OK", body: body, headers: {})
+  end
+
+  def test_binary_body_as_array_buffer
+    respond_with("\x00\xFF\x10\x00".b)
+
+    result = @sandbox.eval(<<~JS)
+      (async () => {
+        const buffer = await (await fetch('https://api.example.com/blob')).arrayBuffer();
+        return [buffer instanceof ArrayBuffer, Array.from(new Uint8Array(buffer))];
+      })()
+    JS
+
+    assert_equal [true, [0, 255, 16, 0]], result.value
+  end
+
+  def test_bytes_returns_uint8_array
+    respond_with("\x01\x02".b)
+
+    assert_equal "\x01\x02".b, @sandbox.eval("(async () => (await fetch('https://api.example.com/')).bytes())()").value
+  end
+
+  def test_text_decodes_utf8
+    respond_with("café \u{1F600}")
+
+    assert_equal "café \u{1F600}", @sandbox.eval("(async () => (await fetch('https://api.example.com/')).text())()").value
+  end
+
+  def test_text_keeps_embedded_nul
+    respond_with("a\u0000b")
+
+    assert_equal "a\u0000b", @sandbox.eval("(async () => (await fetch('https://api.example.com/')).body)()").value
+  end
+
+  def test_invalid_utf8_is_replaced
+    respond_with("ok\xFF".b)
+
+    assert_equal "ok�", @sandbox.eval("(async () => (await fetch('https://api.example.com/')).text())()").value
+  end
+
+  def test_body_reader_yields_chunks
+    respond_with("abcdefghij")
+
+    result = @sandbox.eval(<<~JS)
+      (async () => {
+        const response = await fetch('https://api.example.com/');
+        const reader = response.bodyReader({ chunkSize: 4 });
+        const sizes = [];
+        for (;;) {
+          const { done, value } = await reader.read();
+          if (done) break;
+          sizes.push(value.length);
+        }
+        return [sizes, response.bodyUsed];
+      })()
+    JS
+
+    assert_equal [[4, 4, 2], true], result.value
+  end
+
+  def test_body_reader_with_streaming_decoder
+    # Multi-byte characters split across chunk boundaries
+    respond_with("é\u{1F600}é" * 50)
+
+    result = @sandbox.eval(<<~JS)
+      (async () => {
+        const response = await fetch('https://api.example.com/');
+        const decoder = new TextDecoder();
+        let text = '';
+        for await (const chunk of response.bodyReader({ chunkSize: 3 })) {
+          text += decoder.decode(chunk, { stream: true });
+        }
+        return text + decoder.decode();
+      })()
+    JS
+
+    assert_equal "é\u{1F600}é" * 50, result.value
+  end
+
+  def test_body_reader_consumes_the_body
+    respond_with("data")
+
+    error = assert_raises(QuickJS::JavascriptError) do
+      @sandbox.eval(<<~JS)
+        (async () => {
+          const response = await fetch('https://api.example.com/');
+          response.bodyReader();
+          return await response.text();
+        })()
+      JS
+    end
+    assert_match(/already been consumed/, error.message)
+  end
+
+  def test_clone_copies_bytes
+    respond_with("\x01\x02".b)
+
+    result = @sandbox.eval(<<~JS)
+      (async () => {
+        const response = await fetch('https://api.example.com/');
+        const copy = response.clone();
+        new Uint8Array(await response.arrayBuffer())[0] = 9;
+        return Array.from(new Uint8Array(await copy.arrayBuffer()));
+      })()
+    JS
+
+    assert_equal [1, 2], result.value
+  end
+
+  def test_response_from_typed_array
+    result = @sandbox.eval("new Response(new Uint8Array([104, 105, 33]).subarray(1)).text()")
+
+    assert_equal "i!", result.value
+  end
+
+  def test_text_encoder_round_trip
+    result = @sandbox.eval(<<~JS)
+      const bytes = new TextEncoder().encode('héllo');
+      [bytes.length, new TextDecoder().decode(bytes)]
+    JS
+
+    assert_equal [6, "héllo"], result.value
+  end
+
+  def test_text_decoder_strips_bom_and_rejects_other_encodings
+    assert_equal "x", @sandbox.eval("new TextDecoder().decode(new Uint8Array([0xEF, 0xBB, 0xBF, 0x78]))").value
+    assert_raises(QuickJS::JavascriptError) { @sandbox.eval("new TextDecoder('latin1')") }
+  end
+
+  def test_native_helpers_are_hidden
+    assert_equal [false, false], @sandbox.eval("['decodeUTF8' in fetch, typeof globalThis.decodeUTF8 === 'function']").value
+  end
+end
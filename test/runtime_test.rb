@@ -0,0 +1,117 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class RuntimeTest < Minitest::Test
+  def setup
+    @runtime = QuickJS::Runtime.new(memory_limit: 32_000_000)
+  end
+
+  def test_sandboxes_have_separate_globals
+    first = @runtime.sandbox
+    second = @runtime.sandbox
+    first.eval("globalThis.owner = 'first'")
+
+    assert_equal "first", first.eval("owner").value
+    assert_equal "undefined", second.eval("typeof owner").value
+    assert_same @runtime, first.runtime
+    assert_nil QuickJS::Sandbox.new.runtime
+  end
+
+  def test_shared_sandboxes_take_less_memory
+    own = QuickJS::Sandbox.new.memory_usage[:malloc_size]
+    shared = @runtime.sandbox.memory_usage[:sandbox_malloc_size]
+
+    assert_operator shared, :<, own
+  end
+
+  def test_memory_limit_is_a_share_of_the_runtime
+    sandbox = @runtime.sandbox(memory_limit: 2_000_000)
+    other = @runtime.sandbox
+
+    assert_raises(QuickJS::MemoryLimitError, QuickJS::JavascriptError) do
+      sandbox.eval("globalThis.keep = []; for (;;) keep.push(new Array(1000).fill(1))")
+    end
+    assert_equal 1_000_000, other.eval("new Array(1_000_000).fill(1).length").value
+  end
+
+  def test_timeouts_are_per_sandbox
+    slow = @runtime.sandbox(timeout_ms: 50)
+    other = @runtime.sandbox(timeout_ms: 5000)
+
+    assert_raises(QuickJS::TimeoutError) { slow.eval("while (true) {}") }
+    assert_equal 2, other.eval("1 + 1").value
+    assert_equal 3, slow.eval("1 + 2").value
+  end
+
+  def test_timeout_applies_to_getters_run_by_the_result_conversion
+    sandbox = @runtime.sandbox(timeout_ms: 200)
+    result = sandbox.eval("({ get x() { while (true) {} } })")
+
+    # Interrupted like in a sandbox of its own
+    assert_equal({ "x" => nil }, result.value)
+    assert_equal 2, @runtime.sandbox.eval("1 + 1").value
+  end
+
+  def test_reset_replaces_only_the_sandbox_context
+    sandbox = @runtime.sandbox
+    other = @runtime.sandbox
+    sandbox.eval("globalThis.x = 1")
+    other.eval("globalThis.y = 2")
+    sandbox.reset!
+
+    assert_equal "undefined", sandbox.eval("typeof x").value
+    assert_equal 2, other.eval("y").value
+  end
+
+  def test_collecting_a_sandbox_while_another_runs
+    survivor = @runtime.sandbox
+    20.times { @runtime.sandbox.eval("globalThis.data = new Array(100).fill('x')") }
+    survivor.define_function("collect") do
+      GC.start
+      true
+    end
+
+    assert_equal 3, survivor.eval("collect(); [1, 2, 3].length").value
+    GC.start
+    assert_equal 4, survivor.eval("2 + 2").value
+  end
+
+  def test_threads_take_turns
+    sandboxes = Array.new(4) { @runtime.sandbox }
+    values = sandboxes.each_with_index.map do |sandbox, i|
+      Thread.new { sandbox.eval("let n = 0; for (let j = 0; j < 100000; j++) n += #{i}; n").value }
+    end.map(&:value)
+
+    assert_equal [0, 100_000, 200_000, 300_000], values
+  end
+
+  def test_sibling_cannot_run_inside_a_host_function
+    sandbox = @runtime.sandbox
+    sibling = @runtime.sandbox
+    sandbox.define_function("nested") do
+      sibling.eval("1")
+    rescue QuickJS::Error => e
+      e.message
+    end
+
+    assert_match(/another sandbox/, sandbox.eval("nested()").value)
+    assert_equal 1, sibling.eval("1").value
+  end
+
+  def test_memory_usage
+    sandbox = @runtime.sandbox
+    usage = sandbox.memory_usage
+
+    assert_operator usage[:sandbox_malloc_size], :>, 0
+    assert_operator usage[:malloc_size], :>=, usage[:sandbox_malloc_size]
+    assert_equal usage[:malloc_size], @runtime.memory_usage[:malloc_size]
+  end
+
+  def test_invalid_options
+    assert_raises(QuickJS::ArgumentError) { QuickJS::Runtime.new(memory_limit: 1000) }
+    assert_raises(QuickJS::ArgumentError) { @runtime.sandbox(memory_limit: 0) }
+    assert_raises(QuickJS::ArgumentError) { @runtime.sandbox(gc_threshold: 1_000_000) }
+    assert_raises(QuickJS::ArgumentError) { @runtime.sandbox(allocator: :arena) }
+  end
+end
@@ -0,0 +1,125 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class ScriptTest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new
+  end
+
+  def test_compile_returns_script
+    script = @sandbox.compile("1 + 2")
+
+    assert_instance_of QuickJS::Script, script
+    assert_equal "1 + 2", script.source
+    assert_predicate script.bytecode, :frozen?
+    assert_equal Encoding::BINARY, script.bytecode.encoding
+  end
+
+  def test_run_returns_result
+    result = @sandbox.compile("console.log('hi'); 6 * 7").run(@sandbox)
+
+    assert_equal 42, result.value
+    assert_equal "hi\n", result.console_output
+  end
+
+  def test_run_repeatedly_with_variables
+    script = @sandbox.compile("input.price * input.quantity")
+
+    values = [[2, 3], [5, 4], [10, 10]].map do |price, quantity|
+      script.run(@sandbox, input: { "price" => price, "quantity" => quantity }).value
+    end
+
+    assert_equal [6, 20, 100], values
+  end
+
+  def test_run_sees_sandbox_state
+    @sandbox.eval("var total = 0")
+    script = @sandbox.compile("total += 1")
+
+    3.times { script.run(@sandbox) }
+
+    assert_equal 3, @sandbox.eval("total").value
+  end
+
+  def test_run_in_another_sandbox
+    script = @sandbox.compile("typeof Headers + ':' + (40 + 2)")
+    other = QuickJS::Sandbox.new
+
+    assert_equal "function:42", script.run(other).value
+  end
+
+  def test_run_after_reset
+    script = @sandbox.compile("var seen = (typeof seen === 'undefined') ? 1 : seen + 1; seen")
+    script.run(@sandbox)
+    @sandbox.reset!
+
+    assert_equal 1, script.run(@sandbox).value
+  end
+
+  def test_top_level_await
+    script = @sandbox.compile("await Promise.resolve(5) * 2")
+
+    assert_equal 10, script.run(@sandbox).value
+    assert_equal 10, script.run(@sandbox).value
+  end
+
+  def test_syntax_error_raised_at_compile
+    assert_raises(QuickJS::SyntaxError) { @sandbox.compile("function (") }
+  end
+
+  def test_runtime_errors_raised_from_run
+    script = @sandbox.compile("throw new Error('boom')")
+
+    error = assert_raises(QuickJS::JavascriptError) { script.run(@sandbox) }
+    assert_match(/boom/, error.message)
+    assert_raises(QuickJS::JavascriptError) { script.run(@sandbox) }
+  end
+
+  def test_timeout_applies_to_run
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 50)
+    script = sandbox.compile("while (true) {}")
+
+    assert_raises(QuickJS::TimeoutError) { script.run(sandbox) }
+  end
+
+  def test_bytecode_is_shared_across_sandboxes
+    source = "'shared:' + #{rand(1_000_000)}"
+    first = @sandbox.compile(source)
+    second = QuickJS::Sandbox.new.compile(source.dup)
+
+    assert_same first.bytecode, second.bytecode
+  end
+
+  def test_clear_cache
+    source = "'cleared:' + #{rand(1_000_000)}"
+    first = @sandbox.compile(source)
+    QuickJS::Script.clear_cache
+    second = @sandbox.compile(source)
+
+    refute_same first.bytecode, second.bytecode
+    assert_equal first.run(@sandbox).value, second.run(@sandbox).value
+  end
+
+  def test_many_scripts_in_one_sandbox
+    scripts = 100.times.map { |i| @sandbox.compile("#{i} * 2") }
+
+    assert_equal (0...100).map { |i| i * 2 }, scripts.map { |s| s.run(@sandbox).value }
+  end
+
+  def test_native_run_script_requires_frozen_bytecode
+    native = @sandbox.instance_variable_get(:@native_sandbox)
+    bytecode = native.compile("1").dup
+
+    assert_raises(ArgumentError) { native.run_script(bytecode) }
+  end
+
+  def test_scripts_not_made_by_compile_are_refused
+    bytecode = @sandbox.compile("1").bytecode
+    forged = QuickJS::Script.new("1", bytecode.dup.freeze)
+
+    error = assert_raises(ArgumentError) { forged.run(@sandbox) }
+    assert_match(/not produced by compile/, error.message)
+    assert_raises(ArgumentError) { QuickJS::Script.new("1", "\x02garbage".b.freeze).run(@sandbox) }
+  end
+end
@@ -0,0 +1,73 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class TemplateTest < Minitest::Test
+  HELPERS = <<~JS
+    function double(x) { return x * 2; }
+    var counter = 0;
+  JS
+
+  def test_preload_is_available_in_new_sandboxes
+    template = QuickJS::Template.new(preload: [HELPERS])
+    sandbox = template.sandbox
+
+    assert_equal 42, sandbox.eval("double(21)").value
+  end
+
+  def test_sandboxes_from_template_are_isolated
+    template = QuickJS::Template.new(preload: [HELPERS])
+    first = template.sandbox
+    second = template.sandbox
+
+    first.eval("counter = 99; globalThis.leaked = true")
+
+    assert_equal 0, second.eval("counter").value
+    assert_equal "undefined", second.eval("typeof leaked").value
+  end
+
+  def test_variables_are_snapshotted
+    config = { "currency" => "EUR", "rates" => [1, 2, 3] }
+    template = QuickJS::Template.new(variables: { config: config })
+
+    assert_equal config, template.sandbox.eval("config").value
+  end
+
+  def test_variables_are_visible_to_preload
+    template = QuickJS::Template.new(
+      variables: { factor: 3 },
+      preload: ["function scale(x) { return x * factor; }"]
+    )
+
+    assert_equal 12, template.sandbox.eval("scale(4)").value
+  end
+
+  def test_sandbox_options_are_applied
+    template = QuickJS::Template.new(timeout_ms: 100)
+
+    assert_raises(QuickJS::TimeoutError) do
+      template.sandbox.eval("while(true) {}")
+    end
+  end
+
+  def test_preload_syntax_error_raises_on_creation
+    assert_raises(QuickJS::SyntaxError) do
+      QuickJS::Template.new(preload: ["function ("])
+    end
+  end
+
+  def test_preload_runtime_error_raises_on_creation
+    assert_raises(QuickJS::JavascriptError) do
+      QuickJS::Template.new(preload: ["throw new Error('boom')"])
+    end
+  end
+
+  def test_dump_globals_rejects_functions
+    sandbox = QuickJS::Sandbox.new
+    sandbox.eval("var fn = function() {}")
+
+    assert_raises(QuickJS::JavascriptError) do
+      sandbox.capture_template(["fn"], [])
+    end
+  end
+end
@@ -29,8 +29,8 @@ class MockHTTPSandbox
     sandbox = QuickJS::Sandbox.new
 
     # Inject our mock callback directly (bypassing HTTPConfig/HTTPExecutor)
-    # This is a test-only pattern - we set the callback and clear
-    # the http_executor so reset_http_executor won't overwrite it
+    # This is a test-only pattern - an HTTPExecutor would take precedence
+    # over the callback
     requests = @requests
     responses = @responses
     default = method(:default_response)
@@ -40,8 +40,7 @@ class MockHTTPSandbox
       responses.shift || default.call
     end
 
-    # Ensure reset_http_executor won't run (no @http_executor set)
-    # The sandbox was created without http: option, so @http_executor is nil
+    # The sandbox was created without http: option, so it has no executor
 
     sandbox
   end
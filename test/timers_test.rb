@@ -0,0 +1,120 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+class TimersTest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new(timeout_ms: 2000)
+  end
+
+  def test_timeouts_fire_in_deadline_order
+    result = @sandbox.eval(<<~JS)
+      const order = [];
+      setTimeout(() => order.push('b'), 20);
+      setTimeout(() => order.push('a'), 5);
+      setTimeout(() => order.push('c'), 20);
+      await new Promise((resolve) => setTimeout(resolve, 40));
+      order
+    JS
+
+    assert_equal %w[a b c], result.value
+  end
+
+  def test_eval_waits_for_pending_timers
+    result = @sandbox.eval("setTimeout(() => console.log('later'), 10); 'now'")
+
+    assert_equal "now", result.value
+    assert_equal "later\n", result.console_output
+  end
+
+  def test_arguments_are_passed_to_the_callback
+    assert_equal 5, @sandbox.eval("await new Promise((resolve) => setTimeout((a, b) => resolve(a + b), 0, 2, 3))").value
+  end
+
+  def test_microtasks_run_between_timers
+    result = @sandbox.eval(<<~JS)
+      const order = [];
+      setTimeout(() => { order.push('t1'); Promise.resolve().then(() => order.push('m1')); }, 0);
+      setTimeout(() => order.push('t2'), 0);
+      queueMicrotask(() => order.push('m0'));
+      await new Promise((resolve) => setTimeout(resolve, 5));
+      order
+    JS
+
+    assert_equal %w[m0 t1 m1 t2], result.value
+  end
+
+  def test_clear_timeout
+    result = @sandbox.eval(<<~JS)
+      let fired = false;
+      const id = setTimeout(() => { fired = true; }, 5);
+      clearTimeout(id);
+      clearTimeout(undefined);
+      await new Promise((resolve) => setTimeout(resolve, 20));
+      fired
+    JS
+
+    refute result.value
+  end
+
+  def test_interval_repeats_until_cleared
+    result = @sandbox.eval(<<~JS)
+      let ticks = 0;
+      await new Promise((resolve) => {
+        const id = setInterval(() => {
+          if (++ticks === 3) { clearInterval(id); resolve(); }
+        }, 2);
+      });
+      ticks
+    JS
+
+    assert_equal 3, result.value
+  end
+
+  def test_waiting_sleeps_instead_of_spinning
+    result = @sandbox.eval("await new Promise((resolve) => setTimeout(resolve, 200)); 'done'")
+
+    assert_equal "done", result.value
+    assert_operator result.metrics[:wall_time_ms], :>=, 190
+    assert_operator result.metrics[:cpu_time_ms], :<, 50
+  end
+
+  def test_waiting_is_bounded_by_the_timeout
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 100)
+    started = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+
+    assert_raises(QuickJS::TimeoutError) { sandbox.eval("setInterval(() => {}, 10)") }
+    assert_operator Process.clock_gettime(Process::CLOCK_MONOTONIC) - started, :<, 1
+  end
+
+  def test_timers_are_dropped_after_a_timeout
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 50)
+
+    assert_raises(QuickJS::TimeoutError) do
+      sandbox.eval("setTimeout(() => { globalThis.fired = true; }, 200); while (true) {}")
+    end
+    assert_equal "undefined", sandbox.eval("typeof fired").value
+  end
+
+  def test_callback_errors_fail_the_eval
+    error = assert_raises(QuickJS::JavascriptError) do
+      @sandbox.eval("setTimeout(() => { throw new Error('in timer'); }, 0); 1")
+    end
+    assert_match(/in timer/, error.message)
+  end
+
+  def test_timers_wake_for_ruby_interrupts
+    sandbox = QuickJS::Sandbox.new(timeout_ms: 0)
+    thread = Thread.new { sandbox.eval("await new Promise((resolve) => setTimeout(resolve, 60_000))") }
+    sleep 0.05
+    thread.kill
+    thread.join(1)
+
+    refute_predicate thread, :alive?
+  end
+
+  def test_invalid_callback
+    assert_raises(QuickJS::JavascriptError) { @sandbox.eval("setTimeout('code', 0)") }
+    assert_raises(QuickJS::JavascriptError) { @sandbox.eval("queueMicrotask(42)") }
+  end
+end
@@ -216,7 +216,7 @@ class TopLevelAwaitTest < Minitest::Test
 
     result = sandbox.eval(<<~JS)
       const delay = (ms, value) => new Promise(resolve => {
-        // QuickJS doesn't have setTimeout, so resolve immediately
+        // Resolve immediately rather than waiting on a timer
         resolve(value);
       });
 
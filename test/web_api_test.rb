@@ -0,0 +1,110 @@
+# frozen_string_literal: true
+
+require_relative "test_helper"
+
+# Native Headers, URL and URLSearchParams (ext/quickjs/web_api.c)
+class WebAPITest < Minitest::Test
+  def setup
+    @sandbox = QuickJS::Sandbox.new
+  end
+
+  def eval_js(code)
+    @sandbox.eval(code).value
+  end
+
+  def test_classes_are_defined_on_first_access
+    code = "['Headers', 'URL', 'URLSearchParams'].map(name => typeof Object.getOwnPropertyDescriptor(globalThis, name).get)"
+    assert_equal %w[function function function], eval_js(code)
+
+    eval_js("new URL('http://example.com/')")
+    assert_equal %w[function undefined function], eval_js(code)
+    assert eval_js("Object.getOwnPropertyDescriptor(globalThis, 'URL').value === URL && URL.name === 'URL'")
+  end
+
+  def test_searchparams_defines_urlsearchparams
+    assert eval_js("new URL('http://a/?x=1').searchParams instanceof URLSearchParams")
+    assert_equal "function", eval_js("typeof Object.getOwnPropertyDescriptor(globalThis, 'URLSearchParams').value")
+  end
+
+  def test_globals_can_be_replaced_before_first_access
+    assert_equal 5, eval_js("globalThis.URL = 5; URL")
+    assert_equal "q", eval_js("class H extends Headers { first() { return this.get('a') } }; new H({a: 'q'}).first()")
+  end
+
+  def test_url_normalization
+    assert_equal "http://example.com/a/c?x=1%202#f%20g", eval_js("new URL('HTTP://EXAMPLE.com:80/a/./b/../c?x=1 2#f g').href")
+    assert_equal "http://a/b/x", eval_js("new URL('../x', 'http://a/b/c/d').href")
+    assert_equal "file:///C:/bar", eval_js("new URL('file:///C|/foo/../bar').href")
+    assert_equal "non-spec://h/q", eval_js("new URL('non-spec://h/p/../q').href")
+    assert_equal "web+demo:/.//not-a-host/", eval_js("new URL('web+demo:/.//not-a-host/').href")
+  end
+
+  def test_url_hosts
+    assert_equal "127.0.0.1", eval_js("new URL('http://0x7f.1/').host")
+    assert_equal "[::1]:8080", eval_js("new URL('http://[0:0:0:0:0:0:0:1]:8080/').host")
+    assert_equal "xn--mnchen-3ya.de", eval_js("new URL('https://MÜnchen.de/').hostname")
+    assert_equal [false, false, false], eval_js("['http://1.2.3.4.5/', 'http://[::1', 'http://a:65536/'].map(u => URL.canParse(u))")
+  end
+
+  def test_url_credentials_and_origin
+    assert_equal %w[user p%40ss], eval_js("const u = new URL('http://user:p@ss@host/'); [u.username, u.password]")
+    assert_equal ["https://a.com:8", "null", "null"],
+                 eval_js("['blob:https://a.com:8/x', 'file:///tmp', 'mailto:x@y'].map(u => new URL(u).origin)")
+  end
+
+  def test_url_setters
+    result = eval_js(<<~JS)
+      const url = new URL('http://a/?a=1');
+      url.searchParams.append('b', 'c d');
+      url.host = 'b.org:81';
+      url.pathname = 'x y';
+      url.hash = 'h';
+      const afterSetters = url.href;
+      url.protocol = 'mailto';
+      url.port = 'abc';
+      url.search = '';
+      [afterSetters, url.href, url.searchParams.size]
+    JS
+    assert_equal ["http://b.org:81/x%20y?a=1&b=c+d#h", "http://b.org:81/x%20y#h", 0], result
+  end
+
+  def test_invalid_href_setter_keeps_url
+    assert_equal ["TypeError", "http://a/"], eval_js(<<~JS)
+      const url = new URL('http://a/');
+      let name;
+      try { url.href = 'nope'; } catch (e) { name = e.name; }
+      [name, url.href]
+    JS
+  end
+
+  def test_url_parse_and_can_parse
+    assert_equal [true, nil, "http://a/x"], eval_js("[URL.canParse('/x', 'http://a'), URL.parse('nope'), URL.parse('/x', 'http://a').href]")
+  end
+
+  def test_urlsearchparams_encoding
+    assert_equal "a=1+%2B%C3%A9&b=%7E*", eval_js("new URLSearchParams({a: '1 +é', b: '~*'}).toString()")
+    assert_equal ["a b", "\u{FFFD}"], eval_js("const p = new URLSearchParams('?x=a+b&y=%FF'); [p.get('x'), p.get('y')]")
+  end
+
+  def test_urlsearchparams_sort_is_stable
+    assert_equal "a=2&z=1&z=0", eval_js("const p = new URLSearchParams('z=1&a=2&z=0'); p.sort(); p.toString()")
+  end
+
+  def test_headers_iteration_is_sorted_and_combined
+    result = eval_js(<<~JS)
+      const headers = new Headers([['B', '1'], ['a', ' 2 '], ['b', '3'], ['Set-Cookie', 'x'], ['set-cookie', 'y']]);
+      [[...headers].map(pair => pair.join(': ')), headers.getSetCookie(), headers.get('set-cookie')]
+    JS
+    assert_equal [["a: 2", "b: 1, 3", "set-cookie: x", "set-cookie: y"], %w[x y], "x, y"], result
+  end
+
+  def test_headers_reject_invalid_values
+    assert_equal "TypeError", eval_js("try { new Headers({a: 'x\\r\\ny'}) } catch (e) { e.name }")
+  end
+
+  def test_reset_restores_missing_classes
+    eval_js("new Headers(); globalThis.URL = undefined")
+    @sandbox.reset!
+    assert_equal "http://a/", eval_js("new URL('http://a').href")
+  end
+end